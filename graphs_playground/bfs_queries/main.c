@@ -2,368 +2,2678 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
-#include <crtdbg.h>
+#include <inttypes.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
-typedef struct node {
-    char* data;
-    struct node* next;
-} node_t;
+#define INVALID_VERTEX_ID UINT32_MAX
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define STREAM_BLOCK_SIZE (1 << 20)
+// Chunks of graph text below this size are not worth a thread of their own
+#define LOADER_MIN_CHUNK_SIZE (1 << 20)
+#define MAX_LOADER_THREADS 64
+#define HOP_UNREACHED UINT32_MAX
+// Beamer's switch points: a search goes bottom-up once the edges of the frontier exceed
+// 1/BOTTOM_UP_ALPHA of the edges left unexplored, and back top-down once a shrinking frontier
+// holds fewer than 1/TOP_DOWN_BETA of the vertices
+#define BOTTOM_UP_ALPHA 14
+#define TOP_DOWN_BETA 24
+#define MAX_SEARCH_THREADS 64
+// Top-down levels with fewer frontier edges are expanded by the searching thread alone
+#define PARALLEL_MIN_EDGES 4096
+// Sources a multi-source search follows at once, one bit of a word each
+#define MULTI_SOURCE_LANES 64
+// Bytes the distances of a multi-source pass may take. Every source needs 4 bytes per vertex, so
+// graphs too large for 64 sources within the limit search fewer sources per pass
+#define MULTI_SOURCE_MEMORY_LIMIT ((size_t)1 << 30)
+#define NO_LANE UINT32_MAX
+
+typedef struct arena_block {
+    struct arena_block* next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} arena_block_t;
+
+typedef struct arena {
+    arena_block_t* blocks;
+    size_t block_size;
+    size_t num_allocations;
+    size_t num_blocks;
+    size_t bytes_reserved;
+} arena_t;
+
+typedef struct symbol_table {
+    size_t num_symbols;
+    size_t names_capacity;
+    char** names;
+    // A mapped table finds its names through the offsets of the snapshot, names stays NULL then
+    const uint64_t* name_offsets;
+    const char* name_data;
+    size_t num_slots;
+    uint32_t* slots;
+    arena_t* arena;
+    // Names and slots point into a snapshot mapping, the table is read-only then
+    bool mapped;
+} symbol_table_t;
 
-typedef struct slinked_list {
-    node_t* head;
-    node_t* tail;
+typedef struct name_rank_entry {
+    const char* name;
+    uint32_t vert_id;
+} name_rank_entry_t;
+
+typedef struct traversal_state {
+    size_t capacity;
+    uint32_t epoch;
+    // A vertex is visited when its stamp equals the current epoch
+    uint32_t* visit_epochs;
+    size_t num_visited;
+    uint32_t* visit_order;
+} traversal_state_t;
+
+// Graph file mapped read-only into memory, the loader tokenizes it in place
+typedef struct mapped_file {
+    const char* data;
     size_t size;
-} slinked_list_t;
+} mapped_file_t;
+
+// Cursor over mapped text, lines and tokens are handed out as pointers into the mapping
+typedef struct text_cursor {
+    const char* pos;
+    const char* end;
+} text_cursor_t;
+
+// Output gathered in user space and handed to the kernel with one write() per flush
+typedef struct output_sink {
+    int fd;
+    size_t used;
+    size_t capacity;
+    char* data;
+} output_sink_t;
+
+#define SNAPSHOT_MAGIC "CLABGRPH"
+// Prefix of the graph and snapshot files that are POSIX shared memory segments
+#define SHARED_MEMORY_PREFIX "shm:"
+#define SNAPSHOT_VERSION 2
+// Snapshot flags
+#define SNAPSHOT_DIRECTED 0x1
+#define SNAPSHOT_HAS_CYCLE 0x2
+// Rows keep the order their edges were listed in instead of being sorted by name
+#define SNAPSHOT_FILE_ORDER 0x4
+
+// Sections of a graph snapshot, every one is optional and a section of size 0 is absent
+typedef enum snapshot_section_id {
+    SNAPSHOT_NAME_OFFSETS,
+    SNAPSHOT_NAMES,
+    SNAPSHOT_NAME_SLOTS,
+    SNAPSHOT_EDGE_OFFSETS,
+    SNAPSHOT_EDGE_TARGETS,
+    SNAPSHOT_EDGE_WEIGHTS,
+    SNAPSHOT_NAME_RANKS,
+    SNAPSHOT_TOPOLOGICAL_ORDER,
+    SNAPSHOT_TOPOLOGICAL_POSITIONS,
+    SNAPSHOT_IN_DEGREES,
+    SNAPSHOT_OUT_DEGREES,
+    SNAPSHOT_LISTED_TARGETS,
+    SNAPSHOT_NUM_SECTIONS
+} snapshot_section_id_t;
+
+typedef struct snapshot_section {
+    uint64_t offset;
+    uint64_t size;
+} snapshot_section_t;
+
+// Sections are laid out 8-byte aligned behind the header, so they can be used in place once the
+// snapshot is mapped
+typedef struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t num_vertices;
+    uint64_t num_edges;
+    snapshot_section_t sections[SNAPSHOT_NUM_SECTIONS];
+} snapshot_header_t;
+
+// CSR offsets are used in place as size_t
+_Static_assert(sizeof(size_t) == sizeof(uint64_t), "snapshots store 64-bit offsets");
+
+typedef struct snapshot_writer {
+    FILE* file;
+    snapshot_header_t header;
+    uint64_t offset;
+    snapshot_section_id_t section;
+} snapshot_writer_t;
 
 typedef struct undirected_graph {
     size_t vertices_count;
-    slinked_list_t** adjacency_lists;
+    // Each undirected edge is counted and stored once per endpoint
+    size_t edges_count;
+    symbol_table_t* vertex_names;
+    // Owns the vertex names and the CSR arrays, released in one go
+    arena_t* arena;
+    // Frozen CSR layout, the neighbors of vertex i are in [edge_offsets[i], edge_offsets[i + 1])
+    size_t* edge_offsets;
+    uint32_t* edge_targets;
+    // Compressed layout, which replaces edge_targets when it is chosen. The neighbors of vertex i
+    // are varint gaps between their name ranks in [row_bytes[i], row_bytes[i + 1]) of target_bytes
+    size_t* row_bytes;
+    uint8_t* target_bytes;
+    uint32_t* vertex_by_rank;
+    // Snapshot mapping the arrays above point into, NULL for graphs parsed from text
+    mapped_file_t* snapshot;
 } undirected_graph_t;
 
+// Position in the row of one vertex, in the plain or in the compressed layout
+typedef struct neighbor_cursor {
+    size_t edge;
+    size_t end;
+    // Next encoded gap and the name rank of the last neighbor, compressed rows only
+    const uint8_t* bytes;
+    uint32_t rank;
+} neighbor_cursor_t;
+
+// An edge as a loader worker parsed it, before it is placed in the CSR layout
+typedef struct edge_record {
+    uint32_t src_id;
+    uint32_t dst_id;
+} edge_record_t;
+
+typedef struct edge_buffer {
+    size_t size;
+    size_t capacity;
+    edge_record_t* records;
+} edge_buffer_t;
+
+// Share of one loader worker in every parallel phase of loading a graph
+typedef struct loader_task {
+    undirected_graph_t* graph;
+    // Chunk of the graph text, it starts and ends on a line boundary
+    const char* chunk_begin;
+    const char* chunk_end;
+    size_t num_lines;
+    // Id of the vertex listed on the first line of the chunk
+    size_t first_vert_id;
+    // Names interned by this worker, merged into the graph arena afterwards
+    arena_t* arena;
+    // Edges of the chunk in file order and the file position of the first of them
+    edge_buffer_t* edges;
+    size_t first_edge_position;
+    // CSR rows this worker sorts
+    size_t first_row;
+    size_t end_row;
+    // Scratch arrays shared by all workers while the CSR layout is built
+    const uint32_t* name_ranks;
+    size_t* row_cursors;
+    size_t* edge_positions;
+} loader_task_t;
+
+// Neighbor of a row being sorted, ties between parallel edges keep their file order
+typedef struct row_entry {
+    uint32_t rank;
+    uint32_t target;
+    size_t position;
+} row_entry_t;
+
+// Fixed-capacity ring buffer of vertex IDs, a vertex is marked when it is enqueued so the
+// queue never holds more than V entries
 typedef struct queue {
-    node_t* start;
-    node_t* end;
+    uint32_t* items;
+    size_t capacity;
+    size_t head;
     size_t size;
 } queue_t;
 
-void create_slinked_list(slinked_list_t** list) {
-    (*list) = (slinked_list_t*)malloc(sizeof(slinked_list_t));
-    (*list)->head = (*list)->tail = NULL;
-    (*list)->size = 0;
-}
-
-void insert_node_at_end(slinked_list_t** list, const char* data) {
-    node_t* new_node = (node_t*)malloc(sizeof(node_t));
-    size_t data_len = strlen(data) + 1;
-    char* copy_data = (char*)malloc(data_len);
-    strcpy(copy_data, data);
-    new_node->data = copy_data;
-    new_node->next = NULL;
-    if ((*list)->head == NULL) {
-        (*list)->head = new_node;
-    } else {
-        (*list)->tail->next = new_node;
-    }
+// A bare vertex name asks for the visit order and "d <vertex>" for the hop distances
+typedef enum query_kind {
+    QUERY_VISIT_ORDER,
+    QUERY_HOP_DISTANCES
+} query_kind_t;
+
+// Source vertices of a query file read up front, in the order they are queried
+typedef struct query_batch {
+    size_t num_queries;
+    size_t capacity;
+    uint32_t* sources;
+    uint8_t* kinds;
+    // Every distinct source once in ascending order, with the number of visit order queries it has
+    size_t num_distinct;
+    uint32_t* distinct_sources;
+    uint32_t* source_queries;
+    // Index of the source of every query in distinct_sources
+    uint32_t* source_slots;
+} query_batch_t;
 
-    (*list)->tail = new_node;
-    (*list)->size++;
+// Hop distances and BFS tree parents from one source. Vertices are appended to reached level by
+// level, so every level is a contiguous run of it
+typedef struct hop_distances {
+    size_t capacity;
+    uint32_t* distances;
+    uint32_t* parents;
+    size_t num_reached;
+    uint32_t* reached;
+} hop_distances_t;
+
+// Hop distances from up to MULTI_SOURCE_LANES sources found in one pass. Bit k of the words of a
+// vertex stands for source k, so a row scanned once serves every source still looking for it
+typedef struct multi_source_search {
+    size_t capacity;
+    // Sources a pass may follow, bounded by MULTI_SOURCE_MEMORY_LIMIT
+    size_t max_lanes;
+    size_t num_sources;
+    uint32_t sources[MULTI_SOURCE_LANES];
+    uint64_t all_lanes;
+    uint64_t* seen;
+    // Sources that reached every vertex on the current level and on the next one
+    uint64_t* frontier;
+    uint64_t* next;
+    // Distances from source k are at [k * capacity, (k + 1) * capacity). A distance is written on
+    // the level the bit of the source first shows up on and is valid only where that bit is seen
+    uint32_t* distances;
+} multi_source_search_t;
+
+typedef enum search_step {
+    SEARCH_STEP_CLAIM,
+    SEARCH_STEP_TOP_DOWN,
+    SEARCH_STEP_BOTTOM_UP,
+    SEARCH_STEP_MULTI_SOURCE,
+    SEARCH_STEP_APPEND,
+    SEARCH_STEP_STOP
+} search_step_t;
+
+struct search_pool;
+
+// Thread of a search pool with the vertices it reached on the current level
+typedef struct search_worker {
+    struct search_pool* pool;
+    size_t index;
+    pthread_t thread;
+    size_t num_next;
+    size_t next_capacity;
+    uint32_t* next;
+    size_t next_edges;
+    // Position in reached the vertices of this worker are appended at
+    size_t append_at;
+} search_worker_t;
+
+// Threads that expand the levels of a search together, they meet at the barriers around each step
+typedef struct search_pool {
+    size_t num_workers;
+    search_worker_t* workers;
+    pthread_barrier_t step_begin;
+    pthread_barrier_t step_end;
+    // Work of the current step, set by the searching thread while the workers wait
+    search_step_t step;
+    const undirected_graph_t* graph;
+    hop_distances_t* result;
+    size_t level_begin;
+    size_t level_end;
+    uint32_t level;
+    // An ordered search gives each vertex to the earliest frontier vertex reaching it, as the
+    // sequential search does. claims holds the lowest frontier position seen for every vertex
+    bool ordered;
+    uint32_t* claims;
+    multi_source_search_t* multi_source;
+} search_pool_t;
+
+void create_arena(arena_t** arena, const size_t block_size) {
+    *arena = (arena_t*)malloc(sizeof(arena_t));
+    (*arena)->blocks = NULL;
+    (*arena)->block_size = block_size;
+    (*arena)->num_allocations = 0;
+    (*arena)->num_blocks = 0;
+    (*arena)->bytes_reserved = 0;
 }
 
-void delete_slinked_list_node(node_t* prev_node, node_t* node) {
-    if (node == NULL || prev_node == NULL) {
-        fprintf(stderr, "NULL node provided for deletion");
-        return;
+void* arena_alloc(arena_t* arena, const size_t size) {
+    const size_t aligned_size = (size + 7) & ~(size_t)7;
+    arena_block_t* block = arena->blocks;
+    if (block == NULL || block->used + aligned_size > block->capacity) {
+        const bool dedicated = aligned_size > arena->block_size / 4;
+        const size_t capacity = dedicated ? aligned_size : arena->block_size;
+        arena_block_t* new_block = (arena_block_t*)malloc(sizeof(arena_block_t) + capacity);
+        new_block->used = 0;
+        new_block->capacity = capacity;
+
+        // Large requests get a block of their own behind the current one, so the space left in
+        // the current block is still used by the small requests that follow
+        if (dedicated && block != NULL) {
+            new_block->next = block->next;
+            block->next = new_block;
+        } else {
+            new_block->next = block;
+            arena->blocks = new_block;
+        }
+        block = new_block;
+        arena->num_blocks++;
+        arena->bytes_reserved += capacity;
     }
 
-    if (node->next) {
-        node_t* retire = node;
-        node = node->next;
-        prev_node->next = node;
+    void* ptr = block->data + block->used;
+    block->used += aligned_size;
+    arena->num_allocations++;
+    return ptr;
+}
+
+void reset_arena(arena_t* arena) {
+    arena_block_t* block = arena->blocks;
+    while (block) {
+        arena_block_t* retire = block;
+        block = block->next;
         free(retire);
+    }
+    arena->blocks = NULL;
+}
+
+void free_arena(arena_t* arena) {
+    reset_arena(arena);
+    arena->num_allocations = arena->num_blocks = arena->bytes_reserved = 0;
+}
+
+// Moves all blocks of the other arena into this one, so they are released together
+void merge_arena(arena_t* arena, arena_t* other) {
+    if (other->blocks == NULL) {
         return;
     }
-    prev_node->next = NULL;
-    free(node);
+    arena_block_t* tail = other->blocks;
+    while (tail->next) {
+        tail = tail->next;
+    }
+
+    // Splice the blocks in behind the current block, which keeps serving small requests
+    if (arena->blocks == NULL) {
+        arena->blocks = other->blocks;
+    } else {
+        tail->next = arena->blocks->next;
+        arena->blocks->next = other->blocks;
+    }
+    arena->num_allocations += other->num_allocations;
+    arena->num_blocks += other->num_blocks;
+    arena->bytes_reserved += other->bytes_reserved;
+    other->blocks = NULL;
+    other->num_allocations = other->num_blocks = other->bytes_reserved = 0;
 }
 
-void free_list(slinked_list_t* list) {
-    node_t* temp = list->head;
-    while (temp) {
-        node_t* retire = temp;
-        temp = temp->next;
-        free(retire->data);
-        free(retire);
+void print_allocation_stats(const arena_t* arena) {
+    fprintf(stderr, "Arena: %zu allocations in %zu blocks (%zu bytes)\n", arena->num_allocations,
+            arena->num_blocks, arena->bytes_reserved);
+}
+
+void create_traversal_state(traversal_state_t** state, const size_t capacity) {
+    *state = (traversal_state_t*)malloc(sizeof(traversal_state_t));
+    (*state)->capacity = capacity;
+    (*state)->epoch = 0;
+    (*state)->visit_epochs = (uint32_t*)calloc(capacity, sizeof(uint32_t));
+    (*state)->num_visited = 0;
+    (*state)->visit_order = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+}
+
+void begin_traversal(traversal_state_t* state) {
+    // Bumping the epoch forgets every earlier visit without touching the stamps
+    if (++state->epoch == 0) {
+        memset(state->visit_epochs, 0, state->capacity * sizeof(uint32_t));
+        state->epoch = 1;
     }
-    list->head = list->tail = NULL;
-    list->size = 0;
+    state->num_visited = 0;
 }
 
-void sort_slinked_list(slinked_list_t* list) {
-    if (!list->head) {
-        return;
+bool is_visited(const traversal_state_t* state, const uint32_t vert_id) {
+    return state->visit_epochs[vert_id] == state->epoch;
+}
+
+void mark_visited(traversal_state_t* state, const uint32_t vert_id) {
+    state->visit_epochs[vert_id] = state->epoch;
+    state->visit_order[state->num_visited++] = vert_id;
+}
+
+void free_traversal_state(traversal_state_t* state) {
+    free(state->visit_epochs);
+    free(state->visit_order);
+    state->capacity = state->num_visited = 0;
+}
+
+uint64_t hash_vertex_name(const char* name, const size_t name_len) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < name_len; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 1099511628211ULL;
     }
+    return hash;
+}
 
-    slinked_list_t* copy_list;
-    create_slinked_list(&copy_list);
+void create_symbol_table(symbol_table_t** table, const size_t expected_symbols, arena_t* arena) {
+    *table = (symbol_table_t*)malloc(sizeof(symbol_table_t));
+    (*table)->arena = arena;
+    (*table)->mapped = false;
+    (*table)->num_symbols = 0;
+    (*table)->names_capacity = expected_symbols > 0 ? expected_symbols : 16;
+    (*table)->names = (char**)malloc((*table)->names_capacity * sizeof(char*));
+    (*table)->name_offsets = NULL;
+    (*table)->name_data = NULL;
 
-    node_t* temp = list->head;
-    while (temp) {
-        insert_node_at_end(&copy_list, temp->data);
-        temp = temp->next;
+    // Keep the load factor of the open addressing table at most one half
+    size_t num_slots = 16;
+    while (num_slots < 2 * (*table)->names_capacity) {
+        num_slots <<= 1;
     }
+    (*table)->num_slots = num_slots;
+    (*table)->slots = (uint32_t*)malloc(num_slots * sizeof(uint32_t));
+    memset((*table)->slots, 0xff, num_slots * sizeof(uint32_t));
+}
 
-    free_list(list);
-    insert_node_at_end(&list, copy_list->head->data);
+void free_symbol_table(symbol_table_t* table) {
+    // The names themselves live in the arena of the table or in the snapshot mapping
+    free(table->names);
+    if (!table->mapped) {
+        free(table->slots);
+    }
+    table->num_symbols = table->num_slots = 0;
+}
 
-    if (!copy_list->head->next) {
-        return;
+const char* symbol_table_name(const symbol_table_t* table, const uint32_t vert_id) {
+    if (table->mapped) {
+        return table->name_data + table->name_offsets[vert_id];
     }
+    return table->names[vert_id];
+}
 
-    node_t* curr_head = copy_list->head->next;
-    while (curr_head) {
-        node_t* iter = curr_head;
-        node_t* prev_iter = curr_head;
-        node_t* min = curr_head;
-        node_t* prev_min = curr_head;
-        while (iter) {
-            int32_t rc = strcmp(iter->data, min->data);
-            if (rc < 0) {
-                prev_min = prev_iter;
-                min = iter;
-            }
-            prev_iter = iter;
-            iter = iter->next;
-        }
-        insert_node_at_end(&list, min->data);
-        if (prev_min != min) {
-            delete_slinked_list_node(prev_min, min);
-        } else {
-            curr_head = curr_head->next;
+size_t find_symbol_slot(const symbol_table_t* table, const char* name, const size_t name_len) {
+    const size_t mask = table->num_slots - 1;
+    size_t slot = hash_vertex_name(name, name_len) & mask;
+    while (table->slots[slot] != INVALID_VERTEX_ID) {
+        const char* slot_name = symbol_table_name(table, table->slots[slot]);
+        if (strncmp(slot_name, name, name_len) == 0 && slot_name[name_len] == '\0') {
+            break;
         }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void grow_symbol_table(symbol_table_t* table) {
+    const size_t num_slots = table->num_slots << 1;
+    free(table->slots);
+    table->slots = (uint32_t*)malloc(num_slots * sizeof(uint32_t));
+    memset(table->slots, 0xff, num_slots * sizeof(uint32_t));
+    table->num_slots = num_slots;
+
+    // Rehash every interned name into the larger table
+    for (size_t i = 0; i < table->num_symbols; i++) {
+        const char* name = table->names[i];
+        table->slots[find_symbol_slot(table, name, strlen(name))] = (uint32_t)i;
+    }
+}
+
+uint32_t symbol_table_find(const symbol_table_t* table, const char* name, const size_t name_len) {
+    return table->slots[find_symbol_slot(table, name, name_len)];
+}
+
+uint32_t symbol_table_intern(symbol_table_t* table, const char* name, const size_t name_len) {
+    size_t slot = find_symbol_slot(table, name, name_len);
+    if (table->slots[slot] != INVALID_VERTEX_ID) {
+        return table->slots[slot];
+    }
+
+    if (2 * (table->num_symbols + 1) > table->num_slots) {
+        grow_symbol_table(table);
+        slot = find_symbol_slot(table, name, name_len);
+    }
+    if (table->num_symbols == table->names_capacity) {
+        table->names_capacity *= 2;
+        table->names = (char**)realloc(table->names, table->names_capacity * sizeof(char*));
     }
 
-    // Free heap memory
-    free_list(copy_list);
-    free(copy_list);
+    char* copy_name = (char*)arena_alloc(table->arena, name_len + 1);
+    memcpy(copy_name, name, name_len);
+    copy_name[name_len] = '\0';
+
+    const uint32_t vert_id = (uint32_t)table->num_symbols++;
+    table->names[vert_id] = copy_name;
+    table->slots[slot] = vert_id;
+    return vert_id;
 }
 
-bool data_in_list(slinked_list_t* list, char* data) {
-    for (node_t* iter = list->head; iter != NULL; iter = iter->next) {
-        if (strncmp(iter->data, data, 64) == 0) {
+// Inserts a name under an id picked by the caller, several threads may insert at once as long as
+// the table is sized for all names up front. Returns false when the name is already in the table
+bool symbol_table_insert_concurrent(symbol_table_t* table, const char* name, const size_t name_len,
+                                    const uint32_t vert_id) {
+    // The name is published before its slot, so whoever finds the slot can compare the name
+    __atomic_store_n(&table->names[vert_id], (char*)name, __ATOMIC_RELEASE);
+
+    const size_t mask = table->num_slots - 1;
+    size_t slot = hash_vertex_name(name, name_len) & mask;
+    for (;;) {
+        uint32_t slot_id = __atomic_load_n(&table->slots[slot], __ATOMIC_ACQUIRE);
+        if (slot_id == INVALID_VERTEX_ID &&
+            __atomic_compare_exchange_n(&table->slots[slot], &slot_id, vert_id, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
             return true;
         }
+
+        // The slot is taken, slot_id holds the id of its name
+        const char* slot_name = __atomic_load_n(&table->names[slot_id], __ATOMIC_ACQUIRE);
+        if (strncmp(slot_name, name, name_len) == 0 && slot_name[name_len] == '\0') {
+            return false;
+        }
+        slot = (slot + 1) & mask;
     }
-    return false;
 }
 
-void print_slinked_list(const slinked_list_t* list) {
-    for (node_t* nptr = list->head; nptr != NULL; nptr = nptr->next) {
-        printf("%s - ", nptr->data);
+int compare_name_rank_entries(const void* lhs, const void* rhs) {
+    const name_rank_entry_t* lhs_entry = (const name_rank_entry_t*)lhs;
+    const name_rank_entry_t* rhs_entry = (const name_rank_entry_t*)rhs;
+    return strcmp(lhs_entry->name, rhs_entry->name);
+}
+
+void rank_vertex_names(const symbol_table_t* table, uint32_t* name_ranks) {
+    // name_ranks[id] is the position of the name of id in lexicographic order
+    const size_t num_symbols = table->num_symbols;
+    name_rank_entry_t* entries =
+        (name_rank_entry_t*)malloc(num_symbols * sizeof(name_rank_entry_t));
+    for (size_t i = 0; i < num_symbols; i++) {
+        entries[i].name = symbol_table_name(table, (uint32_t)i);
+        entries[i].vert_id = (uint32_t)i;
     }
-    printf("NULL\n");
+    qsort(entries, num_symbols, sizeof(name_rank_entry_t), compare_name_rank_entries);
+    for (size_t i = 0; i < num_symbols; i++) {
+        name_ranks[entries[i].vert_id] = (uint32_t)i;
+    }
+    free(entries);
 }
 
-void create_queue(queue_t** queue) {
+void create_queue(queue_t** queue, const size_t capacity) {
     *queue = (queue_t*)malloc(sizeof(queue_t));
-    (*queue)->start = (*queue)->end = NULL;
+    (*queue)->items = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    (*queue)->capacity = capacity;
+    (*queue)->head = 0;
     (*queue)->size = 0;
 }
 
-void push_at_queue(queue_t** queue, char* data) {
-    node_t* new_node = (node_t*)malloc(sizeof(node_t));
-    size_t data_len = strlen(data) + 1;
-    char* copy_data = (char*)malloc(data_len);
-    strcpy(copy_data, data);
-    new_node->data = copy_data;
-    new_node->next = NULL;
-    if ((*queue)->start == NULL) {
-        (*queue)->start = new_node;
-    } else {
-        (*queue)->end->next = new_node;
+void push_at_queue(queue_t* queue, const uint32_t vert_id) {
+    size_t tail = queue->head + queue->size;
+    if (tail >= queue->capacity) {
+        tail -= queue->capacity;
     }
-
-    (*queue)->end = new_node;
-    (*queue)->size++;
+    queue->items[tail] = vert_id;
+    queue->size++;
 }
 
-char* pop_from_queue(queue_t* queue) {
+uint32_t pop_from_queue(queue_t* queue) {
     if (queue->size == 0) {
-        return NULL;
+        return INVALID_VERTEX_ID;
     }
 
-    char* return_data = queue->start->data;
-    if (queue->size == 1) {
-        queue->start = queue->end;
-        free(queue->start);
-        queue->start = queue->end = NULL;
-        queue->size = 0;
-        return return_data;
+    const uint32_t return_id = queue->items[queue->head];
+    if (++queue->head == queue->capacity) {
+        queue->head = 0;
     }
-
-    node_t* temp = queue->start;
-    queue->start = queue->start->next;
     queue->size--;
-    free(temp);
 
-    return return_data;
+    return return_id;
 }
 
-void free_queue_data(char* data) { free(data); }
+void clear_queue(queue_t* queue) {
+    queue->head = 0;
+    queue->size = 0;
+}
+
+void free_queue(queue_t* queue) {
+    free(queue->items);
+    queue->capacity = queue->head = queue->size = 0;
+}
+
+bool is_shared_memory_name(const char* file_name) {
+    return strncmp(file_name, SHARED_MEMORY_PREFIX, sizeof(SHARED_MEMORY_PREFIX) - 1) == 0;
+}
+
+// A "shm:<name>" file is the POSIX shared memory segment <name>, every process attached to it
+// maps the same pages. Its sections are checked once when they are attached and used in place from
+// then on, so the segment must come from a trusted publisher that never changes it afterwards
+void map_file(mapped_file_t** file, const char* file_name) {
+    const bool shared = is_shared_memory_name(file_name);
+    const int fd = shared ? shm_open(file_name + sizeof(SHARED_MEMORY_PREFIX) - 1, O_RDONLY, 0)
+                          : open(file_name, O_RDONLY);
+    if (fd == -1) {
+        perror(shared ? "shm_open() failed for graph segment" : "open() failed for graph file");
+        exit(EXIT_FAILURE);
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1) {
+        perror("fstat() failed for graph file");
+        exit(EXIT_FAILURE);
+    }
 
-void free_queeu(queue_t* queue) {
-    while (queue->size != 0) {
-        char* data = pop_from_queue(queue);
-        free_queue_data(data);
+    *file = (mapped_file_t*)malloc(sizeof(mapped_file_t));
+    (*file)->data = NULL;
+    (*file)->size = (size_t)file_stat.st_size;
+    if ((*file)->size > 0) {
+        void* data = mmap(NULL, (*file)->size, PROT_READ, shared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror("mmap() failed for graph file");
+            exit(EXIT_FAILURE);
+        }
+        // The file is read front to back exactly once
+        madvise(data, (*file)->size, MADV_SEQUENTIAL);
+        (*file)->data = (const char*)data;
     }
+    close(fd);
 }
 
-void create_undirected_graph(undirected_graph_t** graph, int num_vertices) {
-    *graph = (undirected_graph_t*)malloc(sizeof(undirected_graph_t));
-    (*graph)->vertices_count = num_vertices;
-    (*graph)->adjacency_lists = (slinked_list_t**)malloc(num_vertices * sizeof(slinked_list_t*));
+void unmap_file(mapped_file_t* file) {
+    if (file->data) {
+        munmap((void*)file->data, file->size);
+    }
+    file->data = NULL;
+    file->size = 0;
 }
 
-void print_undirected_graph(const undirected_graph_t* graph) {
-    printf("Unordered graph size: %llu\n", graph->vertices_count);
-    for (size_t i = 0; i < graph->vertices_count; i++) {
-        print_slinked_list(graph->adjacency_lists[i]);
+// Hands out the next line without its line ending, returns false at the end of the text
+bool next_line(text_cursor_t* cursor, text_cursor_t* line) {
+    if (cursor->pos >= cursor->end) {
+        return false;
     }
+
+    const char* line_begin = cursor->pos;
+    const char* newline = (const char*)memchr(line_begin, '\n', cursor->end - line_begin);
+    const char* line_end = newline ? newline : cursor->end;
+    cursor->pos = newline ? newline + 1 : cursor->end;
+    if (line_end > line_begin && line_end[-1] == '\r') {
+        line_end--;
+    }
+
+    line->pos = line_begin;
+    line->end = line_end;
+    return true;
 }
 
-void read_graph_from_file(undirected_graph_t* graph, FILE* graph_file) {
-    char vertex_buffer[50];
-    for (size_t i = 0; i < graph->vertices_count; i++) {
-        fgets(vertex_buffer, 50, graph_file);
-        vertex_buffer[strlen(vertex_buffer) - 1] = '\0';
-        create_slinked_list(&graph->adjacency_lists[i]);
-        insert_node_at_end(&graph->adjacency_lists[i], vertex_buffer);
-    }
-
-    while (fgets(vertex_buffer, 50, graph_file) != NULL) {
-        int32_t len_vertex_buffer = strlen(vertex_buffer) - 1;
-        int32_t len_first_edge = 0;
-        vertex_buffer[len_vertex_buffer] = '\0';
-        while (vertex_buffer[len_first_edge] != ' ') {
-            ++len_first_edge;
-        }
-        char edge_u[len_first_edge + 1];
-        char edge_v[len_vertex_buffer - len_first_edge];
-        for (int32_t i = 0; i < len_first_edge; i++) {
-            edge_u[i] = vertex_buffer[i];
-        }
-        edge_u[len_first_edge] = '\0';
-        for (int32_t i = 0, j = len_first_edge + 1; j < len_vertex_buffer; i++, j++) {
-            edge_v[i] = vertex_buffer[j];
-        }
-        edge_v[len_vertex_buffer - len_first_edge - 1] = '\0';
-
-        for (size_t i = 0; i < graph->vertices_count; i++) {
-            char* curr_head_data = graph->adjacency_lists[i]->head->data;
-            if (strcmp(curr_head_data, edge_u) == 0) {
-                insert_node_at_end(&graph->adjacency_lists[i], edge_v);
-            } else if (strcmp(curr_head_data, edge_v) == 0) {
-                insert_node_at_end(&graph->adjacency_lists[i], edge_u);
-            }
+#if defined(__x86_64__)
+// Marks every space or tab of an 8-byte word with the high bit of its byte, the lowest marked
+// byte is always a blank, marks above it may be false positives
+uint64_t blank_byte_mask(const uint64_t word) {
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t spaces = word ^ (ones * ' ');
+    const uint64_t tabs = word ^ (ones * '\t');
+    return (((spaces - ones) & ~spaces) | ((tabs - ones) & ~tabs)) & (ones * 0x80);
+}
+
+__attribute__((target("avx2"))) const char* find_blank_avx2(const char* pos, const char* end) {
+    const __m256i spaces = _mm256_set1_epi8(' ');
+    const __m256i tabs = _mm256_set1_epi8('\t');
+    while (end - pos >= 32) {
+        const __m256i block = _mm256_loadu_si256((const __m256i*)pos);
+        const uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, spaces), _mm256_cmpeq_epi8(block, tabs)));
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
         }
+        pos += 32;
     }
+    return pos;
 }
+#endif
 
-void free_graph(undirected_graph_t* graph) {
-    for (size_t i = 0; i < graph->vertices_count; i++) {
-        free_list(graph->adjacency_lists[i]);
-        free(graph->adjacency_lists[i]);
+// Returns the first space or tab in [pos, end), or end when there is none. Blocks of 32, 16 and
+// 8 bytes are compared at once while they fit in the range, only the last few bytes one by one
+const char* find_blank(const char* pos, const char* end) {
+#if defined(__x86_64__)
+    // AVX2 is picked at run time, SSE2 is part of every x86-64 CPU. A search stopped on a blank
+    // finds it again right away in the next step
+    if (end - pos >= 32 && __builtin_cpu_supports("avx2")) {
+        pos = find_blank_avx2(pos, end);
+    }
+    const __m128i spaces = _mm_set1_epi8(' ');
+    const __m128i tabs = _mm_set1_epi8('\t');
+    while (end - pos >= 16) {
+        const __m128i block = _mm_loadu_si128((const __m128i*)pos);
+        const uint32_t mask = (uint32_t)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(block, spaces), _mm_cmpeq_epi8(block, tabs)));
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 16;
+    }
+    while (end - pos >= 8) {
+        uint64_t word;
+        memcpy(&word, pos, sizeof(word));
+        const uint64_t mask = blank_byte_mask(word);
+        if (mask != 0) {
+            return pos + (__builtin_ctzll(mask) >> 3);
+        }
+        pos += 8;
+    }
+#endif
+    while (pos < end && *pos != ' ' && *pos != '\t') {
+        pos++;
     }
-    free(graph->adjacency_lists);
-    graph->vertices_count = 0;
+    return pos;
 }
 
-void bfs_graph(undirected_graph_t* graph, char* src_vertex) {
-    queue_t* bfs_queue = NULL;
-    create_queue(&bfs_queue);
+// Splits the next blank separated token off the front of a line, returns false when none is left
+bool next_token(text_cursor_t* line, const char** token, size_t* token_len) {
+    // Tokens are mostly separated by a single blank, so only the token end is searched in blocks
+    const char* pos = line->pos;
+    while (pos < line->end && (*pos == ' ' || *pos == '\t')) {
+        pos++;
+    }
+    const char* token_begin = pos;
+    pos = find_blank(pos, line->end);
 
-    slinked_list_t* traversed_vert = NULL;
-    create_slinked_list(&traversed_vert);
+    line->pos = pos;
+    *token = token_begin;
+    *token_len = pos - token_begin;
+    return *token_len > 0;
+}
 
-    push_at_queue(&bfs_queue, src_vertex);
-    while (bfs_queue->size > 0) {
-        char* vertex = pop_from_queue(bfs_queue);
-        if (!data_in_list(traversed_vert, vertex)) {
-            insert_node_at_end(&traversed_vert, vertex);
-        }
-
-        for (size_t i = 0; i < graph->vertices_count; i++) {
-            node_t* curr_head = graph->adjacency_lists[i]->head;
-            char* curr_head_data = curr_head->data;
-            if (strncmp(curr_head_data, vertex, 64) == 0) {
-                for (node_t* iter = curr_head->next; iter != NULL; iter = iter->next) {
-                    if (!data_in_list(traversed_vert, iter->data)) {
-                        push_at_queue(&bfs_queue, iter->data);
-                    }
-                }
-                break;
+bool parse_count(const char* token, const size_t token_len, uint64_t* value) {
+    uint64_t result = 0;
+    for (size_t i = 0; i < token_len; i++) {
+        const uint32_t digit = (uint32_t)(token[i] - '0');
+        if (digit > 9 || result > (UINT64_MAX - digit) / 10) {
+            return false;
+        }
+        result = result * 10 + digit;
+    }
+    *value = result;
+    return token_len > 0;
+}
+
+void create_output_sink(output_sink_t** sink, const int fd, const size_t capacity) {
+    *sink = (output_sink_t*)malloc(sizeof(output_sink_t));
+    (*sink)->fd = fd;
+    (*sink)->used = 0;
+    (*sink)->capacity = capacity;
+    (*sink)->data = (char*)malloc(capacity);
+}
+
+void write_all(const int fd, const char* data, size_t size) {
+    // Pipes and sockets may take less than asked for, keep going until everything is out
+    while (size > 0) {
+        const ssize_t written = write(fd, data, size);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
             }
+            perror("write() failed for output");
+            exit(EXIT_FAILURE);
         }
-        free_queue_data(vertex);
+        data += written;
+        size -= (size_t)written;
     }
+}
+
+void flush_output_sink(output_sink_t* sink) {
+    write_all(sink->fd, sink->data, sink->used);
+    sink->used = 0;
+}
+
+void free_output_sink(output_sink_t* sink) {
+    flush_output_sink(sink);
+    free(sink->data);
+    sink->data = NULL;
+    sink->capacity = 0;
+}
 
-    // Print the traversed vertices
-    for (node_t* iter = traversed_vert->head; iter != NULL; iter = iter->next) {
-        printf("%s ", iter->data);
+void sink_write(output_sink_t* sink, const char* data, const size_t size) {
+    if (sink->used + size > sink->capacity) {
+        flush_output_sink(sink);
+        if (size > sink->capacity) {
+            write_all(sink->fd, data, size);
+            return;
+        }
     }
-    printf("\n");
+    memcpy(sink->data + sink->used, data, size);
+    sink->used += size;
+}
 
-    // Free heap memory
-    free_list(traversed_vert);
-    free(traversed_vert);
-    free(bfs_queue);
+void sink_puts(output_sink_t* sink, const char* str) {
+    sink_write(sink, str, strlen(str));
 }
 
-void process_bfs_queries(undirected_graph_t* graph, FILE* query_file) {
-    char query_buffer[64];
-    while (fgets(query_buffer, 64, query_file) != NULL) {
-        query_buffer[strlen(query_buffer) - 1] = '\0';
-        bfs_graph(graph, query_buffer);
+void sink_putc(output_sink_t* sink, const char c) {
+    if (sink->used == sink->capacity) {
+        flush_output_sink(sink);
     }
+    sink->data[sink->used++] = c;
 }
 
-int32_t get_number_of_vertices(FILE* graph_file) {
-    int32_t num_vertices = fgetc(graph_file) - 48;
-    int32_t pos = ftell(graph_file);
-    fseek(graph_file, ++pos, SEEK_CUR);
-    return num_vertices;
+void sink_put_uint(output_sink_t* sink, uint64_t value) {
+    // Digits come out lowest first, so they are filled in from the back of the buffer
+    char digits[20];
+    size_t num_digits = 0;
+    do {
+        digits[sizeof(digits) - ++num_digits] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    sink_write(sink, digits + sizeof(digits) - num_digits, num_digits);
 }
 
-int32_t main(int argc, char* argv[]) {
-    if (argc != 3) {
-        fprintf(stderr, "Incorrect number of arguments: %i provided instead of 3\n", argc);
+// A "shm:<name>" snapshot is published as a new shared memory segment, processes still attached
+// to an earlier segment of that name keep theirs until they detach. The segment is created
+// read-only, so once published no one but its owner can open it for writing
+FILE* open_snapshot_file(const char* file_name) {
+    if (!is_shared_memory_name(file_name)) {
+        return fopen(file_name, "wb");
+    }
+    const char* segment_name = file_name + sizeof(SHARED_MEMORY_PREFIX) - 1;
+    shm_unlink(segment_name);
+    const int fd = shm_open(segment_name, O_CREAT | O_EXCL | O_RDWR, 0444);
+    return fd == -1 ? NULL : fdopen(fd, "wb");
+}
+
+void begin_snapshot(snapshot_writer_t* writer, const char* file_name, const uint32_t flags,
+                    const size_t num_vertices, const size_t num_edges) {
+    writer->file = open_snapshot_file(file_name);
+    if (!writer->file) {
+        perror("Opening the snapshot file failed");
         exit(EXIT_FAILURE);
     }
 
-    const char* graph_file_name = argv[1];
-    const char* query_file_name = argv[2];
+    memset(&writer->header, 0, sizeof(snapshot_header_t));
+    memcpy(writer->header.magic, SNAPSHOT_MAGIC, sizeof(writer->header.magic));
+    writer->header.version = SNAPSHOT_VERSION;
+    writer->header.flags = flags;
+    writer->header.num_vertices = num_vertices;
+    writer->header.num_edges = num_edges;
+
+    // The header is written with the section table once all sections are in, until then a blank
+    // one holds its place, so a snapshot that is still being written is never taken for one
+    const snapshot_header_t blank_header = {0};
+    fwrite(&blank_header, sizeof(snapshot_header_t), 1, writer->file);
+    writer->offset = sizeof(snapshot_header_t);
+}
+
+void begin_snapshot_section(snapshot_writer_t* writer, const snapshot_section_id_t section) {
+    writer->section = section;
+    writer->header.sections[section].offset = writer->offset;
+    writer->header.sections[section].size = 0;
+}
+
+void append_snapshot_data(snapshot_writer_t* writer, const void* data, const size_t size) {
+    fwrite(data, 1, size, writer->file);
+    writer->header.sections[writer->section].size += size;
+    writer->offset += size;
+}
+
+void end_snapshot_section(snapshot_writer_t* writer) {
+    static const char padding[8] = {0};
+    const size_t padding_size = (8 - writer->offset % 8) % 8;
+    fwrite(padding, 1, padding_size, writer->file);
+    writer->offset += padding_size;
+}
+
+void write_snapshot_section(snapshot_writer_t* writer, const snapshot_section_id_t section,
+                            const void* data, const size_t size) {
+    begin_snapshot_section(writer, section);
+    append_snapshot_data(writer, data, size);
+    end_snapshot_section(writer);
+}
 
-    FILE* graph_file = fopen(graph_file_name, "r");
-    if (graph_file == NULL) {
-        fprintf(stderr, "Cannot open %s graph file\n", graph_file_name);
-        fclose(graph_file);
+void end_snapshot(snapshot_writer_t* writer) {
+    fseek(writer->file, 0, SEEK_SET);
+    fwrite(&writer->header, sizeof(snapshot_header_t), 1, writer->file);
+    if (ferror(writer->file) || fclose(writer->file) != 0) {
+        perror("Writing the snapshot file failed");
         exit(EXIT_FAILURE);
     }
+    writer->file = NULL;
+}
 
-    FILE* query_file = fopen(query_file_name, "r");
-    if (query_file == NULL) {
-        fprintf(stderr, "Cannot open %s quary file\n", query_file_name);
-        fclose(graph_file);
-        fclose(query_file);
+bool is_graph_snapshot(const mapped_file_t* file) {
+    return file->size >= sizeof(snapshot_header_t) &&
+           memcmp(file->data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC) - 1) == 0;
+}
+
+// Checks the header and the section table, the attach functions check the contents of the
+// sections they use
+const snapshot_header_t* open_graph_snapshot(const mapped_file_t* file, const uint32_t flags) {
+    const snapshot_header_t* header = (const snapshot_header_t*)file->data;
+    if (header->version != SNAPSHOT_VERSION) {
+        fprintf(stderr, "Unsupported snapshot version %u\n", header->version);
+        exit(EXIT_FAILURE);
+    }
+    if ((header->flags & SNAPSHOT_DIRECTED) != (flags & SNAPSHOT_DIRECTED)) {
+        fprintf(stderr, "Snapshot holds %s graph\n",
+                header->flags & SNAPSHOT_DIRECTED ? "a directed" : "an undirected");
+        exit(EXIT_FAILURE);
+    }
+    if ((header->flags & SNAPSHOT_FILE_ORDER) != (flags & SNAPSHOT_FILE_ORDER)) {
+        fprintf(stderr, "Snapshot rows are in %s order\n",
+                header->flags & SNAPSHOT_FILE_ORDER ? "file" : "name");
+        exit(EXIT_FAILURE);
+    }
+    if (header->num_vertices > UINT32_MAX) {
+        fprintf(stderr, "Invalid vertex count in snapshot: %" PRIu64 "\n", header->num_vertices);
         exit(EXIT_FAILURE);
     }
 
-    int32_t num_vertices = get_number_of_vertices(graph_file);
+    for (size_t i = 0; i < SNAPSHOT_NUM_SECTIONS; i++) {
+        const snapshot_section_t* section = &header->sections[i];
+        if (section->size > 0 &&
+            (section->offset % 8 != 0 || section->offset > file->size ||
+             section->size > file->size - section->offset)) {
+            fprintf(stderr, "Snapshot section %zu is out of bounds\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    // Create empty graph
-    undirected_graph_t* graph = NULL;
-    create_undirected_graph(&graph, num_vertices);
+    // Sections are read in place, prefetch the whole mapping
+    madvise((void*)file->data, file->size, MADV_WILLNEED);
+    return header;
+}
 
-    // Read unordered graph from file
-    read_graph_from_file(graph, graph_file);
+// Returns the section in the mapping, or NULL when the snapshot does not have it
+const void* snapshot_section(const mapped_file_t* file, const snapshot_header_t* header,
+                             const snapshot_section_id_t section, const size_t expected_size) {
+    if (header->sections[section].size == 0) {
+        return expected_size == 0 ? file->data + header->sections[section].offset : NULL;
+    }
+    if (header->sections[section].size != expected_size) {
+        fprintf(stderr, "Snapshot section %d has %" PRIu64 " bytes instead of %zu\n", (int)section,
+                header->sections[section].size, expected_size);
+        exit(EXIT_FAILURE);
+    }
+    return file->data + header->sections[section].offset;
+}
 
-    // Sort the graph adjacency lists
-    for (int32_t i = 0; i < num_vertices; i++) {
-        sort_slinked_list(graph->adjacency_lists[i]);
+const void* required_snapshot_section(const mapped_file_t* file, const snapshot_header_t* header,
+                                      const snapshot_section_id_t section,
+                                      const size_t expected_size) {
+    const void* data = snapshot_section(file, header, section, expected_size);
+    if (data == NULL) {
+        fprintf(stderr, "Snapshot is missing section %d\n", (int)section);
+        exit(EXIT_FAILURE);
     }
+    return data;
+}
 
-    // Print sorted graph
-    print_undirected_graph(graph);
+// Stops with an error unless the offsets start at 0, never decrease and end at the given value
+void check_snapshot_offsets(const uint64_t* offsets, const size_t count, const uint64_t end,
+                            const char* table_name) {
+    bool valid = offsets[0] == 0 && offsets[count] == end;
+    for (size_t i = 0; i < count && valid; i++) {
+        valid = offsets[i] <= offsets[i + 1];
+    }
+    if (!valid) {
+        fprintf(stderr, "Snapshot has an invalid %s\n", table_name);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Stops with an error unless every id is below the limit
+void check_snapshot_ids(const uint32_t* ids, const size_t count, const size_t limit,
+                        const char* table_name) {
+    for (size_t i = 0; i < count; i++) {
+        if (ids[i] >= limit) {
+            fprintf(stderr, "Snapshot has an invalid %s\n", table_name);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// Every name must end with its terminator inside the names section and every slot must be empty
+// or hold a vertex id. No more ids than vertices leaves empty slots for every lookup to stop at
+void check_snapshot_name_table(const uint64_t* name_offsets, const char* names,
+                               const size_t num_symbols, const uint32_t* slots,
+                               const size_t num_slots) {
+    bool valid = name_offsets[0] == 0;
+    for (size_t i = 0; i < num_symbols && valid; i++) {
+        valid = name_offsets[i] < name_offsets[i + 1];
+    }
+    for (size_t i = 0; i < num_symbols && valid; i++) {
+        valid = names[name_offsets[i + 1] - 1] == '\0';
+    }
+    size_t num_filled = 0;
+    for (size_t i = 0; i < num_slots && valid; i++) {
+        if (slots[i] != INVALID_VERTEX_ID) {
+            valid = slots[i] < num_symbols;
+            num_filled++;
+        }
+    }
+    if (!valid || num_filled > num_symbols) {
+        fprintf(stderr, "Snapshot has an invalid name table\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void write_symbol_table_sections(snapshot_writer_t* writer, const symbol_table_t* table) {
+    // Names are stored back to back with their terminators and found through their offsets
+    uint64_t name_offset = 0;
+    begin_snapshot_section(writer, SNAPSHOT_NAME_OFFSETS);
+    for (size_t i = 0; i < table->num_symbols; i++) {
+        append_snapshot_data(writer, &name_offset, sizeof(uint64_t));
+        name_offset += strlen(symbol_table_name(table, (uint32_t)i)) + 1;
+    }
+    append_snapshot_data(writer, &name_offset, sizeof(uint64_t));
+    end_snapshot_section(writer);
+
+    begin_snapshot_section(writer, SNAPSHOT_NAMES);
+    for (size_t i = 0; i < table->num_symbols; i++) {
+        const char* name = symbol_table_name(table, (uint32_t)i);
+        append_snapshot_data(writer, name, strlen(name) + 1);
+    }
+    end_snapshot_section(writer);
+
+    write_snapshot_section(writer, SNAPSHOT_NAME_SLOTS, table->slots,
+                           table->num_slots * sizeof(uint32_t));
+}
+
+void attach_symbol_table(symbol_table_t** table, const mapped_file_t* file,
+                         const snapshot_header_t* header, arena_t* arena) {
+    const size_t num_symbols = header->num_vertices;
+    const uint64_t* name_offsets = (const uint64_t*)required_snapshot_section(
+        file, header, SNAPSHOT_NAME_OFFSETS, (num_symbols + 1) * sizeof(uint64_t));
+    const char* names = (const char*)required_snapshot_section(file, header, SNAPSHOT_NAMES,
+                                                               name_offsets[num_symbols]);
+
+    // The slot table is used as it is, so it must be a valid open addressing table
+    const size_t num_slots = header->sections[SNAPSHOT_NAME_SLOTS].size / sizeof(uint32_t);
+    if (num_slots <= num_symbols || (num_slots & (num_slots - 1)) != 0) {
+        fprintf(stderr, "Snapshot has an invalid name table\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const uint32_t* slots = (const uint32_t*)required_snapshot_section(
+        file, header, SNAPSHOT_NAME_SLOTS, num_slots * sizeof(uint32_t));
+    check_snapshot_name_table(name_offsets, names, num_symbols, slots, num_slots);
+
+    *table = (symbol_table_t*)malloc(sizeof(symbol_table_t));
+    (*table)->arena = arena;
+    (*table)->num_symbols = num_symbols;
+    // Names are looked up in the mapping itself, attaching copies nothing per vertex
+    (*table)->names_capacity = 0;
+    (*table)->names = NULL;
+    (*table)->name_offsets = name_offsets;
+    (*table)->name_data = names;
+    (*table)->num_slots = num_slots;
+    (*table)->slots = (uint32_t*)slots;
+    (*table)->mapped = true;
+}
+
+void create_undirected_graph(undirected_graph_t** graph, const size_t num_vertices) {
+    *graph = (undirected_graph_t*)malloc(sizeof(undirected_graph_t));
+    (*graph)->vertices_count = num_vertices;
+    (*graph)->edges_count = 0;
+    create_arena(&(*graph)->arena, ARENA_BLOCK_SIZE);
+    create_symbol_table(&(*graph)->vertex_names, num_vertices, (*graph)->arena);
+    (*graph)->snapshot = NULL;
+    (*graph)->edge_offsets = NULL;
+    (*graph)->edge_targets = NULL;
+    (*graph)->row_bytes = NULL;
+    (*graph)->target_bytes = NULL;
+    (*graph)->vertex_by_rank = NULL;
+}
+
+void create_edge_buffer(edge_buffer_t** buffer, const size_t capacity) {
+    *buffer = (edge_buffer_t*)malloc(sizeof(edge_buffer_t));
+    (*buffer)->size = 0;
+    (*buffer)->capacity = capacity > 0 ? capacity : 16;
+    (*buffer)->records = (edge_record_t*)malloc((*buffer)->capacity * sizeof(edge_record_t));
+}
+
+void push_edge_record(edge_buffer_t* buffer, const uint32_t src_id, const uint32_t dst_id) {
+    if (buffer->size == buffer->capacity) {
+        buffer->capacity *= 2;
+        buffer->records =
+            (edge_record_t*)realloc(buffer->records, buffer->capacity * sizeof(edge_record_t));
+    }
+    edge_record_t* record = &buffer->records[buffer->size++];
+    record->src_id = src_id;
+    record->dst_id = dst_id;
+}
+
+void free_edge_buffer(edge_buffer_t* buffer) {
+    free(buffer->records);
+    buffer->records = NULL;
+    buffer->size = buffer->capacity = 0;
+}
+
+// "<u> <v>" adds an edge and "<u>" alone a vertex, a vertex is added the first time the stream
+// names it
+void add_stream_line(undirected_graph_t* graph, text_cursor_t line, edge_buffer_t* edges) {
+    const char* edge_u;
+    const char* edge_v;
+    size_t len_u, len_v;
+    if (!next_token(&line, &edge_u, &len_u)) {
+        return;
+    }
+    const uint32_t u_id = symbol_table_intern(graph->vertex_names, edge_u, len_u);
+    if (!next_token(&line, &edge_v, &len_v)) {
+        return;
+    }
+    const uint32_t v_id = symbol_table_intern(graph->vertex_names, edge_v, len_v);
+    push_edge_record(edges, u_id, v_id);
+}
+
+// Reads the stream in blocks and parses every complete line of a block, the unfinished line at
+// its end is carried over to the next one
+void read_edge_stream(undirected_graph_t* graph, const int fd, edge_buffer_t* edges) {
+    size_t capacity = STREAM_BLOCK_SIZE;
+    char* buffer = (char*)malloc(capacity);
+    size_t pending = 0;
+    bool end_of_stream = false;
+    while (!end_of_stream) {
+        if (pending == capacity) {
+            // A single line fills the whole buffer, make room for the rest of it
+            capacity *= 2;
+            buffer = (char*)realloc(buffer, capacity);
+        }
+        const ssize_t num_read = read(fd, buffer + pending, capacity - pending);
+        if (num_read == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read() failed for edge stream");
+            exit(EXIT_FAILURE);
+        }
+        end_of_stream = num_read == 0;
+
+        // Only the new bytes can hold a newline, the carried over line has none
+        const char* data_end = buffer + pending + num_read;
+        const char* lines_end = data_end;
+        if (!end_of_stream) {
+            while (lines_end > buffer + pending && lines_end[-1] != '\n') {
+                lines_end--;
+            }
+            if (lines_end == buffer + pending) {
+                lines_end = buffer;
+            }
+        }
+
+        text_cursor_t cursor = {buffer, lines_end};
+        text_cursor_t line;
+        while (next_line(&cursor, &line)) {
+            add_stream_line(graph, line, edges);
+        }
+        pending = data_end - lines_end;
+        memmove(buffer, lines_end, pending);
+    }
+    free(buffer);
+}
+
+// Runs one phase of the loader, a single task runs on the calling thread without starting any
+void run_loader_tasks(loader_task_t* tasks, const size_t num_tasks, void* (*work)(void*)) {
+    if (num_tasks == 1) {
+        work(&tasks[0]);
+        return;
+    }
+
+    pthread_t threads[MAX_LOADER_THREADS];
+    for (size_t i = 0; i < num_tasks; i++) {
+        if (pthread_create(&threads[i], NULL, work, &tasks[i]) != 0) {
+            fprintf(stderr, "pthread_create() failed for loader task\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (size_t i = 0; i < num_tasks; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+// Splits the text into one chunk per task, every chunk but the last ends right after a newline
+void split_text_into_chunks(const char* begin, const char* end, loader_task_t* tasks,
+                            const size_t num_tasks) {
+    const size_t text_size = end - begin;
+    const char* chunk_begin = begin;
+    for (size_t i = 0; i < num_tasks; i++) {
+        const char* chunk_end = end;
+        if (i + 1 < num_tasks) {
+            chunk_end = begin + text_size / num_tasks * (i + 1);
+            if (chunk_end <= chunk_begin) {
+                chunk_end = chunk_begin;
+            } else {
+                const char* newline =
+                    (const char*)memchr(chunk_end - 1, '\n', end - (chunk_end - 1));
+                chunk_end = newline ? newline + 1 : end;
+            }
+        }
+        tasks[i].chunk_begin = chunk_begin;
+        tasks[i].chunk_end = chunk_end;
+        chunk_begin = chunk_end;
+    }
+}
+
+void* count_chunk_lines(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    size_t num_lines = 0;
+    const char* pos = task->chunk_begin;
+    while ((pos = (const char*)memchr(pos, '\n', task->chunk_end - pos)) != NULL) {
+        num_lines++;
+        pos++;
+    }
+    task->num_lines = num_lines;
+    return NULL;
+}
+
+void* intern_chunk_vertices(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    text_cursor_t cursor = {task->chunk_begin, task->chunk_end};
+    text_cursor_t line;
+    for (size_t vert_id = task->first_vert_id; next_line(&cursor, &line); vert_id++) {
+        const size_t vertex_len = line.end - line.pos;
+        char* name = (char*)arena_alloc(task->arena, vertex_len + 1);
+        memcpy(name, line.pos, vertex_len);
+        name[vertex_len] = '\0';
+        if (!symbol_table_insert_concurrent(task->graph->vertex_names, name, vertex_len,
+                                            (uint32_t)vert_id)) {
+            fprintf(stderr, "Duplicate vertex %s\n", name);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return NULL;
+}
+
+void* parse_chunk_edges(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    const symbol_table_t* vertex_names = task->graph->vertex_names;
+    text_cursor_t cursor = {task->chunk_begin, task->chunk_end};
+    text_cursor_t line;
+    while (next_line(&cursor, &line)) {
+        // Tokenize "<u> <v>" in place, the names are looked up without being copied
+        const text_cursor_t edge_line = line;
+        const char* edge_u;
+        const char* edge_v;
+        size_t len_u, len_v;
+        if (!next_token(&line, &edge_u, &len_u)) {
+            continue;
+        }
+        if (!next_token(&line, &edge_v, &len_v)) {
+            fprintf(stderr, "Skipping malformed edge: %.*s\n", (int)(edge_line.end - edge_line.pos),
+                    edge_line.pos);
+            continue;
+        }
+
+        const uint32_t u_id = symbol_table_find(vertex_names, edge_u, len_u);
+        const uint32_t v_id = symbol_table_find(vertex_names, edge_v, len_v);
+        if (u_id == INVALID_VERTEX_ID || v_id == INVALID_VERTEX_ID) {
+            fprintf(stderr, "Skipping edge with unknown vertex: %.*s\n",
+                    (int)(edge_line.end - edge_line.pos), edge_line.pos);
+            continue;
+        }
+
+        push_edge_record(task->edges, u_id, v_id);
+    }
+    return NULL;
+}
+
+// Counts the edges of every row into edge_offsets[row + 1]
+void* count_chunk_degrees(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    size_t* row_sizes = task->graph->edge_offsets + 1;
+    for (size_t i = 0; i < task->edges->size; i++) {
+        const edge_record_t* record = &task->edges->records[i];
+        __atomic_fetch_add(&row_sizes[record->src_id], 1, __ATOMIC_RELAXED);
+        // Every edge is stored from both endpoints, a loop only once
+        if (record->src_id != record->dst_id) {
+            __atomic_fetch_add(&row_sizes[record->dst_id], 1, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+// Places every edge in the row of its source, in no particular order within the row
+void* scatter_chunk_edges(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    undirected_graph_t* graph = task->graph;
+    for (size_t i = 0; i < task->edges->size; i++) {
+        const edge_record_t* record = &task->edges->records[i];
+        const size_t position = task->first_edge_position + i;
+        const size_t edge = __atomic_fetch_add(&task->row_cursors[record->src_id], 1,
+                                               __ATOMIC_RELAXED);
+        graph->edge_targets[edge] = record->dst_id;
+        task->edge_positions[edge] = position;
+        if (record->src_id != record->dst_id) {
+            const size_t back_edge = __atomic_fetch_add(&task->row_cursors[record->dst_id], 1,
+                                                        __ATOMIC_RELAXED);
+            graph->edge_targets[back_edge] = record->src_id;
+            task->edge_positions[back_edge] = position;
+        }
+    }
+    return NULL;
+}
+
+int compare_row_entries(const void* lhs, const void* rhs) {
+    const row_entry_t* lhs_entry = (const row_entry_t*)lhs;
+    const row_entry_t* rhs_entry = (const row_entry_t*)rhs;
+    if (lhs_entry->rank != rhs_entry->rank) {
+        return lhs_entry->rank < rhs_entry->rank ? -1 : 1;
+    }
+    if (lhs_entry->position != rhs_entry->position) {
+        return lhs_entry->position < rhs_entry->position ? -1 : 1;
+    }
+    return 0;
+}
+
+// Sorts the rows of the task by target name, parallel edges stay in the order they were listed
+void* sort_chunk_rows(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    undirected_graph_t* graph = task->graph;
+    row_entry_t* entries = NULL;
+    size_t entries_capacity = 0;
+    for (size_t row = task->first_row; row < task->end_row; row++) {
+        const size_t row_begin = graph->edge_offsets[row];
+        const size_t row_size = graph->edge_offsets[row + 1] - row_begin;
+        if (row_size < 2) {
+            continue;
+        }
+        if (row_size > entries_capacity) {
+            entries_capacity = row_size;
+            entries = (row_entry_t*)realloc(entries, entries_capacity * sizeof(row_entry_t));
+        }
+
+        for (size_t i = 0; i < row_size; i++) {
+            const uint32_t target = graph->edge_targets[row_begin + i];
+            entries[i].rank = task->name_ranks[target];
+            entries[i].target = target;
+            entries[i].position = task->edge_positions[row_begin + i];
+        }
+        qsort(entries, row_size, sizeof(row_entry_t), compare_row_entries);
+        for (size_t i = 0; i < row_size; i++) {
+            graph->edge_targets[row_begin + i] = entries[i].target;
+        }
+    }
+    free(entries);
+    return NULL;
+}
+
+size_t varint_size(uint32_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+// Seven bits per byte, lowest first, the high bit is set on every byte but the last
+uint8_t* encode_varint(uint8_t* pos, uint32_t value) {
+    while (value >= 0x80) {
+        *pos++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *pos++ = (uint8_t)value;
+    return pos;
+}
+
+// Re-encodes the sorted rows as varint gaps between the name ranks of their neighbors, then
+// releases the plain rows
+void compress_undirected_graph(undirected_graph_t* graph, const uint32_t* name_ranks) {
+    const size_t vertices_count = graph->vertices_count;
+    graph->vertex_by_rank =
+        (uint32_t*)arena_alloc(graph->arena, vertices_count * sizeof(uint32_t));
+    for (size_t i = 0; i < vertices_count; i++) {
+        graph->vertex_by_rank[name_ranks[i]] = (uint32_t)i;
+    }
+
+    // Rows are sorted by name, so every gap is non-negative and most fit in a byte
+    graph->row_bytes = (size_t*)arena_alloc(graph->arena, (vertices_count + 1) * sizeof(size_t));
+    size_t num_bytes = 0;
+    for (size_t row = 0; row < vertices_count; row++) {
+        graph->row_bytes[row] = num_bytes;
+        uint32_t rank = 0;
+        for (size_t edge = graph->edge_offsets[row]; edge < graph->edge_offsets[row + 1]; edge++) {
+            const uint32_t neighbor_rank = name_ranks[graph->edge_targets[edge]];
+            num_bytes += varint_size(neighbor_rank - rank);
+            rank = neighbor_rank;
+        }
+    }
+    graph->row_bytes[vertices_count] = num_bytes;
+
+    graph->target_bytes = (uint8_t*)arena_alloc(graph->arena, num_bytes);
+    uint8_t* pos = graph->target_bytes;
+    for (size_t row = 0; row < vertices_count; row++) {
+        uint32_t rank = 0;
+        for (size_t edge = graph->edge_offsets[row]; edge < graph->edge_offsets[row + 1]; edge++) {
+            const uint32_t neighbor_rank = name_ranks[graph->edge_targets[edge]];
+            pos = encode_varint(pos, neighbor_rank - rank);
+            rank = neighbor_rank;
+        }
+    }
+
+    free(graph->edge_targets);
+    graph->edge_targets = NULL;
+}
+
+void begin_neighbors(const undirected_graph_t* graph, const uint32_t vert_id,
+                     neighbor_cursor_t* cursor) {
+    cursor->edge = graph->edge_offsets[vert_id];
+    cursor->end = graph->edge_offsets[vert_id + 1];
+    cursor->bytes = graph->target_bytes ? graph->target_bytes + graph->row_bytes[vert_id] : NULL;
+    cursor->rank = 0;
+}
+
+// Hands out the next neighbor of the row, returns false at its end
+bool next_neighbor(const undirected_graph_t* graph, neighbor_cursor_t* cursor,
+                   uint32_t* neighbor_id) {
+    if (cursor->edge == cursor->end) {
+        return false;
+    }
+    if (cursor->bytes == NULL) {
+        *neighbor_id = graph->edge_targets[cursor->edge++];
+        return true;
+    }
+
+    // Gaps below 128 take a single byte, so the loop is skipped for most of them
+    uint32_t gap = *cursor->bytes++;
+    if (gap >= 0x80) {
+        gap &= 0x7f;
+        uint32_t shift = 7;
+        uint8_t byte;
+        do {
+            byte = *cursor->bytes++;
+            gap |= (uint32_t)(byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte >= 0x80);
+    }
+    cursor->rank += gap;
+    cursor->edge++;
+    *neighbor_id = graph->vertex_by_rank[cursor->rank];
+    return true;
+}
+
+void print_adjacency_stats(const undirected_graph_t* graph) {
+    const size_t vertices_count = graph->vertices_count;
+    const size_t edges_count = graph->edges_count;
+    size_t num_bytes = (vertices_count + 1) * sizeof(size_t);
+    if (graph->target_bytes) {
+        num_bytes += (vertices_count + 1) * sizeof(size_t) + vertices_count * sizeof(uint32_t) +
+                     graph->row_bytes[vertices_count];
+    } else {
+        num_bytes += edges_count * sizeof(uint32_t);
+    }
+    fprintf(stderr, "Adjacency%s: %zu bytes for %zu edges (%.2f bytes per edge)\n",
+            graph->target_bytes ? " (compressed)" : "", num_bytes, edges_count,
+            edges_count > 0 ? (double)num_bytes / edges_count : 0.0);
+}
+
+void print_undirected_graph(const undirected_graph_t* graph, output_sink_t* out) {
+    sink_puts(out, "Unordered graph size: ");
+    sink_put_uint(out, graph->vertices_count);
+    sink_putc(out, '\n');
+    for (size_t i = 0; i < graph->vertices_count; i++) {
+        sink_puts(out, symbol_table_name(graph->vertex_names, (uint32_t)i));
+        sink_puts(out, " - ");
+        neighbor_cursor_t neighbors;
+        uint32_t neighbor_id;
+        begin_neighbors(graph, (uint32_t)i, &neighbors);
+        while (next_neighbor(graph, &neighbors, &neighbor_id)) {
+            sink_puts(out, symbol_table_name(graph->vertex_names, neighbor_id));
+            sink_puts(out, " - ");
+        }
+        sink_puts(out, "NULL\n");
+    }
+}
+
+// Reads the vertex and edge lists with one loader task per chunk of the text
+void read_graph_from_file(undirected_graph_t* graph, text_cursor_t* cursor,
+                          const size_t expected_edges, loader_task_t* tasks,
+                          const size_t num_tasks) {
+    for (size_t i = 0; i < num_tasks; i++) {
+        tasks[i].graph = graph;
+    }
+
+    // Vertex ids are assigned in the order the vertices are listed, so the lines are counted
+    // first to give every chunk the ids of its vertices and to find where the edges begin
+    const size_t num_vertices = graph->vertices_count;
+    split_text_into_chunks(cursor->pos, cursor->end, tasks, num_tasks);
+    run_loader_tasks(tasks, num_tasks, count_chunk_lines);
+    size_t vert_id = 0;
+    const char* edges_begin = cursor->end;
+    for (size_t i = 0; i < num_tasks; i++) {
+        tasks[i].first_vert_id = vert_id;
+        if (vert_id + tasks[i].num_lines < num_vertices) {
+            vert_id += tasks[i].num_lines;
+            continue;
+        }
+
+        // The vertex list ends in this chunk, cut it right after the last vertex
+        const char* pos = tasks[i].chunk_begin;
+        for (; vert_id < num_vertices; vert_id++) {
+            pos = (const char*)memchr(pos, '\n', tasks[i].chunk_end - pos) + 1;
+        }
+        edges_begin = tasks[i].chunk_end = pos;
+        for (size_t j = i + 1; j < num_tasks; j++) {
+            tasks[j].chunk_begin = tasks[j].chunk_end = pos;
+            tasks[j].first_vert_id = num_vertices;
+        }
+        break;
+    }
+    if (vert_id < num_vertices) {
+        // The last line of the file may lack its newline
+        const bool unterminated_line = cursor->end > cursor->pos && cursor->end[-1] != '\n';
+        if (vert_id + unterminated_line < num_vertices) {
+            fprintf(stderr, "Expected %zu vertices, the graph file has only %zu\n", num_vertices,
+                    vert_id + unterminated_line);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Intern the names in parallel, the table is presized so it never grows meanwhile
+    for (size_t i = 0; i < num_tasks; i++) {
+        create_arena(&tasks[i].arena, ARENA_BLOCK_SIZE);
+    }
+    run_loader_tasks(tasks, num_tasks, intern_chunk_vertices);
+    graph->vertex_names->num_symbols = num_vertices;
+    for (size_t i = 0; i < num_tasks; i++) {
+        merge_arena(graph->arena, tasks[i].arena);
+        free(tasks[i].arena);
+        tasks[i].arena = NULL;
+    }
+
+    // Parse the edges in parallel, every task collects the edges of its chunk in file order
+    const size_t edges_size = cursor->end - edges_begin;
+    split_text_into_chunks(edges_begin, cursor->end, tasks, num_tasks);
+    for (size_t i = 0; i < num_tasks; i++) {
+        const size_t chunk_size = tasks[i].chunk_end - tasks[i].chunk_begin;
+        const size_t chunk_edges = expected_edges > 0 && edges_size > 0
+                                       ? (size_t)((double)expected_edges * chunk_size / edges_size)
+                                       : chunk_size / 16;
+        create_edge_buffer(&tasks[i].edges, chunk_edges + 1);
+    }
+    run_loader_tasks(tasks, num_tasks, parse_chunk_edges);
+}
+
+// Builds the CSR layout from the edges the loader tasks parsed, with every row sorted by name
+void freeze_undirected_graph(undirected_graph_t* graph, loader_task_t* tasks,
+                             const size_t num_tasks, const bool compress) {
+    const size_t vertices_count = graph->vertices_count;
+    graph->edge_offsets = (size_t*)arena_alloc(graph->arena, (vertices_count + 1) * sizeof(size_t));
+    memset(graph->edge_offsets, 0, (vertices_count + 1) * sizeof(size_t));
+    run_loader_tasks(tasks, num_tasks, count_chunk_degrees);
+    for (size_t i = 0; i < vertices_count; i++) {
+        graph->edge_offsets[i + 1] += graph->edge_offsets[i];
+    }
+
+    graph->edges_count = graph->edge_offsets[vertices_count];
+    const size_t targets_size = graph->edges_count * sizeof(uint32_t);
+    if (compress) {
+        // The plain rows are only needed until they are encoded
+        graph->edge_targets = (uint32_t*)malloc(targets_size + 1);
+    } else {
+        graph->edge_targets = (uint32_t*)arena_alloc(graph->arena, targets_size);
+    }
+
+    // Every task scatters its edges through the shared row cursors and tags each with its
+    // position in the file, which the row sort uses to keep the result independent of timing
+    size_t* row_cursors = (size_t*)malloc((vertices_count + 1) * sizeof(size_t));
+    memcpy(row_cursors, graph->edge_offsets, (vertices_count + 1) * sizeof(size_t));
+    size_t* edge_positions = (size_t*)malloc((graph->edges_count + 1) * sizeof(size_t));
+    uint32_t* name_ranks = (uint32_t*)malloc((vertices_count + 1) * sizeof(uint32_t));
+    rank_vertex_names(graph->vertex_names, name_ranks);
+    size_t first_edge_position = 0;
+    for (size_t i = 0; i < num_tasks; i++) {
+        tasks[i].row_cursors = row_cursors;
+        tasks[i].edge_positions = edge_positions;
+        tasks[i].name_ranks = name_ranks;
+        tasks[i].first_edge_position = first_edge_position;
+        first_edge_position += tasks[i].edges->size;
+    }
+    run_loader_tasks(tasks, num_tasks, scatter_chunk_edges);
+
+    // Give every task a run of rows holding about the same number of edges to sort
+    size_t row = 0;
+    for (size_t i = 0; i < num_tasks; i++) {
+        const size_t edges_end = graph->edges_count / num_tasks * (i + 1);
+        tasks[i].first_row = row;
+        const bool last_task = i + 1 == num_tasks;
+        while (row < vertices_count && (last_task || graph->edge_offsets[row + 1] <= edges_end)) {
+            row++;
+        }
+        tasks[i].end_row = row;
+    }
+    run_loader_tasks(tasks, num_tasks, sort_chunk_rows);
+    if (compress) {
+        compress_undirected_graph(graph, name_ranks);
+    }
+
+    free(name_ranks);
+    free(edge_positions);
+    free(row_cursors);
+}
+
+void free_graph(undirected_graph_t* graph) {
+    free_symbol_table(graph->vertex_names);
+    free(graph->vertex_names);
+    free_arena(graph->arena);
+    free(graph->arena);
+    if (graph->snapshot) {
+        unmap_file(graph->snapshot);
+        free(graph->snapshot);
+    }
+    graph->vertices_count = graph->edges_count = 0;
+}
+
+void write_undirected_graph_sections(snapshot_writer_t* writer, const undirected_graph_t* graph) {
+    write_symbol_table_sections(writer, graph->vertex_names);
+    write_snapshot_section(writer, SNAPSHOT_EDGE_OFFSETS, graph->edge_offsets,
+                           (graph->vertices_count + 1) * sizeof(size_t));
+    if (graph->target_bytes == NULL) {
+        write_snapshot_section(writer, SNAPSHOT_EDGE_TARGETS, graph->edge_targets,
+                               graph->edges_count * sizeof(uint32_t));
+        return;
+    }
+
+    // Snapshots always hold the plain layout, compressed rows are decoded on the way out
+    begin_snapshot_section(writer, SNAPSHOT_EDGE_TARGETS);
+    for (uint32_t i = 0; i < graph->vertices_count; i++) {
+        neighbor_cursor_t neighbors;
+        uint32_t neighbor_id;
+        begin_neighbors(graph, i, &neighbors);
+        while (next_neighbor(graph, &neighbors, &neighbor_id)) {
+            append_snapshot_data(writer, &neighbor_id, sizeof(uint32_t));
+        }
+    }
+    end_snapshot_section(writer);
+}
+
+void attach_undirected_graph(undirected_graph_t** graph, mapped_file_t* file) {
+    const snapshot_header_t* header = open_graph_snapshot(file, 0);
+    const size_t vertices_count = header->num_vertices;
+    const size_t edges_count = header->num_edges;
+
+    *graph = (undirected_graph_t*)malloc(sizeof(undirected_graph_t));
+    (*graph)->vertices_count = vertices_count;
+    (*graph)->edges_count = edges_count;
+    create_arena(&(*graph)->arena, ARENA_BLOCK_SIZE);
+    attach_symbol_table(&(*graph)->vertex_names, file, header, (*graph)->arena);
+
+    // The CSR arrays are used in place, the graph owns the mapping from now on
+    (*graph)->edge_offsets = (size_t*)required_snapshot_section(
+        file, header, SNAPSHOT_EDGE_OFFSETS, (vertices_count + 1) * sizeof(size_t));
+    (*graph)->edge_targets = (uint32_t*)required_snapshot_section(
+        file, header, SNAPSHOT_EDGE_TARGETS, edges_count * sizeof(uint32_t));
+    check_snapshot_offsets((const uint64_t*)(*graph)->edge_offsets, vertices_count, edges_count,
+                           "edge table");
+    check_snapshot_ids((*graph)->edge_targets, edges_count, vertices_count, "edge table");
+    (*graph)->row_bytes = NULL;
+    (*graph)->target_bytes = NULL;
+    (*graph)->vertex_by_rank = NULL;
+    (*graph)->snapshot = file;
+}
+
+void create_query_batch(query_batch_t** batch) {
+    *batch = (query_batch_t*)malloc(sizeof(query_batch_t));
+    (*batch)->num_queries = 0;
+    (*batch)->capacity = 16;
+    (*batch)->sources = (uint32_t*)malloc((*batch)->capacity * sizeof(uint32_t));
+    (*batch)->kinds = (uint8_t*)malloc((*batch)->capacity * sizeof(uint8_t));
+    (*batch)->num_distinct = 0;
+    (*batch)->distinct_sources = NULL;
+    (*batch)->source_queries = NULL;
+    (*batch)->source_slots = NULL;
+}
+
+void push_query_source(query_batch_t* batch, const uint32_t src_id, const query_kind_t kind) {
+    if (batch->num_queries == batch->capacity) {
+        batch->capacity *= 2;
+        batch->sources = (uint32_t*)realloc(batch->sources, batch->capacity * sizeof(uint32_t));
+        batch->kinds = (uint8_t*)realloc(batch->kinds, batch->capacity * sizeof(uint8_t));
+    }
+    batch->sources[batch->num_queries] = src_id;
+    batch->kinds[batch->num_queries++] = (uint8_t)kind;
+}
+
+// Reads one query per line, either a source vertex name or "d <vertex>". Unknown vertices are
+// reported and dropped
+void read_query_batch(query_batch_t* batch, const symbol_table_t* vertex_names, FILE* query_file) {
+    char* query_buffer = NULL;
+    size_t query_capacity = 0;
+    while (getline(&query_buffer, &query_capacity, query_file) != -1) {
+        const size_t query_len = strcspn(query_buffer, "\r\n");
+        query_buffer[query_len] = '\0';
+
+        // Vertex names hold no blanks, so a line of two tokens led by "d" is never a name
+        text_cursor_t query_line = {query_buffer, query_buffer + query_len};
+        const char* name = query_buffer;
+        size_t name_len = query_len;
+        query_kind_t kind = QUERY_VISIT_ORDER;
+        const char* token;
+        size_t token_len;
+        if (next_token(&query_line, &token, &token_len) && token_len == 1 && token[0] == 'd' &&
+            next_token(&query_line, &name, &name_len) &&
+            !next_token(&query_line, &token, &token_len)) {
+            kind = QUERY_HOP_DISTANCES;
+        } else {
+            name = query_buffer;
+            name_len = query_len;
+        }
+
+        const uint32_t src_id = symbol_table_find(vertex_names, name, name_len);
+        if (src_id == INVALID_VERTEX_ID) {
+            fprintf(stderr, "Unknown vertex %.*s\n", (int)name_len, name);
+            continue;
+        }
+        push_query_source(batch, src_id, kind);
+    }
+    free(query_buffer);
+}
+
+int compare_vertex_ids(const void* lhs, const void* rhs) {
+    const uint32_t lhs_id = *(const uint32_t*)lhs;
+    const uint32_t rhs_id = *(const uint32_t*)rhs;
+    return lhs_id < rhs_id ? -1 : lhs_id > rhs_id;
+}
+
+// Groups the queries by source, so the work for a source is done once however often it is queried
+void plan_query_batch(query_batch_t* batch) {
+    const size_t num_queries = batch->num_queries;
+    batch->distinct_sources = (uint32_t*)malloc((num_queries + 1) * sizeof(uint32_t));
+    memcpy(batch->distinct_sources, batch->sources, num_queries * sizeof(uint32_t));
+    qsort(batch->distinct_sources, num_queries, sizeof(uint32_t), compare_vertex_ids);
+    size_t num_distinct = 0;
+    for (size_t i = 0; i < num_queries; i++) {
+        const uint32_t src_id = batch->distinct_sources[i];
+        if (num_distinct == 0 || batch->distinct_sources[num_distinct - 1] != src_id) {
+            batch->distinct_sources[num_distinct++] = src_id;
+        }
+    }
+    batch->num_distinct = num_distinct;
+
+    batch->source_queries = (uint32_t*)calloc(num_distinct + 1, sizeof(uint32_t));
+    batch->source_slots = (uint32_t*)malloc((num_queries + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < num_queries; i++) {
+        const uint32_t* slot = (const uint32_t*)bsearch(&batch->sources[i], batch->distinct_sources,
+                                                        num_distinct, sizeof(uint32_t),
+                                                        compare_vertex_ids);
+        batch->source_slots[i] = (uint32_t)(slot - batch->distinct_sources);
+        if (batch->kinds[i] == QUERY_VISIT_ORDER) {
+            batch->source_queries[batch->source_slots[i]]++;
+        }
+    }
+}
+
+void free_query_batch(query_batch_t* batch) {
+    free(batch->sources);
+    free(batch->kinds);
+    free(batch->distinct_sources);
+    free(batch->source_queries);
+    free(batch->source_slots);
+    batch->sources = batch->distinct_sources = batch->source_queries = batch->source_slots = NULL;
+    batch->kinds = NULL;
+    batch->num_queries = batch->num_distinct = batch->capacity = 0;
+}
+
+void bfs_graph(const undirected_graph_t* graph, const uint32_t src_id, traversal_state_t* state,
+               queue_t* bfs_queue) {
+    begin_traversal(state);
+    clear_queue(bfs_queue);
+    mark_visited(state, src_id);
+    push_at_queue(bfs_queue, src_id);
+    while (bfs_queue->size > 0) {
+        const uint32_t vert_id = pop_from_queue(bfs_queue);
+        neighbor_cursor_t neighbors;
+        uint32_t neighbor_id;
+        begin_neighbors(graph, vert_id, &neighbors);
+        while (next_neighbor(graph, &neighbors, &neighbor_id)) {
+            if (!is_visited(state, neighbor_id)) {
+                mark_visited(state, neighbor_id);
+                push_at_queue(bfs_queue, neighbor_id);
+            }
+        }
+    }
+}
+
+void create_hop_distances(hop_distances_t** result, const size_t capacity) {
+    *result = (hop_distances_t*)malloc(sizeof(hop_distances_t));
+    (*result)->capacity = capacity;
+    (*result)->distances = (uint32_t*)malloc((capacity + 1) * sizeof(uint32_t));
+    (*result)->parents = (uint32_t*)malloc((capacity + 1) * sizeof(uint32_t));
+    (*result)->num_reached = 0;
+    (*result)->reached = (uint32_t*)malloc((capacity + 1) * sizeof(uint32_t));
+}
+
+void free_hop_distances(hop_distances_t* result) {
+    free(result->distances);
+    free(result->parents);
+    free(result->reached);
+    result->capacity = result->num_reached = 0;
+}
+
+size_t vertex_degree(const undirected_graph_t* graph, const uint32_t vert_id) {
+    return graph->edge_offsets[vert_id + 1] - graph->edge_offsets[vert_id];
+}
+
+// Expands the level in [level_begin, level_end) of reached through the rows of its vertices,
+// returns the number of edges of the next level
+size_t expand_top_down(const undirected_graph_t* graph, hop_distances_t* result,
+                       const size_t level_begin, const size_t level_end, const uint32_t level) {
+    size_t next_edges = 0;
+    for (size_t i = level_begin; i < level_end; i++) {
+        const uint32_t vert_id = result->reached[i];
+        neighbor_cursor_t neighbors;
+        uint32_t neighbor_id;
+        begin_neighbors(graph, vert_id, &neighbors);
+        while (next_neighbor(graph, &neighbors, &neighbor_id)) {
+            if (result->distances[neighbor_id] == HOP_UNREACHED) {
+                result->distances[neighbor_id] = level + 1;
+                result->parents[neighbor_id] = vert_id;
+                result->reached[result->num_reached++] = neighbor_id;
+                next_edges += vertex_degree(graph, neighbor_id);
+            }
+        }
+    }
+    return next_edges;
+}
+
+// Lets every unreached vertex look for a parent on the current level instead, the row of a vertex
+// is left at the first parent found, which spares most edges once the frontier is large
+size_t expand_bottom_up(const undirected_graph_t* graph, hop_distances_t* result,
+                        const uint32_t level) {
+    size_t next_edges = 0;
+    for (uint32_t vert_id = 0; vert_id < graph->vertices_count; vert_id++) {
+        if (result->distances[vert_id] != HOP_UNREACHED) {
+            continue;
+        }
+        neighbor_cursor_t neighbors;
+        uint32_t neighbor_id;
+        begin_neighbors(graph, vert_id, &neighbors);
+        while (next_neighbor(graph, &neighbors, &neighbor_id)) {
+            if (result->distances[neighbor_id] == level) {
+                result->distances[vert_id] = level + 1;
+                result->parents[vert_id] = neighbor_id;
+                result->reached[result->num_reached++] = vert_id;
+                next_edges += vertex_degree(graph, vert_id);
+                break;
+            }
+        }
+    }
+    return next_edges;
+}
+
+void push_next_vertex(search_worker_t* worker, const uint32_t vert_id) {
+    if (worker->num_next == worker->next_capacity) {
+        worker->next_capacity = worker->next_capacity ? worker->next_capacity * 2 : 1024;
+        worker->next = (uint32_t*)realloc(worker->next, worker->next_capacity * sizeof(uint32_t));
+    }
+    worker->next[worker->num_next++] = vert_id;
+}
+
+// Records the frontier position of every vertex a frontier vertex reaches, the lowest one wins
+void claim_top_down(search_worker_t* worker, const size_t begin, const size_t end) {
+    const search_pool_t* pool = worker->pool;
+    const undirected_graph_t* graph = pool->graph;
+    const hop_distances_t* result = pool->result;
+    for (size_t position = begin; position < end; position++) {
+        neighbor_cursor_t neighbors;
+        uint32_t neighbor_id;
+        begin_neighbors(graph, result->reached[position], &neighbors);
+        while (next_neighbor(graph, &neighbors, &neighbor_id)) {
+            if (__atomic_load_n(&result->distances[neighbor_id], __ATOMIC_RELAXED) !=
+                HOP_UNREACHED) {
+                continue;
+            }
+            uint32_t claim = __atomic_load_n(&pool->claims[neighbor_id], __ATOMIC_RELAXED);
+            while (position < claim &&
+                   !__atomic_compare_exchange_n(&pool->claims[neighbor_id], &claim,
+                                                (uint32_t)position, true, __ATOMIC_RELAXED,
+                                                __ATOMIC_RELAXED)) {
+            }
+        }
+    }
+}
+
+// Top-down share of one worker, an unordered search hands each vertex to whichever worker swaps
+// its distance first
+void expand_top_down_part(search_worker_t* worker, const size_t begin, const size_t end) {
+    const search_pool_t* pool = worker->pool;
+    const undirected_graph_t* graph = pool->graph;
+    hop_distances_t* result = pool->result;
+    const uint32_t next_level = pool->level + 1;
+    for (size_t position = begin; position < end; position++) {
+        const uint32_t vert_id = result->reached[position];
+        neighbor_cursor_t neighbors;
+        uint32_t neighbor_id;
+        begin_neighbors(graph, vert_id, &neighbors);
+        while (next_neighbor(graph, &neighbors, &neighbor_id)) {
+            uint32_t distance = __atomic_load_n(&result->distances[neighbor_id], __ATOMIC_RELAXED);
+            if (distance != HOP_UNREACHED) {
+                continue;
+            }
+            if (pool->ordered) {
+                // Only the claiming worker writes the distance, repeated edges find it set
+                if (pool->claims[neighbor_id] != position) {
+                    continue;
+                }
+                __atomic_store_n(&result->distances[neighbor_id], next_level, __ATOMIC_RELAXED);
+            } else if (!__atomic_compare_exchange_n(&result->distances[neighbor_id], &distance,
+                                                    next_level, false, __ATOMIC_RELAXED,
+                                                    __ATOMIC_RELAXED)) {
+                continue;
+            }
+            result->parents[neighbor_id] = vert_id;
+            push_next_vertex(worker, neighbor_id);
+            worker->next_edges += vertex_degree(graph, neighbor_id);
+        }
+    }
+}
+
+// Bottom-up share of one worker, the vertices of a worker are its own, so no swap is needed
+void expand_bottom_up_part(search_worker_t* worker, const uint32_t begin, const uint32_t end) {
+    const search_pool_t* pool = worker->pool;
+    const undirected_graph_t* graph = pool->graph;
+    hop_distances_t* result = pool->result;
+    for (uint32_t vert_id = begin; vert_id < end; vert_id++) {
+        if (__atomic_load_n(&result->distances[vert_id], __ATOMIC_RELAXED) != HOP_UNREACHED) {
+            continue;
+        }
+        neighbor_cursor_t neighbors;
+        uint32_t neighbor_id;
+        begin_neighbors(graph, vert_id, &neighbors);
+        while (next_neighbor(graph, &neighbors, &neighbor_id)) {
+            if (__atomic_load_n(&result->distances[neighbor_id], __ATOMIC_RELAXED) == pool->level) {
+                __atomic_store_n(&result->distances[vert_id], pool->level + 1, __ATOMIC_RELAXED);
+                result->parents[vert_id] = neighbor_id;
+                push_next_vertex(worker, vert_id);
+                worker->next_edges += vertex_degree(graph, vert_id);
+                break;
+            }
+        }
+    }
+}
+
+void create_multi_source_search(multi_source_search_t** search, const size_t capacity) {
+    *search = (multi_source_search_t*)malloc(sizeof(multi_source_search_t));
+    (*search)->capacity = capacity;
+    const size_t lane_size = (capacity + 1) * sizeof(uint32_t);
+    (*search)->max_lanes = MULTI_SOURCE_MEMORY_LIMIT / lane_size;
+    if ((*search)->max_lanes > MULTI_SOURCE_LANES) {
+        (*search)->max_lanes = MULTI_SOURCE_LANES;
+    } else if ((*search)->max_lanes == 0) {
+        (*search)->max_lanes = 1;
+    }
+    (*search)->num_sources = 0;
+    (*search)->all_lanes = 0;
+    (*search)->seen = (uint64_t*)malloc((capacity + 1) * sizeof(uint64_t));
+    (*search)->frontier = (uint64_t*)malloc((capacity + 1) * sizeof(uint64_t));
+    (*search)->next = (uint64_t*)malloc((capacity + 1) * sizeof(uint64_t));
+    (*search)->distances = (uint32_t*)malloc((*search)->max_lanes * lane_size);
+}
+
+void free_multi_source_search(multi_source_search_t* search) {
+    free(search->seen);
+    free(search->frontier);
+    free(search->next);
+    free(search->distances);
+    search->seen = search->frontier = search->next = NULL;
+    search->distances = NULL;
+    search->capacity = search->max_lanes = search->num_sources = 0;
+}
+
+// Lets every vertex in [begin, end) look for the sources it has not seen yet among the words of
+// its neighbors on the given level. The row is left once every missing source is found, returns
+// the number of vertices reached on the next level
+size_t expand_multi_source_part(const undirected_graph_t* graph, multi_source_search_t* search,
+                                const uint32_t begin, const uint32_t end, const uint32_t level) {
+    const uint64_t* frontier = search->frontier;
+    uint64_t* next = search->next;
+    size_t num_next = 0;
+    for (uint32_t vert_id = begin; vert_id < end; vert_id++) {
+        uint64_t missing = search->all_lanes & ~search->seen[vert_id];
+        uint64_t found = 0;
+        if (missing != 0) {
+            const size_t capacity = search->capacity;
+            neighbor_cursor_t neighbors;
+            uint32_t neighbor_id;
+            begin_neighbors(graph, vert_id, &neighbors);
+            while (next_neighbor(graph, &neighbors, &neighbor_id)) {
+                uint64_t hits = frontier[neighbor_id] & missing;
+                if (hits == 0) {
+                    continue;
+                }
+                found |= hits;
+                missing &= ~hits;
+                while (hits != 0) {
+                    const size_t lane = (size_t)__builtin_ctzll(hits);
+                    search->distances[lane * capacity + vert_id] = level + 1;
+                    hits &= hits - 1;
+                }
+                if (missing == 0) {
+                    break;
+                }
+            }
+        }
+
+        // Only this vertex reads its own seen word, so it can be updated on this level already
+        next[vert_id] = found;
+        search->seen[vert_id] |= found;
+        num_next += found != 0;
+    }
+    return num_next;
+}
+
+// Pushes the words of the frontier vertices to their neighbors instead, which pays off while few
+// vertices are on the frontier
+size_t expand_multi_source_top_down(const undirected_graph_t* graph,
+                                    multi_source_search_t* search, const uint32_t level) {
+    const size_t capacity = search->capacity;
+    const uint64_t* frontier = search->frontier;
+    uint64_t* next = search->next;
+    memset(next, 0, graph->vertices_count * sizeof(uint64_t));
+    size_t num_next = 0;
+    for (uint32_t vert_id = 0; vert_id < graph->vertices_count; vert_id++) {
+        if (frontier[vert_id] == 0) {
+            continue;
+        }
+        neighbor_cursor_t neighbors;
+        uint32_t neighbor_id;
+        begin_neighbors(graph, vert_id, &neighbors);
+        while (next_neighbor(graph, &neighbors, &neighbor_id)) {
+            uint64_t hits = frontier[vert_id] & ~search->seen[neighbor_id];
+            if (hits == 0) {
+                continue;
+            }
+            num_next += next[neighbor_id] == 0;
+            next[neighbor_id] |= hits;
+            search->seen[neighbor_id] |= hits;
+            while (hits != 0) {
+                const size_t lane = (size_t)__builtin_ctzll(hits);
+                search->distances[lane * capacity + neighbor_id] = level + 1;
+                hits &= hits - 1;
+            }
+        }
+    }
+    return num_next;
+}
+
+// Reads the distances of one source off the search. Any neighbor one hop closer to the source is a
+// parent, the first one in the row is taken
+void extract_lane_distances(const undirected_graph_t* graph, const multi_source_search_t* search,
+                            const size_t lane, hop_distances_t* result) {
+    const uint64_t lane_bit = (uint64_t)1 << lane;
+    const uint32_t* lane_distances = &search->distances[lane * search->capacity];
+    for (uint32_t vert_id = 0; vert_id < graph->vertices_count; vert_id++) {
+        if ((search->seen[vert_id] & lane_bit) == 0) {
+            result->distances[vert_id] = HOP_UNREACHED;
+            continue;
+        }
+        const uint32_t distance = lane_distances[vert_id];
+        result->distances[vert_id] = distance;
+        result->parents[vert_id] = vert_id;
+        if (distance == 0) {
+            continue;
+        }
+        neighbor_cursor_t neighbors;
+        uint32_t neighbor_id;
+        begin_neighbors(graph, vert_id, &neighbors);
+        while (next_neighbor(graph, &neighbors, &neighbor_id)) {
+            if ((search->seen[neighbor_id] & lane_bit) != 0 &&
+                lane_distances[neighbor_id] == distance - 1) {
+                result->parents[vert_id] = neighbor_id;
+                break;
+            }
+        }
+    }
+    result->num_reached = 0;
+}
+
+void* run_search_worker(void* arg) {
+    search_worker_t* worker = (search_worker_t*)arg;
+    search_pool_t* pool = worker->pool;
+    while (true) {
+        pthread_barrier_wait(&pool->step_begin);
+        if (pool->step == SEARCH_STEP_STOP) {
+            break;
+        }
+
+        // Every worker takes a fixed run of the frontier or of the vertices, so the runs
+        // concatenated in worker order keep the order of the sequential search
+        const size_t index = worker->index;
+        const size_t num_workers = pool->num_workers;
+        const size_t frontier_size = pool->level_end - pool->level_begin;
+        const size_t begin = pool->level_begin + frontier_size * index / num_workers;
+        const size_t end = pool->level_begin + frontier_size * (index + 1) / num_workers;
+        const size_t vertices_count = pool->graph->vertices_count;
+        if (pool->step == SEARCH_STEP_CLAIM) {
+            claim_top_down(worker, begin, end);
+        } else if (pool->step == SEARCH_STEP_TOP_DOWN) {
+            expand_top_down_part(worker, begin, end);
+        } else if (pool->step == SEARCH_STEP_BOTTOM_UP) {
+            expand_bottom_up_part(worker, (uint32_t)(vertices_count * index / num_workers),
+                                  (uint32_t)(vertices_count * (index + 1) / num_workers));
+        } else if (pool->step == SEARCH_STEP_MULTI_SOURCE) {
+            worker->num_next = expand_multi_source_part(
+                pool->graph, pool->multi_source, (uint32_t)(vertices_count * index / num_workers),
+                (uint32_t)(vertices_count * (index + 1) / num_workers), pool->level);
+        } else if (pool->step == SEARCH_STEP_APPEND) {
+            memcpy(pool->result->reached + worker->append_at, worker->next,
+                   worker->num_next * sizeof(uint32_t));
+        }
+        pthread_barrier_wait(&pool->step_end);
+    }
+    return NULL;
+}
+
+void create_search_pool(search_pool_t** pool, const size_t num_workers, const size_t capacity,
+                        const bool ordered) {
+    *pool = (search_pool_t*)malloc(sizeof(search_pool_t));
+    (*pool)->num_workers = num_workers;
+    (*pool)->workers = (search_worker_t*)calloc(num_workers, sizeof(search_worker_t));
+    (*pool)->ordered = ordered;
+    (*pool)->claims = ordered ? (uint32_t*)malloc((capacity + 1) * sizeof(uint32_t)) : NULL;
+    (*pool)->multi_source = NULL;
+    // The searching thread meets the workers at both barriers
+    pthread_barrier_init(&(*pool)->step_begin, NULL, (unsigned)num_workers + 1);
+    pthread_barrier_init(&(*pool)->step_end, NULL, (unsigned)num_workers + 1);
+    for (size_t i = 0; i < num_workers; i++) {
+        search_worker_t* worker = &(*pool)->workers[i];
+        worker->pool = *pool;
+        worker->index = i;
+        if (pthread_create(&worker->thread, NULL, run_search_worker, worker) != 0) {
+            fprintf(stderr, "pthread_create() failed for search worker\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+void run_search_step(search_pool_t* pool, const search_step_t step) {
+    pool->step = step;
+    pthread_barrier_wait(&pool->step_begin);
+    pthread_barrier_wait(&pool->step_end);
+}
+
+void free_search_pool(search_pool_t* pool) {
+    pool->step = SEARCH_STEP_STOP;
+    pthread_barrier_wait(&pool->step_begin);
+    for (size_t i = 0; i < pool->num_workers; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+        free(pool->workers[i].next);
+    }
+    pthread_barrier_destroy(&pool->step_begin);
+    pthread_barrier_destroy(&pool->step_end);
+    free(pool->workers);
+    free(pool->claims);
+    pool->workers = NULL;
+    pool->claims = NULL;
+    pool->num_workers = 0;
+}
+
+// Expands one level with every worker of the pool and appends the reached vertices to the result
+// in worker order, returns the number of edges of the next level
+size_t expand_in_parallel(search_pool_t* pool, const undirected_graph_t* graph,
+                          hop_distances_t* result, const size_t level_begin,
+                          const size_t level_end, const uint32_t level, const bool bottom_up) {
+    pool->graph = graph;
+    pool->result = result;
+    pool->level_begin = level_begin;
+    pool->level_end = level_end;
+    pool->level = level;
+    for (size_t i = 0; i < pool->num_workers; i++) {
+        pool->workers[i].num_next = 0;
+        pool->workers[i].next_edges = 0;
+    }
+    if (bottom_up) {
+        run_search_step(pool, SEARCH_STEP_BOTTOM_UP);
+    } else {
+        if (pool->ordered) {
+            run_search_step(pool, SEARCH_STEP_CLAIM);
+        }
+        run_search_step(pool, SEARCH_STEP_TOP_DOWN);
+    }
+
+    size_t next_edges = 0;
+    for (size_t i = 0; i < pool->num_workers; i++) {
+        pool->workers[i].append_at = result->num_reached;
+        result->num_reached += pool->workers[i].num_next;
+        next_edges += pool->workers[i].next_edges;
+    }
+    run_search_step(pool, SEARCH_STEP_APPEND);
+    return next_edges;
+}
+
+// Finds the hop distances from all sources of the search level by level. Small frontiers are
+// pushed top-down by the searching thread, larger ones pulled by every vertex, with the workers of
+// the pool if there is one. Only the words of the current and of the next level are kept, they
+// trade places after every level
+void multi_source_bfs(const undirected_graph_t* graph, multi_source_search_t* search,
+                      search_pool_t* pool) {
+    const size_t vertices_count = graph->vertices_count;
+    memset(search->seen, 0, vertices_count * sizeof(uint64_t));
+    memset(search->frontier, 0, vertices_count * sizeof(uint64_t));
+    search->all_lanes = search->num_sources == MULTI_SOURCE_LANES
+                            ? ~(uint64_t)0
+                            : ((uint64_t)1 << search->num_sources) - 1;
+    for (size_t lane = 0; lane < search->num_sources; lane++) {
+        search->seen[search->sources[lane]] |= (uint64_t)1 << lane;
+        search->frontier[search->sources[lane]] |= (uint64_t)1 << lane;
+        search->distances[lane * search->capacity + search->sources[lane]] = 0;
+    }
+
+    size_t frontier_size = search->num_sources;
+    for (uint32_t level = 0; frontier_size > 0; level++) {
+        size_t num_next = 0;
+        if (frontier_size < vertices_count / TOP_DOWN_BETA) {
+            num_next = expand_multi_source_top_down(graph, search, level);
+        } else if (pool) {
+            pool->graph = graph;
+            pool->multi_source = search;
+            pool->level = level;
+            run_search_step(pool, SEARCH_STEP_MULTI_SOURCE);
+            for (size_t i = 0; i < pool->num_workers; i++) {
+                num_next += pool->workers[i].num_next;
+            }
+        } else {
+            num_next = expand_multi_source_part(graph, search, 0, (uint32_t)vertices_count, level);
+        }
+        uint64_t* swapped = search->frontier;
+        search->frontier = search->next;
+        search->next = swapped;
+        frontier_size = num_next;
+    }
+}
+
+// Level-synchronous BFS, each level is expanded top-down or, when direction_optimizing is set,
+// bottom-up depending on the size of the frontier. The graph is undirected, so the row of a
+// vertex also lists the edges into it. Levels too large for one thread go to the pool if any
+void bfs_hop_distances(const undirected_graph_t* graph, const uint32_t src_id,
+                       hop_distances_t* result, search_pool_t* pool,
+                       const bool direction_optimizing) {
+    memset(result->distances, 0xff, graph->vertices_count * sizeof(uint32_t));
+    if (pool && pool->ordered) {
+        memset(pool->claims, 0xff, graph->vertices_count * sizeof(uint32_t));
+    }
+    result->distances[src_id] = 0;
+    result->parents[src_id] = src_id;
+    result->reached[0] = src_id;
+    result->num_reached = 1;
+
+    size_t frontier_edges = vertex_degree(graph, src_id);
+    size_t unexplored_edges = graph->edges_count - frontier_edges;
+    size_t level_begin = 0;
+    size_t previous_size = 0;
+    bool bottom_up = false;
+    for (uint32_t level = 0; level_begin < result->num_reached; level++) {
+        const size_t level_end = result->num_reached;
+        const size_t frontier_size = level_end - level_begin;
+        if (!direction_optimizing) {
+            bottom_up = false;
+        } else if (!bottom_up) {
+            bottom_up = frontier_edges > unexplored_edges / BOTTOM_UP_ALPHA;
+        } else {
+            // A frontier that still grows stays bottom-up however small it is
+            bottom_up = frontier_size >= previous_size ||
+                        frontier_size >= graph->vertices_count / TOP_DOWN_BETA;
+        }
+        previous_size = frontier_size;
+
+        if (pool && (bottom_up || frontier_edges >= PARALLEL_MIN_EDGES)) {
+            frontier_edges = expand_in_parallel(pool, graph, result, level_begin, level_end, level,
+                                                bottom_up);
+        } else {
+            frontier_edges = bottom_up
+                                 ? expand_bottom_up(graph, result, level)
+                                 : expand_top_down(graph, result, level_begin, level_end, level);
+        }
+        unexplored_edges -= frontier_edges < unexplored_edges ? frontier_edges : unexplored_edges;
+        level_begin = level_end;
+    }
+}
+
+// Prints the hop distance and the BFS tree parent of every vertex, in the order of the vertex list
+void print_hop_distances(const undirected_graph_t* graph, const hop_distances_t* result,
+                         output_sink_t* out) {
+    for (uint32_t vert_id = 0; vert_id < graph->vertices_count; vert_id++) {
+        sink_puts(out, symbol_table_name(graph->vertex_names, vert_id));
+        if (result->distances[vert_id] == HOP_UNREACHED) {
+            sink_puts(out, " INF\n");
+            continue;
+        }
+        sink_putc(out, ' ');
+        sink_put_uint(out, result->distances[vert_id]);
+        sink_putc(out, ' ');
+        if (vert_id == result->parents[vert_id]) {
+            sink_putc(out, '-');
+        } else {
+            sink_puts(out, symbol_table_name(graph->vertex_names, result->parents[vert_id]));
+        }
+        sink_putc(out, '\n');
+    }
+    sink_putc(out, '\n');
+}
+
+void print_visit_order(const undirected_graph_t* graph, const uint32_t* visit_order,
+                       const size_t num_visited, output_sink_t* out) {
+    for (size_t i = 0; i < num_visited; i++) {
+        sink_puts(out, symbol_table_name(graph->vertex_names, visit_order[i]));
+        sink_putc(out, ' ');
+    }
+    sink_putc(out, '\n');
+}
+
+// Fills the lanes of the search with the sources of the hop distance queries from the first one on
+// that are not in its lanes yet, and searches from all of them in one pass
+void plan_multi_source_pass(const undirected_graph_t* graph, const query_batch_t* batch,
+                            const size_t first_query, multi_source_search_t* search,
+                            uint32_t* slot_lanes, search_pool_t* pool) {
+    for (size_t lane = 0; lane < search->num_sources; lane++) {
+        const uint32_t* slot =
+            (const uint32_t*)bsearch(&search->sources[lane], batch->distinct_sources,
+                                     batch->num_distinct, sizeof(uint32_t), compare_vertex_ids);
+        slot_lanes[slot - batch->distinct_sources] = NO_LANE;
+    }
+    search->num_sources = 0;
+    for (size_t i = first_query;
+         i < batch->num_queries && search->num_sources < search->max_lanes; i++) {
+        const uint32_t slot = batch->source_slots[i];
+        if (batch->kinds[i] == QUERY_HOP_DISTANCES && slot_lanes[slot] == NO_LANE) {
+            slot_lanes[slot] = (uint32_t)search->num_sources;
+            search->sources[search->num_sources++] = batch->sources[i];
+        }
+    }
+    multi_source_bfs(graph, search, pool);
+}
+
+// With more than one search thread, large levels are expanded by a pool of workers. The order
+// within a level then follows which worker reaches a vertex first, unless ordered is set. With
+// multi_source set, hop distance queries are searched up to MULTI_SOURCE_LANES sources at a time
+void process_bfs_queries(const undirected_graph_t* graph, FILE* query_file, output_sink_t* out,
+                         const size_t num_search_threads, const bool ordered,
+                         const bool multi_source) {
+    // Read all queries first, so every distinct source is searched only once
+    query_batch_t* batch = NULL;
+    create_query_batch(&batch);
+    read_query_batch(batch, graph->vertex_names, query_file);
+    plan_query_batch(batch);
+
+    // The visited stamps, the order buffer and the queue are shared by every search
+    traversal_state_t* state = NULL;
+    create_traversal_state(&state, graph->vertices_count);
+    queue_t* bfs_queue = NULL;
+    create_queue(&bfs_queue, graph->vertices_count);
+
+    // Hop distance queries and the parallel searches have arrays of their own, which every such
+    // search refills
+    hop_distances_t* hops = NULL;
+    create_hop_distances(&hops, graph->vertices_count);
+    search_pool_t* pool = NULL;
+    if (num_search_threads > 1) {
+        create_search_pool(&pool, num_search_threads, graph->vertices_count, ordered);
+    }
+
+    // Lane of every distinct source in the current multi-source pass, NO_LANE when it has none
+    multi_source_search_t* multi_search = NULL;
+    uint32_t* slot_lanes = NULL;
+    if (multi_source) {
+        create_multi_source_search(&multi_search, graph->vertices_count);
+        slot_lanes = (uint32_t*)malloc((batch->num_distinct + 1) * sizeof(uint32_t));
+        memset(slot_lanes, 0xff, (batch->num_distinct + 1) * sizeof(uint32_t));
+    }
+
+    // The visit order of a source is kept only while it has queries left, so the results held at
+    // any time are bounded by the sources that repeat
+    uint32_t** kept_orders = (uint32_t**)calloc(batch->num_distinct + 1, sizeof(uint32_t*));
+    size_t* kept_sizes = (size_t*)calloc(batch->num_distinct + 1, sizeof(size_t));
+    for (size_t i = 0; i < batch->num_queries; i++) {
+        if (batch->kinds[i] == QUERY_HOP_DISTANCES && multi_source) {
+            // A source repeated while its pass is current is answered from its lane
+            const uint32_t slot = batch->source_slots[i];
+            if (slot_lanes[slot] == NO_LANE) {
+                plan_multi_source_pass(graph, batch, i, multi_search, slot_lanes, pool);
+            }
+            extract_lane_distances(graph, multi_search, slot_lanes[slot], hops);
+            print_hop_distances(graph, hops, out);
+            continue;
+        }
+        if (batch->kinds[i] == QUERY_HOP_DISTANCES) {
+            bfs_hop_distances(graph, batch->sources[i], hops, pool, true);
+            print_hop_distances(graph, hops, out);
+            continue;
+        }
+
+        const uint32_t slot = batch->source_slots[i];
+        if (kept_orders[slot]) {
+            print_visit_order(graph, kept_orders[slot], kept_sizes[slot], out);
+        } else {
+            const uint32_t* visit_order = state->visit_order;
+            size_t num_visited = 0;
+            if (pool) {
+                // Levels reached top-down only come out in the order a queue visits them
+                bfs_hop_distances(graph, batch->sources[i], hops, pool, false);
+                visit_order = hops->reached;
+                num_visited = hops->num_reached;
+            } else {
+                // Vertices are marked in the order they are enqueued, which is the BFS order
+                bfs_graph(graph, batch->sources[i], state, bfs_queue);
+                num_visited = state->num_visited;
+            }
+            print_visit_order(graph, visit_order, num_visited, out);
+            if (batch->source_queries[slot] > 1) {
+                const size_t order_size = num_visited * sizeof(uint32_t);
+                kept_sizes[slot] = num_visited;
+                kept_orders[slot] = (uint32_t*)malloc(order_size);
+                memcpy(kept_orders[slot], visit_order, order_size);
+            }
+        }
+
+        if (--batch->source_queries[slot] == 0) {
+            free(kept_orders[slot]);
+            kept_orders[slot] = NULL;
+        }
+    }
+    free(kept_sizes);
+    free(kept_orders);
+    if (multi_search) {
+        free_multi_source_search(multi_search);
+        free(multi_search);
+        free(slot_lanes);
+    }
+    if (pool) {
+        free_search_pool(pool);
+        free(pool);
+    }
+    free_hop_distances(hops);
+    free(hops);
+
+    free_queue(bfs_queue);
+    free(bfs_queue);
+    free_traversal_state(state);
+    free(state);
+    free_query_batch(batch);
+    free(batch);
+}
+
+// Reads the "<vertices> [<edges>]" header line, the edge count is optional and 0 when missing
+void read_graph_header(text_cursor_t* cursor, size_t* num_vertices, size_t* num_edges) {
+    text_cursor_t line;
+    if (!next_line(cursor, &line)) {
+        fprintf(stderr, "Missing graph header\n");
+        exit(EXIT_FAILURE);
+    }
+    const text_cursor_t header = line;
+
+    // Vertex ids are 32-bit and UINT32_MAX marks an invalid id, so both counts are capped there
+    const char* token;
+    size_t token_len;
+    uint64_t vertices = 0;
+    if (!next_token(&line, &token, &token_len) || !parse_count(token, token_len, &vertices) ||
+        vertices > UINT32_MAX) {
+        fprintf(stderr, "Invalid vertex count in graph header: %.*s\n",
+                (int)(header.end - header.pos), header.pos);
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t edges = 0;
+    if (next_token(&line, &token, &token_len) &&
+        (!parse_count(token, token_len, &edges) || edges > UINT32_MAX)) {
+        fprintf(stderr, "Invalid edge count in graph header: %.*s\n",
+                (int)(header.end - header.pos), header.pos);
+        exit(EXIT_FAILURE);
+    }
+
+    *num_vertices = (size_t)vertices;
+    *num_edges = (size_t)edges;
+}
+
+void write_graph_snapshot(const undirected_graph_t* graph, const char* file_name) {
+    snapshot_writer_t writer;
+    begin_snapshot(&writer, file_name, 0, graph->vertices_count, graph->edges_count);
+    write_undirected_graph_sections(&writer, graph);
+    end_snapshot(&writer);
+}
+
+// Parses the mapped graph text and takes over the mapping, which is released once loaded
+void load_graph_text(undirected_graph_t** graph, mapped_file_t* graph_file,
+                     const size_t num_threads, const bool compress) {
+    text_cursor_t graph_cursor = {graph_file->data, graph_file->data + graph_file->size};
+
+    // Read the vertex count and the optional edge count from the header
+    size_t num_vertices = 0;
+    size_t num_edges = 0;
+    read_graph_header(&graph_cursor, &num_vertices, &num_edges);
+
+    // Split the text into chunks of at least LOADER_MIN_CHUNK_SIZE bytes, one per task, so
+    // small graphs are loaded on the calling thread alone
+    size_t num_tasks = 1 + (graph_cursor.end - graph_cursor.pos) / LOADER_MIN_CHUNK_SIZE;
+    if (num_tasks > num_threads) {
+        num_tasks = num_threads;
+    }
+    loader_task_t tasks[MAX_LOADER_THREADS];
+    memset(tasks, 0, sizeof(tasks));
+
+    // Create empty graph presized for the vertex count and read it
+    create_undirected_graph(graph, num_vertices);
+    read_graph_from_file(*graph, &graph_cursor, num_edges, tasks, num_tasks);
+
+    // The names were copied and the edges parsed, the mapping is no longer needed
+    unmap_file(graph_file);
+    free(graph_file);
+
+    // Build the CSR layout with neighbors sorted by name
+    freeze_undirected_graph(*graph, tasks, num_tasks, compress);
+    for (size_t i = 0; i < num_tasks; i++) {
+        free_edge_buffer(tasks[i].edges);
+        free(tasks[i].edges);
+    }
+}
+
+// Builds the graph from an edge stream, neither the vertex nor the edge count is known up front
+void load_graph_stream(undirected_graph_t** graph, const int fd, const bool compress) {
+    // The name table and the edge buffer both grow by doubling as the stream goes on
+    loader_task_t task;
+    memset(&task, 0, sizeof(task));
+    create_undirected_graph(graph, 0);
+    task.graph = *graph;
+    create_edge_buffer(&task.edges, 0);
+    read_edge_stream(*graph, fd, task.edges);
+    (*graph)->vertices_count = (*graph)->vertex_names->num_symbols;
+
+    // The stream has ended, build the CSR layout with neighbors sorted by name
+    freeze_undirected_graph(*graph, &task, 1, compress);
+    free_edge_buffer(task.edges);
+    free(task.edges);
+}
+
+int32_t main(int argc, char* argv[]) {
+    // -w <file> writes the loaded graph to a binary snapshot, which later runs can be given in
+    // place of the graph file, -j <threads> caps the threads that load graph text, -q skips
+    // printing the loaded graph and -z keeps the adjacency compressed. -t <threads> searches with
+    // that many threads and -d keeps their visit order the same as a single thread's, -m answers
+    // hop distance queries for up to 64 sources in one pass, as many as MULTI_SOURCE_MEMORY_LIMIT
+    // allows
+    const char* snapshot_file_name = NULL;
+    bool print_graph = true;
+    bool compress = false;
+    bool ordered = false;
+    bool multi_source = false;
+    long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t num_threads = online_cpus > 0 ? (size_t)online_cpus : 1;
+    size_t num_search_threads = 1;
+    int32_t option;
+    while ((option = getopt(argc, argv, "w:j:t:qzdm")) != -1) {
+        uint64_t threads = 0;
+        if (option == 'w') {
+            snapshot_file_name = optarg;
+        } else if (option == 'q') {
+            print_graph = false;
+        } else if (option == 'z') {
+            compress = true;
+        } else if (option == 'd') {
+            ordered = true;
+        } else if (option == 'm') {
+            multi_source = true;
+        } else if (option == 'j' && parse_count(optarg, strlen(optarg), &threads) && threads > 0) {
+            num_threads = (size_t)threads;
+        } else if (option == 't' && parse_count(optarg, strlen(optarg), &threads) && threads > 0) {
+            num_search_threads = (size_t)threads;
+        } else {
+            fprintf(stderr,
+                    "Usage: %s [-w snapshot_file] [-j threads] [-t threads] [-q] [-z] [-d] [-m] "
+                    "graph_file query_file\n",
+                    argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (num_threads > MAX_LOADER_THREADS) {
+        num_threads = MAX_LOADER_THREADS;
+    }
+    if (num_search_threads > MAX_SEARCH_THREADS) {
+        num_search_threads = MAX_SEARCH_THREADS;
+    }
+
+    if (argc - optind != 2) {
+        fprintf(stderr, "Incorrect number of arguments: %i provided instead of 2\n",
+                argc - optind);
+        exit(EXIT_FAILURE);
+    }
+
+    const char* graph_file_name = argv[optind];
+    const char* query_file_name = argv[optind + 1];
+
+    FILE* query_file = fopen(query_file_name, "r");
+    if (query_file == NULL) {
+        fprintf(stderr, "Cannot open %s quary file\n", query_file_name);
+        exit(EXIT_FAILURE);
+    }
+
+    // A graph file of "-" is an edge stream read from stdin, any other graph file is mapped and
+    // holds either graph text or a binary snapshot. A "shm:<name>" graph file attaches to the
+    // snapshot a "-w shm:<name>" run published
+    undirected_graph_t* graph = NULL;
+    if (strcmp(graph_file_name, "-") == 0) {
+        load_graph_stream(&graph, STDIN_FILENO, compress);
+    } else {
+        mapped_file_t* graph_file = NULL;
+        map_file(&graph_file, graph_file_name);
+        if (is_graph_snapshot(graph_file)) {
+            // Snapshots are stored frozen and sorted, the graph uses the mapping in place
+            attach_undirected_graph(&graph, graph_file);
+        } else {
+            load_graph_text(&graph, graph_file, num_threads, compress);
+        }
+    }
+    print_adjacency_stats(graph);
+    if (snapshot_file_name) {
+        write_graph_snapshot(graph, snapshot_file_name);
+    }
+
+    // All results go through one buffered sink on stdout
+    output_sink_t* out = NULL;
+    create_output_sink(&out, STDOUT_FILENO, OUTPUT_BUFFER_SIZE);
+
+    // Print sorted graph
+    if (print_graph) {
+        print_undirected_graph(graph, out);
+    }
 
     // Process bfs queries
-    process_bfs_queries(graph, query_file);
+    process_bfs_queries(graph, query_file, out, num_search_threads, ordered, multi_source);
+    free_output_sink(out);
+    free(out);
 
-    // Free memory
+    // Report allocator usage and free memory
+    print_allocation_stats(graph->arena);
     free_graph(graph);
     free(graph);
 
     // Close the opened streams
-    fclose(graph_file);
     fclose(query_file);
 
     return 0;
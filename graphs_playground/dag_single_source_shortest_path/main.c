@@ -2,523 +2,2374 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 #include <limits.h>
 
-typedef struct node {
-    char* data;
-    int32_t dist;
-    struct node* next;
-} node_t;
-
-typedef struct slinked_list {
-    size_t size;
-    node_t* head;
-    node_t* tail;
-} slinked_list_t;
+#define INVALID_VERTEX_ID UINT32_MAX
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define STREAM_BLOCK_SIZE (1 << 20)
+// Chunks of graph text below this size are not worth a thread of their own
+#define LOADER_MIN_CHUNK_SIZE (1 << 20)
+#define MAX_LOADER_THREADS 64
+// Distances are kept in 64 bits, no path of 32-bit weights comes close to INFINITE_DISTANCE
+#define INFINITE_DISTANCE INT64_MAX
+#define HEAP_ARITY 4
+#define INVALID_HEAP_INDEX UINT32_MAX
+
+typedef struct arena_block {
+    struct arena_block* next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} arena_block_t;
+
+typedef struct arena {
+    arena_block_t* blocks;
+    size_t block_size;
+    size_t num_allocations;
+    size_t num_blocks;
+    size_t bytes_reserved;
+} arena_t;
 
 typedef struct set {
-    slinked_list_t* list;
+    size_t capacity;
+    uint64_t* words;
 } set_t;
 
+typedef struct symbol_table {
+    size_t num_symbols;
+    size_t names_capacity;
+    char** names;
+    // A mapped table finds its names through the offsets of the snapshot, names stays NULL then
+    const uint64_t* name_offsets;
+    const char* name_data;
+    size_t num_slots;
+    uint32_t* slots;
+    arena_t* arena;
+    // Names and slots point into a snapshot mapping, the table is read-only then
+    bool mapped;
+} symbol_table_t;
+
+typedef struct name_rank_entry {
+    const char* name;
+    uint32_t vert_id;
+} name_rank_entry_t;
+
+typedef struct traversal_state {
+    size_t capacity;
+    uint32_t epoch;
+    // A vertex is visited when its stamp equals the current epoch
+    uint32_t* visit_epochs;
+    size_t num_visited;
+    uint32_t* visit_order;
+} traversal_state_t;
+
+// Source vertices of a query file read up front, in the order they are queried
+typedef struct query_batch {
+    size_t num_queries;
+    size_t capacity;
+    uint32_t* sources;
+    // Every distinct source once in ascending order, with the number of queries it has
+    size_t num_distinct;
+    uint32_t* distinct_sources;
+    uint32_t* source_queries;
+    // Index of the source of every query in distinct_sources
+    uint32_t* source_slots;
+} query_batch_t;
+
+// Fixed-capacity ring buffer of vertex IDs, a vertex is marked when it is enqueued so the
+// queue never holds more than V entries
+typedef struct queue {
+    uint32_t* items;
+    size_t capacity;
+    size_t head;
+    size_t size;
+} queue_t;
+
+typedef struct dfs_frame {
+    uint32_t vert_id;
+    // Next edge of the vertex to be explored
+    size_t edge_cursor;
+} dfs_frame_t;
+
+// Explicit DFS stack, every vertex is on it at most once so V frames are enough
+typedef struct dfs_stack {
+    size_t capacity;
+    size_t size;
+    dfs_frame_t* frames;
+} dfs_stack_t;
+
+// Topological order of the whole graph, computed once and shared by every query
+typedef struct topological_order {
+    size_t num_vertices;
+    bool is_cycle_free;
+    // Vertex ids in topological order
+    uint32_t* order;
+    // Index of every vertex in the order array
+    uint32_t* positions;
+    // Both arrays point into the snapshot of the graph
+    bool mapped;
+} topological_order_t;
+
+// Entry of the shortest path heap, the distance is kept next to the vertex so sifting reads only
+// the heap array
+typedef struct heap_entry {
+    int64_t dist;
+    uint32_t vert_id;
+} heap_entry_t;
+
+// Indexed 4-ary min-heap of vertices keyed by their tentative distance. The children of entry i
+// are 4i + 1 to 4i + 4, which the entries are aligned for to share one cache line
+typedef struct distance_heap {
+    size_t size;
+    size_t capacity;
+    void* storage;
+    heap_entry_t* entries;
+    // Index of every vertex in entries, INVALID_HEAP_INDEX while it is not queued
+    uint32_t* indices;
+} distance_heap_t;
+
+// Work state of the queue-based Bellman-Ford search, reused by every query
+typedef struct bellman_ford_state {
+    // Vertices whose distance dropped and whose edges are still to be relaxed, each queued once
+    queue_t* queue;
+    set_t* queued;
+    uint32_t* parents;
+    // Vertex a parent walk started from plus one, for every vertex the walk went through
+    uint32_t* walk_starts;
+    // Vertices of the negative cycle found, in the order of its edges
+    size_t cycle_length;
+    uint32_t* cycle;
+} bellman_ford_state_t;
+
+// Graph file mapped read-only into memory, the loader tokenizes it in place
+typedef struct mapped_file {
+    const char* data;
+    size_t size;
+} mapped_file_t;
+
+// Cursor over mapped text, lines and tokens are handed out as pointers into the mapping
+typedef struct text_cursor {
+    const char* pos;
+    const char* end;
+} text_cursor_t;
+
+// Output gathered in user space and handed to the kernel with one write() per flush
+typedef struct output_sink {
+    int fd;
+    size_t used;
+    size_t capacity;
+    char* data;
+} output_sink_t;
+
+#define SNAPSHOT_MAGIC "CLABGRPH"
+// Prefix of the graph and snapshot files that are POSIX shared memory segments
+#define SHARED_MEMORY_PREFIX "shm:"
+#define SNAPSHOT_VERSION 2
+// Snapshot flags
+#define SNAPSHOT_DIRECTED 0x1
+#define SNAPSHOT_HAS_CYCLE 0x2
+// Rows keep the order their edges were listed in instead of being sorted by name
+#define SNAPSHOT_FILE_ORDER 0x4
+
+// Sections of a graph snapshot, every one is optional and a section of size 0 is absent
+typedef enum snapshot_section_id {
+    SNAPSHOT_NAME_OFFSETS,
+    SNAPSHOT_NAMES,
+    SNAPSHOT_NAME_SLOTS,
+    SNAPSHOT_EDGE_OFFSETS,
+    SNAPSHOT_EDGE_TARGETS,
+    SNAPSHOT_EDGE_WEIGHTS,
+    SNAPSHOT_NAME_RANKS,
+    SNAPSHOT_TOPOLOGICAL_ORDER,
+    SNAPSHOT_TOPOLOGICAL_POSITIONS,
+    SNAPSHOT_IN_DEGREES,
+    SNAPSHOT_OUT_DEGREES,
+    SNAPSHOT_LISTED_TARGETS,
+    SNAPSHOT_NUM_SECTIONS
+} snapshot_section_id_t;
+
+typedef struct snapshot_section {
+    uint64_t offset;
+    uint64_t size;
+} snapshot_section_t;
+
+// Sections are laid out 8-byte aligned behind the header, so they can be used in place once the
+// snapshot is mapped
+typedef struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t num_vertices;
+    uint64_t num_edges;
+    snapshot_section_t sections[SNAPSHOT_NUM_SECTIONS];
+} snapshot_header_t;
+
+// CSR offsets are used in place as size_t
+_Static_assert(sizeof(size_t) == sizeof(uint64_t), "snapshots store 64-bit offsets");
+
+typedef struct snapshot_writer {
+    FILE* file;
+    snapshot_header_t header;
+    uint64_t offset;
+    snapshot_section_id_t section;
+} snapshot_writer_t;
+
 typedef struct directed_graph {
     size_t num_vertices;
-    slinked_list_t** adjacency_lists;
+    size_t num_edges;
+    symbol_table_t* vertex_names;
+    // Owns the vertex names and the CSR arrays, released in one go
+    arena_t* arena;
+    // Frozen CSR layout, the edges of vertex i are in [edge_offsets[i], edge_offsets[i + 1])
+    size_t* edge_offsets;
+    uint32_t* edge_targets;
+    int32_t* edge_weights;
+    // Snapshot mapping the arrays above point into, NULL for graphs parsed from text
+    mapped_file_t* snapshot;
 } directed_graph_t;
 
-void create_slinked_list(slinked_list_t** list) {
-    *list = (slinked_list_t*)malloc(sizeof(slinked_list_t));
-    (*list)->head = (*list)->tail = NULL;
-    (*list)->size = 0;
-}
+// An edge as a loader worker parsed it, before it is placed in the CSR layout
+typedef struct edge_record {
+    uint32_t src_id;
+    uint32_t dst_id;
+    int32_t weight;
+} edge_record_t;
 
-void insert_node_at_end(slinked_list_t** list, const char* data, const int32_t dist) {
-    node_t* new_node = (node_t*)malloc(sizeof(node_t));
-    const int32_t vert_name_length = strlen(data) + 1;
-    char* copy_vert_name = (char*)malloc(vert_name_length);
-    strcpy(copy_vert_name, data);
-    new_node->data = copy_vert_name;
-    new_node->dist = dist;
-    new_node->next = NULL;
+typedef struct edge_buffer {
+    size_t size;
+    size_t capacity;
+    edge_record_t* records;
+} edge_buffer_t;
+
+// Share of one loader worker in every parallel phase of loading a graph
+typedef struct loader_task {
+    directed_graph_t* graph;
+    // Chunk of the graph text, it starts and ends on a line boundary
+    const char* chunk_begin;
+    const char* chunk_end;
+    size_t num_lines;
+    // Id of the vertex listed on the first line of the chunk
+    size_t first_vert_id;
+    // Names interned by this worker, merged into the graph arena afterwards
+    arena_t* arena;
+    // Edges of the chunk in file order and the file position of the first of them
+    edge_buffer_t* edges;
+    size_t first_edge_position;
+    // CSR rows this worker sorts
+    size_t first_row;
+    size_t end_row;
+    // Scratch arrays shared by all workers while the CSR layout is built
+    const uint32_t* name_ranks;
+    size_t* row_cursors;
+    size_t* edge_positions;
+} loader_task_t;
+
+// Neighbor of a row being sorted, ties between parallel edges keep their file order
+typedef struct row_entry {
+    uint32_t rank;
+    uint32_t target;
+    int32_t weight;
+    size_t position;
+} row_entry_t;
+
+void create_arena(arena_t** arena, const size_t block_size) {
+    *arena = (arena_t*)malloc(sizeof(arena_t));
+    (*arena)->blocks = NULL;
+    (*arena)->block_size = block_size;
+    (*arena)->num_allocations = 0;
+    (*arena)->num_blocks = 0;
+    (*arena)->bytes_reserved = 0;
+}
 
-    if ((*list)->head == NULL) {
-        (*list)->head = new_node;
-    } else {
-        (*list)->tail->next = new_node;
+void* arena_alloc(arena_t* arena, const size_t size) {
+    const size_t aligned_size = (size + 7) & ~(size_t)7;
+    arena_block_t* block = arena->blocks;
+    if (block == NULL || block->used + aligned_size > block->capacity) {
+        const bool dedicated = aligned_size > arena->block_size / 4;
+        const size_t capacity = dedicated ? aligned_size : arena->block_size;
+        arena_block_t* new_block = (arena_block_t*)malloc(sizeof(arena_block_t) + capacity);
+        new_block->used = 0;
+        new_block->capacity = capacity;
+
+        // Large requests get a block of their own behind the current one, so the space left in
+        // the current block is still used by the small requests that follow
+        if (dedicated && block != NULL) {
+            new_block->next = block->next;
+            block->next = new_block;
+        } else {
+            new_block->next = block;
+            arena->blocks = new_block;
+        }
+        block = new_block;
+        arena->num_blocks++;
+        arena->bytes_reserved += capacity;
     }
-    (*list)->tail = new_node;
-    (*list)->size++;
+
+    void* ptr = block->data + block->used;
+    block->used += aligned_size;
+    arena->num_allocations++;
+    return ptr;
 }
 
-void free_slinked_list(slinked_list_t* list) {
-    node_t* temp = list->head;
-    while (temp) {
-        node_t* retire = temp;
-        temp = temp->next;
-        free(retire->data);
+void reset_arena(arena_t* arena) {
+    arena_block_t* block = arena->blocks;
+    while (block) {
+        arena_block_t* retire = block;
+        block = block->next;
         free(retire);
     }
-    list->head = list->tail = NULL;
-    list->size = 0;
+    arena->blocks = NULL;
 }
 
-void delete_slinked_list_node(node_t* prev_node, node_t* node) {
-    if (node == NULL || prev_node == NULL) {
-        fprintf(stderr, "NULL node provided for deletion");
+void free_arena(arena_t* arena) {
+    reset_arena(arena);
+    arena->num_allocations = arena->num_blocks = arena->bytes_reserved = 0;
+}
+
+// Moves all blocks of the other arena into this one, so they are released together
+void merge_arena(arena_t* arena, arena_t* other) {
+    if (other->blocks == NULL) {
         return;
     }
+    arena_block_t* tail = other->blocks;
+    while (tail->next) {
+        tail = tail->next;
+    }
 
-    if (node->next) {
-        node_t* retire = node;
-        node = node->next;
-        prev_node->next = node;
-        free(retire->data);
-        free(retire);
-        return;
+    // Splice the blocks in behind the current block, which keeps serving small requests
+    if (arena->blocks == NULL) {
+        arena->blocks = other->blocks;
+    } else {
+        tail->next = arena->blocks->next;
+        arena->blocks->next = other->blocks;
     }
-    prev_node->next = NULL;
-    free(node->data);
-    free(node);
+    arena->num_allocations += other->num_allocations;
+    arena->num_blocks += other->num_blocks;
+    arena->bytes_reserved += other->bytes_reserved;
+    other->blocks = NULL;
+    other->num_allocations = other->num_blocks = other->bytes_reserved = 0;
 }
 
-void sort_slinked_list(slinked_list_t* list) {
-    if (!list->head) {
-        return;
+void print_allocation_stats(const arena_t* arena) {
+    fprintf(stderr, "Arena: %zu allocations in %zu blocks (%zu bytes)\n", arena->num_allocations,
+            arena->num_blocks, arena->bytes_reserved);
+}
+
+void create_traversal_state(traversal_state_t** state, const size_t capacity) {
+    *state = (traversal_state_t*)malloc(sizeof(traversal_state_t));
+    (*state)->capacity = capacity;
+    (*state)->epoch = 0;
+    (*state)->visit_epochs = (uint32_t*)calloc(capacity, sizeof(uint32_t));
+    (*state)->num_visited = 0;
+    (*state)->visit_order = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+}
+
+void begin_traversal(traversal_state_t* state) {
+    // Bumping the epoch forgets every earlier visit without touching the stamps
+    if (++state->epoch == 0) {
+        memset(state->visit_epochs, 0, state->capacity * sizeof(uint32_t));
+        state->epoch = 1;
     }
+    state->num_visited = 0;
+}
+
+bool is_visited(const traversal_state_t* state, const uint32_t vert_id) {
+    return state->visit_epochs[vert_id] == state->epoch;
+}
+
+void mark_visited(traversal_state_t* state, const uint32_t vert_id) {
+    state->visit_epochs[vert_id] = state->epoch;
+    state->visit_order[state->num_visited++] = vert_id;
+}
+
+void free_traversal_state(traversal_state_t* state) {
+    free(state->visit_epochs);
+    free(state->visit_order);
+    state->capacity = state->num_visited = 0;
+}
+
+void create_dfs_stack(dfs_stack_t** stack, const size_t capacity) {
+    *stack = (dfs_stack_t*)malloc(sizeof(dfs_stack_t));
+    (*stack)->capacity = capacity;
+    (*stack)->size = 0;
+    (*stack)->frames = (dfs_frame_t*)malloc(capacity * sizeof(dfs_frame_t));
+}
+
+void push_dfs_frame(dfs_stack_t* stack, const uint32_t vert_id, const size_t edge_cursor) {
+    stack->frames[stack->size].vert_id = vert_id;
+    stack->frames[stack->size].edge_cursor = edge_cursor;
+    stack->size++;
+}
+
+void free_dfs_stack(dfs_stack_t* stack) {
+    free(stack->frames);
+    stack->capacity = stack->size = 0;
+}
 
-    slinked_list_t* copy_list;
-    create_slinked_list(&copy_list);
+void create_queue(queue_t** queue, const size_t capacity) {
+    *queue = (queue_t*)malloc(sizeof(queue_t));
+    (*queue)->items = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    (*queue)->capacity = capacity;
+    (*queue)->head = 0;
+    (*queue)->size = 0;
+}
 
-    node_t* temp = list->head;
-    while (temp) {
-        insert_node_at_end(&copy_list, temp->data, temp->dist);
-        temp = temp->next;
+void push_at_queue(queue_t* queue, const uint32_t vert_id) {
+    size_t tail = queue->head + queue->size;
+    if (tail >= queue->capacity) {
+        tail -= queue->capacity;
     }
+    queue->items[tail] = vert_id;
+    queue->size++;
+}
 
-    free_slinked_list(list);
-    insert_node_at_end(&list, copy_list->head->data, copy_list->head->dist);
+uint32_t pop_from_queue(queue_t* queue) {
+    if (queue->size == 0) {
+        return INVALID_VERTEX_ID;
+    }
 
-    if (!copy_list->head->next) {
-        return;
+    const uint32_t return_id = queue->items[queue->head];
+    if (++queue->head == queue->capacity) {
+        queue->head = 0;
     }
+    queue->size--;
 
-    node_t* curr_head = copy_list->head->next;
-    while (curr_head) {
-        node_t* iter = curr_head;
-        node_t* prev_iter = curr_head;
-        node_t* min = curr_head;
-        node_t* prev_min = curr_head;
-        while (iter) {
-            int32_t rc = strcmp(iter->data, min->data);
-            if (rc < 0) {
-                prev_min = prev_iter;
-                min = iter;
-            }
-            prev_iter = iter;
-            iter = iter->next;
-        }
-        insert_node_at_end(&list, min->data, min->dist);
-        if (prev_min != min) {
-            delete_slinked_list_node(prev_min, min);
-        } else {
-            curr_head = curr_head->next;
-        }
+    return return_id;
+}
+
+void clear_queue(queue_t* queue) {
+    queue->head = 0;
+    queue->size = 0;
+}
+
+void free_queue(queue_t* queue) {
+    free(queue->items);
+    queue->capacity = queue->head = queue->size = 0;
+}
+
+uint64_t hash_vertex_name(const char* name, const size_t name_len) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < name_len; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 1099511628211ULL;
     }
+    return hash;
+}
 
-    // Free heap memory
-    free_slinked_list(copy_list);
-    free(copy_list);
+void create_symbol_table(symbol_table_t** table, const size_t expected_symbols, arena_t* arena) {
+    *table = (symbol_table_t*)malloc(sizeof(symbol_table_t));
+    (*table)->arena = arena;
+    (*table)->mapped = false;
+    (*table)->num_symbols = 0;
+    (*table)->names_capacity = expected_symbols > 0 ? expected_symbols : 16;
+    (*table)->names = (char**)malloc((*table)->names_capacity * sizeof(char*));
+    (*table)->name_offsets = NULL;
+    (*table)->name_data = NULL;
+
+    // Keep the load factor of the open addressing table at most one half
+    size_t num_slots = 16;
+    while (num_slots < 2 * (*table)->names_capacity) {
+        num_slots <<= 1;
+    }
+    (*table)->num_slots = num_slots;
+    (*table)->slots = (uint32_t*)malloc(num_slots * sizeof(uint32_t));
+    memset((*table)->slots, 0xff, num_slots * sizeof(uint32_t));
 }
 
-void reverse_slinked_list(slinked_list_t** list) {
-    slinked_list_t* reversed_list = NULL;
-    create_slinked_list(&reversed_list);
+void free_symbol_table(symbol_table_t* table) {
+    // The names themselves live in the arena of the table or in the snapshot mapping
+    free(table->names);
+    if (!table->mapped) {
+        free(table->slots);
+    }
+    table->num_symbols = table->num_slots = 0;
+}
 
-    for (int32_t i = (int32_t)(*list)->size - 1; i >= 0; i--) {
-        node_t* iter = (*list)->head;
-        int32_t c = 0;
-        while (c != i) {
-            iter = iter->next;
-            c++;
+const char* symbol_table_name(const symbol_table_t* table, const uint32_t vert_id) {
+    if (table->mapped) {
+        return table->name_data + table->name_offsets[vert_id];
+    }
+    return table->names[vert_id];
+}
+
+size_t find_symbol_slot(const symbol_table_t* table, const char* name, const size_t name_len) {
+    const size_t mask = table->num_slots - 1;
+    size_t slot = hash_vertex_name(name, name_len) & mask;
+    while (table->slots[slot] != INVALID_VERTEX_ID) {
+        const char* slot_name = symbol_table_name(table, table->slots[slot]);
+        if (strncmp(slot_name, name, name_len) == 0 && slot_name[name_len] == '\0') {
+            break;
         }
-        insert_node_at_end(&reversed_list, iter->data, iter->dist);
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void grow_symbol_table(symbol_table_t* table) {
+    const size_t num_slots = table->num_slots << 1;
+    free(table->slots);
+    table->slots = (uint32_t*)malloc(num_slots * sizeof(uint32_t));
+    memset(table->slots, 0xff, num_slots * sizeof(uint32_t));
+    table->num_slots = num_slots;
+
+    // Rehash every interned name into the larger table
+    for (size_t i = 0; i < table->num_symbols; i++) {
+        const char* name = table->names[i];
+        table->slots[find_symbol_slot(table, name, strlen(name))] = (uint32_t)i;
+    }
+}
+
+uint32_t symbol_table_find(const symbol_table_t* table, const char* name, const size_t name_len) {
+    return table->slots[find_symbol_slot(table, name, name_len)];
+}
+
+uint32_t symbol_table_intern(symbol_table_t* table, const char* name, const size_t name_len) {
+    size_t slot = find_symbol_slot(table, name, name_len);
+    if (table->slots[slot] != INVALID_VERTEX_ID) {
+        return table->slots[slot];
     }
 
-    free_slinked_list(*list);
-    (*list) = reversed_list;
+    if (2 * (table->num_symbols + 1) > table->num_slots) {
+        grow_symbol_table(table);
+        slot = find_symbol_slot(table, name, name_len);
+    }
+    if (table->num_symbols == table->names_capacity) {
+        table->names_capacity *= 2;
+        table->names = (char**)realloc(table->names, table->names_capacity * sizeof(char*));
+    }
+
+    char* copy_name = (char*)arena_alloc(table->arena, name_len + 1);
+    memcpy(copy_name, name, name_len);
+    copy_name[name_len] = '\0';
+
+    const uint32_t vert_id = (uint32_t)table->num_symbols++;
+    table->names[vert_id] = copy_name;
+    table->slots[slot] = vert_id;
+    return vert_id;
 }
 
-bool slinked_list_contains(slinked_list_t* list, const char* data) {
-    node_t* iter = list->head;
-    while (iter) {
-        if (strncmp(iter->data, data, 32) == 0) {
+// Inserts a name under an id picked by the caller, several threads may insert at once as long as
+// the table is sized for all names up front. Returns false when the name is already in the table
+bool symbol_table_insert_concurrent(symbol_table_t* table, const char* name, const size_t name_len,
+                                    const uint32_t vert_id) {
+    // The name is published before its slot, so whoever finds the slot can compare the name
+    __atomic_store_n(&table->names[vert_id], (char*)name, __ATOMIC_RELEASE);
+
+    const size_t mask = table->num_slots - 1;
+    size_t slot = hash_vertex_name(name, name_len) & mask;
+    for (;;) {
+        uint32_t slot_id = __atomic_load_n(&table->slots[slot], __ATOMIC_ACQUIRE);
+        if (slot_id == INVALID_VERTEX_ID &&
+            __atomic_compare_exchange_n(&table->slots[slot], &slot_id, vert_id, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
             return true;
         }
-        iter = iter->next;
+
+        // The slot is taken, slot_id holds the id of its name
+        const char* slot_name = __atomic_load_n(&table->names[slot_id], __ATOMIC_ACQUIRE);
+        if (strncmp(slot_name, name, name_len) == 0 && slot_name[name_len] == '\0') {
+            return false;
+        }
+        slot = (slot + 1) & mask;
     }
-    return false;
 }
 
-void print_slinked_list(slinked_list_t* list) {
-    for (node_t* iter = list->head; iter != NULL; iter = iter->next) {
-        printf("%s[%d] - ", iter->data, iter->dist);
+int compare_name_rank_entries(const void* lhs, const void* rhs) {
+    const name_rank_entry_t* lhs_entry = (const name_rank_entry_t*)lhs;
+    const name_rank_entry_t* rhs_entry = (const name_rank_entry_t*)rhs;
+    return strcmp(lhs_entry->name, rhs_entry->name);
+}
+
+void rank_vertex_names(const symbol_table_t* table, uint32_t* name_ranks) {
+    // name_ranks[id] is the position of the name of id in lexicographic order
+    const size_t num_symbols = table->num_symbols;
+    name_rank_entry_t* entries =
+        (name_rank_entry_t*)malloc(num_symbols * sizeof(name_rank_entry_t));
+    for (size_t i = 0; i < num_symbols; i++) {
+        entries[i].name = symbol_table_name(table, (uint32_t)i);
+        entries[i].vert_id = (uint32_t)i;
+    }
+    qsort(entries, num_symbols, sizeof(name_rank_entry_t), compare_name_rank_entries);
+    for (size_t i = 0; i < num_symbols; i++) {
+        name_ranks[entries[i].vert_id] = (uint32_t)i;
     }
-    printf("NULL\n");
+    free(entries);
 }
 
-void create_set(set_t** set) {
+void create_set(set_t** set, const size_t capacity) {
     *set = (set_t*)malloc(sizeof(set_t));
-    create_slinked_list(&(*set)->list);
+    (*set)->capacity = capacity;
+    (*set)->words = (uint64_t*)calloc((capacity + 63) / 64, sizeof(uint64_t));
 }
 
 void free_set(set_t* set) {
-    free_slinked_list(set->list);
-    set->list = NULL;
+    free(set->words);
+    set->words = NULL;
+    set->capacity = 0;
+}
+
+bool set_contains(set_t* set, const uint32_t vert_id) {
+    return (set->words[vert_id >> 6] >> (vert_id & 63)) & 1;
 }
 
-bool set_contains(set_t* set, const char* data) {
-    if (slinked_list_contains(set->list, data)) {
+bool set_insert(set_t* set, const uint32_t vert_id) {
+    if (!set_contains(set, vert_id)) {
+        set->words[vert_id >> 6] |= (uint64_t)1 << (vert_id & 63);
         return true;
     }
     return false;
 }
 
-bool set_insert(set_t* set, node_t* node) {
-    if (!set_contains(set, node->data)) {
-        insert_node_at_end(&set->list, node->data, node->dist);
-        return true;
+bool set_remove(set_t* set, const uint32_t vert_id) {
+    if (!set_contains(set, vert_id)) {
+        return false;
     }
-    return false;
+    set->words[vert_id >> 6] &= ~((uint64_t)1 << (vert_id & 63));
+    return true;
 }
 
-bool set_remove(set_t* set, node_t* node) {
-    if (!set_contains(set, node->data)) {
+bool is_shared_memory_name(const char* file_name) {
+    return strncmp(file_name, SHARED_MEMORY_PREFIX, sizeof(SHARED_MEMORY_PREFIX) - 1) == 0;
+}
+
+// A "shm:<name>" file is the POSIX shared memory segment <name>, every process attached to it
+// maps the same pages. Its sections are checked once when they are attached and used in place from
+// then on, so the segment must come from a trusted publisher that never changes it afterwards
+void map_file(mapped_file_t** file, const char* file_name) {
+    const bool shared = is_shared_memory_name(file_name);
+    const int fd = shared ? shm_open(file_name + sizeof(SHARED_MEMORY_PREFIX) - 1, O_RDONLY, 0)
+                          : open(file_name, O_RDONLY);
+    if (fd == -1) {
+        perror(shared ? "shm_open() failed for graph segment" : "open() failed for graph file");
+        exit(EXIT_FAILURE);
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1) {
+        perror("fstat() failed for graph file");
+        exit(EXIT_FAILURE);
+    }
+
+    *file = (mapped_file_t*)malloc(sizeof(mapped_file_t));
+    (*file)->data = NULL;
+    (*file)->size = (size_t)file_stat.st_size;
+    if ((*file)->size > 0) {
+        void* data = mmap(NULL, (*file)->size, PROT_READ, shared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror("mmap() failed for graph file");
+            exit(EXIT_FAILURE);
+        }
+        // The file is read front to back exactly once
+        madvise(data, (*file)->size, MADV_SEQUENTIAL);
+        (*file)->data = (const char*)data;
+    }
+    close(fd);
+}
+
+void unmap_file(mapped_file_t* file) {
+    if (file->data) {
+        munmap((void*)file->data, file->size);
+    }
+    file->data = NULL;
+    file->size = 0;
+}
+
+// Hands out the next line without its line ending, returns false at the end of the text
+bool next_line(text_cursor_t* cursor, text_cursor_t* line) {
+    if (cursor->pos >= cursor->end) {
         return false;
     }
-    node_t* iter = set->list->head;
-    node_t* prev_iter = iter;
-    while (iter) {
-        if (strncmp(iter->data, node->data, 32) == 0) {
-            if (iter == prev_iter) {  // We are at head
-                node_t* retire = set->list->head;
-                if (set->list->size == 1) {
-                    set->list->head = set->list->tail = NULL;
-                } else {
-                    set->list->head = set->list->head->next;
-                }
-                free(retire->data);
-                free(retire);
-            } else {
-                if (iter == set->list->tail) {  // We can be at tail
-                    set->list->tail = prev_iter;
-                }
-                prev_iter->next = iter->next;
-                free(iter->data);
-                free(iter);
-            }
-            break;
+
+    const char* line_begin = cursor->pos;
+    const char* newline = (const char*)memchr(line_begin, '\n', cursor->end - line_begin);
+    const char* line_end = newline ? newline : cursor->end;
+    cursor->pos = newline ? newline + 1 : cursor->end;
+    if (line_end > line_begin && line_end[-1] == '\r') {
+        line_end--;
+    }
+
+    line->pos = line_begin;
+    line->end = line_end;
+    return true;
+}
+
+#if defined(__x86_64__)
+// Marks every space or tab of an 8-byte word with the high bit of its byte, the lowest marked
+// byte is always a blank, marks above it may be false positives
+uint64_t blank_byte_mask(const uint64_t word) {
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t spaces = word ^ (ones * ' ');
+    const uint64_t tabs = word ^ (ones * '\t');
+    return (((spaces - ones) & ~spaces) | ((tabs - ones) & ~tabs)) & (ones * 0x80);
+}
+
+__attribute__((target("avx2"))) const char* find_blank_avx2(const char* pos, const char* end) {
+    const __m256i spaces = _mm256_set1_epi8(' ');
+    const __m256i tabs = _mm256_set1_epi8('\t');
+    while (end - pos >= 32) {
+        const __m256i block = _mm256_loadu_si256((const __m256i*)pos);
+        const uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, spaces), _mm256_cmpeq_epi8(block, tabs)));
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 32;
+    }
+    return pos;
+}
+#endif
+
+// Returns the first space or tab in [pos, end), or end when there is none. Blocks of 32, 16 and
+// 8 bytes are compared at once while they fit in the range, only the last few bytes one by one
+const char* find_blank(const char* pos, const char* end) {
+#if defined(__x86_64__)
+    // AVX2 is picked at run time, SSE2 is part of every x86-64 CPU. A search stopped on a blank
+    // finds it again right away in the next step
+    if (end - pos >= 32 && __builtin_cpu_supports("avx2")) {
+        pos = find_blank_avx2(pos, end);
+    }
+    const __m128i spaces = _mm_set1_epi8(' ');
+    const __m128i tabs = _mm_set1_epi8('\t');
+    while (end - pos >= 16) {
+        const __m128i block = _mm_loadu_si128((const __m128i*)pos);
+        const uint32_t mask = (uint32_t)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(block, spaces), _mm_cmpeq_epi8(block, tabs)));
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 16;
+    }
+    while (end - pos >= 8) {
+        uint64_t word;
+        memcpy(&word, pos, sizeof(word));
+        const uint64_t mask = blank_byte_mask(word);
+        if (mask != 0) {
+            return pos + (__builtin_ctzll(mask) >> 3);
+        }
+        pos += 8;
+    }
+#endif
+    while (pos < end && *pos != ' ' && *pos != '\t') {
+        pos++;
+    }
+    return pos;
+}
+
+// Splits the next blank separated token off the front of a line, returns false when none is left
+bool next_token(text_cursor_t* line, const char** token, size_t* token_len) {
+    // Tokens are mostly separated by a single blank, so only the token end is searched in blocks
+    const char* pos = line->pos;
+    while (pos < line->end && (*pos == ' ' || *pos == '\t')) {
+        pos++;
+    }
+    const char* token_begin = pos;
+    pos = find_blank(pos, line->end);
+
+    line->pos = pos;
+    *token = token_begin;
+    *token_len = pos - token_begin;
+    return *token_len > 0;
+}
+
+bool parse_count(const char* token, const size_t token_len, uint64_t* value) {
+    uint64_t result = 0;
+    for (size_t i = 0; i < token_len; i++) {
+        const uint32_t digit = (uint32_t)(token[i] - '0');
+        if (digit > 9 || result > (UINT64_MAX - digit) / 10) {
+            return false;
         }
-        prev_iter = iter;
-        iter = iter->next;
+        result = result * 10 + digit;
+    }
+    *value = result;
+    return token_len > 0;
+}
+
+bool parse_int32(const char* token, const size_t token_len, int32_t* value) {
+    size_t i = 0;
+    const bool negative = token_len > 0 && token[0] == '-';
+    if (negative || (token_len > 0 && token[0] == '+')) {
+        i++;
     }
 
-    set->list->size--;
+    // Accumulate in 64 bits, a weight of more than 10 digits is out of range anyway
+    int64_t result = 0;
+    if (i == token_len || token_len - i > 10) {
+        return false;
+    }
+    for (; i < token_len; i++) {
+        const uint32_t digit = (uint32_t)(token[i] - '0');
+        if (digit > 9) {
+            return false;
+        }
+        result = result * 10 + digit;
+    }
+    if (negative) {
+        result = -result;
+    }
+    if (result < INT32_MIN || result > INT32_MAX) {
+        return false;
+    }
+    *value = (int32_t)result;
     return true;
 }
 
+void create_output_sink(output_sink_t** sink, const int fd, const size_t capacity) {
+    *sink = (output_sink_t*)malloc(sizeof(output_sink_t));
+    (*sink)->fd = fd;
+    (*sink)->used = 0;
+    (*sink)->capacity = capacity;
+    (*sink)->data = (char*)malloc(capacity);
+}
+
+void write_all(const int fd, const char* data, size_t size) {
+    // Pipes and sockets may take less than asked for, keep going until everything is out
+    while (size > 0) {
+        const ssize_t written = write(fd, data, size);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("write() failed for output");
+            exit(EXIT_FAILURE);
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+}
+
+void flush_output_sink(output_sink_t* sink) {
+    write_all(sink->fd, sink->data, sink->used);
+    sink->used = 0;
+}
+
+void free_output_sink(output_sink_t* sink) {
+    flush_output_sink(sink);
+    free(sink->data);
+    sink->data = NULL;
+    sink->capacity = 0;
+}
+
+void sink_write(output_sink_t* sink, const char* data, const size_t size) {
+    if (sink->used + size > sink->capacity) {
+        flush_output_sink(sink);
+        if (size > sink->capacity) {
+            write_all(sink->fd, data, size);
+            return;
+        }
+    }
+    memcpy(sink->data + sink->used, data, size);
+    sink->used += size;
+}
+
+void sink_puts(output_sink_t* sink, const char* str) {
+    sink_write(sink, str, strlen(str));
+}
+
+void sink_putc(output_sink_t* sink, const char c) {
+    if (sink->used == sink->capacity) {
+        flush_output_sink(sink);
+    }
+    sink->data[sink->used++] = c;
+}
+
+void sink_put_uint(output_sink_t* sink, uint64_t value) {
+    // Digits come out lowest first, so they are filled in from the back of the buffer
+    char digits[20];
+    size_t num_digits = 0;
+    do {
+        digits[sizeof(digits) - ++num_digits] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    sink_write(sink, digits + sizeof(digits) - num_digits, num_digits);
+}
+
+void sink_put_int(output_sink_t* sink, const int64_t value) {
+    if (value < 0) {
+        sink_putc(sink, '-');
+        sink_put_uint(sink, (uint64_t)0 - (uint64_t)value);
+    } else {
+        sink_put_uint(sink, (uint64_t)value);
+    }
+}
+
+// A "shm:<name>" snapshot is published as a new shared memory segment, processes still attached
+// to an earlier segment of that name keep theirs until they detach. The segment is created
+// read-only, so once published no one but its owner can open it for writing
+FILE* open_snapshot_file(const char* file_name) {
+    if (!is_shared_memory_name(file_name)) {
+        return fopen(file_name, "wb");
+    }
+    const char* segment_name = file_name + sizeof(SHARED_MEMORY_PREFIX) - 1;
+    shm_unlink(segment_name);
+    const int fd = shm_open(segment_name, O_CREAT | O_EXCL | O_RDWR, 0444);
+    return fd == -1 ? NULL : fdopen(fd, "wb");
+}
+
+void begin_snapshot(snapshot_writer_t* writer, const char* file_name, const uint32_t flags,
+                    const size_t num_vertices, const size_t num_edges) {
+    writer->file = open_snapshot_file(file_name);
+    if (!writer->file) {
+        perror("Opening the snapshot file failed");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&writer->header, 0, sizeof(snapshot_header_t));
+    memcpy(writer->header.magic, SNAPSHOT_MAGIC, sizeof(writer->header.magic));
+    writer->header.version = SNAPSHOT_VERSION;
+    writer->header.flags = flags;
+    writer->header.num_vertices = num_vertices;
+    writer->header.num_edges = num_edges;
+
+    // The header is written with the section table once all sections are in, until then a blank
+    // one holds its place, so a snapshot that is still being written is never taken for one
+    const snapshot_header_t blank_header = {0};
+    fwrite(&blank_header, sizeof(snapshot_header_t), 1, writer->file);
+    writer->offset = sizeof(snapshot_header_t);
+}
+
+void begin_snapshot_section(snapshot_writer_t* writer, const snapshot_section_id_t section) {
+    writer->section = section;
+    writer->header.sections[section].offset = writer->offset;
+    writer->header.sections[section].size = 0;
+}
+
+void append_snapshot_data(snapshot_writer_t* writer, const void* data, const size_t size) {
+    fwrite(data, 1, size, writer->file);
+    writer->header.sections[writer->section].size += size;
+    writer->offset += size;
+}
+
+void end_snapshot_section(snapshot_writer_t* writer) {
+    static const char padding[8] = {0};
+    const size_t padding_size = (8 - writer->offset % 8) % 8;
+    fwrite(padding, 1, padding_size, writer->file);
+    writer->offset += padding_size;
+}
+
+void write_snapshot_section(snapshot_writer_t* writer, const snapshot_section_id_t section,
+                            const void* data, const size_t size) {
+    begin_snapshot_section(writer, section);
+    append_snapshot_data(writer, data, size);
+    end_snapshot_section(writer);
+}
+
+void end_snapshot(snapshot_writer_t* writer) {
+    fseek(writer->file, 0, SEEK_SET);
+    fwrite(&writer->header, sizeof(snapshot_header_t), 1, writer->file);
+    if (ferror(writer->file) || fclose(writer->file) != 0) {
+        perror("Writing the snapshot file failed");
+        exit(EXIT_FAILURE);
+    }
+    writer->file = NULL;
+}
+
+bool is_graph_snapshot(const mapped_file_t* file) {
+    return file->size >= sizeof(snapshot_header_t) &&
+           memcmp(file->data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC) - 1) == 0;
+}
+
+// Checks the header and the section table, the attach functions check the contents of the
+// sections they use
+const snapshot_header_t* open_graph_snapshot(const mapped_file_t* file, const uint32_t flags) {
+    const snapshot_header_t* header = (const snapshot_header_t*)file->data;
+    if (header->version != SNAPSHOT_VERSION) {
+        fprintf(stderr, "Unsupported snapshot version %u\n", header->version);
+        exit(EXIT_FAILURE);
+    }
+    if ((header->flags & SNAPSHOT_DIRECTED) != (flags & SNAPSHOT_DIRECTED)) {
+        fprintf(stderr, "Snapshot holds %s graph\n",
+                header->flags & SNAPSHOT_DIRECTED ? "a directed" : "an undirected");
+        exit(EXIT_FAILURE);
+    }
+    if ((header->flags & SNAPSHOT_FILE_ORDER) != (flags & SNAPSHOT_FILE_ORDER)) {
+        fprintf(stderr, "Snapshot rows are in %s order\n",
+                header->flags & SNAPSHOT_FILE_ORDER ? "file" : "name");
+        exit(EXIT_FAILURE);
+    }
+    if (header->num_vertices > UINT32_MAX) {
+        fprintf(stderr, "Invalid vertex count in snapshot: %" PRIu64 "\n", header->num_vertices);
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < SNAPSHOT_NUM_SECTIONS; i++) {
+        const snapshot_section_t* section = &header->sections[i];
+        if (section->size > 0 &&
+            (section->offset % 8 != 0 || section->offset > file->size ||
+             section->size > file->size - section->offset)) {
+            fprintf(stderr, "Snapshot section %zu is out of bounds\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Sections are read in place, prefetch the whole mapping
+    madvise((void*)file->data, file->size, MADV_WILLNEED);
+    return header;
+}
+
+// Returns the section in the mapping, or NULL when the snapshot does not have it
+const void* snapshot_section(const mapped_file_t* file, const snapshot_header_t* header,
+                             const snapshot_section_id_t section, const size_t expected_size) {
+    if (header->sections[section].size == 0) {
+        return expected_size == 0 ? file->data + header->sections[section].offset : NULL;
+    }
+    if (header->sections[section].size != expected_size) {
+        fprintf(stderr, "Snapshot section %d has %" PRIu64 " bytes instead of %zu\n", (int)section,
+                header->sections[section].size, expected_size);
+        exit(EXIT_FAILURE);
+    }
+    return file->data + header->sections[section].offset;
+}
+
+const void* required_snapshot_section(const mapped_file_t* file, const snapshot_header_t* header,
+                                      const snapshot_section_id_t section,
+                                      const size_t expected_size) {
+    const void* data = snapshot_section(file, header, section, expected_size);
+    if (data == NULL) {
+        fprintf(stderr, "Snapshot is missing section %d\n", (int)section);
+        exit(EXIT_FAILURE);
+    }
+    return data;
+}
+
+// Stops with an error unless the offsets start at 0, never decrease and end at the given value
+void check_snapshot_offsets(const uint64_t* offsets, const size_t count, const uint64_t end,
+                            const char* table_name) {
+    bool valid = offsets[0] == 0 && offsets[count] == end;
+    for (size_t i = 0; i < count && valid; i++) {
+        valid = offsets[i] <= offsets[i + 1];
+    }
+    if (!valid) {
+        fprintf(stderr, "Snapshot has an invalid %s\n", table_name);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Stops with an error unless every id is below the limit
+void check_snapshot_ids(const uint32_t* ids, const size_t count, const size_t limit,
+                        const char* table_name) {
+    for (size_t i = 0; i < count; i++) {
+        if (ids[i] >= limit) {
+            fprintf(stderr, "Snapshot has an invalid %s\n", table_name);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// Every name must end with its terminator inside the names section and every slot must be empty
+// or hold a vertex id. No more ids than vertices leaves empty slots for every lookup to stop at
+void check_snapshot_name_table(const uint64_t* name_offsets, const char* names,
+                               const size_t num_symbols, const uint32_t* slots,
+                               const size_t num_slots) {
+    bool valid = name_offsets[0] == 0;
+    for (size_t i = 0; i < num_symbols && valid; i++) {
+        valid = name_offsets[i] < name_offsets[i + 1];
+    }
+    for (size_t i = 0; i < num_symbols && valid; i++) {
+        valid = names[name_offsets[i + 1] - 1] == '\0';
+    }
+    size_t num_filled = 0;
+    for (size_t i = 0; i < num_slots && valid; i++) {
+        if (slots[i] != INVALID_VERTEX_ID) {
+            valid = slots[i] < num_symbols;
+            num_filled++;
+        }
+    }
+    if (!valid || num_filled > num_symbols) {
+        fprintf(stderr, "Snapshot has an invalid name table\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void write_symbol_table_sections(snapshot_writer_t* writer, const symbol_table_t* table) {
+    // Names are stored back to back with their terminators and found through their offsets
+    uint64_t name_offset = 0;
+    begin_snapshot_section(writer, SNAPSHOT_NAME_OFFSETS);
+    for (size_t i = 0; i < table->num_symbols; i++) {
+        append_snapshot_data(writer, &name_offset, sizeof(uint64_t));
+        name_offset += strlen(symbol_table_name(table, (uint32_t)i)) + 1;
+    }
+    append_snapshot_data(writer, &name_offset, sizeof(uint64_t));
+    end_snapshot_section(writer);
+
+    begin_snapshot_section(writer, SNAPSHOT_NAMES);
+    for (size_t i = 0; i < table->num_symbols; i++) {
+        const char* name = symbol_table_name(table, (uint32_t)i);
+        append_snapshot_data(writer, name, strlen(name) + 1);
+    }
+    end_snapshot_section(writer);
+
+    write_snapshot_section(writer, SNAPSHOT_NAME_SLOTS, table->slots,
+                           table->num_slots * sizeof(uint32_t));
+}
+
+void attach_symbol_table(symbol_table_t** table, const mapped_file_t* file,
+                         const snapshot_header_t* header, arena_t* arena) {
+    const size_t num_symbols = header->num_vertices;
+    const uint64_t* name_offsets = (const uint64_t*)required_snapshot_section(
+        file, header, SNAPSHOT_NAME_OFFSETS, (num_symbols + 1) * sizeof(uint64_t));
+    const char* names = (const char*)required_snapshot_section(file, header, SNAPSHOT_NAMES,
+                                                               name_offsets[num_symbols]);
+
+    // The slot table is used as it is, so it must be a valid open addressing table
+    const size_t num_slots = header->sections[SNAPSHOT_NAME_SLOTS].size / sizeof(uint32_t);
+    if (num_slots <= num_symbols || (num_slots & (num_slots - 1)) != 0) {
+        fprintf(stderr, "Snapshot has an invalid name table\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const uint32_t* slots = (const uint32_t*)required_snapshot_section(
+        file, header, SNAPSHOT_NAME_SLOTS, num_slots * sizeof(uint32_t));
+    check_snapshot_name_table(name_offsets, names, num_symbols, slots, num_slots);
+
+    *table = (symbol_table_t*)malloc(sizeof(symbol_table_t));
+    (*table)->arena = arena;
+    (*table)->num_symbols = num_symbols;
+    // Names are looked up in the mapping itself, attaching copies nothing per vertex
+    (*table)->names_capacity = 0;
+    (*table)->names = NULL;
+    (*table)->name_offsets = name_offsets;
+    (*table)->name_data = names;
+    (*table)->num_slots = num_slots;
+    (*table)->slots = (uint32_t*)slots;
+    (*table)->mapped = true;
+}
+
 void create_directed_graph(directed_graph_t** graph, const size_t num_vertices) {
     *graph = (directed_graph_t*)malloc(sizeof(directed_graph_t));
     (*graph)->num_vertices = num_vertices;
-    (*graph)->adjacency_lists = (slinked_list_t**)malloc(num_vertices * sizeof(slinked_list_t*));
-    for (size_t i = 0; i < num_vertices; i++) {
-        create_slinked_list(&(*graph)->adjacency_lists[i]);
+    (*graph)->num_edges = 0;
+    create_arena(&(*graph)->arena, ARENA_BLOCK_SIZE);
+    create_symbol_table(&(*graph)->vertex_names, num_vertices, (*graph)->arena);
+    (*graph)->snapshot = NULL;
+    (*graph)->edge_offsets = NULL;
+    (*graph)->edge_targets = NULL;
+    (*graph)->edge_weights = NULL;
+}
+
+void create_edge_buffer(edge_buffer_t** buffer, const size_t capacity) {
+    *buffer = (edge_buffer_t*)malloc(sizeof(edge_buffer_t));
+    (*buffer)->size = 0;
+    (*buffer)->capacity = capacity > 0 ? capacity : 16;
+    (*buffer)->records = (edge_record_t*)malloc((*buffer)->capacity * sizeof(edge_record_t));
+}
+
+void push_edge_record(edge_buffer_t* buffer, const uint32_t src_id, const uint32_t dst_id,
+                      const int32_t weight) {
+    if (buffer->size == buffer->capacity) {
+        buffer->capacity *= 2;
+        buffer->records =
+            (edge_record_t*)realloc(buffer->records, buffer->capacity * sizeof(edge_record_t));
     }
+    edge_record_t* record = &buffer->records[buffer->size++];
+    record->src_id = src_id;
+    record->dst_id = dst_id;
+    record->weight = weight;
 }
 
-void free_directed_graph(directed_graph_t* graph) {
-    for (size_t i = 0; i < graph->num_vertices; i++) {
-        free_slinked_list(graph->adjacency_lists[i]);
-        free(graph->adjacency_lists[i]);
+void free_edge_buffer(edge_buffer_t* buffer) {
+    free(buffer->records);
+    buffer->records = NULL;
+    buffer->size = buffer->capacity = 0;
+}
+
+// "<u> <v> <distance>" adds an edge and "<u>" alone a vertex, a vertex is added the first time
+// the stream names it
+void add_stream_line(directed_graph_t* graph, text_cursor_t line, edge_buffer_t* edges) {
+    const text_cursor_t stream_line = line;
+    const char* edge_u;
+    const char* edge_v;
+    const char* edge_dist_text;
+    size_t len_u, len_v, len_dist;
+    if (!next_token(&line, &edge_u, &len_u)) {
+        return;
+    }
+    if (!next_token(&line, &edge_v, &len_v)) {
+        symbol_table_intern(graph->vertex_names, edge_u, len_u);
+        return;
+    }
+    int32_t edge_dist = 0;
+    if (!next_token(&line, &edge_dist_text, &len_dist) ||
+        !parse_int32(edge_dist_text, len_dist, &edge_dist)) {
+        fprintf(stderr, "Skipping malformed edge: %.*s\n", (int)(stream_line.end - stream_line.pos),
+                stream_line.pos);
+        return;
     }
-    free(graph->adjacency_lists);
-    graph->num_vertices = 0;
+
+    const uint32_t u_id = symbol_table_intern(graph->vertex_names, edge_u, len_u);
+    const uint32_t v_id = symbol_table_intern(graph->vertex_names, edge_v, len_v);
+    push_edge_record(edges, u_id, v_id, edge_dist);
 }
 
-void print_directed_graph(directed_graph_t* graph) {
-    const size_t graph_size = graph->num_vertices;
-    printf("Ordered graph size: %llu\n", graph_size);
-    for (size_t i = 0; i < graph_size; i++) {
-        print_slinked_list(graph->adjacency_lists[i]);
+// Reads the stream in blocks and parses every complete line of a block, the unfinished line at
+// its end is carried over to the next one
+void read_edge_stream(directed_graph_t* graph, const int fd, edge_buffer_t* edges) {
+    size_t capacity = STREAM_BLOCK_SIZE;
+    char* buffer = (char*)malloc(capacity);
+    size_t pending = 0;
+    bool end_of_stream = false;
+    while (!end_of_stream) {
+        if (pending == capacity) {
+            // A single line fills the whole buffer, make room for the rest of it
+            capacity *= 2;
+            buffer = (char*)realloc(buffer, capacity);
+        }
+        const ssize_t num_read = read(fd, buffer + pending, capacity - pending);
+        if (num_read == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read() failed for edge stream");
+            exit(EXIT_FAILURE);
+        }
+        end_of_stream = num_read == 0;
+
+        // Only the new bytes can hold a newline, the carried over line has none
+        const char* data_end = buffer + pending + num_read;
+        const char* lines_end = data_end;
+        if (!end_of_stream) {
+            while (lines_end > buffer + pending && lines_end[-1] != '\n') {
+                lines_end--;
+            }
+            if (lines_end == buffer + pending) {
+                lines_end = buffer;
+            }
+        }
+
+        text_cursor_t cursor = {buffer, lines_end};
+        text_cursor_t line;
+        while (next_line(&cursor, &line)) {
+            add_stream_line(graph, line, edges);
+        }
+        pending = data_end - lines_end;
+        memmove(buffer, lines_end, pending);
     }
+    free(buffer);
 }
 
-void read_graph_from_file(directed_graph_t** graph, FILE* graph_file) {
-    for (size_t i = 0; i < (*graph)->num_vertices; i++) {
-        char vertex_buffer[64];
-        fgets(vertex_buffer, 64, graph_file);
-        vertex_buffer[strlen(vertex_buffer) - 1] = '\0';
-        const int32_t head_dist = -1;
-        insert_node_at_end(&(*graph)->adjacency_lists[i], vertex_buffer, head_dist);
+// Runs one phase of the loader, a single task runs on the calling thread without starting any
+void run_loader_tasks(loader_task_t* tasks, const size_t num_tasks, void* (*work)(void*)) {
+    if (num_tasks == 1) {
+        work(&tasks[0]);
+        return;
     }
 
-    char edge_buffer[64];
-    while (fgets(edge_buffer, 64, graph_file) != NULL) {
-        edge_buffer[strlen(edge_buffer) - 1] = '\0';
-        char edge_u[32];
-        char edge_v[32];
+    pthread_t threads[MAX_LOADER_THREADS];
+    for (size_t i = 0; i < num_tasks; i++) {
+        if (pthread_create(&threads[i], NULL, work, &tasks[i]) != 0) {
+            fprintf(stderr, "pthread_create() failed for loader task\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (size_t i = 0; i < num_tasks; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
 
-        // Get the lenght of the name of the first vertex
-        int32_t len_name_first_edge = 0;
-        while (edge_buffer[len_name_first_edge] != ' ') {
-            ++len_name_first_edge;
+// Splits the text into one chunk per task, every chunk but the last ends right after a newline
+void split_text_into_chunks(const char* begin, const char* end, loader_task_t* tasks,
+                            const size_t num_tasks) {
+    const size_t text_size = end - begin;
+    const char* chunk_begin = begin;
+    for (size_t i = 0; i < num_tasks; i++) {
+        const char* chunk_end = end;
+        if (i + 1 < num_tasks) {
+            chunk_end = begin + text_size / num_tasks * (i + 1);
+            if (chunk_end <= chunk_begin) {
+                chunk_end = chunk_begin;
+            } else {
+                const char* newline =
+                    (const char*)memchr(chunk_end - 1, '\n', end - (chunk_end - 1));
+                chunk_end = newline ? newline + 1 : end;
+            }
         }
-        // Get the lenght of the name of the second vertex
-        int32_t len_name_second_edge = 0;
-        while (edge_buffer[len_name_first_edge + len_name_second_edge + 1] != ' ') {
-            ++len_name_second_edge;
+        tasks[i].chunk_begin = chunk_begin;
+        tasks[i].chunk_end = chunk_end;
+        chunk_begin = chunk_end;
+    }
+}
+
+void* count_chunk_lines(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    size_t num_lines = 0;
+    const char* pos = task->chunk_begin;
+    while ((pos = (const char*)memchr(pos, '\n', task->chunk_end - pos)) != NULL) {
+        num_lines++;
+        pos++;
+    }
+    task->num_lines = num_lines;
+    return NULL;
+}
+
+void* intern_chunk_vertices(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    text_cursor_t cursor = {task->chunk_begin, task->chunk_end};
+    text_cursor_t line;
+    for (size_t vert_id = task->first_vert_id; next_line(&cursor, &line); vert_id++) {
+        const size_t vertex_len = line.end - line.pos;
+        char* name = (char*)arena_alloc(task->arena, vertex_len + 1);
+        memcpy(name, line.pos, vertex_len);
+        name[vertex_len] = '\0';
+        if (!symbol_table_insert_concurrent(task->graph->vertex_names, name, vertex_len,
+                                            (uint32_t)vert_id)) {
+            fprintf(stderr, "Duplicate vertex %s\n", name);
+            exit(EXIT_FAILURE);
         }
+    }
+    return NULL;
+}
 
-        // Get the distance between both vertices
+void* parse_chunk_edges(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    const symbol_table_t* vertex_names = task->graph->vertex_names;
+    text_cursor_t cursor = {task->chunk_begin, task->chunk_end};
+    text_cursor_t line;
+    while (next_line(&cursor, &line)) {
+        // Tokenize "<u> <v> <distance>" in place, the names are looked up without being copied
+        const text_cursor_t edge_line = line;
+        const char* edge_u;
+        const char* edge_v;
+        const char* edge_dist_text;
+        size_t len_u, len_v, len_dist;
+        if (!next_token(&line, &edge_u, &len_u)) {
+            continue;
+        }
         int32_t edge_dist = 0;
-        sscanf(&edge_buffer[len_name_first_edge + len_name_second_edge + 2], "%d", &edge_dist);
+        if (!next_token(&line, &edge_v, &len_v) ||
+            !next_token(&line, &edge_dist_text, &len_dist) ||
+            !parse_int32(edge_dist_text, len_dist, &edge_dist)) {
+            fprintf(stderr, "Skipping malformed edge: %.*s\n", (int)(edge_line.end - edge_line.pos),
+                    edge_line.pos);
+            continue;
+        }
 
-        // Read the first vertex
-        for (int32_t i = 0; i < len_name_first_edge; i++) {
-            edge_u[i] = edge_buffer[i];
+        // Resolve both vertices to their ids
+        const uint32_t u_id = symbol_table_find(vertex_names, edge_u, len_u);
+        const uint32_t v_id = symbol_table_find(vertex_names, edge_v, len_v);
+        if (u_id == INVALID_VERTEX_ID || v_id == INVALID_VERTEX_ID) {
+            fprintf(stderr, "Skipping edge with unknown vertex: %.*s\n",
+                    (int)(edge_line.end - edge_line.pos), edge_line.pos);
+            continue;
         }
-        edge_u[len_name_first_edge] = '\0';
 
-        // Read the second vertex
-        for (int32_t i = 0; i < len_name_second_edge; i++) {
-            edge_v[i] = edge_buffer[i + len_name_first_edge + 1];
+        push_edge_record(task->edges, u_id, v_id, edge_dist);
+    }
+    return NULL;
+}
+
+// Counts the edges of every row into edge_offsets[row + 1]
+void* count_chunk_degrees(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    size_t* row_sizes = task->graph->edge_offsets + 1;
+    for (size_t i = 0; i < task->edges->size; i++) {
+        const edge_record_t* record = &task->edges->records[i];
+        __atomic_fetch_add(&row_sizes[record->src_id], 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+// Places every edge in the row of its source, in no particular order within the row
+void* scatter_chunk_edges(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    directed_graph_t* graph = task->graph;
+    for (size_t i = 0; i < task->edges->size; i++) {
+        const edge_record_t* record = &task->edges->records[i];
+        const size_t position = task->first_edge_position + i;
+        const size_t edge = __atomic_fetch_add(&task->row_cursors[record->src_id], 1,
+                                               __ATOMIC_RELAXED);
+        graph->edge_targets[edge] = record->dst_id;
+        graph->edge_weights[edge] = record->weight;
+        task->edge_positions[edge] = position;
+    }
+    return NULL;
+}
+
+int compare_row_entries(const void* lhs, const void* rhs) {
+    const row_entry_t* lhs_entry = (const row_entry_t*)lhs;
+    const row_entry_t* rhs_entry = (const row_entry_t*)rhs;
+    if (lhs_entry->rank != rhs_entry->rank) {
+        return lhs_entry->rank < rhs_entry->rank ? -1 : 1;
+    }
+    if (lhs_entry->position != rhs_entry->position) {
+        return lhs_entry->position < rhs_entry->position ? -1 : 1;
+    }
+    return 0;
+}
+
+// Sorts the rows of the task by target name, parallel edges stay in the order they were listed
+void* sort_chunk_rows(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    directed_graph_t* graph = task->graph;
+    row_entry_t* entries = NULL;
+    size_t entries_capacity = 0;
+    for (size_t row = task->first_row; row < task->end_row; row++) {
+        const size_t row_begin = graph->edge_offsets[row];
+        const size_t row_size = graph->edge_offsets[row + 1] - row_begin;
+        if (row_size < 2) {
+            continue;
+        }
+        if (row_size > entries_capacity) {
+            entries_capacity = row_size;
+            entries = (row_entry_t*)realloc(entries, entries_capacity * sizeof(row_entry_t));
         }
-        edge_v[len_name_second_edge] = '\0';
 
-        // Insert the second vertex into the adjacency list of the first
-        for (size_t i = 0; i < (*graph)->num_vertices; i++) {
-            const char* curr_list_head = (*graph)->adjacency_lists[i]->head->data;
-            if (strncmp(curr_list_head, edge_u, 32) == 0) {
-                insert_node_at_end(&(*graph)->adjacency_lists[i], edge_v, edge_dist);
-                break;
-            }
+        for (size_t i = 0; i < row_size; i++) {
+            const uint32_t target = graph->edge_targets[row_begin + i];
+            entries[i].rank = task->name_ranks[target];
+            entries[i].target = target;
+            entries[i].weight = graph->edge_weights[row_begin + i];
+            entries[i].position = task->edge_positions[row_begin + i];
+        }
+        qsort(entries, row_size, sizeof(row_entry_t), compare_row_entries);
+        for (size_t i = 0; i < row_size; i++) {
+            graph->edge_targets[row_begin + i] = entries[i].target;
+            graph->edge_weights[row_begin + i] = entries[i].weight;
         }
     }
+    free(entries);
+    return NULL;
 }
 
-bool dfs_topological_sort(directed_graph_t* graph, node_t* src_vertex,
-                          slinked_list_t* visited_verts, set_t* cycle_verts,
-                          slinked_list_t* sorted_verts) {
-    if (set_contains(cycle_verts, src_vertex->data)) {
-        return false;  // There is a cycle in the graph
+// Builds the CSR layout from the edges the loader tasks parsed, with every row sorted by name
+void freeze_directed_graph(directed_graph_t* graph, loader_task_t* tasks, const size_t num_tasks) {
+    const size_t num_vertices = graph->num_vertices;
+    graph->edge_offsets = (size_t*)arena_alloc(graph->arena, (num_vertices + 1) * sizeof(size_t));
+    memset(graph->edge_offsets, 0, (num_vertices + 1) * sizeof(size_t));
+    run_loader_tasks(tasks, num_tasks, count_chunk_degrees);
+    for (size_t i = 0; i < num_vertices; i++) {
+        graph->edge_offsets[i + 1] += graph->edge_offsets[i];
     }
-    if (!slinked_list_contains(visited_verts, src_vertex->data)) {
-        insert_node_at_end(&visited_verts, src_vertex->data, src_vertex->dist);
-        set_insert(cycle_verts, src_vertex);
-        for (size_t i = 0; i < graph->num_vertices; i++) {
-            node_t* curr_head = graph->adjacency_lists[i]->head;
-            if (strncmp(curr_head->data, src_vertex->data, 32) == 0) {
-                for (node_t* iter = curr_head->next; iter != NULL; iter = iter->next) {
-                    dfs_topological_sort(graph, iter, visited_verts, cycle_verts, sorted_verts);
-                }
-                break;
-            }
+
+    graph->num_edges = graph->edge_offsets[num_vertices];
+    graph->edge_targets =
+        (uint32_t*)arena_alloc(graph->arena, graph->num_edges * sizeof(uint32_t));
+    graph->edge_weights = (int32_t*)arena_alloc(graph->arena, graph->num_edges * sizeof(int32_t));
+
+    // Every task scatters its edges through the shared row cursors and tags each with its
+    // position in the file, which the row sort uses to keep the result independent of timing
+    size_t* row_cursors = (size_t*)malloc((num_vertices + 1) * sizeof(size_t));
+    memcpy(row_cursors, graph->edge_offsets, (num_vertices + 1) * sizeof(size_t));
+    size_t* edge_positions = (size_t*)malloc((graph->num_edges + 1) * sizeof(size_t));
+    uint32_t* name_ranks = (uint32_t*)malloc((num_vertices + 1) * sizeof(uint32_t));
+    rank_vertex_names(graph->vertex_names, name_ranks);
+    size_t first_edge_position = 0;
+    for (size_t i = 0; i < num_tasks; i++) {
+        tasks[i].row_cursors = row_cursors;
+        tasks[i].edge_positions = edge_positions;
+        tasks[i].name_ranks = name_ranks;
+        tasks[i].first_edge_position = first_edge_position;
+        first_edge_position += tasks[i].edges->size;
+    }
+    run_loader_tasks(tasks, num_tasks, scatter_chunk_edges);
+
+    // Give every task a run of rows holding about the same number of edges to sort
+    size_t row = 0;
+    for (size_t i = 0; i < num_tasks; i++) {
+        const size_t edges_end = graph->num_edges / num_tasks * (i + 1);
+        tasks[i].first_row = row;
+        const bool last_task = i + 1 == num_tasks;
+        while (row < num_vertices && (last_task || graph->edge_offsets[row + 1] <= edges_end)) {
+            row++;
+        }
+        tasks[i].end_row = row;
+    }
+    run_loader_tasks(tasks, num_tasks, sort_chunk_rows);
+
+    free(name_ranks);
+    free(edge_positions);
+    free(row_cursors);
+}
+
+void free_directed_graph(directed_graph_t* graph) {
+    free_symbol_table(graph->vertex_names);
+    free(graph->vertex_names);
+    free_arena(graph->arena);
+    free(graph->arena);
+    if (graph->snapshot) {
+        unmap_file(graph->snapshot);
+        free(graph->snapshot);
+    }
+    graph->num_vertices = graph->num_edges = 0;
+}
+
+void write_directed_graph_sections(snapshot_writer_t* writer, const directed_graph_t* graph) {
+    write_symbol_table_sections(writer, graph->vertex_names);
+    write_snapshot_section(writer, SNAPSHOT_EDGE_OFFSETS, graph->edge_offsets,
+                           (graph->num_vertices + 1) * sizeof(size_t));
+    write_snapshot_section(writer, SNAPSHOT_EDGE_TARGETS, graph->edge_targets,
+                           graph->num_edges * sizeof(uint32_t));
+    write_snapshot_section(writer, SNAPSHOT_EDGE_WEIGHTS, graph->edge_weights,
+                           graph->num_edges * sizeof(int32_t));
+}
+
+void attach_directed_graph(directed_graph_t** graph, mapped_file_t* file) {
+    const snapshot_header_t* header = open_graph_snapshot(file, SNAPSHOT_DIRECTED);
+    const size_t num_vertices = header->num_vertices;
+    const size_t num_edges = header->num_edges;
+
+    *graph = (directed_graph_t*)malloc(sizeof(directed_graph_t));
+    (*graph)->num_vertices = num_vertices;
+    (*graph)->num_edges = num_edges;
+    create_arena(&(*graph)->arena, ARENA_BLOCK_SIZE);
+    attach_symbol_table(&(*graph)->vertex_names, file, header, (*graph)->arena);
+
+    // The CSR arrays are used in place, the graph owns the mapping from now on
+    (*graph)->edge_offsets = (size_t*)required_snapshot_section(
+        file, header, SNAPSHOT_EDGE_OFFSETS, (num_vertices + 1) * sizeof(size_t));
+    (*graph)->edge_targets = (uint32_t*)required_snapshot_section(
+        file, header, SNAPSHOT_EDGE_TARGETS, num_edges * sizeof(uint32_t));
+    (*graph)->edge_weights = (int32_t*)required_snapshot_section(
+        file, header, SNAPSHOT_EDGE_WEIGHTS, num_edges * sizeof(int32_t));
+    check_snapshot_offsets((const uint64_t*)(*graph)->edge_offsets, num_vertices, num_edges,
+                           "edge table");
+    check_snapshot_ids((*graph)->edge_targets, num_edges, num_vertices, "edge table");
+    (*graph)->snapshot = file;
+}
+
+void print_directed_graph(const directed_graph_t* graph, output_sink_t* out) {
+    const size_t graph_size = graph->num_vertices;
+    const int32_t head_dist = -1;
+    sink_puts(out, "Ordered graph size: ");
+    sink_put_uint(out, graph_size);
+    sink_putc(out, '\n');
+    for (size_t i = 0; i < graph_size; i++) {
+        sink_puts(out, symbol_table_name(graph->vertex_names, (uint32_t)i));
+        sink_putc(out, '[');
+        sink_put_int(out, head_dist);
+        sink_puts(out, "] - ");
+        for (size_t edge = graph->edge_offsets[i]; edge < graph->edge_offsets[i + 1]; edge++) {
+            sink_puts(out, symbol_table_name(graph->vertex_names, graph->edge_targets[edge]));
+            sink_putc(out, '[');
+            sink_put_int(out, graph->edge_weights[edge]);
+            sink_puts(out, "] - ");
+        }
+        sink_puts(out, "NULL\n");
+    }
+}
+
+// Reads the vertex and edge lists with one loader task per chunk of the text
+void read_graph_from_file(directed_graph_t** graph, text_cursor_t* cursor,
+                          const size_t expected_edges, loader_task_t* tasks,
+                          const size_t num_tasks) {
+    for (size_t i = 0; i < num_tasks; i++) {
+        tasks[i].graph = *graph;
+    }
+
+    // Vertex ids are assigned in the order the vertices are listed, so the lines are counted
+    // first to give every chunk the ids of its vertices and to find where the edges begin
+    const size_t num_vertices = (*graph)->num_vertices;
+    split_text_into_chunks(cursor->pos, cursor->end, tasks, num_tasks);
+    run_loader_tasks(tasks, num_tasks, count_chunk_lines);
+    size_t vert_id = 0;
+    const char* edges_begin = cursor->end;
+    for (size_t i = 0; i < num_tasks; i++) {
+        tasks[i].first_vert_id = vert_id;
+        if (vert_id + tasks[i].num_lines < num_vertices) {
+            vert_id += tasks[i].num_lines;
+            continue;
+        }
+
+        // The vertex list ends in this chunk, cut it right after the last vertex
+        const char* pos = tasks[i].chunk_begin;
+        for (; vert_id < num_vertices; vert_id++) {
+            pos = (const char*)memchr(pos, '\n', tasks[i].chunk_end - pos) + 1;
+        }
+        edges_begin = tasks[i].chunk_end = pos;
+        for (size_t j = i + 1; j < num_tasks; j++) {
+            tasks[j].chunk_begin = tasks[j].chunk_end = pos;
+            tasks[j].first_vert_id = num_vertices;
+        }
+        break;
+    }
+    if (vert_id < num_vertices) {
+        // The last line of the file may lack its newline
+        const bool unterminated_line = cursor->end > cursor->pos && cursor->end[-1] != '\n';
+        if (vert_id + unterminated_line < num_vertices) {
+            fprintf(stderr, "Expected %zu vertices, the graph file has only %zu\n", num_vertices,
+                    vert_id + unterminated_line);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Intern the names in parallel, the table is presized so it never grows meanwhile
+    for (size_t i = 0; i < num_tasks; i++) {
+        create_arena(&tasks[i].arena, ARENA_BLOCK_SIZE);
+    }
+    run_loader_tasks(tasks, num_tasks, intern_chunk_vertices);
+    (*graph)->vertex_names->num_symbols = num_vertices;
+    for (size_t i = 0; i < num_tasks; i++) {
+        merge_arena((*graph)->arena, tasks[i].arena);
+        free(tasks[i].arena);
+        tasks[i].arena = NULL;
+    }
+
+    // Parse the edges in parallel, every task collects the edges of its chunk in file order
+    const size_t edges_size = cursor->end - edges_begin;
+    split_text_into_chunks(edges_begin, cursor->end, tasks, num_tasks);
+    for (size_t i = 0; i < num_tasks; i++) {
+        const size_t chunk_size = tasks[i].chunk_end - tasks[i].chunk_begin;
+        const size_t chunk_edges = expected_edges > 0 && edges_size > 0
+                                       ? (size_t)((double)expected_edges * chunk_size / edges_size)
+                                       : chunk_size / 16;
+        create_edge_buffer(&tasks[i].edges, chunk_edges + 1);
+    }
+    run_loader_tasks(tasks, num_tasks, parse_chunk_edges);
+}
+
+bool dfs_topological_sort(const directed_graph_t* graph, const uint32_t src_id,
+                          traversal_state_t* visited_verts, set_t* cycle_verts, dfs_stack_t* stack,
+                          topological_order_t* top_order, size_t* num_finished) {
+    // The set holds the vertices currently on the stack, reaching one of them again means
+    // there is a cycle in the graph
+    stack->size = 0;
+    mark_visited(visited_verts, src_id);
+    set_insert(cycle_verts, src_id);
+    push_dfs_frame(stack, src_id, graph->edge_offsets[src_id]);
+    while (stack->size > 0) {
+        dfs_frame_t* top = &stack->frames[stack->size - 1];
+        if (top->edge_cursor == graph->edge_offsets[top->vert_id + 1]) {
+            // Finished vertices fill the order from the back, giving the reversed post-order
+            set_remove(cycle_verts, top->vert_id);
+            const size_t position = top_order->num_vertices - ++(*num_finished);
+            top_order->order[position] = top->vert_id;
+            top_order->positions[top->vert_id] = (uint32_t)position;
+            stack->size--;
+            continue;
+        }
+
+        const uint32_t dst_id = graph->edge_targets[top->edge_cursor++];
+        if (set_contains(cycle_verts, dst_id)) {
+            return false;
+        }
+        if (!is_visited(visited_verts, dst_id)) {
+            mark_visited(visited_verts, dst_id);
+            set_insert(cycle_verts, dst_id);
+            push_dfs_frame(stack, dst_id, graph->edge_offsets[dst_id]);
         }
-        set_remove(cycle_verts, src_vertex);
-        insert_node_at_end(&sorted_verts, src_vertex->data, src_vertex->dist);
     }
     return true;
 }
 
-bool graph_topological_sort(directed_graph_t* graph, slinked_list_t* sorted_verts_out) {
-    slinked_list_t* visited_verts;
-    set_t* cycle_verts;
-    create_slinked_list(&visited_verts);
-    create_set(&cycle_verts);
+void create_topological_order(topological_order_t** top_order, const directed_graph_t* graph,
+                              traversal_state_t* visited_verts, dfs_stack_t* stack) {
+    *top_order = (topological_order_t*)malloc(sizeof(topological_order_t));
+    (*top_order)->num_vertices = graph->num_vertices;
+    (*top_order)->is_cycle_free = true;
+    (*top_order)->mapped = false;
+    (*top_order)->order = (uint32_t*)malloc(graph->num_vertices * sizeof(uint32_t));
+    (*top_order)->positions = (uint32_t*)malloc(graph->num_vertices * sizeof(uint32_t));
 
-    bool cycle_free = true;
-    for (size_t i = 0; i < graph->num_vertices; i++) {
-        node_t* curr_vertex = graph->adjacency_lists[i]->head;
-        if (!slinked_list_contains(visited_verts, curr_vertex->data)) {
-            if (!dfs_topological_sort(graph, curr_vertex, visited_verts, cycle_verts,
-                                      sorted_verts_out)) {
-                cycle_free = false;
+    set_t* cycle_verts;
+    create_set(&cycle_verts, graph->num_vertices);
+
+    begin_traversal(visited_verts);
+    size_t num_finished = 0;
+    for (uint32_t i = 0; i < graph->num_vertices; i++) {
+        if (!is_visited(visited_verts, i)) {
+            if (!dfs_topological_sort(graph, i, visited_verts, cycle_verts, stack, *top_order,
+                                      &num_finished)) {
+                (*top_order)->is_cycle_free = false;
                 break;
             }
         }
     }
 
     // Free the heap
-    free_slinked_list(visited_verts);
     free_set(cycle_verts);
-    free(visited_verts);
     free(cycle_verts);
+}
+
+// Takes the order from the snapshot of the graph when it has one, otherwise sorts the graph
+void load_topological_order(topological_order_t** top_order, const directed_graph_t* graph) {
+    if (graph->snapshot) {
+        const mapped_file_t* file = graph->snapshot;
+        const snapshot_header_t* header = (const snapshot_header_t*)file->data;
+        const size_t order_size = graph->num_vertices * sizeof(uint32_t);
+        const uint32_t* order =
+            (const uint32_t*)snapshot_section(file, header, SNAPSHOT_TOPOLOGICAL_ORDER, order_size);
+        const uint32_t* positions = (const uint32_t*)snapshot_section(
+            file, header, SNAPSHOT_TOPOLOGICAL_POSITIONS, order_size);
+        const bool has_cycle = header->flags & SNAPSHOT_HAS_CYCLE;
+        if (order && positions && !has_cycle) {
+            // Every vertex must be found at its own position, which makes both a permutation
+            check_snapshot_ids(order, graph->num_vertices, graph->num_vertices,
+                               "topological order");
+            for (size_t i = 0; i < graph->num_vertices; i++) {
+                if (positions[order[i]] != i) {
+                    fprintf(stderr, "Snapshot has an invalid topological order\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+        if ((order && positions) || has_cycle) {
+            *top_order = (topological_order_t*)malloc(sizeof(topological_order_t));
+            (*top_order)->num_vertices = graph->num_vertices;
+            (*top_order)->is_cycle_free = !has_cycle;
+            (*top_order)->order = has_cycle ? NULL : (uint32_t*)order;
+            (*top_order)->positions = has_cycle ? NULL : (uint32_t*)positions;
+            (*top_order)->mapped = true;
+            return;
+        }
+    }
 
-    return cycle_free;
+    traversal_state_t* visited_verts = NULL;
+    create_traversal_state(&visited_verts, graph->num_vertices);
+    dfs_stack_t* stack = NULL;
+    create_dfs_stack(&stack, graph->num_vertices);
+    create_topological_order(top_order, graph, visited_verts, stack);
+    free_dfs_stack(stack);
+    free(stack);
+    free_traversal_state(visited_verts);
+    free(visited_verts);
 }
 
-int32_t get_distance(slinked_list_t* top_sorted_verts, const int32_t* distances,
-                     const char* src_vertex) {
-    int32_t c = 0;
-    for (node_t* iter = top_sorted_verts->head; iter != NULL; iter = iter->next) {
-        if (strncmp(iter->data, src_vertex, 32) == 0) {
-            break;
+void free_topological_order(topological_order_t* top_order) {
+    if (!top_order->mapped) {
+        free(top_order->order);
+        free(top_order->positions);
+    }
+    top_order->num_vertices = 0;
+}
+
+void create_query_batch(query_batch_t** batch) {
+    *batch = (query_batch_t*)malloc(sizeof(query_batch_t));
+    (*batch)->num_queries = 0;
+    (*batch)->capacity = 16;
+    (*batch)->sources = (uint32_t*)malloc((*batch)->capacity * sizeof(uint32_t));
+    (*batch)->num_distinct = 0;
+    (*batch)->distinct_sources = NULL;
+    (*batch)->source_queries = NULL;
+    (*batch)->source_slots = NULL;
+}
+
+void push_query_source(query_batch_t* batch, const uint32_t src_id) {
+    if (batch->num_queries == batch->capacity) {
+        batch->capacity *= 2;
+        batch->sources = (uint32_t*)realloc(batch->sources, batch->capacity * sizeof(uint32_t));
+    }
+    batch->sources[batch->num_queries++] = src_id;
+}
+
+// Reads one source vertex name per line, unknown vertices are reported and dropped
+void read_query_batch(query_batch_t* batch, const symbol_table_t* vertex_names, FILE* query_file) {
+    char* query_buffer = NULL;
+    size_t query_capacity = 0;
+    while (getline(&query_buffer, &query_capacity, query_file) != -1) {
+        const size_t query_len = strcspn(query_buffer, "\r\n");
+        query_buffer[query_len] = '\0';
+        const uint32_t src_id = symbol_table_find(vertex_names, query_buffer, query_len);
+        if (src_id == INVALID_VERTEX_ID) {
+            fprintf(stderr, "Unknown vertex %s\n", query_buffer);
+            continue;
         }
-        c++;
+        push_query_source(batch, src_id);
     }
-    return distances[c];
+    free(query_buffer);
 }
 
-void update_distance(slinked_list_t* top_sorted_verts, int32_t* distances, const char* src_vertex,
-                     const int32_t dist) {
-    int32_t c = 0;
-    for (node_t* iter = top_sorted_verts->head; iter != NULL; iter = iter->next) {
-        if (strncmp(iter->data, src_vertex, 32) == 0) {
-            distances[c] = dist;
-            return;
+int compare_vertex_ids(const void* lhs, const void* rhs) {
+    const uint32_t lhs_id = *(const uint32_t*)lhs;
+    const uint32_t rhs_id = *(const uint32_t*)rhs;
+    return lhs_id < rhs_id ? -1 : lhs_id > rhs_id;
+}
+
+// Groups the queries by source, so the work for a source is done once however often it is queried
+void plan_query_batch(query_batch_t* batch) {
+    const size_t num_queries = batch->num_queries;
+    batch->distinct_sources = (uint32_t*)malloc((num_queries + 1) * sizeof(uint32_t));
+    memcpy(batch->distinct_sources, batch->sources, num_queries * sizeof(uint32_t));
+    qsort(batch->distinct_sources, num_queries, sizeof(uint32_t), compare_vertex_ids);
+    size_t num_distinct = 0;
+    for (size_t i = 0; i < num_queries; i++) {
+        const uint32_t src_id = batch->distinct_sources[i];
+        if (num_distinct == 0 || batch->distinct_sources[num_distinct - 1] != src_id) {
+            batch->distinct_sources[num_distinct++] = src_id;
         }
-        c++;
+    }
+    batch->num_distinct = num_distinct;
+
+    batch->source_queries = (uint32_t*)calloc(num_distinct + 1, sizeof(uint32_t));
+    batch->source_slots = (uint32_t*)malloc((num_queries + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < num_queries; i++) {
+        const uint32_t* slot = (const uint32_t*)bsearch(&batch->sources[i], batch->distinct_sources,
+                                                        num_distinct, sizeof(uint32_t),
+                                                        compare_vertex_ids);
+        batch->source_slots[i] = (uint32_t)(slot - batch->distinct_sources);
+        batch->source_queries[batch->source_slots[i]]++;
     }
 }
 
-int32_t get_weight(directed_graph_t* graph, const node_t* u_vert, const node_t* v_vert) {
-    for (size_t i = 0; i < graph->num_vertices; i++) {
-        node_t* head = graph->adjacency_lists[i]->head;
-        if (strncmp(head->data, u_vert->data, 32) == 0) {
-            for (node_t* iter = head->next; iter != NULL; iter = iter->next) {
-                if (strncmp(iter->data, v_vert->data, 32) == 0) {
-                    return iter->dist;
-                }
-            }
+void free_query_batch(query_batch_t* batch) {
+    free(batch->sources);
+    free(batch->distinct_sources);
+    free(batch->source_queries);
+    free(batch->source_slots);
+    batch->sources = batch->distinct_sources = batch->source_queries = batch->source_slots = NULL;
+    batch->num_queries = batch->num_distinct = batch->capacity = 0;
+}
+
+int64_t get_distance(const topological_order_t* top_order, const int64_t* distances,
+                     const uint32_t vert_id) {
+    return distances[top_order->positions[vert_id]];
+}
+
+void update_distance(const topological_order_t* top_order, int64_t* distances,
+                     const uint32_t vert_id, const int64_t dist) {
+    distances[top_order->positions[vert_id]] = dist;
+}
+
+void create_distance_heap(distance_heap_t** heap, const size_t capacity) {
+    *heap = (distance_heap_t*)malloc(sizeof(distance_heap_t));
+    (*heap)->size = 0;
+    (*heap)->capacity = capacity;
+    // Offset the entries so no group of siblings straddles a cache line
+    (*heap)->storage = malloc((capacity + HEAP_ARITY) * sizeof(heap_entry_t) + 64);
+    const uintptr_t aligned = ((uintptr_t)(*heap)->storage + 63) & ~(uintptr_t)63;
+    (*heap)->entries = (heap_entry_t*)aligned + (HEAP_ARITY - 1);
+    (*heap)->indices = (uint32_t*)malloc((capacity + 1) * sizeof(uint32_t));
+    memset((*heap)->indices, 0xff, (capacity + 1) * sizeof(uint32_t));
+}
+
+void free_distance_heap(distance_heap_t* heap) {
+    free(heap->storage);
+    free(heap->indices);
+    heap->storage = NULL;
+    heap->entries = NULL;
+    heap->indices = NULL;
+    heap->size = heap->capacity = 0;
+}
+
+void place_heap_entry(distance_heap_t* heap, const size_t index, const heap_entry_t entry) {
+    heap->entries[index] = entry;
+    heap->indices[entry.vert_id] = (uint32_t)index;
+}
+
+void sift_heap_up(distance_heap_t* heap, size_t index) {
+    const heap_entry_t entry = heap->entries[index];
+    while (index > 0) {
+        const size_t parent = (index - 1) / HEAP_ARITY;
+        if (heap->entries[parent].dist <= entry.dist) {
             break;
         }
+        place_heap_entry(heap, index, heap->entries[parent]);
+        index = parent;
     }
-    return INT32_MAX - 100000;
+    place_heap_entry(heap, index, entry);
 }
 
-void run_bellman_ford_shortest_path(directed_graph_t* graph, const char* src_vertex) {
-    slinked_list_t* top_sorted_verts;
-    create_slinked_list(&top_sorted_verts);
+void sift_heap_down(distance_heap_t* heap, size_t index) {
+    const heap_entry_t entry = heap->entries[index];
+    while (true) {
+        const size_t first_child = index * HEAP_ARITY + 1;
+        if (first_child >= heap->size) {
+            break;
+        }
+        const size_t end_child =
+            first_child + HEAP_ARITY < heap->size ? first_child + HEAP_ARITY : heap->size;
+        size_t closest = first_child;
+        for (size_t child = first_child + 1; child < end_child; child++) {
+            if (heap->entries[child].dist < heap->entries[closest].dist) {
+                closest = child;
+            }
+        }
+        if (heap->entries[closest].dist >= entry.dist) {
+            break;
+        }
+        place_heap_entry(heap, index, heap->entries[closest]);
+        index = closest;
+    }
+    place_heap_entry(heap, index, entry);
+}
 
-    // Sort the graph topologically
-    bool is_cycle_free = graph_topological_sort(graph, top_sorted_verts);
-    if (!is_cycle_free) {
-        printf("Cycle detected\n");
-        return;
+// Queues the vertex, or moves it up when it is queued already with a larger distance
+void decrease_heap_key(distance_heap_t* heap, const uint32_t vert_id, const int64_t dist) {
+    size_t index = heap->indices[vert_id];
+    if (index == INVALID_HEAP_INDEX) {
+        index = heap->size++;
     }
+    heap->entries[index].dist = dist;
+    heap->entries[index].vert_id = vert_id;
+    sift_heap_up(heap, index);
+}
 
-    // Reverse the topologically sorted list
-    reverse_slinked_list(&top_sorted_verts);
+uint32_t pop_heap_min(distance_heap_t* heap) {
+    const uint32_t vert_id = heap->entries[0].vert_id;
+    heap->indices[vert_id] = INVALID_HEAP_INDEX;
+    if (--heap->size > 0) {
+        heap->entries[0] = heap->entries[heap->size];
+        sift_heap_down(heap, 0);
+    }
+    return vert_id;
+}
 
+void run_dag_shortest_path(const directed_graph_t* graph, const uint32_t src_id,
+                           const topological_order_t* top_order, int64_t* distances) {
     // Initialize the distances array to infinity
-    int32_t distances[top_sorted_verts->size];
-    for (size_t i = 0; i < graph->num_vertices; i++) {
-        distances[i] = INT32_MAX - 100000;
+    for (size_t i = 0; i < top_order->num_vertices; i++) {
+        distances[i] = INFINITE_DISTANCE;
     }
 
     // Update the source vertex to distance 0
-    update_distance(top_sorted_verts, distances, src_vertex, 0);
+    update_distance(top_order, distances, src_id, 0);
 
     // Update the rest of the distances
-    for (node_t* u_vert = top_sorted_verts->head; u_vert != NULL; u_vert = u_vert->next) {
-        const int32_t u_vert_dist = get_distance(top_sorted_verts, distances, u_vert->data);
-        for (size_t i = 0; i < graph->num_vertices; i++) {
-            if (strncmp(u_vert->data, graph->adjacency_lists[i]->head->data, 32) == 0) {
-                node_t* curr_head = graph->adjacency_lists[i]->head;
-                for (node_t* v_vert = curr_head->next; v_vert != NULL; v_vert = v_vert->next) {
-                    const int32_t v_vert_dist =
-                        get_distance(top_sorted_verts, distances, v_vert->data);
-                    const int32_t weight_u_v = get_weight(graph, u_vert, v_vert);
-                    if (v_vert_dist > u_vert_dist + weight_u_v) {
-                        update_distance(top_sorted_verts, distances, v_vert->data,
-                                        u_vert_dist + weight_u_v);
-                    }
-                }
-                break;
+    for (size_t position = 0; position < top_order->num_vertices; position++) {
+        const uint32_t u_id = top_order->order[position];
+        const int64_t u_vert_dist = distances[position];
+        // The source never reached u, a negative edge out of it must not lower INFINITE_DISTANCE
+        if (u_vert_dist == INFINITE_DISTANCE) {
+            continue;
+        }
+        for (size_t edge = graph->edge_offsets[u_id]; edge < graph->edge_offsets[u_id + 1];
+             edge++) {
+            const uint32_t v_id = graph->edge_targets[edge];
+            const int64_t v_vert_dist = get_distance(top_order, distances, v_id);
+            const int64_t candidate = u_vert_dist + graph->edge_weights[edge];
+            if (candidate < v_vert_dist) {
+                update_distance(top_order, distances, v_id, candidate);
+            }
+        }
+    }
+}
+
+bool has_negative_weights(const directed_graph_t* graph) {
+    for (size_t edge = 0; edge < graph->num_edges; edge++) {
+        if (graph->edge_weights[edge] < 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Graphs with a cycle have no topological order to relax the edges in, Dijkstra's algorithm
+// settles the vertices by distance instead. The weights must not be negative, distances are
+// indexed by vertex id
+void run_dijkstra_shortest_path(const directed_graph_t* graph, const uint32_t src_id,
+                                distance_heap_t* heap, int64_t* distances) {
+    for (size_t i = 0; i < graph->num_vertices; i++) {
+        distances[i] = INFINITE_DISTANCE;
+    }
+    distances[src_id] = 0;
+    decrease_heap_key(heap, src_id, 0);
+
+    // A settled vertex never gets a shorter distance again, so it is never queued twice
+    while (heap->size > 0) {
+        const uint32_t u_id = pop_heap_min(heap);
+        const int64_t u_vert_dist = distances[u_id];
+        for (size_t edge = graph->edge_offsets[u_id]; edge < graph->edge_offsets[u_id + 1];
+             edge++) {
+            const uint32_t v_id = graph->edge_targets[edge];
+            const int64_t candidate = u_vert_dist + graph->edge_weights[edge];
+            if (candidate < distances[v_id]) {
+                distances[v_id] = candidate;
+                decrease_heap_key(heap, v_id, candidate);
+            }
+        }
+    }
+}
+
+void create_bellman_ford_state(bellman_ford_state_t** state, const size_t capacity) {
+    *state = (bellman_ford_state_t*)malloc(sizeof(bellman_ford_state_t));
+    create_queue(&(*state)->queue, capacity);
+    create_set(&(*state)->queued, capacity);
+    (*state)->parents = (uint32_t*)malloc((capacity + 1) * sizeof(uint32_t));
+    (*state)->walk_starts = (uint32_t*)malloc((capacity + 1) * sizeof(uint32_t));
+    (*state)->cycle_length = 0;
+    (*state)->cycle = (uint32_t*)malloc((capacity + 1) * sizeof(uint32_t));
+}
+
+void free_bellman_ford_state(bellman_ford_state_t* state) {
+    free_queue(state->queue);
+    free(state->queue);
+    free_set(state->queued);
+    free(state->queued);
+    free(state->parents);
+    free(state->walk_starts);
+    free(state->cycle);
+    state->parents = state->walk_starts = state->cycle = NULL;
+    state->cycle_length = 0;
+}
+
+// Follows the parents of every reached vertex until the walk reaches the source or a vertex seen
+// before. A cycle among the parents is always negative, it is stored in the order of its edges
+bool find_negative_cycle(const directed_graph_t* graph, bellman_ford_state_t* state,
+                         const int64_t* distances) {
+    memset(state->walk_starts, 0, graph->num_vertices * sizeof(uint32_t));
+    for (uint32_t start_id = 0; start_id < graph->num_vertices; start_id++) {
+        if (distances[start_id] == INFINITE_DISTANCE || state->walk_starts[start_id] != 0) {
+            continue;
+        }
+        uint32_t vert_id = start_id;
+        while (vert_id != INVALID_VERTEX_ID && state->walk_starts[vert_id] == 0) {
+            state->walk_starts[vert_id] = start_id + 1;
+            vert_id = state->parents[vert_id];
+        }
+        if (vert_id == INVALID_VERTEX_ID || state->walk_starts[vert_id] != start_id + 1) {
+            continue;
+        }
+
+        // The walk went against the edges, so the cycle is stored back to front
+        state->cycle_length = 0;
+        uint32_t cycle_id = vert_id;
+        do {
+            state->cycle[state->cycle_length++] = cycle_id;
+            cycle_id = state->parents[cycle_id];
+        } while (cycle_id != vert_id);
+        for (size_t i = 0; i < state->cycle_length / 2; i++) {
+            const uint32_t swapped = state->cycle[i];
+            state->cycle[i] = state->cycle[state->cycle_length - 1 - i];
+            state->cycle[state->cycle_length - 1 - i] = swapped;
+        }
+        return true;
+    }
+    return false;
+}
+
+// Queue-based Bellman-Ford for graphs with a cycle and negative weights. Only the vertices whose
+// distance dropped have their edges relaxed again, so the search ends as soon as a round changes
+// nothing. A negative cycle keeps the queue from emptying, so the parents are checked for one
+// after every V relaxations, which adds O(1) per relaxation. Returns false when a negative cycle
+// is reachable from the source, which leaves the cycle in the state. Distances are indexed by
+// vertex id
+bool run_bellman_ford_shortest_path(const directed_graph_t* graph, const uint32_t src_id,
+                                    bellman_ford_state_t* state, int64_t* distances) {
+    for (size_t i = 0; i < graph->num_vertices; i++) {
+        distances[i] = INFINITE_DISTANCE;
+    }
+    distances[src_id] = 0;
+    state->parents[src_id] = INVALID_VERTEX_ID;
+    clear_queue(state->queue);
+    push_at_queue(state->queue, src_id);
+    set_insert(state->queued, src_id);
+
+    bool cycle_found = false;
+    size_t relaxations = 0;
+    while (state->queue->size > 0 && !cycle_found) {
+        const uint32_t u_id = pop_from_queue(state->queue);
+        set_remove(state->queued, u_id);
+        const int64_t u_vert_dist = distances[u_id];
+        for (size_t edge = graph->edge_offsets[u_id]; edge < graph->edge_offsets[u_id + 1];
+             edge++) {
+            const uint32_t v_id = graph->edge_targets[edge];
+            const int64_t candidate = u_vert_dist + graph->edge_weights[edge];
+            if (candidate >= distances[v_id]) {
+                continue;
+            }
+            distances[v_id] = candidate;
+            state->parents[v_id] = u_id;
+            if (set_insert(state->queued, v_id)) {
+                push_at_queue(state->queue, v_id);
             }
         }
+        relaxations += graph->edge_offsets[u_id + 1] - graph->edge_offsets[u_id];
+        if (relaxations >= graph->num_vertices) {
+            relaxations = 0;
+            cycle_found = find_negative_cycle(graph, state, distances);
+        }
     }
 
-    // Print the findings
-    int32_t c = 0;
-    for (node_t* iter = top_sorted_verts->head; iter != NULL; iter = iter->next) {
-        if (distances[c] == INT32_MAX - 100000) {
-            printf("%s INF\n", iter->data);
+    // Vertices left queued after a cycle are unmarked for the next search
+    while (state->queue->size > 0) {
+        set_remove(state->queued, pop_from_queue(state->queue));
+    }
+    return !cycle_found;
+}
 
+void print_negative_cycle(const directed_graph_t* graph, const bellman_ford_state_t* state,
+                          output_sink_t* out) {
+    sink_puts(out, "Negative cycle:");
+    for (size_t i = 0; i < state->cycle_length; i++) {
+        sink_putc(out, ' ');
+        sink_puts(out, symbol_table_name(graph->vertex_names, state->cycle[i]));
+    }
+    sink_putc(out, '\n');
+}
+
+// Prints the distances in topological order, or in the order of the vertex list when the graph
+// has a cycle and the distances are indexed by vertex id
+void print_shortest_paths(const directed_graph_t* graph, const topological_order_t* top_order,
+                          const int64_t* distances, output_sink_t* out) {
+    for (size_t position = 0; position < top_order->num_vertices; position++) {
+        const uint32_t vert_id =
+            top_order->is_cycle_free ? top_order->order[position] : (uint32_t)position;
+        sink_puts(out, symbol_table_name(graph->vertex_names, vert_id));
+        if (distances[position] == INFINITE_DISTANCE) {
+            sink_puts(out, " INF\n");
         } else {
-            printf("%s %d\n", iter->data, distances[c]);
+            sink_putc(out, ' ');
+            sink_put_int(out, distances[position]);
+            sink_putc(out, '\n');
         }
-        c++;
     }
-    printf("\n");
+    sink_putc(out, '\n');
+}
 
-    // Free the heap
-    free_slinked_list(top_sorted_verts);
-    free(top_sorted_verts);
+void process_single_source_shortest_path_queries(const directed_graph_t* graph,
+                                                 const topological_order_t* top_order,
+                                                 FILE* query_file, output_sink_t* out) {
+    // Read all queries first, so the distances from every distinct source are found only once
+    query_batch_t* batch = NULL;
+    create_query_batch(&batch);
+    read_query_batch(batch, graph->vertex_names, query_file);
+    plan_query_batch(batch);
+
+    // Distances are indexed by topological position, or by vertex id in a graph with a cycle, and
+    // reused by every query. The distances of a source are kept only while it has queries left
+    const size_t distances_size = graph->num_vertices * sizeof(int64_t);
+    int64_t* distances = (int64_t*)malloc(distances_size);
+    // A graph with a cycle is searched with the heap, or by Bellman-Ford when a weight is negative
+    distance_heap_t* heap = NULL;
+    bellman_ford_state_t* bellman_ford = NULL;
+    if (!top_order->is_cycle_free && has_negative_weights(graph)) {
+        create_bellman_ford_state(&bellman_ford, graph->num_vertices);
+    } else if (!top_order->is_cycle_free) {
+        create_distance_heap(&heap, graph->num_vertices);
+    }
+    int64_t** kept_distances = (int64_t**)calloc(batch->num_distinct + 1, sizeof(int64_t*));
+    for (size_t i = 0; i < batch->num_queries; i++) {
+        const uint32_t slot = batch->source_slots[i];
+        if (kept_distances[slot]) {
+            print_shortest_paths(graph, top_order, kept_distances[slot], out);
+        } else {
+            if (top_order->is_cycle_free) {
+                run_dag_shortest_path(graph, batch->sources[i], top_order, distances);
+            } else if (heap) {
+                run_dijkstra_shortest_path(graph, batch->sources[i], heap, distances);
+            } else if (!run_bellman_ford_shortest_path(graph, batch->sources[i], bellman_ford,
+                                                       distances)) {
+                // A source that reaches a negative cycle has no shortest paths to keep
+                print_negative_cycle(graph, bellman_ford, out);
+                sink_putc(out, '\n');
+                batch->source_queries[slot]--;
+                continue;
+            }
+            print_shortest_paths(graph, top_order, distances, out);
+            if (batch->source_queries[slot] > 1) {
+                kept_distances[slot] = (int64_t*)malloc(distances_size);
+                memcpy(kept_distances[slot], distances, distances_size);
+            }
+        }
+
+        if (--batch->source_queries[slot] == 0) {
+            free(kept_distances[slot]);
+            kept_distances[slot] = NULL;
+        }
+    }
+    free(kept_distances);
+    free(distances);
+    if (heap) {
+        free_distance_heap(heap);
+        free(heap);
+    }
+    if (bellman_ford) {
+        free_bellman_ford_state(bellman_ford);
+        free(bellman_ford);
+    }
+
+    free_query_batch(batch);
+    free(batch);
 }
 
-void process_single_source_shortest_path_queries(directed_graph_t* graph, FILE* query_file) {
-    char query_buffer[32];
-    while (fgets(query_buffer, 64, query_file) != NULL) {
-        query_buffer[strlen(query_buffer) - 1] = '\0';
-        run_bellman_ford_shortest_path(graph, query_buffer);
+// Reads the "<vertices> [<edges>]" header line, the edge count is optional and 0 when missing
+void read_graph_header(text_cursor_t* cursor, size_t* num_vertices, size_t* num_edges) {
+    text_cursor_t line;
+    if (!next_line(cursor, &line)) {
+        fprintf(stderr, "Missing graph header\n");
+        exit(EXIT_FAILURE);
+    }
+    const text_cursor_t header = line;
+
+    // Vertex ids are 32-bit and UINT32_MAX marks an invalid id, so both counts are capped there
+    const char* token;
+    size_t token_len;
+    uint64_t vertices = 0;
+    if (!next_token(&line, &token, &token_len) || !parse_count(token, token_len, &vertices) ||
+        vertices > UINT32_MAX) {
+        fprintf(stderr, "Invalid vertex count in graph header: %.*s\n",
+                (int)(header.end - header.pos), header.pos);
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t edges = 0;
+    if (next_token(&line, &token, &token_len) &&
+        (!parse_count(token, token_len, &edges) || edges > UINT32_MAX)) {
+        fprintf(stderr, "Invalid edge count in graph header: %.*s\n",
+                (int)(header.end - header.pos), header.pos);
+        exit(EXIT_FAILURE);
     }
+
+    *num_vertices = (size_t)vertices;
+    *num_edges = (size_t)edges;
 }
 
-int32_t get_number_of_vertices(FILE* graph_file) {
-    const int32_t num_vertices = fgetc(graph_file) - 48;
-    int32_t pos = ftell(graph_file);
-    fseek(graph_file, ++pos, SEEK_CUR);
-    return num_vertices;
+void write_graph_snapshot(const directed_graph_t* graph, const topological_order_t* top_order,
+                          const char* file_name) {
+    snapshot_writer_t writer;
+    const uint32_t flags = SNAPSHOT_DIRECTED | (top_order->is_cycle_free ? 0 : SNAPSHOT_HAS_CYCLE);
+    begin_snapshot(&writer, file_name, flags, graph->num_vertices, graph->num_edges);
+    write_directed_graph_sections(&writer, graph);
+    if (top_order->is_cycle_free) {
+        const size_t order_size = top_order->num_vertices * sizeof(uint32_t);
+        write_snapshot_section(&writer, SNAPSHOT_TOPOLOGICAL_ORDER, top_order->order, order_size);
+        write_snapshot_section(&writer, SNAPSHOT_TOPOLOGICAL_POSITIONS, top_order->positions,
+                               order_size);
+    }
+    end_snapshot(&writer);
+}
+
+// Parses the mapped graph text and takes over the mapping, which is released once loaded
+void load_graph_text(directed_graph_t** graph, mapped_file_t* graph_file,
+                     const size_t num_threads) {
+    text_cursor_t graph_cursor = {graph_file->data, graph_file->data + graph_file->size};
+
+    // Read the vertex count and the optional edge count from the header
+    size_t num_vertices = 0;
+    size_t num_edges = 0;
+    read_graph_header(&graph_cursor, &num_vertices, &num_edges);
+
+    // Split the text into chunks of at least LOADER_MIN_CHUNK_SIZE bytes, one per task, so
+    // small graphs are loaded on the calling thread alone
+    size_t num_tasks = 1 + (graph_cursor.end - graph_cursor.pos) / LOADER_MIN_CHUNK_SIZE;
+    if (num_tasks > num_threads) {
+        num_tasks = num_threads;
+    }
+    loader_task_t tasks[MAX_LOADER_THREADS];
+    memset(tasks, 0, sizeof(tasks));
+
+    // Create empty graph presized for the vertex count and read it
+    create_directed_graph(graph, num_vertices);
+    read_graph_from_file(graph, &graph_cursor, num_edges, tasks, num_tasks);
+
+    // The names were copied and the edges parsed, the mapping is no longer needed
+    unmap_file(graph_file);
+    free(graph_file);
+
+    // Build the CSR layout with neighbors sorted by name
+    freeze_directed_graph(*graph, tasks, num_tasks);
+    for (size_t i = 0; i < num_tasks; i++) {
+        free_edge_buffer(tasks[i].edges);
+        free(tasks[i].edges);
+    }
+}
+
+// Builds the graph from an edge stream, neither the vertex nor the edge count is known up front
+void load_graph_stream(directed_graph_t** graph, const int fd) {
+    // The name table and the edge buffer both grow by doubling as the stream goes on
+    loader_task_t task;
+    memset(&task, 0, sizeof(task));
+    create_directed_graph(graph, 0);
+    task.graph = *graph;
+    create_edge_buffer(&task.edges, 0);
+    read_edge_stream(*graph, fd, task.edges);
+    (*graph)->num_vertices = (*graph)->vertex_names->num_symbols;
+
+    // The stream has ended, build the CSR layout with neighbors sorted by name
+    freeze_directed_graph(*graph, &task, 1);
+    free_edge_buffer(task.edges);
+    free(task.edges);
 }
 
 int32_t main(int32_t argc, char** argv) {
     char *graph_file_name, *query_file_name;
-    if (argc != 3) {
-        fprintf(stderr, "Incorrect number of arguments provided\n");
-        exit(EXIT_FAILURE);
+
+    // -w <file> writes the loaded graph to a binary snapshot, which later runs can be given in
+    // place of the graph file, -j <threads> caps the threads that load graph text and -q skips
+    // printing the loaded graph
+    const char* snapshot_file_name = NULL;
+    bool print_graph = true;
+    long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t num_threads = online_cpus > 0 ? (size_t)online_cpus : 1;
+    int32_t option;
+    while ((option = getopt(argc, argv, "w:j:q")) != -1) {
+        uint64_t threads = 0;
+        if (option == 'w') {
+            snapshot_file_name = optarg;
+        } else if (option == 'q') {
+            print_graph = false;
+        } else if (option == 'j' && parse_count(optarg, strlen(optarg), &threads) && threads > 0) {
+            num_threads = (size_t)threads;
+        } else {
+            fprintf(stderr,
+                    "Usage: %s [-w snapshot_file] [-j threads] [-q] graph_file query_file\n",
+                    argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (num_threads > MAX_LOADER_THREADS) {
+        num_threads = MAX_LOADER_THREADS;
     }
 
-    graph_file_name = argv[1];
-    FILE* graph_file = fopen(graph_file_name, "r");
-    if (!graph_file) {
-        perror("fopen() failed for graph file");
+    if (argc - optind != 2) {
+        fprintf(stderr, "Incorrect number of arguments provided\n");
         exit(EXIT_FAILURE);
     }
 
-    query_file_name = argv[2];
+    graph_file_name = argv[optind];
+    query_file_name = argv[optind + 1];
     FILE* query_file = fopen(query_file_name, "r");
     if (!query_file) {
         perror("fopen() failed for query file");
         exit(EXIT_FAILURE);
     }
 
-    // Read number of vertices in graph
-    int32_t num_vertices = get_number_of_vertices(graph_file);
-
-    // Create empty graph with given number of vertices
+    // A graph file of "-" is an edge stream read from stdin, any other graph file is mapped and
+    // holds either graph text or a binary snapshot. A "shm:<name>" graph file attaches to the
+    // snapshot a "-w shm:<name>" run published
     directed_graph_t* graph = NULL;
-    create_directed_graph(&graph, (size_t)num_vertices);
-
-    // Read the graph from file
-    read_graph_from_file(&graph, graph_file);
+    if (strcmp(graph_file_name, "-") == 0) {
+        load_graph_stream(&graph, STDIN_FILENO);
+    } else {
+        mapped_file_t* graph_file = NULL;
+        map_file(&graph_file, graph_file_name);
+        if (is_graph_snapshot(graph_file)) {
+            // Snapshots are stored frozen and sorted, the graph uses the mapping in place
+            attach_directed_graph(&graph, graph_file);
+        } else {
+            load_graph_text(&graph, graph_file, num_threads);
+        }
+    }
 
-    // Sort the graph adjacency lists
-    for (int32_t i = 0; i < num_vertices; i++) {
-        sort_slinked_list(graph->adjacency_lists[i]);
+    // The graph never changes between queries, so it is sorted topologically only once
+    topological_order_t* top_order = NULL;
+    load_topological_order(&top_order, graph);
+    if (snapshot_file_name) {
+        write_graph_snapshot(graph, top_order, snapshot_file_name);
     }
 
+    // All results go through one buffered sink on stdout
+    output_sink_t* out = NULL;
+    create_output_sink(&out, STDOUT_FILENO, OUTPUT_BUFFER_SIZE);
+
     // Print the read graph
-    print_directed_graph(graph);
+    if (print_graph) {
+        print_directed_graph(graph, out);
+    }
 
     // Process queries
-    process_single_source_shortest_path_queries(graph, query_file);
-
-    // Free graph memory
+    process_single_source_shortest_path_queries(graph, top_order, query_file, out);
+    free_output_sink(out);
+    free(out);
+    free_topological_order(top_order);
+    free(top_order);
+
+    // Report allocator usage and free graph memory
+    print_allocation_stats(graph->arena);
     free_directed_graph(graph);
     free(graph);
 
     // Close files
-    fclose(graph_file);
     fclose(query_file);
 
     return 0;
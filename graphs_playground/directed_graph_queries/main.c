@@ -2,232 +2,1804 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
-typedef struct node {
-    char* vert_name;
-    int32_t dist;
-    struct node* next;
-} node_t;
+#define INVALID_VERTEX_ID UINT32_MAX
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define STREAM_BLOCK_SIZE (1 << 20)
+// Chunks of graph text below this size are not worth a thread of their own
+#define LOADER_MIN_CHUNK_SIZE (1 << 20)
+#define MAX_LOADER_THREADS 64
 
-typedef struct slinked_list {
+typedef struct arena_block {
+    struct arena_block* next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} arena_block_t;
+
+typedef struct arena {
+    arena_block_t* blocks;
+    size_t block_size;
+    size_t num_allocations;
+    size_t num_blocks;
+    size_t bytes_reserved;
+} arena_t;
+
+typedef struct symbol_table {
+    size_t num_symbols;
+    size_t names_capacity;
+    char** names;
+    // A mapped table finds its names through the offsets of the snapshot, names stays NULL then
+    const uint64_t* name_offsets;
+    const char* name_data;
+    size_t num_slots;
+    uint32_t* slots;
+    arena_t* arena;
+    // Names and slots point into a snapshot mapping, the table is read-only then
+    bool mapped;
+} symbol_table_t;
+
+typedef struct degree_rank_entry {
+    uint32_t degree;
+    uint32_t vert_id;
+} degree_rank_entry_t;
+
+// Query of a query file read up front, value is the vertex id or the k of a top-k query
+typedef struct degree_query {
+    char type;
+    uint64_t value;
+} degree_query_t;
+
+// Graph file mapped read-only into memory, the loader tokenizes it in place
+typedef struct mapped_file {
+    const char* data;
     size_t size;
-    node_t* head;
-    node_t* tail;
-} slinked_list_t;
+} mapped_file_t;
+
+// Cursor over mapped text, lines and tokens are handed out as pointers into the mapping
+typedef struct text_cursor {
+    const char* pos;
+    const char* end;
+} text_cursor_t;
+
+// Output gathered in user space and handed to the kernel with one write() per flush
+typedef struct output_sink {
+    int fd;
+    size_t used;
+    size_t capacity;
+    char* data;
+} output_sink_t;
+
+#define SNAPSHOT_MAGIC "CLABGRPH"
+// Prefix of the graph and snapshot files that are POSIX shared memory segments
+#define SHARED_MEMORY_PREFIX "shm:"
+#define SNAPSHOT_VERSION 2
+// Snapshot flags
+#define SNAPSHOT_DIRECTED 0x1
+#define SNAPSHOT_HAS_CYCLE 0x2
+// Rows keep the order their edges were listed in instead of being sorted by name
+#define SNAPSHOT_FILE_ORDER 0x4
+
+// Sections of a graph snapshot, every one is optional and a section of size 0 is absent
+typedef enum snapshot_section_id {
+    SNAPSHOT_NAME_OFFSETS,
+    SNAPSHOT_NAMES,
+    SNAPSHOT_NAME_SLOTS,
+    SNAPSHOT_EDGE_OFFSETS,
+    SNAPSHOT_EDGE_TARGETS,
+    SNAPSHOT_EDGE_WEIGHTS,
+    SNAPSHOT_NAME_RANKS,
+    SNAPSHOT_TOPOLOGICAL_ORDER,
+    SNAPSHOT_TOPOLOGICAL_POSITIONS,
+    SNAPSHOT_IN_DEGREES,
+    SNAPSHOT_OUT_DEGREES,
+    SNAPSHOT_LISTED_TARGETS,
+    SNAPSHOT_NUM_SECTIONS
+} snapshot_section_id_t;
+
+typedef struct snapshot_section {
+    uint64_t offset;
+    uint64_t size;
+} snapshot_section_t;
+
+// Sections are laid out 8-byte aligned behind the header, so they can be used in place once the
+// snapshot is mapped
+typedef struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t num_vertices;
+    uint64_t num_edges;
+    snapshot_section_t sections[SNAPSHOT_NUM_SECTIONS];
+} snapshot_header_t;
+
+// CSR offsets are used in place as size_t
+_Static_assert(sizeof(size_t) == sizeof(uint64_t), "snapshots store 64-bit offsets");
+
+typedef struct snapshot_writer {
+    FILE* file;
+    snapshot_header_t header;
+    uint64_t offset;
+    snapshot_section_id_t section;
+} snapshot_writer_t;
 
 typedef struct directed_graph {
     size_t num_vertices;
-    slinked_list_t** adjacency_lists;
+    size_t num_edges;
+    symbol_table_t* vertex_names;
+    // Owns the vertex names and the CSR arrays, released in one go
+    arena_t* arena;
+    // Frozen CSR layout, the edges of vertex i are in [edge_offsets[i], edge_offsets[i + 1])
+    size_t* edge_offsets;
+    uint32_t* edge_targets;
+    int32_t* edge_weights;
+    // Degrees counted while the edges are read, so every degree query is a lookup
+    uint32_t* in_degrees;
+    uint32_t* out_degrees;
+    // Snapshot mapping the arrays above point into, NULL for graphs parsed from text
+    mapped_file_t* snapshot;
 } directed_graph_t;
 
-void create_slinked_list(slinked_list_t** list) {
-    *list = (slinked_list_t*)malloc(sizeof(slinked_list_t));
-    (*list)->head = (*list)->tail = NULL;
-    (*list)->size = 0;
+// An edge as a loader worker parsed it, before it is placed in the CSR layout
+typedef struct edge_record {
+    uint32_t src_id;
+    uint32_t dst_id;
+    int32_t weight;
+} edge_record_t;
+
+typedef struct edge_buffer {
+    size_t size;
+    size_t capacity;
+    edge_record_t* records;
+} edge_buffer_t;
+
+// Share of one loader worker in every parallel phase of loading a graph
+typedef struct loader_task {
+    directed_graph_t* graph;
+    // Chunk of the graph text, it starts and ends on a line boundary
+    const char* chunk_begin;
+    const char* chunk_end;
+    size_t num_lines;
+    // Id of the vertex listed on the first line of the chunk
+    size_t first_vert_id;
+    // Names interned by this worker, merged into the graph arena afterwards
+    arena_t* arena;
+    // Edges of the chunk in file order and the file position of the first of them
+    edge_buffer_t* edges;
+    size_t first_edge_position;
+    // CSR rows this worker sorts
+    size_t first_row;
+    size_t end_row;
+    // Scratch arrays shared by all workers while the CSR layout is built
+    size_t* row_cursors;
+    size_t* edge_positions;
+} loader_task_t;
+
+// Neighbor of a row being put back in file order
+typedef struct row_entry {
+    uint32_t target;
+    int32_t weight;
+    size_t position;
+} row_entry_t;
+
+void create_arena(arena_t** arena, const size_t block_size) {
+    *arena = (arena_t*)malloc(sizeof(arena_t));
+    (*arena)->blocks = NULL;
+    (*arena)->block_size = block_size;
+    (*arena)->num_allocations = 0;
+    (*arena)->num_blocks = 0;
+    (*arena)->bytes_reserved = 0;
 }
 
-void insert_node_at_end(slinked_list_t** list, const char* vert_name, const int32_t dist) {
-    node_t* new_node = (node_t*)malloc(sizeof(node_t));
-    const int32_t vert_name_length = strlen(vert_name) + 1;
-    char* copy_vert_name = (char*)malloc(vert_name_length);
-    strcpy(copy_vert_name, vert_name);
-    new_node->vert_name = copy_vert_name;
-    new_node->dist = dist;
-    new_node->next = NULL;
+void* arena_alloc(arena_t* arena, const size_t size) {
+    const size_t aligned_size = (size + 7) & ~(size_t)7;
+    arena_block_t* block = arena->blocks;
+    if (block == NULL || block->used + aligned_size > block->capacity) {
+        const bool dedicated = aligned_size > arena->block_size / 4;
+        const size_t capacity = dedicated ? aligned_size : arena->block_size;
+        arena_block_t* new_block = (arena_block_t*)malloc(sizeof(arena_block_t) + capacity);
+        new_block->used = 0;
+        new_block->capacity = capacity;
 
-    if ((*list)->head == NULL) {
-        (*list)->head = new_node;
-    } else {
-        (*list)->tail->next = new_node;
+        // Large requests get a block of their own behind the current one, so the space left in
+        // the current block is still used by the small requests that follow
+        if (dedicated && block != NULL) {
+            new_block->next = block->next;
+            block->next = new_block;
+        } else {
+            new_block->next = block;
+            arena->blocks = new_block;
+        }
+        block = new_block;
+        arena->num_blocks++;
+        arena->bytes_reserved += capacity;
     }
-    (*list)->tail = new_node;
-    (*list)->size++;
+
+    void* ptr = block->data + block->used;
+    block->used += aligned_size;
+    arena->num_allocations++;
+    return ptr;
 }
 
-void free_slinked_list(slinked_list_t* list) {
-    node_t* temp = list->head;
-    while (temp) {
-        node_t* retire = temp;
-        temp = temp->next;
-        free(retire->vert_name);
+void reset_arena(arena_t* arena) {
+    arena_block_t* block = arena->blocks;
+    while (block) {
+        arena_block_t* retire = block;
+        block = block->next;
         free(retire);
     }
-    list->head = list->tail = NULL;
-    list->size = 0;
+    arena->blocks = NULL;
+}
+
+void free_arena(arena_t* arena) {
+    reset_arena(arena);
+    arena->num_allocations = arena->num_blocks = arena->bytes_reserved = 0;
+}
+
+// Moves all blocks of the other arena into this one, so they are released together
+void merge_arena(arena_t* arena, arena_t* other) {
+    if (other->blocks == NULL) {
+        return;
+    }
+    arena_block_t* tail = other->blocks;
+    while (tail->next) {
+        tail = tail->next;
+    }
+
+    // Splice the blocks in behind the current block, which keeps serving small requests
+    if (arena->blocks == NULL) {
+        arena->blocks = other->blocks;
+    } else {
+        tail->next = arena->blocks->next;
+        arena->blocks->next = other->blocks;
+    }
+    arena->num_allocations += other->num_allocations;
+    arena->num_blocks += other->num_blocks;
+    arena->bytes_reserved += other->bytes_reserved;
+    other->blocks = NULL;
+    other->num_allocations = other->num_blocks = other->bytes_reserved = 0;
+}
+
+void print_allocation_stats(const arena_t* arena) {
+    fprintf(stderr, "Arena: %zu allocations in %zu blocks (%zu bytes)\n", arena->num_allocations,
+            arena->num_blocks, arena->bytes_reserved);
+}
+
+uint64_t hash_vertex_name(const char* name, const size_t name_len) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < name_len; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+void create_symbol_table(symbol_table_t** table, const size_t expected_symbols, arena_t* arena) {
+    *table = (symbol_table_t*)malloc(sizeof(symbol_table_t));
+    (*table)->arena = arena;
+    (*table)->mapped = false;
+    (*table)->num_symbols = 0;
+    (*table)->names_capacity = expected_symbols > 0 ? expected_symbols : 16;
+    (*table)->names = (char**)malloc((*table)->names_capacity * sizeof(char*));
+    (*table)->name_offsets = NULL;
+    (*table)->name_data = NULL;
+
+    // Keep the load factor of the open addressing table at most one half
+    size_t num_slots = 16;
+    while (num_slots < 2 * (*table)->names_capacity) {
+        num_slots <<= 1;
+    }
+    (*table)->num_slots = num_slots;
+    (*table)->slots = (uint32_t*)malloc(num_slots * sizeof(uint32_t));
+    memset((*table)->slots, 0xff, num_slots * sizeof(uint32_t));
+}
+
+void free_symbol_table(symbol_table_t* table) {
+    // The names themselves live in the arena of the table or in the snapshot mapping
+    free(table->names);
+    if (!table->mapped) {
+        free(table->slots);
+    }
+    table->num_symbols = table->num_slots = 0;
+}
+
+const char* symbol_table_name(const symbol_table_t* table, const uint32_t vert_id) {
+    if (table->mapped) {
+        return table->name_data + table->name_offsets[vert_id];
+    }
+    return table->names[vert_id];
+}
+
+size_t find_symbol_slot(const symbol_table_t* table, const char* name, const size_t name_len) {
+    const size_t mask = table->num_slots - 1;
+    size_t slot = hash_vertex_name(name, name_len) & mask;
+    while (table->slots[slot] != INVALID_VERTEX_ID) {
+        const char* slot_name = symbol_table_name(table, table->slots[slot]);
+        if (strncmp(slot_name, name, name_len) == 0 && slot_name[name_len] == '\0') {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void grow_symbol_table(symbol_table_t* table) {
+    const size_t num_slots = table->num_slots << 1;
+    free(table->slots);
+    table->slots = (uint32_t*)malloc(num_slots * sizeof(uint32_t));
+    memset(table->slots, 0xff, num_slots * sizeof(uint32_t));
+    table->num_slots = num_slots;
+
+    // Rehash every interned name into the larger table
+    for (size_t i = 0; i < table->num_symbols; i++) {
+        const char* name = table->names[i];
+        table->slots[find_symbol_slot(table, name, strlen(name))] = (uint32_t)i;
+    }
+}
+
+uint32_t symbol_table_find(const symbol_table_t* table, const char* name, const size_t name_len) {
+    return table->slots[find_symbol_slot(table, name, name_len)];
+}
+
+uint32_t symbol_table_intern(symbol_table_t* table, const char* name, const size_t name_len) {
+    size_t slot = find_symbol_slot(table, name, name_len);
+    if (table->slots[slot] != INVALID_VERTEX_ID) {
+        return table->slots[slot];
+    }
+
+    if (2 * (table->num_symbols + 1) > table->num_slots) {
+        grow_symbol_table(table);
+        slot = find_symbol_slot(table, name, name_len);
+    }
+    if (table->num_symbols == table->names_capacity) {
+        table->names_capacity *= 2;
+        table->names = (char**)realloc(table->names, table->names_capacity * sizeof(char*));
+    }
+
+    char* copy_name = (char*)arena_alloc(table->arena, name_len + 1);
+    memcpy(copy_name, name, name_len);
+    copy_name[name_len] = '\0';
+
+    const uint32_t vert_id = (uint32_t)table->num_symbols++;
+    table->names[vert_id] = copy_name;
+    table->slots[slot] = vert_id;
+    return vert_id;
+}
+
+// Inserts a name under an id picked by the caller, several threads may insert at once as long as
+// the table is sized for all names up front. Returns false when the name is already in the table
+bool symbol_table_insert_concurrent(symbol_table_t* table, const char* name, const size_t name_len,
+                                    const uint32_t vert_id) {
+    // The name is published before its slot, so whoever finds the slot can compare the name
+    __atomic_store_n(&table->names[vert_id], (char*)name, __ATOMIC_RELEASE);
+
+    const size_t mask = table->num_slots - 1;
+    size_t slot = hash_vertex_name(name, name_len) & mask;
+    for (;;) {
+        uint32_t slot_id = __atomic_load_n(&table->slots[slot], __ATOMIC_ACQUIRE);
+        if (slot_id == INVALID_VERTEX_ID &&
+            __atomic_compare_exchange_n(&table->slots[slot], &slot_id, vert_id, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return true;
+        }
+
+        // The slot is taken, slot_id holds the id of its name
+        const char* slot_name = __atomic_load_n(&table->names[slot_id], __ATOMIC_ACQUIRE);
+        if (strncmp(slot_name, name, name_len) == 0 && slot_name[name_len] == '\0') {
+            return false;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+bool is_shared_memory_name(const char* file_name) {
+    return strncmp(file_name, SHARED_MEMORY_PREFIX, sizeof(SHARED_MEMORY_PREFIX) - 1) == 0;
+}
+
+// A "shm:<name>" file is the POSIX shared memory segment <name>, every process attached to it
+// maps the same pages. Its sections are checked once when they are attached and used in place from
+// then on, so the segment must come from a trusted publisher that never changes it afterwards
+void map_file(mapped_file_t** file, const char* file_name) {
+    const bool shared = is_shared_memory_name(file_name);
+    const int fd = shared ? shm_open(file_name + sizeof(SHARED_MEMORY_PREFIX) - 1, O_RDONLY, 0)
+                          : open(file_name, O_RDONLY);
+    if (fd == -1) {
+        perror(shared ? "shm_open() failed for graph segment" : "open() failed for graph file");
+        exit(EXIT_FAILURE);
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1) {
+        perror("fstat() failed for graph file");
+        exit(EXIT_FAILURE);
+    }
+
+    *file = (mapped_file_t*)malloc(sizeof(mapped_file_t));
+    (*file)->data = NULL;
+    (*file)->size = (size_t)file_stat.st_size;
+    if ((*file)->size > 0) {
+        void* data = mmap(NULL, (*file)->size, PROT_READ, shared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror("mmap() failed for graph file");
+            exit(EXIT_FAILURE);
+        }
+        // The file is read front to back exactly once
+        madvise(data, (*file)->size, MADV_SEQUENTIAL);
+        (*file)->data = (const char*)data;
+    }
+    close(fd);
+}
+
+void unmap_file(mapped_file_t* file) {
+    if (file->data) {
+        munmap((void*)file->data, file->size);
+    }
+    file->data = NULL;
+    file->size = 0;
+}
+
+// Hands out the next line without its line ending, returns false at the end of the text
+bool next_line(text_cursor_t* cursor, text_cursor_t* line) {
+    if (cursor->pos >= cursor->end) {
+        return false;
+    }
+
+    const char* line_begin = cursor->pos;
+    const char* newline = (const char*)memchr(line_begin, '\n', cursor->end - line_begin);
+    const char* line_end = newline ? newline : cursor->end;
+    cursor->pos = newline ? newline + 1 : cursor->end;
+    if (line_end > line_begin && line_end[-1] == '\r') {
+        line_end--;
+    }
+
+    line->pos = line_begin;
+    line->end = line_end;
+    return true;
+}
+
+#if defined(__x86_64__)
+// Marks every space or tab of an 8-byte word with the high bit of its byte, the lowest marked
+// byte is always a blank, marks above it may be false positives
+uint64_t blank_byte_mask(const uint64_t word) {
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t spaces = word ^ (ones * ' ');
+    const uint64_t tabs = word ^ (ones * '\t');
+    return (((spaces - ones) & ~spaces) | ((tabs - ones) & ~tabs)) & (ones * 0x80);
+}
+
+__attribute__((target("avx2"))) const char* find_blank_avx2(const char* pos, const char* end) {
+    const __m256i spaces = _mm256_set1_epi8(' ');
+    const __m256i tabs = _mm256_set1_epi8('\t');
+    while (end - pos >= 32) {
+        const __m256i block = _mm256_loadu_si256((const __m256i*)pos);
+        const uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, spaces), _mm256_cmpeq_epi8(block, tabs)));
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 32;
+    }
+    return pos;
+}
+#endif
+
+// Returns the first space or tab in [pos, end), or end when there is none. Blocks of 32, 16 and
+// 8 bytes are compared at once while they fit in the range, only the last few bytes one by one
+const char* find_blank(const char* pos, const char* end) {
+#if defined(__x86_64__)
+    // AVX2 is picked at run time, SSE2 is part of every x86-64 CPU. A search stopped on a blank
+    // finds it again right away in the next step
+    if (end - pos >= 32 && __builtin_cpu_supports("avx2")) {
+        pos = find_blank_avx2(pos, end);
+    }
+    const __m128i spaces = _mm_set1_epi8(' ');
+    const __m128i tabs = _mm_set1_epi8('\t');
+    while (end - pos >= 16) {
+        const __m128i block = _mm_loadu_si128((const __m128i*)pos);
+        const uint32_t mask = (uint32_t)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(block, spaces), _mm_cmpeq_epi8(block, tabs)));
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 16;
+    }
+    while (end - pos >= 8) {
+        uint64_t word;
+        memcpy(&word, pos, sizeof(word));
+        const uint64_t mask = blank_byte_mask(word);
+        if (mask != 0) {
+            return pos + (__builtin_ctzll(mask) >> 3);
+        }
+        pos += 8;
+    }
+#endif
+    while (pos < end && *pos != ' ' && *pos != '\t') {
+        pos++;
+    }
+    return pos;
+}
+
+// Splits the next blank separated token off the front of a line, returns false when none is left
+bool next_token(text_cursor_t* line, const char** token, size_t* token_len) {
+    // Tokens are mostly separated by a single blank, so only the token end is searched in blocks
+    const char* pos = line->pos;
+    while (pos < line->end && (*pos == ' ' || *pos == '\t')) {
+        pos++;
+    }
+    const char* token_begin = pos;
+    pos = find_blank(pos, line->end);
+
+    line->pos = pos;
+    *token = token_begin;
+    *token_len = pos - token_begin;
+    return *token_len > 0;
+}
+
+bool parse_count(const char* token, const size_t token_len, uint64_t* value) {
+    uint64_t result = 0;
+    for (size_t i = 0; i < token_len; i++) {
+        const uint32_t digit = (uint32_t)(token[i] - '0');
+        if (digit > 9 || result > (UINT64_MAX - digit) / 10) {
+            return false;
+        }
+        result = result * 10 + digit;
+    }
+    *value = result;
+    return token_len > 0;
+}
+
+bool parse_int32(const char* token, const size_t token_len, int32_t* value) {
+    size_t i = 0;
+    const bool negative = token_len > 0 && token[0] == '-';
+    if (negative || (token_len > 0 && token[0] == '+')) {
+        i++;
+    }
+
+    // Accumulate in 64 bits, a weight of more than 10 digits is out of range anyway
+    int64_t result = 0;
+    if (i == token_len || token_len - i > 10) {
+        return false;
+    }
+    for (; i < token_len; i++) {
+        const uint32_t digit = (uint32_t)(token[i] - '0');
+        if (digit > 9) {
+            return false;
+        }
+        result = result * 10 + digit;
+    }
+    if (negative) {
+        result = -result;
+    }
+    if (result < INT32_MIN || result > INT32_MAX) {
+        return false;
+    }
+    *value = (int32_t)result;
+    return true;
+}
+
+void create_output_sink(output_sink_t** sink, const int fd, const size_t capacity) {
+    *sink = (output_sink_t*)malloc(sizeof(output_sink_t));
+    (*sink)->fd = fd;
+    (*sink)->used = 0;
+    (*sink)->capacity = capacity;
+    (*sink)->data = (char*)malloc(capacity);
 }
 
-void print_slinked_list(slinked_list_t* list) {
-    for (node_t* iter = list->head; iter != NULL; iter = iter->next) {
-        printf("%s[%d] - ", iter->vert_name, iter->dist);
+void write_all(const int fd, const char* data, size_t size) {
+    // Pipes and sockets may take less than asked for, keep going until everything is out
+    while (size > 0) {
+        const ssize_t written = write(fd, data, size);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("write() failed for output");
+            exit(EXIT_FAILURE);
+        }
+        data += written;
+        size -= (size_t)written;
     }
-    printf("NULL\n");
+}
+
+void flush_output_sink(output_sink_t* sink) {
+    write_all(sink->fd, sink->data, sink->used);
+    sink->used = 0;
+}
+
+void free_output_sink(output_sink_t* sink) {
+    flush_output_sink(sink);
+    free(sink->data);
+    sink->data = NULL;
+    sink->capacity = 0;
+}
+
+void sink_write(output_sink_t* sink, const char* data, const size_t size) {
+    if (sink->used + size > sink->capacity) {
+        flush_output_sink(sink);
+        if (size > sink->capacity) {
+            write_all(sink->fd, data, size);
+            return;
+        }
+    }
+    memcpy(sink->data + sink->used, data, size);
+    sink->used += size;
+}
+
+void sink_puts(output_sink_t* sink, const char* str) {
+    sink_write(sink, str, strlen(str));
+}
+
+void sink_putc(output_sink_t* sink, const char c) {
+    if (sink->used == sink->capacity) {
+        flush_output_sink(sink);
+    }
+    sink->data[sink->used++] = c;
+}
+
+void sink_put_uint(output_sink_t* sink, uint64_t value) {
+    // Digits come out lowest first, so they are filled in from the back of the buffer
+    char digits[20];
+    size_t num_digits = 0;
+    do {
+        digits[sizeof(digits) - ++num_digits] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    sink_write(sink, digits + sizeof(digits) - num_digits, num_digits);
+}
+
+void sink_put_int(output_sink_t* sink, const int64_t value) {
+    if (value < 0) {
+        sink_putc(sink, '-');
+        sink_put_uint(sink, (uint64_t)0 - (uint64_t)value);
+    } else {
+        sink_put_uint(sink, (uint64_t)value);
+    }
+}
+
+// A "shm:<name>" snapshot is published as a new shared memory segment, processes still attached
+// to an earlier segment of that name keep theirs until they detach. The segment is created
+// read-only, so once published no one but its owner can open it for writing
+FILE* open_snapshot_file(const char* file_name) {
+    if (!is_shared_memory_name(file_name)) {
+        return fopen(file_name, "wb");
+    }
+    const char* segment_name = file_name + sizeof(SHARED_MEMORY_PREFIX) - 1;
+    shm_unlink(segment_name);
+    const int fd = shm_open(segment_name, O_CREAT | O_EXCL | O_RDWR, 0444);
+    return fd == -1 ? NULL : fdopen(fd, "wb");
+}
+
+void begin_snapshot(snapshot_writer_t* writer, const char* file_name, const uint32_t flags,
+                    const size_t num_vertices, const size_t num_edges) {
+    writer->file = open_snapshot_file(file_name);
+    if (!writer->file) {
+        perror("Opening the snapshot file failed");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&writer->header, 0, sizeof(snapshot_header_t));
+    memcpy(writer->header.magic, SNAPSHOT_MAGIC, sizeof(writer->header.magic));
+    writer->header.version = SNAPSHOT_VERSION;
+    writer->header.flags = flags;
+    writer->header.num_vertices = num_vertices;
+    writer->header.num_edges = num_edges;
+
+    // The header is written with the section table once all sections are in, until then a blank
+    // one holds its place, so a snapshot that is still being written is never taken for one
+    const snapshot_header_t blank_header = {0};
+    fwrite(&blank_header, sizeof(snapshot_header_t), 1, writer->file);
+    writer->offset = sizeof(snapshot_header_t);
+}
+
+void begin_snapshot_section(snapshot_writer_t* writer, const snapshot_section_id_t section) {
+    writer->section = section;
+    writer->header.sections[section].offset = writer->offset;
+    writer->header.sections[section].size = 0;
+}
+
+void append_snapshot_data(snapshot_writer_t* writer, const void* data, const size_t size) {
+    fwrite(data, 1, size, writer->file);
+    writer->header.sections[writer->section].size += size;
+    writer->offset += size;
+}
+
+void end_snapshot_section(snapshot_writer_t* writer) {
+    static const char padding[8] = {0};
+    const size_t padding_size = (8 - writer->offset % 8) % 8;
+    fwrite(padding, 1, padding_size, writer->file);
+    writer->offset += padding_size;
+}
+
+void write_snapshot_section(snapshot_writer_t* writer, const snapshot_section_id_t section,
+                            const void* data, const size_t size) {
+    begin_snapshot_section(writer, section);
+    append_snapshot_data(writer, data, size);
+    end_snapshot_section(writer);
+}
+
+void end_snapshot(snapshot_writer_t* writer) {
+    fseek(writer->file, 0, SEEK_SET);
+    fwrite(&writer->header, sizeof(snapshot_header_t), 1, writer->file);
+    if (ferror(writer->file) || fclose(writer->file) != 0) {
+        perror("Writing the snapshot file failed");
+        exit(EXIT_FAILURE);
+    }
+    writer->file = NULL;
+}
+
+bool is_graph_snapshot(const mapped_file_t* file) {
+    return file->size >= sizeof(snapshot_header_t) &&
+           memcmp(file->data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC) - 1) == 0;
+}
+
+// Checks the header and the section table, the attach functions check the contents of the
+// sections they use
+const snapshot_header_t* open_graph_snapshot(const mapped_file_t* file, const uint32_t flags) {
+    const snapshot_header_t* header = (const snapshot_header_t*)file->data;
+    if (header->version != SNAPSHOT_VERSION) {
+        fprintf(stderr, "Unsupported snapshot version %u\n", header->version);
+        exit(EXIT_FAILURE);
+    }
+    if ((header->flags & SNAPSHOT_DIRECTED) != (flags & SNAPSHOT_DIRECTED)) {
+        fprintf(stderr, "Snapshot holds %s graph\n",
+                header->flags & SNAPSHOT_DIRECTED ? "a directed" : "an undirected");
+        exit(EXIT_FAILURE);
+    }
+    if ((header->flags & SNAPSHOT_FILE_ORDER) != (flags & SNAPSHOT_FILE_ORDER)) {
+        fprintf(stderr, "Snapshot rows are in %s order\n",
+                header->flags & SNAPSHOT_FILE_ORDER ? "file" : "name");
+        exit(EXIT_FAILURE);
+    }
+    if (header->num_vertices > UINT32_MAX) {
+        fprintf(stderr, "Invalid vertex count in snapshot: %" PRIu64 "\n", header->num_vertices);
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < SNAPSHOT_NUM_SECTIONS; i++) {
+        const snapshot_section_t* section = &header->sections[i];
+        if (section->size > 0 &&
+            (section->offset % 8 != 0 || section->offset > file->size ||
+             section->size > file->size - section->offset)) {
+            fprintf(stderr, "Snapshot section %zu is out of bounds\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Sections are read in place, prefetch the whole mapping
+    madvise((void*)file->data, file->size, MADV_WILLNEED);
+    return header;
+}
+
+// Returns the section in the mapping, or NULL when the snapshot does not have it
+const void* snapshot_section(const mapped_file_t* file, const snapshot_header_t* header,
+                             const snapshot_section_id_t section, const size_t expected_size) {
+    if (header->sections[section].size == 0) {
+        return expected_size == 0 ? file->data + header->sections[section].offset : NULL;
+    }
+    if (header->sections[section].size != expected_size) {
+        fprintf(stderr, "Snapshot section %d has %" PRIu64 " bytes instead of %zu\n", (int)section,
+                header->sections[section].size, expected_size);
+        exit(EXIT_FAILURE);
+    }
+    return file->data + header->sections[section].offset;
+}
+
+const void* required_snapshot_section(const mapped_file_t* file, const snapshot_header_t* header,
+                                      const snapshot_section_id_t section,
+                                      const size_t expected_size) {
+    const void* data = snapshot_section(file, header, section, expected_size);
+    if (data == NULL) {
+        fprintf(stderr, "Snapshot is missing section %d\n", (int)section);
+        exit(EXIT_FAILURE);
+    }
+    return data;
+}
+
+// Stops with an error unless the offsets start at 0, never decrease and end at the given value
+void check_snapshot_offsets(const uint64_t* offsets, const size_t count, const uint64_t end,
+                            const char* table_name) {
+    bool valid = offsets[0] == 0 && offsets[count] == end;
+    for (size_t i = 0; i < count && valid; i++) {
+        valid = offsets[i] <= offsets[i + 1];
+    }
+    if (!valid) {
+        fprintf(stderr, "Snapshot has an invalid %s\n", table_name);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Stops with an error unless every id is below the limit
+void check_snapshot_ids(const uint32_t* ids, const size_t count, const size_t limit,
+                        const char* table_name) {
+    for (size_t i = 0; i < count; i++) {
+        if (ids[i] >= limit) {
+            fprintf(stderr, "Snapshot has an invalid %s\n", table_name);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// Every name must end with its terminator inside the names section and every slot must be empty
+// or hold a vertex id. No more ids than vertices leaves empty slots for every lookup to stop at
+void check_snapshot_name_table(const uint64_t* name_offsets, const char* names,
+                               const size_t num_symbols, const uint32_t* slots,
+                               const size_t num_slots) {
+    bool valid = name_offsets[0] == 0;
+    for (size_t i = 0; i < num_symbols && valid; i++) {
+        valid = name_offsets[i] < name_offsets[i + 1];
+    }
+    for (size_t i = 0; i < num_symbols && valid; i++) {
+        valid = names[name_offsets[i + 1] - 1] == '\0';
+    }
+    size_t num_filled = 0;
+    for (size_t i = 0; i < num_slots && valid; i++) {
+        if (slots[i] != INVALID_VERTEX_ID) {
+            valid = slots[i] < num_symbols;
+            num_filled++;
+        }
+    }
+    if (!valid || num_filled > num_symbols) {
+        fprintf(stderr, "Snapshot has an invalid name table\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void write_symbol_table_sections(snapshot_writer_t* writer, const symbol_table_t* table) {
+    // Names are stored back to back with their terminators and found through their offsets
+    uint64_t name_offset = 0;
+    begin_snapshot_section(writer, SNAPSHOT_NAME_OFFSETS);
+    for (size_t i = 0; i < table->num_symbols; i++) {
+        append_snapshot_data(writer, &name_offset, sizeof(uint64_t));
+        name_offset += strlen(symbol_table_name(table, (uint32_t)i)) + 1;
+    }
+    append_snapshot_data(writer, &name_offset, sizeof(uint64_t));
+    end_snapshot_section(writer);
+
+    begin_snapshot_section(writer, SNAPSHOT_NAMES);
+    for (size_t i = 0; i < table->num_symbols; i++) {
+        const char* name = symbol_table_name(table, (uint32_t)i);
+        append_snapshot_data(writer, name, strlen(name) + 1);
+    }
+    end_snapshot_section(writer);
+
+    write_snapshot_section(writer, SNAPSHOT_NAME_SLOTS, table->slots,
+                           table->num_slots * sizeof(uint32_t));
+}
+
+void attach_symbol_table(symbol_table_t** table, const mapped_file_t* file,
+                         const snapshot_header_t* header, arena_t* arena) {
+    const size_t num_symbols = header->num_vertices;
+    const uint64_t* name_offsets = (const uint64_t*)required_snapshot_section(
+        file, header, SNAPSHOT_NAME_OFFSETS, (num_symbols + 1) * sizeof(uint64_t));
+    const char* names = (const char*)required_snapshot_section(file, header, SNAPSHOT_NAMES,
+                                                               name_offsets[num_symbols]);
+
+    // The slot table is used as it is, so it must be a valid open addressing table
+    const size_t num_slots = header->sections[SNAPSHOT_NAME_SLOTS].size / sizeof(uint32_t);
+    if (num_slots <= num_symbols || (num_slots & (num_slots - 1)) != 0) {
+        fprintf(stderr, "Snapshot has an invalid name table\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const uint32_t* slots = (const uint32_t*)required_snapshot_section(
+        file, header, SNAPSHOT_NAME_SLOTS, num_slots * sizeof(uint32_t));
+    check_snapshot_name_table(name_offsets, names, num_symbols, slots, num_slots);
+
+    *table = (symbol_table_t*)malloc(sizeof(symbol_table_t));
+    (*table)->arena = arena;
+    (*table)->num_symbols = num_symbols;
+    // Names are looked up in the mapping itself, attaching copies nothing per vertex
+    (*table)->names_capacity = 0;
+    (*table)->names = NULL;
+    (*table)->name_offsets = name_offsets;
+    (*table)->name_data = names;
+    (*table)->num_slots = num_slots;
+    (*table)->slots = (uint32_t*)slots;
+    (*table)->mapped = true;
+}
+
+void create_degree_tables(directed_graph_t* graph) {
+    const size_t degrees_size = graph->num_vertices * sizeof(uint32_t);
+    graph->in_degrees = (uint32_t*)arena_alloc(graph->arena, degrees_size);
+    graph->out_degrees = (uint32_t*)arena_alloc(graph->arena, degrees_size);
+    memset(graph->in_degrees, 0, degrees_size);
+    memset(graph->out_degrees, 0, degrees_size);
 }
 
 void create_directed_graph(directed_graph_t** graph, const size_t num_vertices) {
     *graph = (directed_graph_t*)malloc(sizeof(directed_graph_t));
     (*graph)->num_vertices = num_vertices;
-    (*graph)->adjacency_lists = (slinked_list_t**)malloc(num_vertices * sizeof(slinked_list_t*));
+    (*graph)->num_edges = 0;
+    create_arena(&(*graph)->arena, ARENA_BLOCK_SIZE);
+    create_symbol_table(&(*graph)->vertex_names, num_vertices, (*graph)->arena);
+    (*graph)->snapshot = NULL;
+    (*graph)->edge_offsets = NULL;
+    (*graph)->edge_targets = NULL;
+    (*graph)->edge_weights = NULL;
+    create_degree_tables(*graph);
+}
+
+void create_edge_buffer(edge_buffer_t** buffer, const size_t capacity) {
+    *buffer = (edge_buffer_t*)malloc(sizeof(edge_buffer_t));
+    (*buffer)->size = 0;
+    (*buffer)->capacity = capacity > 0 ? capacity : 16;
+    (*buffer)->records = (edge_record_t*)malloc((*buffer)->capacity * sizeof(edge_record_t));
+}
+
+void push_edge_record(edge_buffer_t* buffer, const uint32_t src_id, const uint32_t dst_id,
+                      const int32_t weight) {
+    if (buffer->size == buffer->capacity) {
+        buffer->capacity *= 2;
+        buffer->records =
+            (edge_record_t*)realloc(buffer->records, buffer->capacity * sizeof(edge_record_t));
+    }
+    edge_record_t* record = &buffer->records[buffer->size++];
+    record->src_id = src_id;
+    record->dst_id = dst_id;
+    record->weight = weight;
+}
+
+void free_edge_buffer(edge_buffer_t* buffer) {
+    free(buffer->records);
+    buffer->records = NULL;
+    buffer->size = buffer->capacity = 0;
+}
+
+// "<u> <v> <distance>" adds an edge and "<u>" alone a vertex, a vertex is added the first time
+// the stream names it
+void add_stream_line(directed_graph_t* graph, text_cursor_t line, edge_buffer_t* edges) {
+    const text_cursor_t stream_line = line;
+    const char* edge_u;
+    const char* edge_v;
+    const char* edge_dist_text;
+    size_t len_u, len_v, len_dist;
+    if (!next_token(&line, &edge_u, &len_u)) {
+        return;
+    }
+    if (!next_token(&line, &edge_v, &len_v)) {
+        symbol_table_intern(graph->vertex_names, edge_u, len_u);
+        return;
+    }
+    int32_t edge_dist = 0;
+    if (!next_token(&line, &edge_dist_text, &len_dist) ||
+        !parse_int32(edge_dist_text, len_dist, &edge_dist)) {
+        fprintf(stderr, "Skipping malformed edge: %.*s\n", (int)(stream_line.end - stream_line.pos),
+                stream_line.pos);
+        return;
+    }
+
+    const uint32_t u_id = symbol_table_intern(graph->vertex_names, edge_u, len_u);
+    const uint32_t v_id = symbol_table_intern(graph->vertex_names, edge_v, len_v);
+    push_edge_record(edges, u_id, v_id, edge_dist);
+}
+
+// Reads the stream in blocks and parses every complete line of a block, the unfinished line at
+// its end is carried over to the next one
+void read_edge_stream(directed_graph_t* graph, const int fd, edge_buffer_t* edges) {
+    size_t capacity = STREAM_BLOCK_SIZE;
+    char* buffer = (char*)malloc(capacity);
+    size_t pending = 0;
+    bool end_of_stream = false;
+    while (!end_of_stream) {
+        if (pending == capacity) {
+            // A single line fills the whole buffer, make room for the rest of it
+            capacity *= 2;
+            buffer = (char*)realloc(buffer, capacity);
+        }
+        const ssize_t num_read = read(fd, buffer + pending, capacity - pending);
+        if (num_read == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read() failed for edge stream");
+            exit(EXIT_FAILURE);
+        }
+        end_of_stream = num_read == 0;
+
+        // Only the new bytes can hold a newline, the carried over line has none
+        const char* data_end = buffer + pending + num_read;
+        const char* lines_end = data_end;
+        if (!end_of_stream) {
+            while (lines_end > buffer + pending && lines_end[-1] != '\n') {
+                lines_end--;
+            }
+            if (lines_end == buffer + pending) {
+                lines_end = buffer;
+            }
+        }
+
+        text_cursor_t cursor = {buffer, lines_end};
+        text_cursor_t line;
+        while (next_line(&cursor, &line)) {
+            add_stream_line(graph, line, edges);
+        }
+        pending = data_end - lines_end;
+        memmove(buffer, lines_end, pending);
+    }
+    free(buffer);
+}
+
+// Runs one phase of the loader, a single task runs on the calling thread without starting any
+void run_loader_tasks(loader_task_t* tasks, const size_t num_tasks, void* (*work)(void*)) {
+    if (num_tasks == 1) {
+        work(&tasks[0]);
+        return;
+    }
+
+    pthread_t threads[MAX_LOADER_THREADS];
+    for (size_t i = 0; i < num_tasks; i++) {
+        if (pthread_create(&threads[i], NULL, work, &tasks[i]) != 0) {
+            fprintf(stderr, "pthread_create() failed for loader task\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (size_t i = 0; i < num_tasks; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+// Splits the text into one chunk per task, every chunk but the last ends right after a newline
+void split_text_into_chunks(const char* begin, const char* end, loader_task_t* tasks,
+                            const size_t num_tasks) {
+    const size_t text_size = end - begin;
+    const char* chunk_begin = begin;
+    for (size_t i = 0; i < num_tasks; i++) {
+        const char* chunk_end = end;
+        if (i + 1 < num_tasks) {
+            chunk_end = begin + text_size / num_tasks * (i + 1);
+            if (chunk_end <= chunk_begin) {
+                chunk_end = chunk_begin;
+            } else {
+                const char* newline =
+                    (const char*)memchr(chunk_end - 1, '\n', end - (chunk_end - 1));
+                chunk_end = newline ? newline + 1 : end;
+            }
+        }
+        tasks[i].chunk_begin = chunk_begin;
+        tasks[i].chunk_end = chunk_end;
+        chunk_begin = chunk_end;
+    }
+}
+
+void* count_chunk_lines(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    size_t num_lines = 0;
+    const char* pos = task->chunk_begin;
+    while ((pos = (const char*)memchr(pos, '\n', task->chunk_end - pos)) != NULL) {
+        num_lines++;
+        pos++;
+    }
+    task->num_lines = num_lines;
+    return NULL;
+}
+
+void* intern_chunk_vertices(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    text_cursor_t cursor = {task->chunk_begin, task->chunk_end};
+    text_cursor_t line;
+    for (size_t vert_id = task->first_vert_id; next_line(&cursor, &line); vert_id++) {
+        const size_t vertex_len = line.end - line.pos;
+        char* name = (char*)arena_alloc(task->arena, vertex_len + 1);
+        memcpy(name, line.pos, vertex_len);
+        name[vertex_len] = '\0';
+        if (!symbol_table_insert_concurrent(task->graph->vertex_names, name, vertex_len,
+                                            (uint32_t)vert_id)) {
+            fprintf(stderr, "Duplicate vertex %s\n", name);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return NULL;
+}
+
+void* parse_chunk_edges(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    const symbol_table_t* vertex_names = task->graph->vertex_names;
+    text_cursor_t cursor = {task->chunk_begin, task->chunk_end};
+    text_cursor_t line;
+    while (next_line(&cursor, &line)) {
+        // Tokenize "<u> <v> <distance>" in place, the names are looked up without being copied
+        const text_cursor_t edge_line = line;
+        const char* edge_u;
+        const char* edge_v;
+        const char* edge_dist_text;
+        size_t len_u, len_v, len_dist;
+        if (!next_token(&line, &edge_u, &len_u)) {
+            continue;
+        }
+        int32_t edge_dist = 0;
+        if (!next_token(&line, &edge_v, &len_v) ||
+            !next_token(&line, &edge_dist_text, &len_dist) ||
+            !parse_int32(edge_dist_text, len_dist, &edge_dist)) {
+            fprintf(stderr, "Skipping malformed edge: %.*s\n", (int)(edge_line.end - edge_line.pos),
+                    edge_line.pos);
+            continue;
+        }
+
+        // Resolve both vertices to their ids
+        const uint32_t u_id = symbol_table_find(vertex_names, edge_u, len_u);
+        const uint32_t v_id = symbol_table_find(vertex_names, edge_v, len_v);
+        if (u_id == INVALID_VERTEX_ID || v_id == INVALID_VERTEX_ID) {
+            fprintf(stderr, "Skipping edge with unknown vertex: %.*s\n",
+                    (int)(edge_line.end - edge_line.pos), edge_line.pos);
+            continue;
+        }
+
+        push_edge_record(task->edges, u_id, v_id, edge_dist);
+    }
+    return NULL;
+}
+
+// Counts the edges of every row into edge_offsets[row + 1]
+void* count_chunk_degrees(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    size_t* row_sizes = task->graph->edge_offsets + 1;
+    for (size_t i = 0; i < task->edges->size; i++) {
+        const edge_record_t* record = &task->edges->records[i];
+        __atomic_fetch_add(&row_sizes[record->src_id], 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&task->graph->in_degrees[record->dst_id], 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+// Places every edge in the row of its source, in no particular order within the row
+void* scatter_chunk_edges(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    directed_graph_t* graph = task->graph;
+    for (size_t i = 0; i < task->edges->size; i++) {
+        const edge_record_t* record = &task->edges->records[i];
+        const size_t position = task->first_edge_position + i;
+        const size_t edge = __atomic_fetch_add(&task->row_cursors[record->src_id], 1,
+                                               __ATOMIC_RELAXED);
+        graph->edge_targets[edge] = record->dst_id;
+        graph->edge_weights[edge] = record->weight;
+        task->edge_positions[edge] = position;
+    }
+    return NULL;
+}
+
+int compare_row_entries(const void* lhs, const void* rhs) {
+    const row_entry_t* lhs_entry = (const row_entry_t*)lhs;
+    const row_entry_t* rhs_entry = (const row_entry_t*)rhs;
+    if (lhs_entry->position != rhs_entry->position) {
+        return lhs_entry->position < rhs_entry->position ? -1 : 1;
+    }
+    return 0;
+}
+
+// Puts the rows of the task back in the order their edges were listed, which the concurrent scatter
+// does not keep. This tool prints rows as listed, so unlike the traversal tools it never sorts them
+// by name
+void* sort_chunk_rows(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    directed_graph_t* graph = task->graph;
+    row_entry_t* entries = NULL;
+    size_t entries_capacity = 0;
+    for (size_t row = task->first_row; row < task->end_row; row++) {
+        const size_t row_begin = graph->edge_offsets[row];
+        const size_t row_size = graph->edge_offsets[row + 1] - row_begin;
+        // Rows whose edges all came from one task are already in order
+        const size_t* positions = &task->edge_positions[row_begin];
+        bool in_file_order = true;
+        for (size_t i = 1; i < row_size && in_file_order; i++) {
+            in_file_order = positions[i - 1] < positions[i];
+        }
+        if (in_file_order) {
+            continue;
+        }
+        if (row_size > entries_capacity) {
+            entries_capacity = row_size;
+            entries = (row_entry_t*)realloc(entries, entries_capacity * sizeof(row_entry_t));
+        }
+
+        for (size_t i = 0; i < row_size; i++) {
+            entries[i].target = graph->edge_targets[row_begin + i];
+            entries[i].weight = graph->edge_weights[row_begin + i];
+            entries[i].position = positions[i];
+        }
+        qsort(entries, row_size, sizeof(row_entry_t), compare_row_entries);
+        for (size_t i = 0; i < row_size; i++) {
+            graph->edge_targets[row_begin + i] = entries[i].target;
+            graph->edge_weights[row_begin + i] = entries[i].weight;
+        }
+    }
+    free(entries);
+    return NULL;
+}
+
+// Builds the CSR layout from the edges the loader tasks parsed, with every row in file order
+void freeze_directed_graph(directed_graph_t* graph, loader_task_t* tasks, const size_t num_tasks) {
+    const size_t num_vertices = graph->num_vertices;
+    graph->edge_offsets = (size_t*)arena_alloc(graph->arena, (num_vertices + 1) * sizeof(size_t));
+    memset(graph->edge_offsets, 0, (num_vertices + 1) * sizeof(size_t));
+    run_loader_tasks(tasks, num_tasks, count_chunk_degrees);
     for (size_t i = 0; i < num_vertices; i++) {
-        create_slinked_list(&(*graph)->adjacency_lists[i]);
+        graph->edge_offsets[i + 1] += graph->edge_offsets[i];
     }
+    for (size_t i = 0; i < num_vertices; i++) {
+        graph->out_degrees[i] = (uint32_t)(graph->edge_offsets[i + 1] - graph->edge_offsets[i]);
+    }
+
+    graph->num_edges = graph->edge_offsets[num_vertices];
+    graph->edge_targets =
+        (uint32_t*)arena_alloc(graph->arena, graph->num_edges * sizeof(uint32_t));
+    graph->edge_weights = (int32_t*)arena_alloc(graph->arena, graph->num_edges * sizeof(int32_t));
+
+    // Every task scatters its edges through the shared row cursors and tags each with its
+    // position in the file, which the row sort uses to keep the result independent of timing
+    size_t* row_cursors = (size_t*)malloc((num_vertices + 1) * sizeof(size_t));
+    memcpy(row_cursors, graph->edge_offsets, (num_vertices + 1) * sizeof(size_t));
+    size_t* edge_positions = (size_t*)malloc((graph->num_edges + 1) * sizeof(size_t));
+    size_t first_edge_position = 0;
+    for (size_t i = 0; i < num_tasks; i++) {
+        tasks[i].row_cursors = row_cursors;
+        tasks[i].edge_positions = edge_positions;
+        tasks[i].first_edge_position = first_edge_position;
+        first_edge_position += tasks[i].edges->size;
+    }
+    run_loader_tasks(tasks, num_tasks, scatter_chunk_edges);
+
+    // Give every task a run of rows holding about the same number of edges to sort
+    size_t row = 0;
+    for (size_t i = 0; i < num_tasks; i++) {
+        const size_t edges_end = graph->num_edges / num_tasks * (i + 1);
+        tasks[i].first_row = row;
+        const bool last_task = i + 1 == num_tasks;
+        while (row < num_vertices && (last_task || graph->edge_offsets[row + 1] <= edges_end)) {
+            row++;
+        }
+        tasks[i].end_row = row;
+    }
+    run_loader_tasks(tasks, num_tasks, sort_chunk_rows);
+
+    free(edge_positions);
+    free(row_cursors);
 }
 
 void free_directed_graph(directed_graph_t* graph) {
-    for (size_t i = 0; i < graph->num_vertices; i++) {
-        free_slinked_list(graph->adjacency_lists[i]);
-        free(graph->adjacency_lists[i]);
+    free_symbol_table(graph->vertex_names);
+    free(graph->vertex_names);
+    free_arena(graph->arena);
+    free(graph->arena);
+    if (graph->snapshot) {
+        unmap_file(graph->snapshot);
+        free(graph->snapshot);
     }
-    free(graph->adjacency_lists);
-    graph->num_vertices = 0;
+    graph->num_vertices = graph->num_edges = 0;
 }
 
-void print_directed_graph(directed_graph_t* graph) {
+void write_directed_graph_sections(snapshot_writer_t* writer, const directed_graph_t* graph) {
+    write_symbol_table_sections(writer, graph->vertex_names);
+    write_snapshot_section(writer, SNAPSHOT_EDGE_OFFSETS, graph->edge_offsets,
+                           (graph->num_vertices + 1) * sizeof(size_t));
+    write_snapshot_section(writer, SNAPSHOT_EDGE_TARGETS, graph->edge_targets,
+                           graph->num_edges * sizeof(uint32_t));
+    write_snapshot_section(writer, SNAPSHOT_EDGE_WEIGHTS, graph->edge_weights,
+                           graph->num_edges * sizeof(int32_t));
+}
+
+void attach_directed_graph(directed_graph_t** graph, mapped_file_t* file) {
+    const snapshot_header_t* header =
+        open_graph_snapshot(file, SNAPSHOT_DIRECTED | SNAPSHOT_FILE_ORDER);
+    const size_t num_vertices = header->num_vertices;
+    const size_t num_edges = header->num_edges;
+
+    *graph = (directed_graph_t*)malloc(sizeof(directed_graph_t));
+    (*graph)->num_vertices = num_vertices;
+    (*graph)->num_edges = num_edges;
+    create_arena(&(*graph)->arena, ARENA_BLOCK_SIZE);
+    attach_symbol_table(&(*graph)->vertex_names, file, header, (*graph)->arena);
+
+    // The CSR arrays are used in place, the graph owns the mapping from now on
+    (*graph)->edge_offsets = (size_t*)required_snapshot_section(
+        file, header, SNAPSHOT_EDGE_OFFSETS, (num_vertices + 1) * sizeof(size_t));
+    (*graph)->edge_targets = (uint32_t*)required_snapshot_section(
+        file, header, SNAPSHOT_EDGE_TARGETS, num_edges * sizeof(uint32_t));
+    (*graph)->edge_weights = (int32_t*)required_snapshot_section(
+        file, header, SNAPSHOT_EDGE_WEIGHTS, num_edges * sizeof(int32_t));
+    check_snapshot_offsets((const uint64_t*)(*graph)->edge_offsets, num_vertices, num_edges,
+                           "edge table");
+    check_snapshot_ids((*graph)->edge_targets, num_edges, num_vertices, "edge table");
+
+    // Degrees are used in place when the snapshot has them, otherwise counted from the CSR arrays
+    const size_t degrees_size = num_vertices * sizeof(uint32_t);
+    (*graph)->in_degrees =
+        (uint32_t*)snapshot_section(file, header, SNAPSHOT_IN_DEGREES, degrees_size);
+    (*graph)->out_degrees =
+        (uint32_t*)snapshot_section(file, header, SNAPSHOT_OUT_DEGREES, degrees_size);
+    if ((*graph)->in_degrees && (*graph)->out_degrees) {
+        // Out-degrees must match the rows and in-degrees add up to the edges
+        uint64_t in_degrees_sum = 0;
+        bool valid = true;
+        for (size_t i = 0; i < num_vertices && valid; i++) {
+            valid = (*graph)->out_degrees[i] ==
+                    (*graph)->edge_offsets[i + 1] - (*graph)->edge_offsets[i];
+            in_degrees_sum += (*graph)->in_degrees[i];
+        }
+        if (!valid || in_degrees_sum != num_edges) {
+            fprintf(stderr, "Snapshot has an invalid degree table\n");
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        (*graph)->in_degrees = (uint32_t*)arena_alloc((*graph)->arena, degrees_size);
+        (*graph)->out_degrees = (uint32_t*)arena_alloc((*graph)->arena, degrees_size);
+        memset((*graph)->in_degrees, 0, degrees_size);
+        for (size_t i = 0; i < num_vertices; i++) {
+            (*graph)->out_degrees[i] =
+                (uint32_t)((*graph)->edge_offsets[i + 1] - (*graph)->edge_offsets[i]);
+        }
+        for (size_t edge = 0; edge < num_edges; edge++) {
+            (*graph)->in_degrees[(*graph)->edge_targets[edge]]++;
+        }
+    }
+    (*graph)->snapshot = file;
+}
+
+void print_directed_graph(const directed_graph_t* graph, output_sink_t* out) {
     const size_t graph_size = graph->num_vertices;
-    printf("Ordered graph size: %llu\n", graph_size);
+    const int32_t head_dist = -1;
+    sink_puts(out, "Ordered graph size: ");
+    sink_put_uint(out, graph_size);
+    sink_putc(out, '\n');
     for (size_t i = 0; i < graph_size; i++) {
-        print_slinked_list(graph->adjacency_lists[i]);
+        sink_puts(out, symbol_table_name(graph->vertex_names, (uint32_t)i));
+        sink_putc(out, '[');
+        sink_put_int(out, head_dist);
+        sink_puts(out, "] - ");
+        for (size_t edge = graph->edge_offsets[i]; edge < graph->edge_offsets[i + 1]; edge++) {
+            sink_puts(out, symbol_table_name(graph->vertex_names, graph->edge_targets[edge]));
+            sink_putc(out, '[');
+            sink_put_int(out, graph->edge_weights[edge]);
+            sink_puts(out, "] - ");
+        }
+        sink_puts(out, "NULL\n");
     }
 }
 
-void read_directed_graph_from_file(directed_graph_t** graph, FILE* graph_file) {
-    for (size_t i = 0; i < (*graph)->num_vertices; i++) {
-        char vertex_buffer[64];
-        fgets(vertex_buffer, 64, graph_file);
-        vertex_buffer[strlen(vertex_buffer) - 1] = '\0';
-        const int32_t head_dist = -1;
-        insert_node_at_end(&(*graph)->adjacency_lists[i], vertex_buffer, head_dist);
+// Reads the vertex and edge lists with one loader task per chunk of the text
+void read_directed_graph_from_file(directed_graph_t** graph, text_cursor_t* cursor,
+                                   const size_t expected_edges, loader_task_t* tasks,
+                                   const size_t num_tasks) {
+    for (size_t i = 0; i < num_tasks; i++) {
+        tasks[i].graph = *graph;
     }
 
-    char edge_buffer[64];
-    while (fgets(edge_buffer, 64, graph_file) != NULL) {
-        edge_buffer[strlen(edge_buffer) - 1] = '\0';
-        char edge_u[32];
-        char edge_v[32];
+    // Vertex ids are assigned in the order the vertices are listed, so the lines are counted
+    // first to give every chunk the ids of its vertices and to find where the edges begin
+    const size_t num_vertices = (*graph)->num_vertices;
+    split_text_into_chunks(cursor->pos, cursor->end, tasks, num_tasks);
+    run_loader_tasks(tasks, num_tasks, count_chunk_lines);
+    size_t vert_id = 0;
+    const char* edges_begin = cursor->end;
+    for (size_t i = 0; i < num_tasks; i++) {
+        tasks[i].first_vert_id = vert_id;
+        if (vert_id + tasks[i].num_lines < num_vertices) {
+            vert_id += tasks[i].num_lines;
+            continue;
+        }
 
-        // Get the lenght of the name of the first vertex
-        int32_t len_name_first_edge = 0;
-        while (edge_buffer[len_name_first_edge] != ' ') {
-            ++len_name_first_edge;
+        // The vertex list ends in this chunk, cut it right after the last vertex
+        const char* pos = tasks[i].chunk_begin;
+        for (; vert_id < num_vertices; vert_id++) {
+            pos = (const char*)memchr(pos, '\n', tasks[i].chunk_end - pos) + 1;
+        }
+        edges_begin = tasks[i].chunk_end = pos;
+        for (size_t j = i + 1; j < num_tasks; j++) {
+            tasks[j].chunk_begin = tasks[j].chunk_end = pos;
+            tasks[j].first_vert_id = num_vertices;
         }
-        // Get the lenght of the name of the second vertex
-        int32_t len_name_second_edge = 0;
-        while (edge_buffer[len_name_first_edge + len_name_second_edge + 1] != ' ') {
-            ++len_name_second_edge;
+        break;
+    }
+    if (vert_id < num_vertices) {
+        // The last line of the file may lack its newline
+        const bool unterminated_line = cursor->end > cursor->pos && cursor->end[-1] != '\n';
+        if (vert_id + unterminated_line < num_vertices) {
+            fprintf(stderr, "Expected %zu vertices, the graph file has only %zu\n", num_vertices,
+                    vert_id + unterminated_line);
+            exit(EXIT_FAILURE);
         }
+    }
 
-        // Get the distance between both vertices
-        int32_t edge_dist = 0;
-        sscanf(&edge_buffer[len_name_first_edge + len_name_second_edge + 2], "%d", &edge_dist);
+    // Intern the names in parallel, the table is presized so it never grows meanwhile
+    for (size_t i = 0; i < num_tasks; i++) {
+        create_arena(&tasks[i].arena, ARENA_BLOCK_SIZE);
+    }
+    run_loader_tasks(tasks, num_tasks, intern_chunk_vertices);
+    (*graph)->vertex_names->num_symbols = num_vertices;
+    for (size_t i = 0; i < num_tasks; i++) {
+        merge_arena((*graph)->arena, tasks[i].arena);
+        free(tasks[i].arena);
+        tasks[i].arena = NULL;
+    }
 
-        // Read the first vertex
-        for (int32_t i = 0; i < len_name_first_edge; i++) {
-            edge_u[i] = edge_buffer[i];
-        }
-        edge_u[len_name_first_edge] = '\0';
+    // Parse the edges in parallel, every task collects the edges of its chunk in file order
+    const size_t edges_size = cursor->end - edges_begin;
+    split_text_into_chunks(edges_begin, cursor->end, tasks, num_tasks);
+    for (size_t i = 0; i < num_tasks; i++) {
+        const size_t chunk_size = tasks[i].chunk_end - tasks[i].chunk_begin;
+        const size_t chunk_edges = expected_edges > 0 && edges_size > 0
+                                       ? (size_t)((double)expected_edges * chunk_size / edges_size)
+                                       : chunk_size / 16;
+        create_edge_buffer(&tasks[i].edges, chunk_edges + 1);
+    }
+    run_loader_tasks(tasks, num_tasks, parse_chunk_edges);
+}
 
-        // Read the second vertex
-        for (int32_t i = 0; i < len_name_second_edge; i++) {
-            edge_v[i] = edge_buffer[i + len_name_first_edge + 1];
-        }
-        edge_v[len_name_second_edge] = '\0';
+int compare_degree_rank_entries(const void* lhs, const void* rhs) {
+    const degree_rank_entry_t* lhs_entry = (const degree_rank_entry_t*)lhs;
+    const degree_rank_entry_t* rhs_entry = (const degree_rank_entry_t*)rhs;
+    // Highest degree first, ties keep the order in which the vertices are listed
+    if (lhs_entry->degree != rhs_entry->degree) {
+        return lhs_entry->degree > rhs_entry->degree ? -1 : 1;
+    }
+    return lhs_entry->vert_id < rhs_entry->vert_id ? -1 : 1;
+}
 
-        // Insert the second vertex into the adjacency list of the first
-        for (size_t i = 0; i < (*graph)->num_vertices; i++) {
-            const char* curr_list_head = (*graph)->adjacency_lists[i]->head->vert_name;
-            if (strncmp(curr_list_head, edge_u, 32) == 0) {
-                insert_node_at_end(&(*graph)->adjacency_lists[i], edge_v, edge_dist);
-                break;
+// Returns the k highest ranked vertices in rank order, they are selected through a heap with the
+// lowest ranked of them on top, so only k entries are ever sorted
+degree_rank_entry_t* rank_vertices_by_degree(const directed_graph_t* graph,
+                                             const uint32_t* degrees, const size_t k) {
+    degree_rank_entry_t* entries =
+        (degree_rank_entry_t*)malloc((k + 1) * sizeof(degree_rank_entry_t));
+    size_t size = 0;
+    for (size_t i = 0; i < graph->num_vertices && k > 0; i++) {
+        const degree_rank_entry_t entry = {degrees[i], (uint32_t)i};
+        size_t pos;
+        if (size < k) {
+            pos = size++;
+            while (pos > 0 && compare_degree_rank_entries(&entry, &entries[(pos - 1) / 2]) > 0) {
+                entries[pos] = entries[(pos - 1) / 2];
+                pos = (pos - 1) / 2;
+            }
+        } else if (compare_degree_rank_entries(&entry, &entries[0]) < 0) {
+            // The entry outranks the lowest kept one, sink it down from the top in its place
+            pos = 0;
+            for (;;) {
+                size_t lowest = 2 * pos + 1;
+                if (lowest >= size) {
+                    break;
+                }
+                if (lowest + 1 < size &&
+                    compare_degree_rank_entries(&entries[lowest + 1], &entries[lowest]) > 0) {
+                    lowest++;
+                }
+                if (compare_degree_rank_entries(&entries[lowest], &entry) < 0) {
+                    break;
+                }
+                entries[pos] = entries[lowest];
+                pos = lowest;
             }
+        } else {
+            continue;
         }
+        entries[pos] = entry;
     }
+    qsort(entries, size, sizeof(degree_rank_entry_t), compare_degree_rank_entries);
+    return entries;
 }
 
-void process_query(directed_graph_t* graph, FILE* query_file) {
-    char query_buffer[64];
-    while (fgets(query_buffer, 64, query_file) != NULL) {
-        size_t buffer_len = strlen(query_buffer);
-        query_buffer[buffer_len - 1] = '\0';
+void print_top_degrees(const directed_graph_t* graph, const degree_rank_entry_t* ranking,
+                       const char* degree_kind, size_t k, output_sink_t* out) {
+    if (k > graph->num_vertices) {
+        k = graph->num_vertices;
+    }
+    sink_puts(out, "Top ");
+    sink_put_uint(out, k);
+    sink_puts(out, " vertices by ");
+    sink_puts(out, degree_kind);
+    sink_puts(out, " degree:\n");
+    for (size_t i = 0; i < k; i++) {
+        sink_puts(out, symbol_table_name(graph->vertex_names, ranking[i].vert_id));
+        sink_puts(out, ": ");
+        sink_put_uint(out, ranking[i].degree);
+        sink_putc(out, '\n');
+    }
+}
+
+void push_degree_query(degree_query_t** queries, size_t* num_queries, size_t* capacity,
+                       const char type, const uint64_t value) {
+    if (*num_queries == *capacity) {
+        *capacity = *capacity > 0 ? 2 * *capacity : 16;
+        *queries = (degree_query_t*)realloc(*queries, *capacity * sizeof(degree_query_t));
+    }
+    (*queries)[*num_queries].type = type;
+    (*queries)[*num_queries].value = value;
+    (*num_queries)++;
+}
+
+// Query types: "o <vertex>" and "i <vertex>" print one degree, "t" prints the degree table
+// of all vertices and "I <k>" / "O <k>" the k vertices with the highest in / out degree
+void process_query(const directed_graph_t* graph, FILE* query_file, output_sink_t* out) {
+    // Read all queries first, so every top-k query of a kind is served by a single ranking
+    // that is as long as the largest k asked for
+    degree_query_t* queries = NULL;
+    size_t num_queries = 0;
+    size_t queries_capacity = 0;
+    size_t max_in_k = 0;
+    size_t max_out_k = 0;
+
+    char* query_buffer = NULL;
+    size_t query_capacity = 0;
+    while (getline(&query_buffer, &query_capacity, query_file) != -1) {
+        const size_t query_len = strcspn(query_buffer, "\r\n");
+        query_buffer[query_len] = '\0';
 
         // Get the query type
         char query = query_buffer[0];
-        char vertex[64];
-        sscanf(&query_buffer[2], "%s", vertex);
-
-        if (query == 'o') {
-            for (size_t i = 0; i < graph->num_vertices; i++) {
-                char* curr_head_vertex = graph->adjacency_lists[i]->head->vert_name;
-                if (strncmp(curr_head_vertex, vertex, 64) == 0) {
-                    printf("Out degree of vertex %s: %llu\n", vertex,
-                           graph->adjacency_lists[i]->size - 1);
-                    break;
-                }
+        if (query == 't') {
+            push_degree_query(&queries, &num_queries, &queries_capacity, query, 0);
+            continue;
+        }
+
+        if (query == 'I' || query == 'O') {
+            text_cursor_t query_line = {&query_buffer[1], query_buffer + query_len};
+            const char* k_text;
+            size_t k_len;
+            uint64_t k = 0;
+            if (!next_token(&query_line, &k_text, &k_len) || !parse_count(k_text, k_len, &k)) {
+                continue;
             }
-        } else if (query == 'i') {
-            int32_t in_degree = 0;
-            for (size_t i = 0; i < graph->num_vertices; i++) {
-                for (node_t* iter = graph->adjacency_lists[i]->head; iter != NULL;
-                     iter = iter->next) {
-                    if (strncmp(iter->vert_name, vertex, 64) == 0) {
-                        in_degree++;
-                    }
-                }
+            if (k > graph->num_vertices) {
+                k = graph->num_vertices;
+            }
+            size_t* max_k = query == 'I' ? &max_in_k : &max_out_k;
+            if (k > *max_k) {
+                *max_k = (size_t)k;
             }
-            printf("In degree of vertex %s: %d\n", vertex, in_degree - 1);
+            push_degree_query(&queries, &num_queries, &queries_capacity, query, k);
+            continue;
+        }
+
+        // The vertex name is the first token after the query type, of any length
+        char* vertex = &query_buffer[1] + strspn(&query_buffer[1], " ");
+        const size_t vertex_len = strcspn(vertex, " ");
+        if (vertex_len == 0) {
+            continue;
+        }
+        vertex[vertex_len] = '\0';
+
+        const uint32_t vert_id = symbol_table_find(graph->vertex_names, vertex, vertex_len);
+        if (vert_id == INVALID_VERTEX_ID) {
+            fprintf(stderr, "Unknown vertex %s\n", vertex);
+            continue;
+        }
+        if (query == 'o' || query == 'i') {
+            push_degree_query(&queries, &num_queries, &queries_capacity, query, vert_id);
         }
     }
+    free(query_buffer);
+
+    degree_rank_entry_t* in_degree_ranking =
+        rank_vertices_by_degree(graph, graph->in_degrees, max_in_k);
+    degree_rank_entry_t* out_degree_ranking =
+        rank_vertices_by_degree(graph, graph->out_degrees, max_out_k);
+
+    // Answer the queries in the order they were given
+    for (size_t i = 0; i < num_queries; i++) {
+        const degree_query_t* query = &queries[i];
+        if (query->type == 't') {
+            // Full degree table in vertex order
+            sink_puts(out, "Degree table:\n");
+            for (size_t vert_id = 0; vert_id < graph->num_vertices; vert_id++) {
+                sink_puts(out, symbol_table_name(graph->vertex_names, (uint32_t)vert_id));
+                sink_puts(out, ": in ");
+                sink_put_uint(out, graph->in_degrees[vert_id]);
+                sink_puts(out, ", out ");
+                sink_put_uint(out, graph->out_degrees[vert_id]);
+                sink_putc(out, '\n');
+            }
+        } else if (query->type == 'I') {
+            print_top_degrees(graph, in_degree_ranking, "in", (size_t)query->value, out);
+        } else if (query->type == 'O') {
+            print_top_degrees(graph, out_degree_ranking, "out", (size_t)query->value, out);
+        } else {
+            const uint32_t vert_id = (uint32_t)query->value;
+            const bool out_degree = query->type == 'o';
+            const uint32_t* degrees = out_degree ? graph->out_degrees : graph->in_degrees;
+            sink_puts(out, out_degree ? "Out degree of vertex " : "In degree of vertex ");
+            sink_puts(out, symbol_table_name(graph->vertex_names, vert_id));
+            sink_puts(out, ": ");
+            sink_put_uint(out, degrees[vert_id]);
+            sink_putc(out, '\n');
+        }
+    }
+    free(queries);
+
+    free(in_degree_ranking);
+    free(out_degree_ranking);
+}
+
+// Reads the "<vertices> [<edges>]" header line, the edge count is optional and 0 when missing
+void read_graph_header(text_cursor_t* cursor, size_t* num_vertices, size_t* num_edges) {
+    text_cursor_t line;
+    if (!next_line(cursor, &line)) {
+        fprintf(stderr, "Missing graph header\n");
+        exit(EXIT_FAILURE);
+    }
+    const text_cursor_t header = line;
+
+    // Vertex ids are 32-bit and UINT32_MAX marks an invalid id, so both counts are capped there
+    const char* token;
+    size_t token_len;
+    uint64_t vertices = 0;
+    if (!next_token(&line, &token, &token_len) || !parse_count(token, token_len, &vertices) ||
+        vertices > UINT32_MAX) {
+        fprintf(stderr, "Invalid vertex count in graph header: %.*s\n",
+                (int)(header.end - header.pos), header.pos);
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t edges = 0;
+    if (next_token(&line, &token, &token_len) &&
+        (!parse_count(token, token_len, &edges) || edges > UINT32_MAX)) {
+        fprintf(stderr, "Invalid edge count in graph header: %.*s\n",
+                (int)(header.end - header.pos), header.pos);
+        exit(EXIT_FAILURE);
+    }
+
+    *num_vertices = (size_t)vertices;
+    *num_edges = (size_t)edges;
+}
+
+void write_graph_snapshot(const directed_graph_t* graph, const char* file_name) {
+    snapshot_writer_t writer;
+    begin_snapshot(&writer, file_name, SNAPSHOT_DIRECTED | SNAPSHOT_FILE_ORDER, graph->num_vertices,
+                   graph->num_edges);
+    write_directed_graph_sections(&writer, graph);
+    const size_t degrees_size = graph->num_vertices * sizeof(uint32_t);
+    write_snapshot_section(&writer, SNAPSHOT_IN_DEGREES, graph->in_degrees, degrees_size);
+    write_snapshot_section(&writer, SNAPSHOT_OUT_DEGREES, graph->out_degrees, degrees_size);
+    end_snapshot(&writer);
+}
+
+// Parses the mapped graph text and takes over the mapping, which is released once loaded
+void load_graph_text(directed_graph_t** graph, mapped_file_t* graph_file,
+                     const size_t num_threads) {
+    text_cursor_t graph_cursor = {graph_file->data, graph_file->data + graph_file->size};
+
+    // Read the vertex count and the optional edge count from the header
+    size_t num_vertices = 0;
+    size_t num_edges = 0;
+    read_graph_header(&graph_cursor, &num_vertices, &num_edges);
+
+    // Split the text into chunks of at least LOADER_MIN_CHUNK_SIZE bytes, one per task, so
+    // small graphs are loaded on the calling thread alone
+    size_t num_tasks = 1 + (graph_cursor.end - graph_cursor.pos) / LOADER_MIN_CHUNK_SIZE;
+    if (num_tasks > num_threads) {
+        num_tasks = num_threads;
+    }
+    loader_task_t tasks[MAX_LOADER_THREADS];
+    memset(tasks, 0, sizeof(tasks));
+
+    // Create empty graph presized for the vertex count and read it
+    create_directed_graph(graph, num_vertices);
+    read_directed_graph_from_file(graph, &graph_cursor, num_edges, tasks, num_tasks);
+
+    // The names were copied and the edges parsed, the mapping is no longer needed
+    unmap_file(graph_file);
+    free(graph_file);
+
+    // Build the CSR layout with neighbors in file order
+    freeze_directed_graph(*graph, tasks, num_tasks);
+    for (size_t i = 0; i < num_tasks; i++) {
+        free_edge_buffer(tasks[i].edges);
+        free(tasks[i].edges);
+    }
 }
 
-int32_t get_number_of_vertices(FILE* graph_file) {
-    int32_t num_vertices = fgetc(graph_file) - 48;
-    int32_t pos = ftell(graph_file);
-    fseek(graph_file, ++pos, SEEK_CUR);
-    return num_vertices;
+// Builds the graph from an edge stream, neither the vertex nor the edge count is known up front
+void load_graph_stream(directed_graph_t** graph, const int fd) {
+    // The name table and the edge buffer both grow by doubling as the stream goes on
+    loader_task_t task;
+    memset(&task, 0, sizeof(task));
+    create_directed_graph(graph, 0);
+    task.graph = *graph;
+    create_edge_buffer(&task.edges, 0);
+    read_edge_stream(*graph, fd, task.edges);
+    (*graph)->num_vertices = (*graph)->vertex_names->num_symbols;
+    create_degree_tables(*graph);
+
+    // The stream has ended, build the CSR layout with neighbors in file order
+    freeze_directed_graph(*graph, &task, 1);
+    free_edge_buffer(task.edges);
+    free(task.edges);
 }
 
 int32_t main(int32_t argc, char** argv) {
     char *graph_file_name, *query_file_name;
-    if (argc != 3) {
-        fprintf(stderr, "Incorrect number of arguments provided\n");
-        exit(EXIT_FAILURE);
-    }
 
-    graph_file_name = argv[1];
-    query_file_name = argv[2];
+    // -w <file> writes the loaded graph to a binary snapshot, which later runs can be given in
+    // place of the graph file, -j <threads> caps the threads that load graph text and -q skips
+    // printing the loaded graph
+    const char* snapshot_file_name = NULL;
+    bool print_graph = true;
+    long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t num_threads = online_cpus > 0 ? (size_t)online_cpus : 1;
+    int32_t option;
+    while ((option = getopt(argc, argv, "w:j:q")) != -1) {
+        uint64_t threads = 0;
+        if (option == 'w') {
+            snapshot_file_name = optarg;
+        } else if (option == 'q') {
+            print_graph = false;
+        } else if (option == 'j' && parse_count(optarg, strlen(optarg), &threads) && threads > 0) {
+            num_threads = (size_t)threads;
+        } else {
+            fprintf(stderr,
+                    "Usage: %s [-w snapshot_file] [-j threads] [-q] graph_file query_file\n",
+                    argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (num_threads > MAX_LOADER_THREADS) {
+        num_threads = MAX_LOADER_THREADS;
+    }
 
-    FILE* graph_file = fopen(graph_file_name, "r");
-    if (!graph_file) {
-        perror("fopen() failed for graph file");
+    if (argc - optind != 2) {
+        fprintf(stderr, "Incorrect number of arguments provided\n");
         exit(EXIT_FAILURE);
     }
 
+    graph_file_name = argv[optind];
+    query_file_name = argv[optind + 1];
+
     FILE* query_file = fopen(query_file_name, "r");
     if (!query_file) {
         perror("fopen() failed for query file");
         exit(EXIT_FAILURE);
     }
 
-    // Read number of vertices in graph
-    int32_t num_vertices = get_number_of_vertices(graph_file);
-
-    // Create empty graph with given number of vertices
+    // A graph file of "-" is an edge stream read from stdin, any other graph file is mapped and
+    // holds either graph text or a binary snapshot. A "shm:<name>" graph file attaches to the
+    // snapshot a "-w shm:<name>" run published
     directed_graph_t* graph = NULL;
-    create_directed_graph(&graph, (size_t)num_vertices);
+    if (strcmp(graph_file_name, "-") == 0) {
+        load_graph_stream(&graph, STDIN_FILENO);
+    } else {
+        mapped_file_t* graph_file = NULL;
+        map_file(&graph_file, graph_file_name);
+        if (is_graph_snapshot(graph_file)) {
+            // Snapshots are stored frozen, the graph uses the mapping in place
+            attach_directed_graph(&graph, graph_file);
+        } else {
+            load_graph_text(&graph, graph_file, num_threads);
+        }
+    }
+    if (snapshot_file_name) {
+        write_graph_snapshot(graph, snapshot_file_name);
+    }
+    // All results go through one buffered sink on stdout
+    output_sink_t* out = NULL;
+    create_output_sink(&out, STDOUT_FILENO, OUTPUT_BUFFER_SIZE);
 
-    // Read the graph from file
-    read_directed_graph_from_file(&graph, graph_file);
     // Print the read graph
-    print_directed_graph(graph);
+    if (print_graph) {
+        print_directed_graph(graph, out);
+    }
 
     // Process queries
-    process_query(graph, query_file);
+    process_query(graph, query_file, out);
+    free_output_sink(out);
+    free(out);
 
-    // Free graph memory
+    // Report allocator usage and free graph memory
+    print_allocation_stats(graph->arena);
     free_directed_graph(graph);
     free(graph);
 
     // Close files
-    fclose(graph_file);
     fclose(query_file);
 
     return 0;
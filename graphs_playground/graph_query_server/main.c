@@ -0,0 +1,2833 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include <limits.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define INVALID_VERTEX_ID UINT32_MAX
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define STREAM_BLOCK_SIZE (1 << 20)
+// Chunks of graph text below this size are not worth a thread of their own
+#define LOADER_MIN_CHUNK_SIZE (1 << 20)
+#define MAX_LOADER_THREADS 64
+// Distances are kept in 64 bits, no path of 32-bit weights comes close to INFINITE_DISTANCE
+#define INFINITE_DISTANCE INT64_MAX
+#define HEAP_ARITY 4
+#define INVALID_HEAP_INDEX UINT32_MAX
+// Requests are read in blocks of this size, a longer request line grows the buffer of its client
+#define REQUEST_BLOCK_SIZE 4096
+// Longest request line a client may send, the rest of a longer one is skipped
+#define MAX_REQUEST_SIZE (1 << 16)
+#define MAX_CLIENTS 64
+
+typedef struct arena_block {
+    struct arena_block* next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} arena_block_t;
+
+typedef struct arena {
+    arena_block_t* blocks;
+    size_t block_size;
+    size_t num_allocations;
+    size_t num_blocks;
+    size_t bytes_reserved;
+} arena_t;
+
+typedef struct set {
+    size_t capacity;
+    uint64_t* words;
+} set_t;
+
+typedef struct symbol_table {
+    size_t num_symbols;
+    size_t names_capacity;
+    char** names;
+    // A mapped table finds its names through the offsets of the snapshot, names stays NULL then
+    const uint64_t* name_offsets;
+    const char* name_data;
+    size_t num_slots;
+    uint32_t* slots;
+    arena_t* arena;
+    // Names and slots point into a snapshot mapping, the table is read-only then
+    bool mapped;
+} symbol_table_t;
+
+typedef struct name_rank_entry {
+    const char* name;
+    uint32_t vert_id;
+} name_rank_entry_t;
+
+typedef struct traversal_state {
+    size_t capacity;
+    uint32_t epoch;
+    // A vertex is visited when its stamp equals the current epoch
+    uint32_t* visit_epochs;
+    size_t num_visited;
+    uint32_t* visit_order;
+} traversal_state_t;
+
+// Fixed-capacity ring buffer of vertex IDs, a vertex is marked when it is enqueued so the
+// queue never holds more than V entries
+typedef struct queue {
+    uint32_t* items;
+    size_t capacity;
+    size_t head;
+    size_t size;
+} queue_t;
+
+typedef struct dfs_frame {
+    uint32_t vert_id;
+    // Next edge of the vertex to be explored
+    size_t edge_cursor;
+} dfs_frame_t;
+
+// Explicit DFS stack, every vertex is on it at most once so V frames are enough
+typedef struct dfs_stack {
+    size_t capacity;
+    size_t size;
+    dfs_frame_t* frames;
+} dfs_stack_t;
+
+// Topological order of the whole graph, computed once and shared by every query
+typedef struct topological_order {
+    size_t num_vertices;
+    bool is_cycle_free;
+    // Vertex ids in topological order
+    uint32_t* order;
+    // Index of every vertex in the order array
+    uint32_t* positions;
+    // Both arrays point into the snapshot of the graph
+    bool mapped;
+} topological_order_t;
+
+// Entry of the shortest path heap, the distance is kept next to the vertex so sifting reads only
+// the heap array
+typedef struct heap_entry {
+    int64_t dist;
+    uint32_t vert_id;
+} heap_entry_t;
+
+// Indexed 4-ary min-heap of vertices keyed by their tentative distance. The children of entry i
+// are 4i + 1 to 4i + 4, which the entries are aligned for to share one cache line
+typedef struct distance_heap {
+    size_t size;
+    size_t capacity;
+    void* storage;
+    heap_entry_t* entries;
+    // Index of every vertex in entries, INVALID_HEAP_INDEX while it is not queued
+    uint32_t* indices;
+} distance_heap_t;
+
+// Work state of the queue-based Bellman-Ford search, reused by every query
+typedef struct bellman_ford_state {
+    // Vertices whose distance dropped and whose edges are still to be relaxed, each queued once
+    queue_t* queue;
+    set_t* queued;
+    uint32_t* parents;
+    // Vertex a parent walk started from plus one, for every vertex the walk went through
+    uint32_t* walk_starts;
+    // Vertices of the negative cycle found, in the order of its edges
+    size_t cycle_length;
+    uint32_t* cycle;
+} bellman_ford_state_t;
+
+// Graph file mapped read-only into memory, the loader tokenizes it in place
+typedef struct mapped_file {
+    const char* data;
+    size_t size;
+} mapped_file_t;
+
+// Cursor over mapped text, lines and tokens are handed out as pointers into the mapping
+typedef struct text_cursor {
+    const char* pos;
+    const char* end;
+} text_cursor_t;
+
+// Output gathered in user space and handed to the kernel with one write() per flush
+// Answers a client has not taken yet, the bytes in [begin, end) of data
+typedef struct output_queue {
+    size_t begin;
+    size_t end;
+    size_t capacity;
+    char* data;
+} output_queue_t;
+
+typedef struct output_sink {
+    int fd;
+    size_t used;
+    size_t capacity;
+    char* data;
+    // A client that went away fails the sink, everything written to it afterwards is dropped
+    bool failed;
+    // Flushed bytes go to the queue instead of fd when there is one, so the server never waits
+    // for a client to read its answers
+    output_queue_t* queue;
+} output_sink_t;
+
+#define SNAPSHOT_MAGIC "CLABGRPH"
+// Prefix of the graph and snapshot files that are POSIX shared memory segments
+#define SHARED_MEMORY_PREFIX "shm:"
+#define SNAPSHOT_VERSION 2
+// Snapshot flags
+#define SNAPSHOT_DIRECTED 0x1
+#define SNAPSHOT_HAS_CYCLE 0x2
+// Rows keep the order their edges were listed in instead of being sorted by name
+#define SNAPSHOT_FILE_ORDER 0x4
+
+// Sections of a graph snapshot, every one is optional and a section of size 0 is absent
+typedef enum snapshot_section_id {
+    SNAPSHOT_NAME_OFFSETS,
+    SNAPSHOT_NAMES,
+    SNAPSHOT_NAME_SLOTS,
+    SNAPSHOT_EDGE_OFFSETS,
+    SNAPSHOT_EDGE_TARGETS,
+    SNAPSHOT_EDGE_WEIGHTS,
+    SNAPSHOT_NAME_RANKS,
+    SNAPSHOT_TOPOLOGICAL_ORDER,
+    SNAPSHOT_TOPOLOGICAL_POSITIONS,
+    SNAPSHOT_IN_DEGREES,
+    SNAPSHOT_OUT_DEGREES,
+    SNAPSHOT_LISTED_TARGETS,
+    SNAPSHOT_NUM_SECTIONS
+} snapshot_section_id_t;
+
+typedef struct snapshot_section {
+    uint64_t offset;
+    uint64_t size;
+} snapshot_section_t;
+
+// Sections are laid out 8-byte aligned behind the header, so they can be used in place once the
+// snapshot is mapped
+typedef struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t num_vertices;
+    uint64_t num_edges;
+    snapshot_section_t sections[SNAPSHOT_NUM_SECTIONS];
+} snapshot_header_t;
+
+// CSR offsets are used in place as size_t
+_Static_assert(sizeof(size_t) == sizeof(uint64_t), "snapshots store 64-bit offsets");
+
+typedef struct snapshot_writer {
+    FILE* file;
+    snapshot_header_t header;
+    uint64_t offset;
+    snapshot_section_id_t section;
+} snapshot_writer_t;
+
+typedef struct directed_graph {
+    size_t num_vertices;
+    size_t num_edges;
+    symbol_table_t* vertex_names;
+    // Owns the vertex names and the CSR arrays, released in one go
+    arena_t* arena;
+    // Frozen CSR layout, the edges of vertex i are in [edge_offsets[i], edge_offsets[i + 1])
+    size_t* edge_offsets;
+    uint32_t* edge_targets;
+    int32_t* edge_weights;
+    // Degrees counted once the graph is frozen, so every degree query is a lookup
+    uint32_t* in_degrees;
+    uint32_t* out_degrees;
+    // Snapshot mapping the arrays above point into, NULL for graphs parsed from text
+    mapped_file_t* snapshot;
+} directed_graph_t;
+
+// An edge as a loader worker parsed it, before it is placed in the CSR layout
+typedef struct edge_record {
+    uint32_t src_id;
+    uint32_t dst_id;
+    int32_t weight;
+} edge_record_t;
+
+typedef struct edge_buffer {
+    size_t size;
+    size_t capacity;
+    edge_record_t* records;
+} edge_buffer_t;
+
+// Share of one loader worker in every parallel phase of loading a graph
+typedef struct loader_task {
+    directed_graph_t* graph;
+    // Chunk of the graph text, it starts and ends on a line boundary
+    const char* chunk_begin;
+    const char* chunk_end;
+    size_t num_lines;
+    // Id of the vertex listed on the first line of the chunk
+    size_t first_vert_id;
+    // Names interned by this worker, merged into the graph arena afterwards
+    arena_t* arena;
+    // Edges of the chunk in file order and the file position of the first of them
+    edge_buffer_t* edges;
+    size_t first_edge_position;
+    // CSR rows this worker sorts
+    size_t first_row;
+    size_t end_row;
+    // Scratch arrays shared by all workers while the CSR layout is built
+    const uint32_t* name_ranks;
+    size_t* row_cursors;
+    size_t* edge_positions;
+} loader_task_t;
+
+// Scratch space of the queries, allocated once and reused by every query of every client
+typedef struct query_session {
+    traversal_state_t* state;
+    queue_t* bfs_queue;
+    dfs_stack_t* stack;
+    int64_t* distances;
+    // Shortest paths in a graph with a cycle are found with the heap, as long as no weight is
+    // negative, and by Bellman-Ford otherwise
+    distance_heap_t* heap;
+    bool negative_weights;
+    bellman_ford_state_t* bellman_ford;
+    output_sink_t* out;
+} query_session_t;
+
+// Connection the server reads request lines from, answers go to out_fd
+typedef struct client {
+    int in_fd;
+    int out_fd;
+    // Request lines read but not answered yet, the last one may be unfinished
+    size_t pending;
+    size_t capacity;
+    char* buffer;
+    // Set while the rest of a request longer than MAX_REQUEST_SIZE is skipped
+    bool skipping;
+    bool end_of_input;
+    // Answers waiting until the socket of the client has room for them, NULL when answers are
+    // written to out_fd right away
+    output_queue_t* output;
+} client_t;
+
+// Neighbor of a row being sorted, ties between parallel edges keep their file order
+typedef struct row_entry {
+    uint32_t rank;
+    uint32_t target;
+    int32_t weight;
+    size_t position;
+} row_entry_t;
+
+void create_arena(arena_t** arena, const size_t block_size) {
+    *arena = (arena_t*)malloc(sizeof(arena_t));
+    (*arena)->blocks = NULL;
+    (*arena)->block_size = block_size;
+    (*arena)->num_allocations = 0;
+    (*arena)->num_blocks = 0;
+    (*arena)->bytes_reserved = 0;
+}
+
+void* arena_alloc(arena_t* arena, const size_t size) {
+    const size_t aligned_size = (size + 7) & ~(size_t)7;
+    arena_block_t* block = arena->blocks;
+    if (block == NULL || block->used + aligned_size > block->capacity) {
+        const bool dedicated = aligned_size > arena->block_size / 4;
+        const size_t capacity = dedicated ? aligned_size : arena->block_size;
+        arena_block_t* new_block = (arena_block_t*)malloc(sizeof(arena_block_t) + capacity);
+        new_block->used = 0;
+        new_block->capacity = capacity;
+
+        // Large requests get a block of their own behind the current one, so the space left in
+        // the current block is still used by the small requests that follow
+        if (dedicated && block != NULL) {
+            new_block->next = block->next;
+            block->next = new_block;
+        } else {
+            new_block->next = block;
+            arena->blocks = new_block;
+        }
+        block = new_block;
+        arena->num_blocks++;
+        arena->bytes_reserved += capacity;
+    }
+
+    void* ptr = block->data + block->used;
+    block->used += aligned_size;
+    arena->num_allocations++;
+    return ptr;
+}
+
+void reset_arena(arena_t* arena) {
+    arena_block_t* block = arena->blocks;
+    while (block) {
+        arena_block_t* retire = block;
+        block = block->next;
+        free(retire);
+    }
+    arena->blocks = NULL;
+}
+
+void free_arena(arena_t* arena) {
+    reset_arena(arena);
+    arena->num_allocations = arena->num_blocks = arena->bytes_reserved = 0;
+}
+
+// Moves all blocks of the other arena into this one, so they are released together
+void merge_arena(arena_t* arena, arena_t* other) {
+    if (other->blocks == NULL) {
+        return;
+    }
+    arena_block_t* tail = other->blocks;
+    while (tail->next) {
+        tail = tail->next;
+    }
+
+    // Splice the blocks in behind the current block, which keeps serving small requests
+    if (arena->blocks == NULL) {
+        arena->blocks = other->blocks;
+    } else {
+        tail->next = arena->blocks->next;
+        arena->blocks->next = other->blocks;
+    }
+    arena->num_allocations += other->num_allocations;
+    arena->num_blocks += other->num_blocks;
+    arena->bytes_reserved += other->bytes_reserved;
+    other->blocks = NULL;
+    other->num_allocations = other->num_blocks = other->bytes_reserved = 0;
+}
+
+void print_allocation_stats(const arena_t* arena) {
+    fprintf(stderr, "Arena: %zu allocations in %zu blocks (%zu bytes)\n", arena->num_allocations,
+            arena->num_blocks, arena->bytes_reserved);
+}
+
+void create_traversal_state(traversal_state_t** state, const size_t capacity) {
+    *state = (traversal_state_t*)malloc(sizeof(traversal_state_t));
+    (*state)->capacity = capacity;
+    (*state)->epoch = 0;
+    (*state)->visit_epochs = (uint32_t*)calloc(capacity, sizeof(uint32_t));
+    (*state)->num_visited = 0;
+    (*state)->visit_order = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+}
+
+void begin_traversal(traversal_state_t* state) {
+    // Bumping the epoch forgets every earlier visit without touching the stamps
+    if (++state->epoch == 0) {
+        memset(state->visit_epochs, 0, state->capacity * sizeof(uint32_t));
+        state->epoch = 1;
+    }
+    state->num_visited = 0;
+}
+
+bool is_visited(const traversal_state_t* state, const uint32_t vert_id) {
+    return state->visit_epochs[vert_id] == state->epoch;
+}
+
+void mark_visited(traversal_state_t* state, const uint32_t vert_id) {
+    state->visit_epochs[vert_id] = state->epoch;
+    state->visit_order[state->num_visited++] = vert_id;
+}
+
+void free_traversal_state(traversal_state_t* state) {
+    free(state->visit_epochs);
+    free(state->visit_order);
+    state->capacity = state->num_visited = 0;
+}
+
+void create_dfs_stack(dfs_stack_t** stack, const size_t capacity) {
+    *stack = (dfs_stack_t*)malloc(sizeof(dfs_stack_t));
+    (*stack)->capacity = capacity;
+    (*stack)->size = 0;
+    (*stack)->frames = (dfs_frame_t*)malloc(capacity * sizeof(dfs_frame_t));
+}
+
+void push_dfs_frame(dfs_stack_t* stack, const uint32_t vert_id, const size_t edge_cursor) {
+    stack->frames[stack->size].vert_id = vert_id;
+    stack->frames[stack->size].edge_cursor = edge_cursor;
+    stack->size++;
+}
+
+void free_dfs_stack(dfs_stack_t* stack) {
+    free(stack->frames);
+    stack->capacity = stack->size = 0;
+}
+
+void create_queue(queue_t** queue, const size_t capacity) {
+    *queue = (queue_t*)malloc(sizeof(queue_t));
+    (*queue)->items = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    (*queue)->capacity = capacity;
+    (*queue)->head = 0;
+    (*queue)->size = 0;
+}
+
+void push_at_queue(queue_t* queue, const uint32_t vert_id) {
+    size_t tail = queue->head + queue->size;
+    if (tail >= queue->capacity) {
+        tail -= queue->capacity;
+    }
+    queue->items[tail] = vert_id;
+    queue->size++;
+}
+
+uint32_t pop_from_queue(queue_t* queue) {
+    if (queue->size == 0) {
+        return INVALID_VERTEX_ID;
+    }
+
+    const uint32_t return_id = queue->items[queue->head];
+    if (++queue->head == queue->capacity) {
+        queue->head = 0;
+    }
+    queue->size--;
+
+    return return_id;
+}
+
+void clear_queue(queue_t* queue) {
+    queue->head = 0;
+    queue->size = 0;
+}
+
+void free_queue(queue_t* queue) {
+    free(queue->items);
+    queue->capacity = queue->head = queue->size = 0;
+}
+
+uint64_t hash_vertex_name(const char* name, const size_t name_len) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < name_len; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+void create_symbol_table(symbol_table_t** table, const size_t expected_symbols, arena_t* arena) {
+    *table = (symbol_table_t*)malloc(sizeof(symbol_table_t));
+    (*table)->arena = arena;
+    (*table)->mapped = false;
+    (*table)->num_symbols = 0;
+    (*table)->names_capacity = expected_symbols > 0 ? expected_symbols : 16;
+    (*table)->names = (char**)malloc((*table)->names_capacity * sizeof(char*));
+    (*table)->name_offsets = NULL;
+    (*table)->name_data = NULL;
+
+    // Keep the load factor of the open addressing table at most one half
+    size_t num_slots = 16;
+    while (num_slots < 2 * (*table)->names_capacity) {
+        num_slots <<= 1;
+    }
+    (*table)->num_slots = num_slots;
+    (*table)->slots = (uint32_t*)malloc(num_slots * sizeof(uint32_t));
+    memset((*table)->slots, 0xff, num_slots * sizeof(uint32_t));
+}
+
+void free_symbol_table(symbol_table_t* table) {
+    // The names themselves live in the arena of the table or in the snapshot mapping
+    free(table->names);
+    if (!table->mapped) {
+        free(table->slots);
+    }
+    table->num_symbols = table->num_slots = 0;
+}
+
+const char* symbol_table_name(const symbol_table_t* table, const uint32_t vert_id) {
+    if (table->mapped) {
+        return table->name_data + table->name_offsets[vert_id];
+    }
+    return table->names[vert_id];
+}
+
+size_t find_symbol_slot(const symbol_table_t* table, const char* name, const size_t name_len) {
+    const size_t mask = table->num_slots - 1;
+    size_t slot = hash_vertex_name(name, name_len) & mask;
+    while (table->slots[slot] != INVALID_VERTEX_ID) {
+        const char* slot_name = symbol_table_name(table, table->slots[slot]);
+        if (strncmp(slot_name, name, name_len) == 0 && slot_name[name_len] == '\0') {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void grow_symbol_table(symbol_table_t* table) {
+    const size_t num_slots = table->num_slots << 1;
+    free(table->slots);
+    table->slots = (uint32_t*)malloc(num_slots * sizeof(uint32_t));
+    memset(table->slots, 0xff, num_slots * sizeof(uint32_t));
+    table->num_slots = num_slots;
+
+    // Rehash every interned name into the larger table
+    for (size_t i = 0; i < table->num_symbols; i++) {
+        const char* name = table->names[i];
+        table->slots[find_symbol_slot(table, name, strlen(name))] = (uint32_t)i;
+    }
+}
+
+uint32_t symbol_table_find(const symbol_table_t* table, const char* name, const size_t name_len) {
+    return table->slots[find_symbol_slot(table, name, name_len)];
+}
+
+uint32_t symbol_table_intern(symbol_table_t* table, const char* name, const size_t name_len) {
+    size_t slot = find_symbol_slot(table, name, name_len);
+    if (table->slots[slot] != INVALID_VERTEX_ID) {
+        return table->slots[slot];
+    }
+
+    if (2 * (table->num_symbols + 1) > table->num_slots) {
+        grow_symbol_table(table);
+        slot = find_symbol_slot(table, name, name_len);
+    }
+    if (table->num_symbols == table->names_capacity) {
+        table->names_capacity *= 2;
+        table->names = (char**)realloc(table->names, table->names_capacity * sizeof(char*));
+    }
+
+    char* copy_name = (char*)arena_alloc(table->arena, name_len + 1);
+    memcpy(copy_name, name, name_len);
+    copy_name[name_len] = '\0';
+
+    const uint32_t vert_id = (uint32_t)table->num_symbols++;
+    table->names[vert_id] = copy_name;
+    table->slots[slot] = vert_id;
+    return vert_id;
+}
+
+// Inserts a name under an id picked by the caller, several threads may insert at once as long as
+// the table is sized for all names up front. Returns false when the name is already in the table
+bool symbol_table_insert_concurrent(symbol_table_t* table, const char* name, const size_t name_len,
+                                    const uint32_t vert_id) {
+    // The name is published before its slot, so whoever finds the slot can compare the name
+    __atomic_store_n(&table->names[vert_id], (char*)name, __ATOMIC_RELEASE);
+
+    const size_t mask = table->num_slots - 1;
+    size_t slot = hash_vertex_name(name, name_len) & mask;
+    for (;;) {
+        uint32_t slot_id = __atomic_load_n(&table->slots[slot], __ATOMIC_ACQUIRE);
+        if (slot_id == INVALID_VERTEX_ID &&
+            __atomic_compare_exchange_n(&table->slots[slot], &slot_id, vert_id, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return true;
+        }
+
+        // The slot is taken, slot_id holds the id of its name
+        const char* slot_name = __atomic_load_n(&table->names[slot_id], __ATOMIC_ACQUIRE);
+        if (strncmp(slot_name, name, name_len) == 0 && slot_name[name_len] == '\0') {
+            return false;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+int compare_name_rank_entries(const void* lhs, const void* rhs) {
+    const name_rank_entry_t* lhs_entry = (const name_rank_entry_t*)lhs;
+    const name_rank_entry_t* rhs_entry = (const name_rank_entry_t*)rhs;
+    return strcmp(lhs_entry->name, rhs_entry->name);
+}
+
+void rank_vertex_names(const symbol_table_t* table, uint32_t* name_ranks) {
+    // name_ranks[id] is the position of the name of id in lexicographic order
+    const size_t num_symbols = table->num_symbols;
+    name_rank_entry_t* entries =
+        (name_rank_entry_t*)malloc(num_symbols * sizeof(name_rank_entry_t));
+    for (size_t i = 0; i < num_symbols; i++) {
+        entries[i].name = symbol_table_name(table, (uint32_t)i);
+        entries[i].vert_id = (uint32_t)i;
+    }
+    qsort(entries, num_symbols, sizeof(name_rank_entry_t), compare_name_rank_entries);
+    for (size_t i = 0; i < num_symbols; i++) {
+        name_ranks[entries[i].vert_id] = (uint32_t)i;
+    }
+    free(entries);
+}
+
+void create_set(set_t** set, const size_t capacity) {
+    *set = (set_t*)malloc(sizeof(set_t));
+    (*set)->capacity = capacity;
+    (*set)->words = (uint64_t*)calloc((capacity + 63) / 64, sizeof(uint64_t));
+}
+
+void free_set(set_t* set) {
+    free(set->words);
+    set->words = NULL;
+    set->capacity = 0;
+}
+
+bool set_contains(set_t* set, const uint32_t vert_id) {
+    return (set->words[vert_id >> 6] >> (vert_id & 63)) & 1;
+}
+
+bool set_insert(set_t* set, const uint32_t vert_id) {
+    if (!set_contains(set, vert_id)) {
+        set->words[vert_id >> 6] |= (uint64_t)1 << (vert_id & 63);
+        return true;
+    }
+    return false;
+}
+
+bool set_remove(set_t* set, const uint32_t vert_id) {
+    if (!set_contains(set, vert_id)) {
+        return false;
+    }
+    set->words[vert_id >> 6] &= ~((uint64_t)1 << (vert_id & 63));
+    return true;
+}
+
+bool is_shared_memory_name(const char* file_name) {
+    return strncmp(file_name, SHARED_MEMORY_PREFIX, sizeof(SHARED_MEMORY_PREFIX) - 1) == 0;
+}
+
+// A "shm:<name>" file is the POSIX shared memory segment <name>, every process attached to it
+// maps the same pages. Its sections are checked once when they are attached and used in place from
+// then on, so the segment must come from a trusted publisher that never changes it afterwards
+void map_file(mapped_file_t** file, const char* file_name) {
+    const bool shared = is_shared_memory_name(file_name);
+    const int fd = shared ? shm_open(file_name + sizeof(SHARED_MEMORY_PREFIX) - 1, O_RDONLY, 0)
+                          : open(file_name, O_RDONLY);
+    if (fd == -1) {
+        perror(shared ? "shm_open() failed for graph segment" : "open() failed for graph file");
+        exit(EXIT_FAILURE);
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1) {
+        perror("fstat() failed for graph file");
+        exit(EXIT_FAILURE);
+    }
+
+    *file = (mapped_file_t*)malloc(sizeof(mapped_file_t));
+    (*file)->data = NULL;
+    (*file)->size = (size_t)file_stat.st_size;
+    if ((*file)->size > 0) {
+        void* data = mmap(NULL, (*file)->size, PROT_READ, shared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror("mmap() failed for graph file");
+            exit(EXIT_FAILURE);
+        }
+        // The file is read front to back exactly once
+        madvise(data, (*file)->size, MADV_SEQUENTIAL);
+        (*file)->data = (const char*)data;
+    }
+    close(fd);
+}
+
+void unmap_file(mapped_file_t* file) {
+    if (file->data) {
+        munmap((void*)file->data, file->size);
+    }
+    file->data = NULL;
+    file->size = 0;
+}
+
+// Hands out the next line without its line ending, returns false at the end of the text
+bool next_line(text_cursor_t* cursor, text_cursor_t* line) {
+    if (cursor->pos >= cursor->end) {
+        return false;
+    }
+
+    const char* line_begin = cursor->pos;
+    const char* newline = (const char*)memchr(line_begin, '\n', cursor->end - line_begin);
+    const char* line_end = newline ? newline : cursor->end;
+    cursor->pos = newline ? newline + 1 : cursor->end;
+    if (line_end > line_begin && line_end[-1] == '\r') {
+        line_end--;
+    }
+
+    line->pos = line_begin;
+    line->end = line_end;
+    return true;
+}
+
+#if defined(__x86_64__)
+// Marks every space or tab of an 8-byte word with the high bit of its byte, the lowest marked
+// byte is always a blank, marks above it may be false positives
+uint64_t blank_byte_mask(const uint64_t word) {
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t spaces = word ^ (ones * ' ');
+    const uint64_t tabs = word ^ (ones * '\t');
+    return (((spaces - ones) & ~spaces) | ((tabs - ones) & ~tabs)) & (ones * 0x80);
+}
+
+__attribute__((target("avx2"))) const char* find_blank_avx2(const char* pos, const char* end) {
+    const __m256i spaces = _mm256_set1_epi8(' ');
+    const __m256i tabs = _mm256_set1_epi8('\t');
+    while (end - pos >= 32) {
+        const __m256i block = _mm256_loadu_si256((const __m256i*)pos);
+        const uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, spaces), _mm256_cmpeq_epi8(block, tabs)));
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 32;
+    }
+    return pos;
+}
+#endif
+
+// Returns the first space or tab in [pos, end), or end when there is none. Blocks of 32, 16 and
+// 8 bytes are compared at once while they fit in the range, only the last few bytes one by one
+const char* find_blank(const char* pos, const char* end) {
+#if defined(__x86_64__)
+    // AVX2 is picked at run time, SSE2 is part of every x86-64 CPU. A search stopped on a blank
+    // finds it again right away in the next step
+    if (end - pos >= 32 && __builtin_cpu_supports("avx2")) {
+        pos = find_blank_avx2(pos, end);
+    }
+    const __m128i spaces = _mm_set1_epi8(' ');
+    const __m128i tabs = _mm_set1_epi8('\t');
+    while (end - pos >= 16) {
+        const __m128i block = _mm_loadu_si128((const __m128i*)pos);
+        const uint32_t mask = (uint32_t)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(block, spaces), _mm_cmpeq_epi8(block, tabs)));
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 16;
+    }
+    while (end - pos >= 8) {
+        uint64_t word;
+        memcpy(&word, pos, sizeof(word));
+        const uint64_t mask = blank_byte_mask(word);
+        if (mask != 0) {
+            return pos + (__builtin_ctzll(mask) >> 3);
+        }
+        pos += 8;
+    }
+#endif
+    while (pos < end && *pos != ' ' && *pos != '\t') {
+        pos++;
+    }
+    return pos;
+}
+
+// Splits the next blank separated token off the front of a line, returns false when none is left
+bool next_token(text_cursor_t* line, const char** token, size_t* token_len) {
+    // Tokens are mostly separated by a single blank, so only the token end is searched in blocks
+    const char* pos = line->pos;
+    while (pos < line->end && (*pos == ' ' || *pos == '\t')) {
+        pos++;
+    }
+    const char* token_begin = pos;
+    pos = find_blank(pos, line->end);
+
+    line->pos = pos;
+    *token = token_begin;
+    *token_len = pos - token_begin;
+    return *token_len > 0;
+}
+
+bool parse_count(const char* token, const size_t token_len, uint64_t* value) {
+    uint64_t result = 0;
+    for (size_t i = 0; i < token_len; i++) {
+        const uint32_t digit = (uint32_t)(token[i] - '0');
+        if (digit > 9 || result > (UINT64_MAX - digit) / 10) {
+            return false;
+        }
+        result = result * 10 + digit;
+    }
+    *value = result;
+    return token_len > 0;
+}
+
+bool parse_int32(const char* token, const size_t token_len, int32_t* value) {
+    size_t i = 0;
+    const bool negative = token_len > 0 && token[0] == '-';
+    if (negative || (token_len > 0 && token[0] == '+')) {
+        i++;
+    }
+
+    // Accumulate in 64 bits, a weight of more than 10 digits is out of range anyway
+    int64_t result = 0;
+    if (i == token_len || token_len - i > 10) {
+        return false;
+    }
+    for (; i < token_len; i++) {
+        const uint32_t digit = (uint32_t)(token[i] - '0');
+        if (digit > 9) {
+            return false;
+        }
+        result = result * 10 + digit;
+    }
+    if (negative) {
+        result = -result;
+    }
+    if (result < INT32_MIN || result > INT32_MAX) {
+        return false;
+    }
+    *value = (int32_t)result;
+    return true;
+}
+
+void create_output_sink(output_sink_t** sink, const int fd, const size_t capacity) {
+    *sink = (output_sink_t*)malloc(sizeof(output_sink_t));
+    (*sink)->fd = fd;
+    (*sink)->used = 0;
+    (*sink)->capacity = capacity;
+    (*sink)->data = (char*)malloc(capacity);
+    (*sink)->failed = false;
+    (*sink)->queue = NULL;
+}
+
+volatile sig_atomic_t stop_requested = 0;
+
+// Returns false when the descriptor fails, a client hanging up must not take the server down.
+// Gives up as well once the server is asked to stop, a reader that never reads must not hold it
+bool write_all(const int fd, const char* data, size_t size) {
+    // Pipes and sockets may take less than asked for, keep going until everything is out
+    while (size > 0) {
+        const ssize_t written = write(fd, data, size);
+        if (written == -1) {
+            if (errno == EINTR && !stop_requested) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+void create_output_queue(output_queue_t** queue) {
+    *queue = (output_queue_t*)malloc(sizeof(output_queue_t));
+    (*queue)->begin = (*queue)->end = (*queue)->capacity = 0;
+    (*queue)->data = NULL;
+}
+
+void free_output_queue(output_queue_t* queue) {
+    free(queue->data);
+    queue->data = NULL;
+    queue->begin = queue->end = queue->capacity = 0;
+}
+
+size_t output_queue_size(const output_queue_t* queue) {
+    return queue ? queue->end - queue->begin : 0;
+}
+
+// Returns false when the queue cannot grow, the client is dropped then
+bool append_output_queue(output_queue_t* queue, const char* data, const size_t size) {
+    if (queue->end + size > queue->capacity) {
+        // Move the unsent bytes to the front first, the queue only grows when that is not enough
+        memmove(queue->data, queue->data + queue->begin, queue->end - queue->begin);
+        queue->end -= queue->begin;
+        queue->begin = 0;
+    }
+    if (queue->end + size > queue->capacity) {
+        size_t capacity = queue->capacity ? queue->capacity : OUTPUT_BUFFER_SIZE;
+        while (capacity < queue->end + size) {
+            capacity *= 2;
+        }
+        char* data_grown = (char*)realloc(queue->data, capacity);
+        if (data_grown == NULL) {
+            return false;
+        }
+        queue->data = data_grown;
+        queue->capacity = capacity;
+    }
+    memcpy(queue->data + queue->end, data, size);
+    queue->end += size;
+    return true;
+}
+
+void emit_sink_data(output_sink_t* sink, const char* data, const size_t size) {
+    if (sink->failed) {
+        return;
+    }
+    if (sink->queue ? !append_output_queue(sink->queue, data, size)
+                    : !write_all(sink->fd, data, size)) {
+        sink->failed = true;
+    }
+}
+
+void flush_output_sink(output_sink_t* sink) {
+    emit_sink_data(sink, sink->data, sink->used);
+    sink->used = 0;
+}
+
+void free_output_sink(output_sink_t* sink) {
+    flush_output_sink(sink);
+    free(sink->data);
+    sink->data = NULL;
+    sink->capacity = 0;
+}
+
+void sink_write(output_sink_t* sink, const char* data, const size_t size) {
+    if (sink->used + size > sink->capacity) {
+        flush_output_sink(sink);
+        if (size > sink->capacity) {
+            emit_sink_data(sink, data, size);
+            return;
+        }
+    }
+    memcpy(sink->data + sink->used, data, size);
+    sink->used += size;
+}
+
+void sink_puts(output_sink_t* sink, const char* str) {
+    sink_write(sink, str, strlen(str));
+}
+
+void sink_putc(output_sink_t* sink, const char c) {
+    if (sink->used == sink->capacity) {
+        flush_output_sink(sink);
+    }
+    sink->data[sink->used++] = c;
+}
+
+void sink_put_uint(output_sink_t* sink, uint64_t value) {
+    // Digits come out lowest first, so they are filled in from the back of the buffer
+    char digits[20];
+    size_t num_digits = 0;
+    do {
+        digits[sizeof(digits) - ++num_digits] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    sink_write(sink, digits + sizeof(digits) - num_digits, num_digits);
+}
+
+void sink_put_int(output_sink_t* sink, const int64_t value) {
+    if (value < 0) {
+        sink_putc(sink, '-');
+        sink_put_uint(sink, (uint64_t)0 - (uint64_t)value);
+    } else {
+        sink_put_uint(sink, (uint64_t)value);
+    }
+}
+
+// A "shm:<name>" snapshot is published as a new shared memory segment, processes still attached
+// to an earlier segment of that name keep theirs until they detach. The segment is created
+// read-only, so once published no one but its owner can open it for writing
+FILE* open_snapshot_file(const char* file_name) {
+    if (!is_shared_memory_name(file_name)) {
+        return fopen(file_name, "wb");
+    }
+    const char* segment_name = file_name + sizeof(SHARED_MEMORY_PREFIX) - 1;
+    shm_unlink(segment_name);
+    const int fd = shm_open(segment_name, O_CREAT | O_EXCL | O_RDWR, 0444);
+    return fd == -1 ? NULL : fdopen(fd, "wb");
+}
+
+void begin_snapshot(snapshot_writer_t* writer, const char* file_name, const uint32_t flags,
+                    const size_t num_vertices, const size_t num_edges) {
+    writer->file = open_snapshot_file(file_name);
+    if (!writer->file) {
+        perror("Opening the snapshot file failed");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&writer->header, 0, sizeof(snapshot_header_t));
+    memcpy(writer->header.magic, SNAPSHOT_MAGIC, sizeof(writer->header.magic));
+    writer->header.version = SNAPSHOT_VERSION;
+    writer->header.flags = flags;
+    writer->header.num_vertices = num_vertices;
+    writer->header.num_edges = num_edges;
+
+    // The header is written with the section table once all sections are in, until then a blank
+    // one holds its place, so a snapshot that is still being written is never taken for one
+    const snapshot_header_t blank_header = {0};
+    fwrite(&blank_header, sizeof(snapshot_header_t), 1, writer->file);
+    writer->offset = sizeof(snapshot_header_t);
+}
+
+void begin_snapshot_section(snapshot_writer_t* writer, const snapshot_section_id_t section) {
+    writer->section = section;
+    writer->header.sections[section].offset = writer->offset;
+    writer->header.sections[section].size = 0;
+}
+
+void append_snapshot_data(snapshot_writer_t* writer, const void* data, const size_t size) {
+    fwrite(data, 1, size, writer->file);
+    writer->header.sections[writer->section].size += size;
+    writer->offset += size;
+}
+
+void end_snapshot_section(snapshot_writer_t* writer) {
+    static const char padding[8] = {0};
+    const size_t padding_size = (8 - writer->offset % 8) % 8;
+    fwrite(padding, 1, padding_size, writer->file);
+    writer->offset += padding_size;
+}
+
+void write_snapshot_section(snapshot_writer_t* writer, const snapshot_section_id_t section,
+                            const void* data, const size_t size) {
+    begin_snapshot_section(writer, section);
+    append_snapshot_data(writer, data, size);
+    end_snapshot_section(writer);
+}
+
+void end_snapshot(snapshot_writer_t* writer) {
+    fseek(writer->file, 0, SEEK_SET);
+    fwrite(&writer->header, sizeof(snapshot_header_t), 1, writer->file);
+    if (ferror(writer->file) || fclose(writer->file) != 0) {
+        perror("Writing the snapshot file failed");
+        exit(EXIT_FAILURE);
+    }
+    writer->file = NULL;
+}
+
+bool is_graph_snapshot(const mapped_file_t* file) {
+    return file->size >= sizeof(snapshot_header_t) &&
+           memcmp(file->data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC) - 1) == 0;
+}
+
+// Checks the header and the section table, the attach functions check the contents of the
+// sections they use
+const snapshot_header_t* open_graph_snapshot(const mapped_file_t* file, const uint32_t flags) {
+    const snapshot_header_t* header = (const snapshot_header_t*)file->data;
+    if (header->version != SNAPSHOT_VERSION) {
+        fprintf(stderr, "Unsupported snapshot version %u\n", header->version);
+        exit(EXIT_FAILURE);
+    }
+    if ((header->flags & SNAPSHOT_DIRECTED) != (flags & SNAPSHOT_DIRECTED)) {
+        fprintf(stderr, "Snapshot holds %s graph\n",
+                header->flags & SNAPSHOT_DIRECTED ? "a directed" : "an undirected");
+        exit(EXIT_FAILURE);
+    }
+    if ((header->flags & SNAPSHOT_FILE_ORDER) != (flags & SNAPSHOT_FILE_ORDER)) {
+        fprintf(stderr, "Snapshot rows are in %s order\n",
+                header->flags & SNAPSHOT_FILE_ORDER ? "file" : "name");
+        exit(EXIT_FAILURE);
+    }
+    if (header->num_vertices > UINT32_MAX) {
+        fprintf(stderr, "Invalid vertex count in snapshot: %" PRIu64 "\n", header->num_vertices);
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < SNAPSHOT_NUM_SECTIONS; i++) {
+        const snapshot_section_t* section = &header->sections[i];
+        if (section->size > 0 &&
+            (section->offset % 8 != 0 || section->offset > file->size ||
+             section->size > file->size - section->offset)) {
+            fprintf(stderr, "Snapshot section %zu is out of bounds\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Sections are read in place, prefetch the whole mapping
+    madvise((void*)file->data, file->size, MADV_WILLNEED);
+    return header;
+}
+
+// Returns the section in the mapping, or NULL when the snapshot does not have it
+const void* snapshot_section(const mapped_file_t* file, const snapshot_header_t* header,
+                             const snapshot_section_id_t section, const size_t expected_size) {
+    if (header->sections[section].size == 0) {
+        return expected_size == 0 ? file->data + header->sections[section].offset : NULL;
+    }
+    if (header->sections[section].size != expected_size) {
+        fprintf(stderr, "Snapshot section %d has %" PRIu64 " bytes instead of %zu\n", (int)section,
+                header->sections[section].size, expected_size);
+        exit(EXIT_FAILURE);
+    }
+    return file->data + header->sections[section].offset;
+}
+
+const void* required_snapshot_section(const mapped_file_t* file, const snapshot_header_t* header,
+                                      const snapshot_section_id_t section,
+                                      const size_t expected_size) {
+    const void* data = snapshot_section(file, header, section, expected_size);
+    if (data == NULL) {
+        fprintf(stderr, "Snapshot is missing section %d\n", (int)section);
+        exit(EXIT_FAILURE);
+    }
+    return data;
+}
+
+// Stops with an error unless the offsets start at 0, never decrease and end at the given value
+void check_snapshot_offsets(const uint64_t* offsets, const size_t count, const uint64_t end,
+                            const char* table_name) {
+    bool valid = offsets[0] == 0 && offsets[count] == end;
+    for (size_t i = 0; i < count && valid; i++) {
+        valid = offsets[i] <= offsets[i + 1];
+    }
+    if (!valid) {
+        fprintf(stderr, "Snapshot has an invalid %s\n", table_name);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Stops with an error unless every id is below the limit
+void check_snapshot_ids(const uint32_t* ids, const size_t count, const size_t limit,
+                        const char* table_name) {
+    for (size_t i = 0; i < count; i++) {
+        if (ids[i] >= limit) {
+            fprintf(stderr, "Snapshot has an invalid %s\n", table_name);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// Every name must end with its terminator inside the names section and every slot must be empty
+// or hold a vertex id. No more ids than vertices leaves empty slots for every lookup to stop at
+void check_snapshot_name_table(const uint64_t* name_offsets, const char* names,
+                               const size_t num_symbols, const uint32_t* slots,
+                               const size_t num_slots) {
+    bool valid = name_offsets[0] == 0;
+    for (size_t i = 0; i < num_symbols && valid; i++) {
+        valid = name_offsets[i] < name_offsets[i + 1];
+    }
+    for (size_t i = 0; i < num_symbols && valid; i++) {
+        valid = names[name_offsets[i + 1] - 1] == '\0';
+    }
+    size_t num_filled = 0;
+    for (size_t i = 0; i < num_slots && valid; i++) {
+        if (slots[i] != INVALID_VERTEX_ID) {
+            valid = slots[i] < num_symbols;
+            num_filled++;
+        }
+    }
+    if (!valid || num_filled > num_symbols) {
+        fprintf(stderr, "Snapshot has an invalid name table\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void write_symbol_table_sections(snapshot_writer_t* writer, const symbol_table_t* table) {
+    // Names are stored back to back with their terminators and found through their offsets
+    uint64_t name_offset = 0;
+    begin_snapshot_section(writer, SNAPSHOT_NAME_OFFSETS);
+    for (size_t i = 0; i < table->num_symbols; i++) {
+        append_snapshot_data(writer, &name_offset, sizeof(uint64_t));
+        name_offset += strlen(symbol_table_name(table, (uint32_t)i)) + 1;
+    }
+    append_snapshot_data(writer, &name_offset, sizeof(uint64_t));
+    end_snapshot_section(writer);
+
+    begin_snapshot_section(writer, SNAPSHOT_NAMES);
+    for (size_t i = 0; i < table->num_symbols; i++) {
+        const char* name = symbol_table_name(table, (uint32_t)i);
+        append_snapshot_data(writer, name, strlen(name) + 1);
+    }
+    end_snapshot_section(writer);
+
+    write_snapshot_section(writer, SNAPSHOT_NAME_SLOTS, table->slots,
+                           table->num_slots * sizeof(uint32_t));
+}
+
+void attach_symbol_table(symbol_table_t** table, const mapped_file_t* file,
+                         const snapshot_header_t* header, arena_t* arena) {
+    const size_t num_symbols = header->num_vertices;
+    const uint64_t* name_offsets = (const uint64_t*)required_snapshot_section(
+        file, header, SNAPSHOT_NAME_OFFSETS, (num_symbols + 1) * sizeof(uint64_t));
+    const char* names = (const char*)required_snapshot_section(file, header, SNAPSHOT_NAMES,
+                                                               name_offsets[num_symbols]);
+
+    // The slot table is used as it is, so it must be a valid open addressing table
+    const size_t num_slots = header->sections[SNAPSHOT_NAME_SLOTS].size / sizeof(uint32_t);
+    if (num_slots <= num_symbols || (num_slots & (num_slots - 1)) != 0) {
+        fprintf(stderr, "Snapshot has an invalid name table\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const uint32_t* slots = (const uint32_t*)required_snapshot_section(
+        file, header, SNAPSHOT_NAME_SLOTS, num_slots * sizeof(uint32_t));
+    check_snapshot_name_table(name_offsets, names, num_symbols, slots, num_slots);
+
+    *table = (symbol_table_t*)malloc(sizeof(symbol_table_t));
+    (*table)->arena = arena;
+    (*table)->num_symbols = num_symbols;
+    // Names are looked up in the mapping itself, attaching copies nothing per vertex
+    (*table)->names_capacity = 0;
+    (*table)->names = NULL;
+    (*table)->name_offsets = name_offsets;
+    (*table)->name_data = names;
+    (*table)->num_slots = num_slots;
+    (*table)->slots = (uint32_t*)slots;
+    (*table)->mapped = true;
+}
+
+void create_directed_graph(directed_graph_t** graph, const size_t num_vertices) {
+    *graph = (directed_graph_t*)malloc(sizeof(directed_graph_t));
+    (*graph)->num_vertices = num_vertices;
+    (*graph)->num_edges = 0;
+    create_arena(&(*graph)->arena, ARENA_BLOCK_SIZE);
+    create_symbol_table(&(*graph)->vertex_names, num_vertices, (*graph)->arena);
+    (*graph)->snapshot = NULL;
+    (*graph)->edge_offsets = NULL;
+    (*graph)->edge_targets = NULL;
+    (*graph)->edge_weights = NULL;
+    (*graph)->in_degrees = NULL;
+    (*graph)->out_degrees = NULL;
+}
+
+void create_edge_buffer(edge_buffer_t** buffer, const size_t capacity) {
+    *buffer = (edge_buffer_t*)malloc(sizeof(edge_buffer_t));
+    (*buffer)->size = 0;
+    (*buffer)->capacity = capacity > 0 ? capacity : 16;
+    (*buffer)->records = (edge_record_t*)malloc((*buffer)->capacity * sizeof(edge_record_t));
+}
+
+void push_edge_record(edge_buffer_t* buffer, const uint32_t src_id, const uint32_t dst_id,
+                      const int32_t weight) {
+    if (buffer->size == buffer->capacity) {
+        buffer->capacity *= 2;
+        buffer->records =
+            (edge_record_t*)realloc(buffer->records, buffer->capacity * sizeof(edge_record_t));
+    }
+    edge_record_t* record = &buffer->records[buffer->size++];
+    record->src_id = src_id;
+    record->dst_id = dst_id;
+    record->weight = weight;
+}
+
+void free_edge_buffer(edge_buffer_t* buffer) {
+    free(buffer->records);
+    buffer->records = NULL;
+    buffer->size = buffer->capacity = 0;
+}
+
+// "<u> <v> <distance>" adds an edge and "<u>" alone a vertex, a vertex is added the first time
+// the stream names it
+void add_stream_line(directed_graph_t* graph, text_cursor_t line, edge_buffer_t* edges) {
+    const text_cursor_t stream_line = line;
+    const char* edge_u;
+    const char* edge_v;
+    const char* edge_dist_text;
+    size_t len_u, len_v, len_dist;
+    if (!next_token(&line, &edge_u, &len_u)) {
+        return;
+    }
+    if (!next_token(&line, &edge_v, &len_v)) {
+        symbol_table_intern(graph->vertex_names, edge_u, len_u);
+        return;
+    }
+    int32_t edge_dist = 0;
+    if (!next_token(&line, &edge_dist_text, &len_dist) ||
+        !parse_int32(edge_dist_text, len_dist, &edge_dist)) {
+        fprintf(stderr, "Skipping malformed edge: %.*s\n", (int)(stream_line.end - stream_line.pos),
+                stream_line.pos);
+        return;
+    }
+
+    const uint32_t u_id = symbol_table_intern(graph->vertex_names, edge_u, len_u);
+    const uint32_t v_id = symbol_table_intern(graph->vertex_names, edge_v, len_v);
+    push_edge_record(edges, u_id, v_id, edge_dist);
+}
+
+// Reads the stream in blocks and parses every complete line of a block, the unfinished line at
+// its end is carried over to the next one
+void read_edge_stream(directed_graph_t* graph, const int fd, edge_buffer_t* edges) {
+    size_t capacity = STREAM_BLOCK_SIZE;
+    char* buffer = (char*)malloc(capacity);
+    size_t pending = 0;
+    bool end_of_stream = false;
+    while (!end_of_stream) {
+        if (pending == capacity) {
+            // A single line fills the whole buffer, make room for the rest of it
+            capacity *= 2;
+            buffer = (char*)realloc(buffer, capacity);
+        }
+        const ssize_t num_read = read(fd, buffer + pending, capacity - pending);
+        if (num_read == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read() failed for edge stream");
+            exit(EXIT_FAILURE);
+        }
+        end_of_stream = num_read == 0;
+
+        // Only the new bytes can hold a newline, the carried over line has none
+        const char* data_end = buffer + pending + num_read;
+        const char* lines_end = data_end;
+        if (!end_of_stream) {
+            while (lines_end > buffer + pending && lines_end[-1] != '\n') {
+                lines_end--;
+            }
+            if (lines_end == buffer + pending) {
+                lines_end = buffer;
+            }
+        }
+
+        text_cursor_t cursor = {buffer, lines_end};
+        text_cursor_t line;
+        while (next_line(&cursor, &line)) {
+            add_stream_line(graph, line, edges);
+        }
+        pending = data_end - lines_end;
+        memmove(buffer, lines_end, pending);
+    }
+    free(buffer);
+}
+
+// Runs one phase of the loader, a single task runs on the calling thread without starting any
+void run_loader_tasks(loader_task_t* tasks, const size_t num_tasks, void* (*work)(void*)) {
+    if (num_tasks == 1) {
+        work(&tasks[0]);
+        return;
+    }
+
+    pthread_t threads[MAX_LOADER_THREADS];
+    for (size_t i = 0; i < num_tasks; i++) {
+        if (pthread_create(&threads[i], NULL, work, &tasks[i]) != 0) {
+            fprintf(stderr, "pthread_create() failed for loader task\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (size_t i = 0; i < num_tasks; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+// Splits the text into one chunk per task, every chunk but the last ends right after a newline
+void split_text_into_chunks(const char* begin, const char* end, loader_task_t* tasks,
+                            const size_t num_tasks) {
+    const size_t text_size = end - begin;
+    const char* chunk_begin = begin;
+    for (size_t i = 0; i < num_tasks; i++) {
+        const char* chunk_end = end;
+        if (i + 1 < num_tasks) {
+            chunk_end = begin + text_size / num_tasks * (i + 1);
+            if (chunk_end <= chunk_begin) {
+                chunk_end = chunk_begin;
+            } else {
+                const char* newline =
+                    (const char*)memchr(chunk_end - 1, '\n', end - (chunk_end - 1));
+                chunk_end = newline ? newline + 1 : end;
+            }
+        }
+        tasks[i].chunk_begin = chunk_begin;
+        tasks[i].chunk_end = chunk_end;
+        chunk_begin = chunk_end;
+    }
+}
+
+void* count_chunk_lines(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    size_t num_lines = 0;
+    const char* pos = task->chunk_begin;
+    while ((pos = (const char*)memchr(pos, '\n', task->chunk_end - pos)) != NULL) {
+        num_lines++;
+        pos++;
+    }
+    task->num_lines = num_lines;
+    return NULL;
+}
+
+void* intern_chunk_vertices(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    text_cursor_t cursor = {task->chunk_begin, task->chunk_end};
+    text_cursor_t line;
+    for (size_t vert_id = task->first_vert_id; next_line(&cursor, &line); vert_id++) {
+        const size_t vertex_len = line.end - line.pos;
+        char* name = (char*)arena_alloc(task->arena, vertex_len + 1);
+        memcpy(name, line.pos, vertex_len);
+        name[vertex_len] = '\0';
+        if (!symbol_table_insert_concurrent(task->graph->vertex_names, name, vertex_len,
+                                            (uint32_t)vert_id)) {
+            fprintf(stderr, "Duplicate vertex %s\n", name);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return NULL;
+}
+
+void* parse_chunk_edges(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    const symbol_table_t* vertex_names = task->graph->vertex_names;
+    text_cursor_t cursor = {task->chunk_begin, task->chunk_end};
+    text_cursor_t line;
+    while (next_line(&cursor, &line)) {
+        // Tokenize "<u> <v> <distance>" in place, the names are looked up without being copied
+        const text_cursor_t edge_line = line;
+        const char* edge_u;
+        const char* edge_v;
+        const char* edge_dist_text;
+        size_t len_u, len_v, len_dist;
+        if (!next_token(&line, &edge_u, &len_u)) {
+            continue;
+        }
+        int32_t edge_dist = 0;
+        if (!next_token(&line, &edge_v, &len_v) ||
+            !next_token(&line, &edge_dist_text, &len_dist) ||
+            !parse_int32(edge_dist_text, len_dist, &edge_dist)) {
+            fprintf(stderr, "Skipping malformed edge: %.*s\n", (int)(edge_line.end - edge_line.pos),
+                    edge_line.pos);
+            continue;
+        }
+
+        // Resolve both vertices to their ids
+        const uint32_t u_id = symbol_table_find(vertex_names, edge_u, len_u);
+        const uint32_t v_id = symbol_table_find(vertex_names, edge_v, len_v);
+        if (u_id == INVALID_VERTEX_ID || v_id == INVALID_VERTEX_ID) {
+            fprintf(stderr, "Skipping edge with unknown vertex: %.*s\n",
+                    (int)(edge_line.end - edge_line.pos), edge_line.pos);
+            continue;
+        }
+
+        push_edge_record(task->edges, u_id, v_id, edge_dist);
+    }
+    return NULL;
+}
+
+// Counts the edges of every row into edge_offsets[row + 1]
+void* count_chunk_degrees(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    size_t* row_sizes = task->graph->edge_offsets + 1;
+    for (size_t i = 0; i < task->edges->size; i++) {
+        const edge_record_t* record = &task->edges->records[i];
+        __atomic_fetch_add(&row_sizes[record->src_id], 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+// Places every edge in the row of its source, in no particular order within the row
+void* scatter_chunk_edges(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    directed_graph_t* graph = task->graph;
+    for (size_t i = 0; i < task->edges->size; i++) {
+        const edge_record_t* record = &task->edges->records[i];
+        const size_t position = task->first_edge_position + i;
+        const size_t edge = __atomic_fetch_add(&task->row_cursors[record->src_id], 1,
+                                               __ATOMIC_RELAXED);
+        graph->edge_targets[edge] = record->dst_id;
+        graph->edge_weights[edge] = record->weight;
+        task->edge_positions[edge] = position;
+    }
+    return NULL;
+}
+
+int compare_row_entries(const void* lhs, const void* rhs) {
+    const row_entry_t* lhs_entry = (const row_entry_t*)lhs;
+    const row_entry_t* rhs_entry = (const row_entry_t*)rhs;
+    if (lhs_entry->rank != rhs_entry->rank) {
+        return lhs_entry->rank < rhs_entry->rank ? -1 : 1;
+    }
+    if (lhs_entry->position != rhs_entry->position) {
+        return lhs_entry->position < rhs_entry->position ? -1 : 1;
+    }
+    return 0;
+}
+
+// Sorts the rows of the task by target name, parallel edges stay in the order they were listed
+void* sort_chunk_rows(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    directed_graph_t* graph = task->graph;
+    row_entry_t* entries = NULL;
+    size_t entries_capacity = 0;
+    for (size_t row = task->first_row; row < task->end_row; row++) {
+        const size_t row_begin = graph->edge_offsets[row];
+        const size_t row_size = graph->edge_offsets[row + 1] - row_begin;
+        if (row_size < 2) {
+            continue;
+        }
+        if (row_size > entries_capacity) {
+            entries_capacity = row_size;
+            entries = (row_entry_t*)realloc(entries, entries_capacity * sizeof(row_entry_t));
+        }
+
+        for (size_t i = 0; i < row_size; i++) {
+            const uint32_t target = graph->edge_targets[row_begin + i];
+            entries[i].rank = task->name_ranks[target];
+            entries[i].target = target;
+            entries[i].weight = graph->edge_weights[row_begin + i];
+            entries[i].position = task->edge_positions[row_begin + i];
+        }
+        qsort(entries, row_size, sizeof(row_entry_t), compare_row_entries);
+        for (size_t i = 0; i < row_size; i++) {
+            graph->edge_targets[row_begin + i] = entries[i].target;
+            graph->edge_weights[row_begin + i] = entries[i].weight;
+        }
+    }
+    free(entries);
+    return NULL;
+}
+
+void count_vertex_degrees(directed_graph_t* graph) {
+    const size_t degrees_size = graph->num_vertices * sizeof(uint32_t);
+    graph->in_degrees = (uint32_t*)arena_alloc(graph->arena, degrees_size);
+    graph->out_degrees = (uint32_t*)arena_alloc(graph->arena, degrees_size);
+    memset(graph->in_degrees, 0, degrees_size);
+    for (size_t i = 0; i < graph->num_vertices; i++) {
+        graph->out_degrees[i] = (uint32_t)(graph->edge_offsets[i + 1] - graph->edge_offsets[i]);
+    }
+    for (size_t edge = 0; edge < graph->num_edges; edge++) {
+        graph->in_degrees[graph->edge_targets[edge]]++;
+    }
+}
+
+// Builds the CSR layout from the edges the loader tasks parsed, with every row sorted by name
+void freeze_directed_graph(directed_graph_t* graph, loader_task_t* tasks, const size_t num_tasks) {
+    const size_t num_vertices = graph->num_vertices;
+    graph->edge_offsets = (size_t*)arena_alloc(graph->arena, (num_vertices + 1) * sizeof(size_t));
+    memset(graph->edge_offsets, 0, (num_vertices + 1) * sizeof(size_t));
+    run_loader_tasks(tasks, num_tasks, count_chunk_degrees);
+    for (size_t i = 0; i < num_vertices; i++) {
+        graph->edge_offsets[i + 1] += graph->edge_offsets[i];
+    }
+
+    graph->num_edges = graph->edge_offsets[num_vertices];
+    graph->edge_targets =
+        (uint32_t*)arena_alloc(graph->arena, graph->num_edges * sizeof(uint32_t));
+    graph->edge_weights = (int32_t*)arena_alloc(graph->arena, graph->num_edges * sizeof(int32_t));
+
+    // Every task scatters its edges through the shared row cursors and tags each with its
+    // position in the file, which the row sort uses to keep the result independent of timing
+    size_t* row_cursors = (size_t*)malloc((num_vertices + 1) * sizeof(size_t));
+    memcpy(row_cursors, graph->edge_offsets, (num_vertices + 1) * sizeof(size_t));
+    size_t* edge_positions = (size_t*)malloc((graph->num_edges + 1) * sizeof(size_t));
+    uint32_t* name_ranks = (uint32_t*)malloc((num_vertices + 1) * sizeof(uint32_t));
+    rank_vertex_names(graph->vertex_names, name_ranks);
+    size_t first_edge_position = 0;
+    for (size_t i = 0; i < num_tasks; i++) {
+        tasks[i].row_cursors = row_cursors;
+        tasks[i].edge_positions = edge_positions;
+        tasks[i].name_ranks = name_ranks;
+        tasks[i].first_edge_position = first_edge_position;
+        first_edge_position += tasks[i].edges->size;
+    }
+    run_loader_tasks(tasks, num_tasks, scatter_chunk_edges);
+
+    // Give every task a run of rows holding about the same number of edges to sort
+    size_t row = 0;
+    for (size_t i = 0; i < num_tasks; i++) {
+        const size_t edges_end = graph->num_edges / num_tasks * (i + 1);
+        tasks[i].first_row = row;
+        const bool last_task = i + 1 == num_tasks;
+        while (row < num_vertices && (last_task || graph->edge_offsets[row + 1] <= edges_end)) {
+            row++;
+        }
+        tasks[i].end_row = row;
+    }
+    run_loader_tasks(tasks, num_tasks, sort_chunk_rows);
+
+    free(name_ranks);
+    free(edge_positions);
+    free(row_cursors);
+    count_vertex_degrees(graph);
+}
+
+void free_directed_graph(directed_graph_t* graph) {
+    free_symbol_table(graph->vertex_names);
+    free(graph->vertex_names);
+    free_arena(graph->arena);
+    free(graph->arena);
+    if (graph->snapshot) {
+        unmap_file(graph->snapshot);
+        free(graph->snapshot);
+    }
+    graph->num_vertices = graph->num_edges = 0;
+}
+
+void write_directed_graph_sections(snapshot_writer_t* writer, const directed_graph_t* graph) {
+    write_symbol_table_sections(writer, graph->vertex_names);
+    write_snapshot_section(writer, SNAPSHOT_EDGE_OFFSETS, graph->edge_offsets,
+                           (graph->num_vertices + 1) * sizeof(size_t));
+    write_snapshot_section(writer, SNAPSHOT_EDGE_TARGETS, graph->edge_targets,
+                           graph->num_edges * sizeof(uint32_t));
+    write_snapshot_section(writer, SNAPSHOT_EDGE_WEIGHTS, graph->edge_weights,
+                           graph->num_edges * sizeof(int32_t));
+}
+
+void attach_directed_graph(directed_graph_t** graph, mapped_file_t* file) {
+    const snapshot_header_t* header = open_graph_snapshot(file, SNAPSHOT_DIRECTED);
+    const size_t num_vertices = header->num_vertices;
+    const size_t num_edges = header->num_edges;
+
+    *graph = (directed_graph_t*)malloc(sizeof(directed_graph_t));
+    (*graph)->num_vertices = num_vertices;
+    (*graph)->num_edges = num_edges;
+    create_arena(&(*graph)->arena, ARENA_BLOCK_SIZE);
+    attach_symbol_table(&(*graph)->vertex_names, file, header, (*graph)->arena);
+
+    // The CSR arrays are used in place, the graph owns the mapping from now on
+    (*graph)->edge_offsets = (size_t*)required_snapshot_section(
+        file, header, SNAPSHOT_EDGE_OFFSETS, (num_vertices + 1) * sizeof(size_t));
+    (*graph)->edge_targets = (uint32_t*)required_snapshot_section(
+        file, header, SNAPSHOT_EDGE_TARGETS, num_edges * sizeof(uint32_t));
+    (*graph)->edge_weights = (int32_t*)required_snapshot_section(
+        file, header, SNAPSHOT_EDGE_WEIGHTS, num_edges * sizeof(int32_t));
+    check_snapshot_offsets((const uint64_t*)(*graph)->edge_offsets, num_vertices, num_edges,
+                           "edge table");
+    check_snapshot_ids((*graph)->edge_targets, num_edges, num_vertices, "edge table");
+
+    // Degrees are used in place when the snapshot has them, otherwise counted from the CSR arrays
+    const size_t degrees_size = num_vertices * sizeof(uint32_t);
+    (*graph)->in_degrees =
+        (uint32_t*)snapshot_section(file, header, SNAPSHOT_IN_DEGREES, degrees_size);
+    (*graph)->out_degrees =
+        (uint32_t*)snapshot_section(file, header, SNAPSHOT_OUT_DEGREES, degrees_size);
+    if ((*graph)->in_degrees && (*graph)->out_degrees) {
+        // Out-degrees must match the rows and in-degrees add up to the edges
+        uint64_t in_degrees_sum = 0;
+        bool valid = true;
+        for (size_t i = 0; i < num_vertices && valid; i++) {
+            valid = (*graph)->out_degrees[i] ==
+                    (*graph)->edge_offsets[i + 1] - (*graph)->edge_offsets[i];
+            in_degrees_sum += (*graph)->in_degrees[i];
+        }
+        if (!valid || in_degrees_sum != num_edges) {
+            fprintf(stderr, "Snapshot has an invalid degree table\n");
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        count_vertex_degrees(*graph);
+    }
+    (*graph)->snapshot = file;
+}
+
+// Prints the row of one vertex the way the other tools print it in their graph dumps
+void print_adjacency(const directed_graph_t* graph, const uint32_t vert_id, output_sink_t* out) {
+    const int32_t head_dist = -1;
+    sink_puts(out, symbol_table_name(graph->vertex_names, vert_id));
+    sink_putc(out, '[');
+    sink_put_int(out, head_dist);
+    sink_puts(out, "] - ");
+    for (size_t edge = graph->edge_offsets[vert_id]; edge < graph->edge_offsets[vert_id + 1];
+         edge++) {
+        sink_puts(out, symbol_table_name(graph->vertex_names, graph->edge_targets[edge]));
+        sink_putc(out, '[');
+        sink_put_int(out, graph->edge_weights[edge]);
+        sink_puts(out, "] - ");
+    }
+    sink_puts(out, "NULL\n");
+}
+
+// Reads the vertex and edge lists with one loader task per chunk of the text
+void read_graph_from_file(directed_graph_t** graph, text_cursor_t* cursor,
+                          const size_t expected_edges, loader_task_t* tasks,
+                          const size_t num_tasks) {
+    for (size_t i = 0; i < num_tasks; i++) {
+        tasks[i].graph = *graph;
+    }
+
+    // Vertex ids are assigned in the order the vertices are listed, so the lines are counted
+    // first to give every chunk the ids of its vertices and to find where the edges begin
+    const size_t num_vertices = (*graph)->num_vertices;
+    split_text_into_chunks(cursor->pos, cursor->end, tasks, num_tasks);
+    run_loader_tasks(tasks, num_tasks, count_chunk_lines);
+    size_t vert_id = 0;
+    const char* edges_begin = cursor->end;
+    for (size_t i = 0; i < num_tasks; i++) {
+        tasks[i].first_vert_id = vert_id;
+        if (vert_id + tasks[i].num_lines < num_vertices) {
+            vert_id += tasks[i].num_lines;
+            continue;
+        }
+
+        // The vertex list ends in this chunk, cut it right after the last vertex
+        const char* pos = tasks[i].chunk_begin;
+        for (; vert_id < num_vertices; vert_id++) {
+            pos = (const char*)memchr(pos, '\n', tasks[i].chunk_end - pos) + 1;
+        }
+        edges_begin = tasks[i].chunk_end = pos;
+        for (size_t j = i + 1; j < num_tasks; j++) {
+            tasks[j].chunk_begin = tasks[j].chunk_end = pos;
+            tasks[j].first_vert_id = num_vertices;
+        }
+        break;
+    }
+    if (vert_id < num_vertices) {
+        // The last line of the file may lack its newline
+        const bool unterminated_line = cursor->end > cursor->pos && cursor->end[-1] != '\n';
+        if (vert_id + unterminated_line < num_vertices) {
+            fprintf(stderr, "Expected %zu vertices, the graph file has only %zu\n", num_vertices,
+                    vert_id + unterminated_line);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Intern the names in parallel, the table is presized so it never grows meanwhile
+    for (size_t i = 0; i < num_tasks; i++) {
+        create_arena(&tasks[i].arena, ARENA_BLOCK_SIZE);
+    }
+    run_loader_tasks(tasks, num_tasks, intern_chunk_vertices);
+    (*graph)->vertex_names->num_symbols = num_vertices;
+    for (size_t i = 0; i < num_tasks; i++) {
+        merge_arena((*graph)->arena, tasks[i].arena);
+        free(tasks[i].arena);
+        tasks[i].arena = NULL;
+    }
+
+    // Parse the edges in parallel, every task collects the edges of its chunk in file order
+    const size_t edges_size = cursor->end - edges_begin;
+    split_text_into_chunks(edges_begin, cursor->end, tasks, num_tasks);
+    for (size_t i = 0; i < num_tasks; i++) {
+        const size_t chunk_size = tasks[i].chunk_end - tasks[i].chunk_begin;
+        const size_t chunk_edges = expected_edges > 0 && edges_size > 0
+                                       ? (size_t)((double)expected_edges * chunk_size / edges_size)
+                                       : chunk_size / 16;
+        create_edge_buffer(&tasks[i].edges, chunk_edges + 1);
+    }
+    run_loader_tasks(tasks, num_tasks, parse_chunk_edges);
+}
+
+bool dfs_topological_sort(const directed_graph_t* graph, const uint32_t src_id,
+                          traversal_state_t* visited_verts, set_t* cycle_verts, dfs_stack_t* stack,
+                          topological_order_t* top_order, size_t* num_finished) {
+    // The set holds the vertices currently on the stack, reaching one of them again means
+    // there is a cycle in the graph
+    stack->size = 0;
+    mark_visited(visited_verts, src_id);
+    set_insert(cycle_verts, src_id);
+    push_dfs_frame(stack, src_id, graph->edge_offsets[src_id]);
+    while (stack->size > 0) {
+        dfs_frame_t* top = &stack->frames[stack->size - 1];
+        if (top->edge_cursor == graph->edge_offsets[top->vert_id + 1]) {
+            // Finished vertices fill the order from the back, giving the reversed post-order
+            set_remove(cycle_verts, top->vert_id);
+            const size_t position = top_order->num_vertices - ++(*num_finished);
+            top_order->order[position] = top->vert_id;
+            top_order->positions[top->vert_id] = (uint32_t)position;
+            stack->size--;
+            continue;
+        }
+
+        const uint32_t dst_id = graph->edge_targets[top->edge_cursor++];
+        if (set_contains(cycle_verts, dst_id)) {
+            return false;
+        }
+        if (!is_visited(visited_verts, dst_id)) {
+            mark_visited(visited_verts, dst_id);
+            set_insert(cycle_verts, dst_id);
+            push_dfs_frame(stack, dst_id, graph->edge_offsets[dst_id]);
+        }
+    }
+    return true;
+}
+
+void create_topological_order(topological_order_t** top_order, const directed_graph_t* graph,
+                              traversal_state_t* visited_verts, dfs_stack_t* stack) {
+    *top_order = (topological_order_t*)malloc(sizeof(topological_order_t));
+    (*top_order)->num_vertices = graph->num_vertices;
+    (*top_order)->is_cycle_free = true;
+    (*top_order)->mapped = false;
+    (*top_order)->order = (uint32_t*)malloc(graph->num_vertices * sizeof(uint32_t));
+    (*top_order)->positions = (uint32_t*)malloc(graph->num_vertices * sizeof(uint32_t));
+
+    set_t* cycle_verts;
+    create_set(&cycle_verts, graph->num_vertices);
+
+    begin_traversal(visited_verts);
+    size_t num_finished = 0;
+    for (uint32_t i = 0; i < graph->num_vertices; i++) {
+        if (!is_visited(visited_verts, i)) {
+            if (!dfs_topological_sort(graph, i, visited_verts, cycle_verts, stack, *top_order,
+                                      &num_finished)) {
+                (*top_order)->is_cycle_free = false;
+                break;
+            }
+        }
+    }
+
+    // Free the heap
+    free_set(cycle_verts);
+    free(cycle_verts);
+}
+
+// Takes the order from the snapshot of the graph when it has one, otherwise sorts the graph
+void load_topological_order(topological_order_t** top_order, const directed_graph_t* graph) {
+    if (graph->snapshot) {
+        const mapped_file_t* file = graph->snapshot;
+        const snapshot_header_t* header = (const snapshot_header_t*)file->data;
+        const size_t order_size = graph->num_vertices * sizeof(uint32_t);
+        const uint32_t* order =
+            (const uint32_t*)snapshot_section(file, header, SNAPSHOT_TOPOLOGICAL_ORDER, order_size);
+        const uint32_t* positions = (const uint32_t*)snapshot_section(
+            file, header, SNAPSHOT_TOPOLOGICAL_POSITIONS, order_size);
+        const bool has_cycle = header->flags & SNAPSHOT_HAS_CYCLE;
+        if (order && positions && !has_cycle) {
+            // Every vertex must be found at its own position, which makes both a permutation
+            check_snapshot_ids(order, graph->num_vertices, graph->num_vertices,
+                               "topological order");
+            for (size_t i = 0; i < graph->num_vertices; i++) {
+                if (positions[order[i]] != i) {
+                    fprintf(stderr, "Snapshot has an invalid topological order\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+        if ((order && positions) || has_cycle) {
+            *top_order = (topological_order_t*)malloc(sizeof(topological_order_t));
+            (*top_order)->num_vertices = graph->num_vertices;
+            (*top_order)->is_cycle_free = !has_cycle;
+            (*top_order)->order = has_cycle ? NULL : (uint32_t*)order;
+            (*top_order)->positions = has_cycle ? NULL : (uint32_t*)positions;
+            (*top_order)->mapped = true;
+            return;
+        }
+    }
+
+    traversal_state_t* visited_verts = NULL;
+    create_traversal_state(&visited_verts, graph->num_vertices);
+    dfs_stack_t* stack = NULL;
+    create_dfs_stack(&stack, graph->num_vertices);
+    create_topological_order(top_order, graph, visited_verts, stack);
+    free_dfs_stack(stack);
+    free(stack);
+    free_traversal_state(visited_verts);
+    free(visited_verts);
+}
+
+void free_topological_order(topological_order_t* top_order) {
+    if (!top_order->mapped) {
+        free(top_order->order);
+        free(top_order->positions);
+    }
+    top_order->num_vertices = 0;
+}
+
+int64_t get_distance(const topological_order_t* top_order, const int64_t* distances,
+                     const uint32_t vert_id) {
+    return distances[top_order->positions[vert_id]];
+}
+
+void update_distance(const topological_order_t* top_order, int64_t* distances,
+                     const uint32_t vert_id, const int64_t dist) {
+    distances[top_order->positions[vert_id]] = dist;
+}
+
+void create_distance_heap(distance_heap_t** heap, const size_t capacity) {
+    *heap = (distance_heap_t*)malloc(sizeof(distance_heap_t));
+    (*heap)->size = 0;
+    (*heap)->capacity = capacity;
+    // Offset the entries so no group of siblings straddles a cache line
+    (*heap)->storage = malloc((capacity + HEAP_ARITY) * sizeof(heap_entry_t) + 64);
+    const uintptr_t aligned = ((uintptr_t)(*heap)->storage + 63) & ~(uintptr_t)63;
+    (*heap)->entries = (heap_entry_t*)aligned + (HEAP_ARITY - 1);
+    (*heap)->indices = (uint32_t*)malloc((capacity + 1) * sizeof(uint32_t));
+    memset((*heap)->indices, 0xff, (capacity + 1) * sizeof(uint32_t));
+}
+
+void free_distance_heap(distance_heap_t* heap) {
+    free(heap->storage);
+    free(heap->indices);
+    heap->storage = NULL;
+    heap->entries = NULL;
+    heap->indices = NULL;
+    heap->size = heap->capacity = 0;
+}
+
+void place_heap_entry(distance_heap_t* heap, const size_t index, const heap_entry_t entry) {
+    heap->entries[index] = entry;
+    heap->indices[entry.vert_id] = (uint32_t)index;
+}
+
+void sift_heap_up(distance_heap_t* heap, size_t index) {
+    const heap_entry_t entry = heap->entries[index];
+    while (index > 0) {
+        const size_t parent = (index - 1) / HEAP_ARITY;
+        if (heap->entries[parent].dist <= entry.dist) {
+            break;
+        }
+        place_heap_entry(heap, index, heap->entries[parent]);
+        index = parent;
+    }
+    place_heap_entry(heap, index, entry);
+}
+
+void sift_heap_down(distance_heap_t* heap, size_t index) {
+    const heap_entry_t entry = heap->entries[index];
+    while (true) {
+        const size_t first_child = index * HEAP_ARITY + 1;
+        if (first_child >= heap->size) {
+            break;
+        }
+        const size_t end_child =
+            first_child + HEAP_ARITY < heap->size ? first_child + HEAP_ARITY : heap->size;
+        size_t closest = first_child;
+        for (size_t child = first_child + 1; child < end_child; child++) {
+            if (heap->entries[child].dist < heap->entries[closest].dist) {
+                closest = child;
+            }
+        }
+        if (heap->entries[closest].dist >= entry.dist) {
+            break;
+        }
+        place_heap_entry(heap, index, heap->entries[closest]);
+        index = closest;
+    }
+    place_heap_entry(heap, index, entry);
+}
+
+// Queues the vertex, or moves it up when it is queued already with a larger distance
+void decrease_heap_key(distance_heap_t* heap, const uint32_t vert_id, const int64_t dist) {
+    size_t index = heap->indices[vert_id];
+    if (index == INVALID_HEAP_INDEX) {
+        index = heap->size++;
+    }
+    heap->entries[index].dist = dist;
+    heap->entries[index].vert_id = vert_id;
+    sift_heap_up(heap, index);
+}
+
+uint32_t pop_heap_min(distance_heap_t* heap) {
+    const uint32_t vert_id = heap->entries[0].vert_id;
+    heap->indices[vert_id] = INVALID_HEAP_INDEX;
+    if (--heap->size > 0) {
+        heap->entries[0] = heap->entries[heap->size];
+        sift_heap_down(heap, 0);
+    }
+    return vert_id;
+}
+
+void run_dag_shortest_path(const directed_graph_t* graph, const uint32_t src_id,
+                           const topological_order_t* top_order, int64_t* distances) {
+    // Initialize the distances array to infinity
+    for (size_t i = 0; i < top_order->num_vertices; i++) {
+        distances[i] = INFINITE_DISTANCE;
+    }
+
+    // Update the source vertex to distance 0
+    update_distance(top_order, distances, src_id, 0);
+
+    // Update the rest of the distances
+    for (size_t position = 0; position < top_order->num_vertices; position++) {
+        const uint32_t u_id = top_order->order[position];
+        const int64_t u_vert_dist = distances[position];
+        // The source never reached u, a negative edge out of it must not lower INFINITE_DISTANCE
+        if (u_vert_dist == INFINITE_DISTANCE) {
+            continue;
+        }
+        for (size_t edge = graph->edge_offsets[u_id]; edge < graph->edge_offsets[u_id + 1];
+             edge++) {
+            const uint32_t v_id = graph->edge_targets[edge];
+            const int64_t v_vert_dist = get_distance(top_order, distances, v_id);
+            const int64_t candidate = u_vert_dist + graph->edge_weights[edge];
+            if (candidate < v_vert_dist) {
+                update_distance(top_order, distances, v_id, candidate);
+            }
+        }
+    }
+}
+
+bool has_negative_weights(const directed_graph_t* graph) {
+    for (size_t edge = 0; edge < graph->num_edges; edge++) {
+        if (graph->edge_weights[edge] < 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Graphs with a cycle have no topological order to relax the edges in, Dijkstra's algorithm
+// settles the vertices by distance instead. The weights must not be negative, distances are
+// indexed by vertex id
+void run_dijkstra_shortest_path(const directed_graph_t* graph, const uint32_t src_id,
+                                distance_heap_t* heap, int64_t* distances) {
+    for (size_t i = 0; i < graph->num_vertices; i++) {
+        distances[i] = INFINITE_DISTANCE;
+    }
+    distances[src_id] = 0;
+    decrease_heap_key(heap, src_id, 0);
+
+    // A settled vertex never gets a shorter distance again, so it is never queued twice
+    while (heap->size > 0) {
+        const uint32_t u_id = pop_heap_min(heap);
+        const int64_t u_vert_dist = distances[u_id];
+        for (size_t edge = graph->edge_offsets[u_id]; edge < graph->edge_offsets[u_id + 1];
+             edge++) {
+            const uint32_t v_id = graph->edge_targets[edge];
+            const int64_t candidate = u_vert_dist + graph->edge_weights[edge];
+            if (candidate < distances[v_id]) {
+                distances[v_id] = candidate;
+                decrease_heap_key(heap, v_id, candidate);
+            }
+        }
+    }
+}
+
+void create_bellman_ford_state(bellman_ford_state_t** state, const size_t capacity) {
+    *state = (bellman_ford_state_t*)malloc(sizeof(bellman_ford_state_t));
+    create_queue(&(*state)->queue, capacity);
+    create_set(&(*state)->queued, capacity);
+    (*state)->parents = (uint32_t*)malloc((capacity + 1) * sizeof(uint32_t));
+    (*state)->walk_starts = (uint32_t*)malloc((capacity + 1) * sizeof(uint32_t));
+    (*state)->cycle_length = 0;
+    (*state)->cycle = (uint32_t*)malloc((capacity + 1) * sizeof(uint32_t));
+}
+
+void free_bellman_ford_state(bellman_ford_state_t* state) {
+    free_queue(state->queue);
+    free(state->queue);
+    free_set(state->queued);
+    free(state->queued);
+    free(state->parents);
+    free(state->walk_starts);
+    free(state->cycle);
+    state->parents = state->walk_starts = state->cycle = NULL;
+    state->cycle_length = 0;
+}
+
+// Follows the parents of every reached vertex until the walk reaches the source or a vertex seen
+// before. A cycle among the parents is always negative, it is stored in the order of its edges
+bool find_negative_cycle(const directed_graph_t* graph, bellman_ford_state_t* state,
+                         const int64_t* distances) {
+    memset(state->walk_starts, 0, graph->num_vertices * sizeof(uint32_t));
+    for (uint32_t start_id = 0; start_id < graph->num_vertices; start_id++) {
+        if (distances[start_id] == INFINITE_DISTANCE || state->walk_starts[start_id] != 0) {
+            continue;
+        }
+        uint32_t vert_id = start_id;
+        while (vert_id != INVALID_VERTEX_ID && state->walk_starts[vert_id] == 0) {
+            state->walk_starts[vert_id] = start_id + 1;
+            vert_id = state->parents[vert_id];
+        }
+        if (vert_id == INVALID_VERTEX_ID || state->walk_starts[vert_id] != start_id + 1) {
+            continue;
+        }
+
+        // The walk went against the edges, so the cycle is stored back to front
+        state->cycle_length = 0;
+        uint32_t cycle_id = vert_id;
+        do {
+            state->cycle[state->cycle_length++] = cycle_id;
+            cycle_id = state->parents[cycle_id];
+        } while (cycle_id != vert_id);
+        for (size_t i = 0; i < state->cycle_length / 2; i++) {
+            const uint32_t swapped = state->cycle[i];
+            state->cycle[i] = state->cycle[state->cycle_length - 1 - i];
+            state->cycle[state->cycle_length - 1 - i] = swapped;
+        }
+        return true;
+    }
+    return false;
+}
+
+// Queue-based Bellman-Ford for graphs with a cycle and negative weights. Only the vertices whose
+// distance dropped have their edges relaxed again, so the search ends as soon as a round changes
+// nothing. A negative cycle keeps the queue from emptying, so the parents are checked for one
+// after every V relaxations, which adds O(1) per relaxation. Returns false when a negative cycle
+// is reachable from the source, which leaves the cycle in the state. Distances are indexed by
+// vertex id
+bool run_bellman_ford_shortest_path(const directed_graph_t* graph, const uint32_t src_id,
+                                    bellman_ford_state_t* state, int64_t* distances) {
+    for (size_t i = 0; i < graph->num_vertices; i++) {
+        distances[i] = INFINITE_DISTANCE;
+    }
+    distances[src_id] = 0;
+    state->parents[src_id] = INVALID_VERTEX_ID;
+    clear_queue(state->queue);
+    push_at_queue(state->queue, src_id);
+    set_insert(state->queued, src_id);
+
+    bool cycle_found = false;
+    size_t relaxations = 0;
+    while (state->queue->size > 0 && !cycle_found) {
+        const uint32_t u_id = pop_from_queue(state->queue);
+        set_remove(state->queued, u_id);
+        const int64_t u_vert_dist = distances[u_id];
+        for (size_t edge = graph->edge_offsets[u_id]; edge < graph->edge_offsets[u_id + 1];
+             edge++) {
+            const uint32_t v_id = graph->edge_targets[edge];
+            const int64_t candidate = u_vert_dist + graph->edge_weights[edge];
+            if (candidate >= distances[v_id]) {
+                continue;
+            }
+            distances[v_id] = candidate;
+            state->parents[v_id] = u_id;
+            if (set_insert(state->queued, v_id)) {
+                push_at_queue(state->queue, v_id);
+            }
+        }
+        relaxations += graph->edge_offsets[u_id + 1] - graph->edge_offsets[u_id];
+        if (relaxations >= graph->num_vertices) {
+            relaxations = 0;
+            cycle_found = find_negative_cycle(graph, state, distances);
+        }
+    }
+
+    // Vertices left queued after a cycle are unmarked for the next search
+    while (state->queue->size > 0) {
+        set_remove(state->queued, pop_from_queue(state->queue));
+    }
+    return !cycle_found;
+}
+
+void print_negative_cycle(const directed_graph_t* graph, const bellman_ford_state_t* state,
+                          output_sink_t* out) {
+    sink_puts(out, "Negative cycle:");
+    for (size_t i = 0; i < state->cycle_length; i++) {
+        sink_putc(out, ' ');
+        sink_puts(out, symbol_table_name(graph->vertex_names, state->cycle[i]));
+    }
+    sink_putc(out, '\n');
+}
+
+// Prints the distances in topological order, or in the order of the vertex list when the graph
+// has a cycle and the distances are indexed by vertex id
+void print_shortest_paths(const directed_graph_t* graph, const topological_order_t* top_order,
+                          const int64_t* distances, output_sink_t* out) {
+    for (size_t position = 0; position < top_order->num_vertices; position++) {
+        const uint32_t vert_id =
+            top_order->is_cycle_free ? top_order->order[position] : (uint32_t)position;
+        sink_puts(out, symbol_table_name(graph->vertex_names, vert_id));
+        if (distances[position] == INFINITE_DISTANCE) {
+            sink_puts(out, " INF\n");
+        } else {
+            sink_putc(out, ' ');
+            sink_put_int(out, distances[position]);
+            sink_putc(out, '\n');
+        }
+    }
+}
+
+void bfs_graph(const directed_graph_t* graph, const uint32_t src_id, traversal_state_t* state,
+               queue_t* bfs_queue) {
+    begin_traversal(state);
+    clear_queue(bfs_queue);
+    mark_visited(state, src_id);
+    push_at_queue(bfs_queue, src_id);
+    while (bfs_queue->size > 0) {
+        const uint32_t vert_id = pop_from_queue(bfs_queue);
+        for (size_t edge = graph->edge_offsets[vert_id]; edge < graph->edge_offsets[vert_id + 1];
+             edge++) {
+            const uint32_t neighbor_id = graph->edge_targets[edge];
+            if (!is_visited(state, neighbor_id)) {
+                mark_visited(state, neighbor_id);
+                push_at_queue(bfs_queue, neighbor_id);
+            }
+        }
+    }
+}
+
+void dfs_graph(const directed_graph_t* graph, const uint32_t src_id, traversal_state_t* state,
+               dfs_stack_t* stack) {
+    // Each frame resumes the edge scan of its vertex where the last descent left it
+    stack->size = 0;
+    push_dfs_frame(stack, src_id, graph->edge_offsets[src_id]);
+    while (stack->size > 0) {
+        dfs_frame_t* top = &stack->frames[stack->size - 1];
+        if (top->edge_cursor == graph->edge_offsets[top->vert_id + 1]) {
+            stack->size--;
+            continue;
+        }
+
+        const uint32_t dst_id = graph->edge_targets[top->edge_cursor++];
+        if (!is_visited(state, dst_id)) {
+            mark_visited(state, dst_id);
+            push_dfs_frame(stack, dst_id, graph->edge_offsets[dst_id]);
+        }
+    }
+}
+
+void print_visit_order(const directed_graph_t* graph, const traversal_state_t* state,
+                       output_sink_t* out) {
+    for (size_t i = 0; i < state->num_visited; i++) {
+        sink_puts(out, symbol_table_name(graph->vertex_names, state->visit_order[i]));
+        sink_putc(out, ' ');
+    }
+    sink_putc(out, '\n');
+}
+
+void create_query_session(query_session_t** session, const directed_graph_t* graph) {
+    const size_t num_vertices = graph->num_vertices;
+    *session = (query_session_t*)malloc(sizeof(query_session_t));
+    create_traversal_state(&(*session)->state, num_vertices);
+    create_queue(&(*session)->bfs_queue, num_vertices);
+    create_dfs_stack(&(*session)->stack, num_vertices);
+    (*session)->distances = (int64_t*)malloc((num_vertices + 1) * sizeof(int64_t));
+    create_distance_heap(&(*session)->heap, num_vertices);
+    (*session)->negative_weights = has_negative_weights(graph);
+    create_bellman_ford_state(&(*session)->bellman_ford, num_vertices);
+    create_output_sink(&(*session)->out, STDOUT_FILENO, OUTPUT_BUFFER_SIZE);
+}
+
+void free_query_session(query_session_t* session) {
+    free_traversal_state(session->state);
+    free(session->state);
+    free_queue(session->bfs_queue);
+    free(session->bfs_queue);
+    free_dfs_stack(session->stack);
+    free(session->stack);
+    free(session->distances);
+    free_distance_heap(session->heap);
+    free(session->heap);
+    free_bellman_ford_state(session->bellman_ford);
+    free(session->bellman_ford);
+    free_output_sink(session->out);
+    free(session->out);
+}
+
+// Request lines: "o <vertex>" and "i <vertex>" print the out / in degree, "a <vertex>" the row
+// of the vertex, "b <vertex>" the BFS order from it, "d [<vertex>]" the DFS order from it or of
+// the whole graph and "s <vertex>" the shortest paths from it. Every answer ends with an empty
+// line, so a client can send many requests before it reads the answers
+void answer_request(const directed_graph_t* graph, const topological_order_t* top_order,
+                    query_session_t* session, text_cursor_t line) {
+    const text_cursor_t request = line;
+    output_sink_t* out = session->out;
+    const char* token;
+    size_t token_len;
+    if (!next_token(&line, &token, &token_len)) {
+        return;
+    }
+    char query = token_len == 1 ? token[0] : '\0';
+
+    uint32_t vert_id = INVALID_VERTEX_ID;
+    if (next_token(&line, &token, &token_len)) {
+        vert_id = symbol_table_find(graph->vertex_names, token, token_len);
+        if (vert_id == INVALID_VERTEX_ID) {
+            sink_puts(out, "Unknown vertex ");
+            sink_write(out, token, token_len);
+            sink_puts(out, "\n\n");
+            return;
+        }
+    } else if (query != 'd') {
+        query = '\0';
+    }
+
+    if (query == 'o' || query == 'i') {
+        const bool out_degree = query == 'o';
+        const uint32_t* degrees = out_degree ? graph->out_degrees : graph->in_degrees;
+        sink_puts(out, out_degree ? "Out degree of vertex " : "In degree of vertex ");
+        sink_puts(out, symbol_table_name(graph->vertex_names, vert_id));
+        sink_puts(out, ": ");
+        sink_put_uint(out, degrees[vert_id]);
+        sink_putc(out, '\n');
+    } else if (query == 'a') {
+        print_adjacency(graph, vert_id, out);
+    } else if (query == 'b') {
+        // Vertices are marked in the order they are enqueued, which is the BFS order
+        bfs_graph(graph, vert_id, session->state, session->bfs_queue);
+        print_visit_order(graph, session->state, out);
+    } else if (query == 'd') {
+        begin_traversal(session->state);
+        if (vert_id != INVALID_VERTEX_ID) {
+            mark_visited(session->state, vert_id);
+            dfs_graph(graph, vert_id, session->state, session->stack);
+        } else {
+            // Every vertex not reached yet starts a search of its own, in vertex order
+            for (uint32_t i = 0; i < graph->num_vertices; i++) {
+                if (!is_visited(session->state, i)) {
+                    mark_visited(session->state, i);
+                    dfs_graph(graph, i, session->state, session->stack);
+                }
+            }
+        }
+        print_visit_order(graph, session->state, out);
+    } else if (query == 's') {
+        if (top_order->is_cycle_free) {
+            run_dag_shortest_path(graph, vert_id, top_order, session->distances);
+            print_shortest_paths(graph, top_order, session->distances, out);
+        } else if (!session->negative_weights) {
+            run_dijkstra_shortest_path(graph, vert_id, session->heap, session->distances);
+            print_shortest_paths(graph, top_order, session->distances, out);
+        } else if (run_bellman_ford_shortest_path(graph, vert_id, session->bellman_ford,
+                                                  session->distances)) {
+            print_shortest_paths(graph, top_order, session->distances, out);
+        } else {
+            print_negative_cycle(graph, session->bellman_ford, out);
+        }
+    } else {
+        sink_puts(out, "Unknown request ");
+        sink_write(out, request.pos, request.end - request.pos);
+        sink_putc(out, '\n');
+    }
+    sink_putc(out, '\n');
+}
+
+// Socket clients get an output queue, answers to the others are written to out_fd right away
+void create_client(client_t** client, const int in_fd, const int out_fd, const bool queued) {
+    *client = (client_t*)malloc(sizeof(client_t));
+    (*client)->in_fd = in_fd;
+    (*client)->out_fd = out_fd;
+    (*client)->pending = 0;
+    (*client)->capacity = REQUEST_BLOCK_SIZE;
+    (*client)->buffer = (char*)malloc(REQUEST_BLOCK_SIZE);
+    (*client)->skipping = false;
+    (*client)->end_of_input = false;
+    (*client)->output = NULL;
+    if (queued) {
+        create_output_queue(&(*client)->output);
+    }
+}
+
+void free_client(client_t* client) {
+    free(client->buffer);
+    client->buffer = NULL;
+    client->pending = client->capacity = 0;
+    if (client->output) {
+        free_output_queue(client->output);
+        free(client->output);
+        client->output = NULL;
+    }
+}
+
+// Reads what the client sent into its request buffer, returns false when reading fails. A
+// descriptor without anything to read yet leaves the buffer as it is
+bool read_client_requests(client_t* client) {
+    if (client->pending == client->capacity && client->capacity < MAX_REQUEST_SIZE) {
+        // A single request fills the whole buffer, make room for the rest of it
+        char* buffer_grown = (char*)realloc(client->buffer, client->capacity * 2);
+        if (buffer_grown == NULL) {
+            return false;
+        }
+        client->buffer = buffer_grown;
+        client->capacity *= 2;
+    }
+    const ssize_t num_read =
+        read(client->in_fd, client->buffer + client->pending, client->capacity - client->pending);
+    if (num_read == -1) {
+        return errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    if (num_read == 0) {
+        client->end_of_input = true;
+        return true;
+    }
+
+    char* data = client->buffer + client->pending;
+    size_t size = (size_t)num_read;
+    if (client->skipping) {
+        // Drop the rest of the overlong request up to its newline
+        const char* newline = (const char*)memchr(data, '\n', size);
+        if (newline == NULL) {
+            return true;
+        }
+        client->skipping = false;
+        size -= newline + 1 - data;
+        memmove(data, newline + 1, size);
+    }
+    client->pending += size;
+    return true;
+}
+
+// Answers the complete request lines of the client until OUTPUT_BUFFER_SIZE bytes of answers wait
+// for it, the other lines are answered once the client has taken those. After the client stopped
+// sending, an unfinished last line is answered too
+void answer_client_requests(const directed_graph_t* graph, const topological_order_t* top_order,
+                            query_session_t* session, client_t* client) {
+    output_sink_t* out = session->out;
+    out->fd = client->out_fd;
+    out->queue = client->output;
+    out->failed = false;
+    const char* lines_begin = client->buffer;
+    const char* data_end = client->buffer + client->pending;
+    while (lines_begin < data_end &&
+           output_queue_size(client->output) + out->used < OUTPUT_BUFFER_SIZE) {
+        const char* newline = (const char*)memchr(lines_begin, '\n', data_end - lines_begin);
+        if (newline == NULL && !client->end_of_input) {
+            break;
+        }
+        text_cursor_t cursor = {lines_begin, newline ? newline + 1 : data_end};
+        text_cursor_t line;
+        next_line(&cursor, &line);
+        answer_request(graph, top_order, session, line);
+        lines_begin = cursor.pos;
+    }
+    client->pending = data_end - lines_begin;
+    memmove(client->buffer, lines_begin, client->pending);
+
+    if (client->pending == MAX_REQUEST_SIZE) {
+        // The buffer is full and holds no newline, the request is refused and skipped
+        sink_puts(out, "Unknown request longer than ");
+        sink_put_uint(out, MAX_REQUEST_SIZE);
+        sink_puts(out, " bytes\n\n");
+        client->pending = 0;
+        client->skipping = true;
+    }
+    flush_output_sink(out);
+    // The queue goes away with its client, the sink must not hold on to it
+    out->queue = NULL;
+}
+
+// True when the client sent a request that is not answered yet, it is answered without waiting for
+// more input
+bool client_has_request(const client_t* client) {
+    return client->pending > 0 &&
+           (client->end_of_input || memchr(client->buffer, '\n', client->pending) != NULL);
+}
+
+// Sends as much of the queued answers as the client takes without blocking, returns false once
+// the client cannot be written to
+bool send_client_output(client_t* client) {
+    output_queue_t* queue = client->output;
+    while (queue->begin < queue->end) {
+        const ssize_t written =
+            write(client->out_fd, queue->data + queue->begin, queue->end - queue->begin);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        queue->begin += (size_t)written;
+    }
+    queue->begin = queue->end = 0;
+    return true;
+}
+
+// Sends the waiting answers first, and reads and answers new requests only once the client has
+// taken all of them. Returns false once the client has hung up and got every answer, or when it
+// cannot be served any more
+bool serve_client(const directed_graph_t* graph, const topological_order_t* top_order,
+                  query_session_t* session, client_t* client) {
+    if (client->output && !send_client_output(client)) {
+        return false;
+    }
+    if (output_queue_size(client->output) > 0) {
+        return true;
+    }
+
+    // Lines left over when the answers filled up the queue are answered before reading more
+    answer_client_requests(graph, top_order, session, client);
+    if (output_queue_size(client->output) == 0 && !client->end_of_input) {
+        if (!read_client_requests(client)) {
+            return false;
+        }
+        answer_client_requests(graph, top_order, session, client);
+    }
+    if (session->out->failed || (client->output && !send_client_output(client))) {
+        return false;
+    }
+    return !client->end_of_input || client->pending > 0 ||
+           output_queue_size(client->output) > 0;
+}
+
+void request_stop(int signal_number) {
+    (void)signal_number;
+    stop_requested = 1;
+}
+
+void install_signal_handlers() {
+    // A client that hangs up must not kill the server with SIGPIPE, the write to it fails instead
+    signal(SIGPIPE, SIG_IGN);
+
+    // Without SA_RESTART a blocked poll() or open() returns once the server is asked to stop
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+}
+
+int open_server_socket(const char* socket_path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path %s is too long\n", socket_path);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(address.sun_path, socket_path);
+
+    // A socket left behind by an earlier server is replaced, any other file is left alone
+    struct stat file_stat;
+    if (lstat(socket_path, &file_stat) == 0 && S_ISSOCK(file_stat.st_mode)) {
+        unlink(socket_path);
+    }
+
+    const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd == -1) {
+        perror("socket() failed for server socket");
+        exit(EXIT_FAILURE);
+    }
+    if (bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) == -1) {
+        perror("bind() failed for server socket");
+        exit(EXIT_FAILURE);
+    }
+    if (listen(listen_fd, MAX_CLIENTS) == -1) {
+        perror("listen() failed for server socket");
+        exit(EXIT_FAILURE);
+    }
+    return listen_fd;
+}
+
+// Serves all clients on the calling thread, every request is answered as soon as it is read, so
+// the clients share the scratch space of one session
+void serve_socket(const directed_graph_t* graph, const topological_order_t* top_order,
+                  query_session_t* session, const char* socket_path) {
+    const int listen_fd = open_server_socket(socket_path);
+    fprintf(stderr, "Serving requests on %s\n", socket_path);
+
+    struct pollfd fds[MAX_CLIENTS + 1];
+    client_t* clients[MAX_CLIENTS];
+    size_t num_clients = 0;
+    while (!stop_requested) {
+        // New connections wait in the backlog while every client slot is taken
+        fds[0].fd = num_clients < MAX_CLIENTS ? listen_fd : -1;
+        fds[0].events = POLLIN;
+        // A client with answers waiting gets no new requests read until it has taken them, one
+        // with requests left over is served as soon as its socket has room for their answers
+        for (size_t i = 0; i < num_clients; i++) {
+            const bool busy =
+                output_queue_size(clients[i]->output) > 0 || client_has_request(clients[i]);
+            fds[i + 1].fd = clients[i]->in_fd;
+            fds[i + 1].events = busy ? POLLOUT : POLLIN;
+        }
+        if (poll(fds, num_clients + 1, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll() failed for server socket");
+            exit(EXIT_FAILURE);
+        }
+
+        // Walk the clients from the back, a dropped client is replaced by one already served
+        for (size_t i = num_clients; i-- > 0;) {
+            if (fds[i + 1].revents == 0 || serve_client(graph, top_order, session, clients[i])) {
+                continue;
+            }
+            close(clients[i]->in_fd);
+            free_client(clients[i]);
+            free(clients[i]);
+            clients[i] = clients[--num_clients];
+        }
+
+        if (fds[0].revents & POLLIN) {
+            const int client_fd = accept(listen_fd, NULL, NULL);
+            if (client_fd == -1) {
+                if (errno != EINTR) {
+                    perror("accept() failed for server socket");
+                }
+                continue;
+            }
+            // Answers are sent as the socket has room for them, so writing never blocks the
+            // other clients
+            fcntl(client_fd, F_SETFL, fcntl(client_fd, F_GETFL) | O_NONBLOCK);
+            create_client(&clients[num_clients++], client_fd, client_fd, true);
+        }
+    }
+
+    for (size_t i = 0; i < num_clients; i++) {
+        close(clients[i]->in_fd);
+        free_client(clients[i]);
+        free(clients[i]);
+    }
+    close(listen_fd);
+    unlink(socket_path);
+}
+
+// Reads requests from a named pipe and answers them on stdout, the pipe is opened again whenever
+// its last writer closes it, so clients can come and go
+void serve_fifo(const directed_graph_t* graph, const topological_order_t* top_order,
+                query_session_t* session, const char* fifo_path) {
+    if (mkfifo(fifo_path, 0666) == -1 && errno != EEXIST) {
+        perror("mkfifo() failed for request pipe");
+        exit(EXIT_FAILURE);
+    }
+    struct stat file_stat;
+    if (stat(fifo_path, &file_stat) == -1 || !S_ISFIFO(file_stat.st_mode)) {
+        fprintf(stderr, "%s is not a named pipe\n", fifo_path);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "Serving requests on %s\n", fifo_path);
+
+    while (!stop_requested) {
+        // Opening the pipe for reading waits for the next writer
+        const int fifo_fd = open(fifo_path, O_RDONLY);
+        if (fifo_fd == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("open() failed for request pipe");
+            exit(EXIT_FAILURE);
+        }
+
+        client_t* client = NULL;
+        create_client(&client, fifo_fd, STDOUT_FILENO, false);
+        while (!stop_requested && serve_client(graph, top_order, session, client)) {
+        }
+        close(fifo_fd);
+        free_client(client);
+        free(client);
+
+        if (session->out->failed) {
+            fprintf(stderr, "Writing answers to stdout failed\n");
+            break;
+        }
+    }
+}
+
+// Reads the "<vertices> [<edges>]" header line, the edge count is optional and 0 when missing
+void read_graph_header(text_cursor_t* cursor, size_t* num_vertices, size_t* num_edges) {
+    text_cursor_t line;
+    if (!next_line(cursor, &line)) {
+        fprintf(stderr, "Missing graph header\n");
+        exit(EXIT_FAILURE);
+    }
+    const text_cursor_t header = line;
+
+    // Vertex ids are 32-bit and UINT32_MAX marks an invalid id, so both counts are capped there
+    const char* token;
+    size_t token_len;
+    uint64_t vertices = 0;
+    if (!next_token(&line, &token, &token_len) || !parse_count(token, token_len, &vertices) ||
+        vertices > UINT32_MAX) {
+        fprintf(stderr, "Invalid vertex count in graph header: %.*s\n",
+                (int)(header.end - header.pos), header.pos);
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t edges = 0;
+    if (next_token(&line, &token, &token_len) &&
+        (!parse_count(token, token_len, &edges) || edges > UINT32_MAX)) {
+        fprintf(stderr, "Invalid edge count in graph header: %.*s\n",
+                (int)(header.end - header.pos), header.pos);
+        exit(EXIT_FAILURE);
+    }
+
+    *num_vertices = (size_t)vertices;
+    *num_edges = (size_t)edges;
+}
+
+void write_graph_snapshot(const directed_graph_t* graph, const topological_order_t* top_order,
+                          const char* file_name) {
+    snapshot_writer_t writer;
+    const uint32_t flags = SNAPSHOT_DIRECTED | (top_order->is_cycle_free ? 0 : SNAPSHOT_HAS_CYCLE);
+    begin_snapshot(&writer, file_name, flags, graph->num_vertices, graph->num_edges);
+    write_directed_graph_sections(&writer, graph);
+    if (top_order->is_cycle_free) {
+        const size_t order_size = top_order->num_vertices * sizeof(uint32_t);
+        write_snapshot_section(&writer, SNAPSHOT_TOPOLOGICAL_ORDER, top_order->order, order_size);
+        write_snapshot_section(&writer, SNAPSHOT_TOPOLOGICAL_POSITIONS, top_order->positions,
+                               order_size);
+    }
+    const size_t degrees_size = graph->num_vertices * sizeof(uint32_t);
+    write_snapshot_section(&writer, SNAPSHOT_IN_DEGREES, graph->in_degrees, degrees_size);
+    write_snapshot_section(&writer, SNAPSHOT_OUT_DEGREES, graph->out_degrees, degrees_size);
+    end_snapshot(&writer);
+}
+
+// Parses the mapped graph text and takes over the mapping, which is released once loaded
+void load_graph_text(directed_graph_t** graph, mapped_file_t* graph_file,
+                     const size_t num_threads) {
+    text_cursor_t graph_cursor = {graph_file->data, graph_file->data + graph_file->size};
+
+    // Read the vertex count and the optional edge count from the header
+    size_t num_vertices = 0;
+    size_t num_edges = 0;
+    read_graph_header(&graph_cursor, &num_vertices, &num_edges);
+
+    // Split the text into chunks of at least LOADER_MIN_CHUNK_SIZE bytes, one per task, so
+    // small graphs are loaded on the calling thread alone
+    size_t num_tasks = 1 + (graph_cursor.end - graph_cursor.pos) / LOADER_MIN_CHUNK_SIZE;
+    if (num_tasks > num_threads) {
+        num_tasks = num_threads;
+    }
+    loader_task_t tasks[MAX_LOADER_THREADS];
+    memset(tasks, 0, sizeof(tasks));
+
+    // Create empty graph presized for the vertex count and read it
+    create_directed_graph(graph, num_vertices);
+    read_graph_from_file(graph, &graph_cursor, num_edges, tasks, num_tasks);
+
+    // The names were copied and the edges parsed, the mapping is no longer needed
+    unmap_file(graph_file);
+    free(graph_file);
+
+    // Build the CSR layout with neighbors sorted by name
+    freeze_directed_graph(*graph, tasks, num_tasks);
+    for (size_t i = 0; i < num_tasks; i++) {
+        free_edge_buffer(tasks[i].edges);
+        free(tasks[i].edges);
+    }
+}
+
+// Builds the graph from an edge stream, neither the vertex nor the edge count is known up front
+void load_graph_stream(directed_graph_t** graph, const int fd) {
+    // The name table and the edge buffer both grow by doubling as the stream goes on
+    loader_task_t task;
+    memset(&task, 0, sizeof(task));
+    create_directed_graph(graph, 0);
+    task.graph = *graph;
+    create_edge_buffer(&task.edges, 0);
+    read_edge_stream(*graph, fd, task.edges);
+    (*graph)->num_vertices = (*graph)->vertex_names->num_symbols;
+
+    // The stream has ended, build the CSR layout with neighbors sorted by name
+    freeze_directed_graph(*graph, &task, 1);
+    free_edge_buffer(task.edges);
+    free(task.edges);
+}
+
+int32_t main(int32_t argc, char** argv) {
+    // -s <file> serves requests on a Unix domain socket and -f <file> on a named pipe, whose
+    // answers go to stdout. -w <file> writes the loaded graph to a binary snapshot, which later
+    // runs can be given in place of the graph file, -j <threads> caps the threads that load graph
+    // text
+    const char* socket_path = NULL;
+    const char* fifo_path = NULL;
+    const char* snapshot_file_name = NULL;
+    long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t num_threads = online_cpus > 0 ? (size_t)online_cpus : 1;
+    int32_t option;
+    while ((option = getopt(argc, argv, "s:f:w:j:")) != -1) {
+        uint64_t threads = 0;
+        if (option == 's') {
+            socket_path = optarg;
+        } else if (option == 'f') {
+            fifo_path = optarg;
+        } else if (option == 'w') {
+            snapshot_file_name = optarg;
+        } else if (option == 'j' && parse_count(optarg, strlen(optarg), &threads) && threads > 0) {
+            num_threads = (size_t)threads;
+        } else {
+            socket_path = fifo_path = NULL;
+            break;
+        }
+    }
+    if ((socket_path == NULL) == (fifo_path == NULL)) {
+        fprintf(stderr,
+                "Usage: %s (-s socket_file | -f fifo_file) [-w snapshot_file] [-j threads] "
+                "graph_file\n",
+                argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (num_threads > MAX_LOADER_THREADS) {
+        num_threads = MAX_LOADER_THREADS;
+    }
+
+    if (argc - optind != 1) {
+        fprintf(stderr, "Incorrect number of arguments provided\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const char* graph_file_name = argv[optind];
+
+    // A graph file of "-" is an edge stream read from stdin, any other graph file is mapped and
+    // holds either graph text or a binary snapshot. A "shm:<name>" graph file attaches to the
+    // snapshot a "-w shm:<name>" run published
+    directed_graph_t* graph = NULL;
+    if (strcmp(graph_file_name, "-") == 0) {
+        load_graph_stream(&graph, STDIN_FILENO);
+    } else {
+        mapped_file_t* graph_file = NULL;
+        map_file(&graph_file, graph_file_name);
+        if (is_graph_snapshot(graph_file)) {
+            // Snapshots are stored frozen and sorted, the graph uses the mapping in place
+            attach_directed_graph(&graph, graph_file);
+        } else {
+            load_graph_text(&graph, graph_file, num_threads);
+        }
+    }
+
+    // The graph never changes while it is served, so it is sorted topologically only once
+    topological_order_t* top_order = NULL;
+    load_topological_order(&top_order, graph);
+    if (snapshot_file_name) {
+        write_graph_snapshot(graph, top_order, snapshot_file_name);
+    }
+
+    // Serve requests until the server is interrupted or terminated
+    install_signal_handlers();
+    query_session_t* session = NULL;
+    create_query_session(&session, graph);
+    if (socket_path) {
+        serve_socket(graph, top_order, session, socket_path);
+    } else {
+        serve_fifo(graph, top_order, session, fifo_path);
+    }
+    free_query_session(session);
+    free(session);
+    free_topological_order(top_order);
+    free(top_order);
+
+    // Report allocator usage and free graph memory
+    print_allocation_stats(graph->arena);
+    free_directed_graph(graph);
+    free(graph);
+
+    return 0;
+}
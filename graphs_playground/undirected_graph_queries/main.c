@@ -2,266 +2,1615 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
-typedef struct node {
-    char* data;
-    struct node* next;
-} node_t;
+#define INVALID_VERTEX_ID UINT32_MAX
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define STREAM_BLOCK_SIZE (1 << 20)
+// Chunks of graph text below this size are not worth a thread of their own
+#define LOADER_MIN_CHUNK_SIZE (1 << 20)
+#define MAX_LOADER_THREADS 64
+
+typedef struct arena_block {
+    struct arena_block* next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} arena_block_t;
+
+typedef struct arena {
+    arena_block_t* blocks;
+    size_t block_size;
+    size_t num_allocations;
+    size_t num_blocks;
+    size_t bytes_reserved;
+} arena_t;
 
-typedef struct slinked_list {
-    node_t* head;
-    node_t* tail;
+typedef struct symbol_table {
+    size_t num_symbols;
+    size_t names_capacity;
+    char** names;
+    // A mapped table finds its names through the offsets of the snapshot, names stays NULL then
+    const uint64_t* name_offsets;
+    const char* name_data;
+    size_t num_slots;
+    uint32_t* slots;
+    arena_t* arena;
+    // Names and slots point into a snapshot mapping, the table is read-only then
+    bool mapped;
+} symbol_table_t;
+
+typedef struct name_rank_entry {
+    const char* name;
+    uint32_t vert_id;
+} name_rank_entry_t;
+
+// Graph file mapped read-only into memory, the loader tokenizes it in place
+typedef struct mapped_file {
+    const char* data;
     size_t size;
-} slinked_list_t;
+} mapped_file_t;
+
+// Cursor over mapped text, lines and tokens are handed out as pointers into the mapping
+typedef struct text_cursor {
+    const char* pos;
+    const char* end;
+} text_cursor_t;
+
+// Output gathered in user space and handed to the kernel with one write() per flush
+typedef struct output_sink {
+    int fd;
+    size_t used;
+    size_t capacity;
+    char* data;
+} output_sink_t;
+
+#define SNAPSHOT_MAGIC "CLABGRPH"
+// Prefix of the graph and snapshot files that are POSIX shared memory segments
+#define SHARED_MEMORY_PREFIX "shm:"
+#define SNAPSHOT_VERSION 2
+// Snapshot flags
+#define SNAPSHOT_DIRECTED 0x1
+#define SNAPSHOT_HAS_CYCLE 0x2
+// Rows keep the order their edges were listed in instead of being sorted by name
+#define SNAPSHOT_FILE_ORDER 0x4
+
+// Sections of a graph snapshot, every one is optional and a section of size 0 is absent
+typedef enum snapshot_section_id {
+    SNAPSHOT_NAME_OFFSETS,
+    SNAPSHOT_NAMES,
+    SNAPSHOT_NAME_SLOTS,
+    SNAPSHOT_EDGE_OFFSETS,
+    SNAPSHOT_EDGE_TARGETS,
+    SNAPSHOT_EDGE_WEIGHTS,
+    SNAPSHOT_NAME_RANKS,
+    SNAPSHOT_TOPOLOGICAL_ORDER,
+    SNAPSHOT_TOPOLOGICAL_POSITIONS,
+    SNAPSHOT_IN_DEGREES,
+    SNAPSHOT_OUT_DEGREES,
+    SNAPSHOT_LISTED_TARGETS,
+    SNAPSHOT_NUM_SECTIONS
+} snapshot_section_id_t;
+
+typedef struct snapshot_section {
+    uint64_t offset;
+    uint64_t size;
+} snapshot_section_t;
+
+// Sections are laid out 8-byte aligned behind the header, so they can be used in place once the
+// snapshot is mapped
+typedef struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t num_vertices;
+    uint64_t num_edges;
+    snapshot_section_t sections[SNAPSHOT_NUM_SECTIONS];
+} snapshot_header_t;
+
+// CSR offsets are used in place as size_t
+_Static_assert(sizeof(size_t) == sizeof(uint64_t), "snapshots store 64-bit offsets");
+
+typedef struct snapshot_writer {
+    FILE* file;
+    snapshot_header_t header;
+    uint64_t offset;
+    snapshot_section_id_t section;
+} snapshot_writer_t;
 
 typedef struct undirected_graph {
     size_t vertices_count;
-    slinked_list_t** adjacency_lists;
+    // Each undirected edge is counted and stored once per endpoint
+    size_t edges_count;
+    symbol_table_t* vertex_names;
+    // Owns the vertex names and the CSR arrays, released in one go
+    arena_t* arena;
+    // Frozen CSR layout, the neighbors of vertex i are in [edge_offsets[i], edge_offsets[i + 1])
+    size_t* edge_offsets;
+    uint32_t* edge_targets;
+    // Position of every vertex in name order, the CSR rows are kept in this order
+    uint32_t* name_ranks;
+    // The same rows in the order their edges were listed, the 'a' query prints both
+    uint32_t* listed_targets;
+    // Snapshot mapping the arrays above point into, NULL for graphs parsed from text
+    mapped_file_t* snapshot;
 } undirected_graph_t;
 
-void create_slinked_list(slinked_list_t** list) {
-    (*list) = (slinked_list_t*)malloc(sizeof(slinked_list_t));
-    (*list)->head = (*list)->tail = NULL;
-    (*list)->size = 0;
+// An edge as a loader worker parsed it, before it is placed in the CSR layout
+typedef struct edge_record {
+    uint32_t src_id;
+    uint32_t dst_id;
+} edge_record_t;
+
+typedef struct edge_buffer {
+    size_t size;
+    size_t capacity;
+    edge_record_t* records;
+} edge_buffer_t;
+
+// Share of one loader worker in every parallel phase of loading a graph
+typedef struct loader_task {
+    undirected_graph_t* graph;
+    // Chunk of the graph text, it starts and ends on a line boundary
+    const char* chunk_begin;
+    const char* chunk_end;
+    size_t num_lines;
+    // Id of the vertex listed on the first line of the chunk
+    size_t first_vert_id;
+    // Names interned by this worker, merged into the graph arena afterwards
+    arena_t* arena;
+    // Edges of the chunk in file order and the file position of the first of them
+    edge_buffer_t* edges;
+    size_t first_edge_position;
+    // CSR rows this worker sorts
+    size_t first_row;
+    size_t end_row;
+    // Scratch arrays shared by all workers while the CSR layout is built
+    const uint32_t* name_ranks;
+    size_t* row_cursors;
+    size_t* edge_positions;
+} loader_task_t;
+
+// Neighbor of a row being sorted, ties between parallel edges keep their file order
+typedef struct row_entry {
+    uint32_t rank;
+    uint32_t target;
+    size_t position;
+} row_entry_t;
+
+void create_arena(arena_t** arena, const size_t block_size) {
+    *arena = (arena_t*)malloc(sizeof(arena_t));
+    (*arena)->blocks = NULL;
+    (*arena)->block_size = block_size;
+    (*arena)->num_allocations = 0;
+    (*arena)->num_blocks = 0;
+    (*arena)->bytes_reserved = 0;
 }
 
-void insert_node_at_end(slinked_list_t** list, char* data) {
-    node_t* new_node = (node_t*)malloc(sizeof(node_t));
-    char* copy_data = (char*)malloc(strlen(data) + 1);
-    strcpy(copy_data, data);
-    new_node->data = copy_data;
-    new_node->next = NULL;
-    if ((*list)->head == NULL) {
-        (*list)->head = new_node;
-    } else {
-        (*list)->tail->next = new_node;
+void* arena_alloc(arena_t* arena, const size_t size) {
+    const size_t aligned_size = (size + 7) & ~(size_t)7;
+    arena_block_t* block = arena->blocks;
+    if (block == NULL || block->used + aligned_size > block->capacity) {
+        const bool dedicated = aligned_size > arena->block_size / 4;
+        const size_t capacity = dedicated ? aligned_size : arena->block_size;
+        arena_block_t* new_block = (arena_block_t*)malloc(sizeof(arena_block_t) + capacity);
+        new_block->used = 0;
+        new_block->capacity = capacity;
+
+        // Large requests get a block of their own behind the current one, so the space left in
+        // the current block is still used by the small requests that follow
+        if (dedicated && block != NULL) {
+            new_block->next = block->next;
+            block->next = new_block;
+        } else {
+            new_block->next = block;
+            arena->blocks = new_block;
+        }
+        block = new_block;
+        arena->num_blocks++;
+        arena->bytes_reserved += capacity;
     }
 
-    (*list)->tail = new_node;
-    (*list)->size++;
+    void* ptr = block->data + block->used;
+    block->used += aligned_size;
+    arena->num_allocations++;
+    return ptr;
 }
 
-void delete_node(node_t* prev_node, node_t* node) {
-    if (node == NULL || prev_node == NULL) {
-        fprintf(stderr, "NULL node provided for deletion");
-        return;
+void reset_arena(arena_t* arena) {
+    arena_block_t* block = arena->blocks;
+    while (block) {
+        arena_block_t* retire = block;
+        block = block->next;
+        free(retire);
     }
+    arena->blocks = NULL;
+}
 
-    if (node->next) {
-        node_t* retire = node;
-        node = node->next;
-        prev_node->next = node;
-        free(retire->data);
-        free(retire);
+void free_arena(arena_t* arena) {
+    reset_arena(arena);
+    arena->num_allocations = arena->num_blocks = arena->bytes_reserved = 0;
+}
+
+// Moves all blocks of the other arena into this one, so they are released together
+void merge_arena(arena_t* arena, arena_t* other) {
+    if (other->blocks == NULL) {
         return;
     }
-    prev_node->next = NULL;
-    free(node);
+    arena_block_t* tail = other->blocks;
+    while (tail->next) {
+        tail = tail->next;
+    }
+
+    // Splice the blocks in behind the current block, which keeps serving small requests
+    if (arena->blocks == NULL) {
+        arena->blocks = other->blocks;
+    } else {
+        tail->next = arena->blocks->next;
+        arena->blocks->next = other->blocks;
+    }
+    arena->num_allocations += other->num_allocations;
+    arena->num_blocks += other->num_blocks;
+    arena->bytes_reserved += other->bytes_reserved;
+    other->blocks = NULL;
+    other->num_allocations = other->num_blocks = other->bytes_reserved = 0;
 }
 
-void free_list(slinked_list_t* list) {
-    node_t* temp = list->head;
-    while (temp) {
-        node_t* retire = temp;
-        temp = temp->next;
-        free(retire->data);
-        free(retire);
+void print_allocation_stats(const arena_t* arena) {
+    fprintf(stderr, "Arena: %zu allocations in %zu blocks (%zu bytes)\n", arena->num_allocations,
+            arena->num_blocks, arena->bytes_reserved);
+}
+
+uint64_t hash_vertex_name(const char* name, const size_t name_len) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < name_len; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+void create_symbol_table(symbol_table_t** table, const size_t expected_symbols, arena_t* arena) {
+    *table = (symbol_table_t*)malloc(sizeof(symbol_table_t));
+    (*table)->arena = arena;
+    (*table)->mapped = false;
+    (*table)->num_symbols = 0;
+    (*table)->names_capacity = expected_symbols > 0 ? expected_symbols : 16;
+    (*table)->names = (char**)malloc((*table)->names_capacity * sizeof(char*));
+    (*table)->name_offsets = NULL;
+    (*table)->name_data = NULL;
+
+    // Keep the load factor of the open addressing table at most one half
+    size_t num_slots = 16;
+    while (num_slots < 2 * (*table)->names_capacity) {
+        num_slots <<= 1;
+    }
+    (*table)->num_slots = num_slots;
+    (*table)->slots = (uint32_t*)malloc(num_slots * sizeof(uint32_t));
+    memset((*table)->slots, 0xff, num_slots * sizeof(uint32_t));
+}
+
+void free_symbol_table(symbol_table_t* table) {
+    // The names themselves live in the arena of the table or in the snapshot mapping
+    free(table->names);
+    if (!table->mapped) {
+        free(table->slots);
+    }
+    table->num_symbols = table->num_slots = 0;
+}
+
+const char* symbol_table_name(const symbol_table_t* table, const uint32_t vert_id) {
+    if (table->mapped) {
+        return table->name_data + table->name_offsets[vert_id];
+    }
+    return table->names[vert_id];
+}
+
+size_t find_symbol_slot(const symbol_table_t* table, const char* name, const size_t name_len) {
+    const size_t mask = table->num_slots - 1;
+    size_t slot = hash_vertex_name(name, name_len) & mask;
+    while (table->slots[slot] != INVALID_VERTEX_ID) {
+        const char* slot_name = symbol_table_name(table, table->slots[slot]);
+        if (strncmp(slot_name, name, name_len) == 0 && slot_name[name_len] == '\0') {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void grow_symbol_table(symbol_table_t* table) {
+    const size_t num_slots = table->num_slots << 1;
+    free(table->slots);
+    table->slots = (uint32_t*)malloc(num_slots * sizeof(uint32_t));
+    memset(table->slots, 0xff, num_slots * sizeof(uint32_t));
+    table->num_slots = num_slots;
+
+    // Rehash every interned name into the larger table
+    for (size_t i = 0; i < table->num_symbols; i++) {
+        const char* name = table->names[i];
+        table->slots[find_symbol_slot(table, name, strlen(name))] = (uint32_t)i;
+    }
+}
+
+uint32_t symbol_table_find(const symbol_table_t* table, const char* name, const size_t name_len) {
+    return table->slots[find_symbol_slot(table, name, name_len)];
+}
+
+uint32_t symbol_table_intern(symbol_table_t* table, const char* name, const size_t name_len) {
+    size_t slot = find_symbol_slot(table, name, name_len);
+    if (table->slots[slot] != INVALID_VERTEX_ID) {
+        return table->slots[slot];
+    }
+
+    if (2 * (table->num_symbols + 1) > table->num_slots) {
+        grow_symbol_table(table);
+        slot = find_symbol_slot(table, name, name_len);
+    }
+    if (table->num_symbols == table->names_capacity) {
+        table->names_capacity *= 2;
+        table->names = (char**)realloc(table->names, table->names_capacity * sizeof(char*));
+    }
+
+    char* copy_name = (char*)arena_alloc(table->arena, name_len + 1);
+    memcpy(copy_name, name, name_len);
+    copy_name[name_len] = '\0';
+
+    const uint32_t vert_id = (uint32_t)table->num_symbols++;
+    table->names[vert_id] = copy_name;
+    table->slots[slot] = vert_id;
+    return vert_id;
+}
+
+// Inserts a name under an id picked by the caller, several threads may insert at once as long as
+// the table is sized for all names up front. Returns false when the name is already in the table
+bool symbol_table_insert_concurrent(symbol_table_t* table, const char* name, const size_t name_len,
+                                    const uint32_t vert_id) {
+    // The name is published before its slot, so whoever finds the slot can compare the name
+    __atomic_store_n(&table->names[vert_id], (char*)name, __ATOMIC_RELEASE);
+
+    const size_t mask = table->num_slots - 1;
+    size_t slot = hash_vertex_name(name, name_len) & mask;
+    for (;;) {
+        uint32_t slot_id = __atomic_load_n(&table->slots[slot], __ATOMIC_ACQUIRE);
+        if (slot_id == INVALID_VERTEX_ID &&
+            __atomic_compare_exchange_n(&table->slots[slot], &slot_id, vert_id, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return true;
+        }
+
+        // The slot is taken, slot_id holds the id of its name
+        const char* slot_name = __atomic_load_n(&table->names[slot_id], __ATOMIC_ACQUIRE);
+        if (strncmp(slot_name, name, name_len) == 0 && slot_name[name_len] == '\0') {
+            return false;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+int compare_name_rank_entries(const void* lhs, const void* rhs) {
+    const name_rank_entry_t* lhs_entry = (const name_rank_entry_t*)lhs;
+    const name_rank_entry_t* rhs_entry = (const name_rank_entry_t*)rhs;
+    return strcmp(lhs_entry->name, rhs_entry->name);
+}
+
+void rank_vertex_names(const symbol_table_t* table, uint32_t* name_ranks) {
+    // name_ranks[id] is the position of the name of id in lexicographic order
+    const size_t num_symbols = table->num_symbols;
+    name_rank_entry_t* entries =
+        (name_rank_entry_t*)malloc(num_symbols * sizeof(name_rank_entry_t));
+    for (size_t i = 0; i < num_symbols; i++) {
+        entries[i].name = symbol_table_name(table, (uint32_t)i);
+        entries[i].vert_id = (uint32_t)i;
+    }
+    qsort(entries, num_symbols, sizeof(name_rank_entry_t), compare_name_rank_entries);
+    for (size_t i = 0; i < num_symbols; i++) {
+        name_ranks[entries[i].vert_id] = (uint32_t)i;
+    }
+    free(entries);
+}
+
+bool is_shared_memory_name(const char* file_name) {
+    return strncmp(file_name, SHARED_MEMORY_PREFIX, sizeof(SHARED_MEMORY_PREFIX) - 1) == 0;
+}
+
+// A "shm:<name>" file is the POSIX shared memory segment <name>, every process attached to it
+// maps the same pages. Its sections are checked once when they are attached and used in place from
+// then on, so the segment must come from a trusted publisher that never changes it afterwards
+void map_file(mapped_file_t** file, const char* file_name) {
+    const bool shared = is_shared_memory_name(file_name);
+    const int fd = shared ? shm_open(file_name + sizeof(SHARED_MEMORY_PREFIX) - 1, O_RDONLY, 0)
+                          : open(file_name, O_RDONLY);
+    if (fd == -1) {
+        perror(shared ? "shm_open() failed for graph segment" : "open() failed for graph file");
+        exit(EXIT_FAILURE);
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1) {
+        perror("fstat() failed for graph file");
+        exit(EXIT_FAILURE);
+    }
+
+    *file = (mapped_file_t*)malloc(sizeof(mapped_file_t));
+    (*file)->data = NULL;
+    (*file)->size = (size_t)file_stat.st_size;
+    if ((*file)->size > 0) {
+        void* data = mmap(NULL, (*file)->size, PROT_READ, shared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror("mmap() failed for graph file");
+            exit(EXIT_FAILURE);
+        }
+        // The file is read front to back exactly once
+        madvise(data, (*file)->size, MADV_SEQUENTIAL);
+        (*file)->data = (const char*)data;
     }
-    list->head = list->tail = NULL;
-    list->size = 0;
+    close(fd);
 }
 
-void sort_slinked_list(const slinked_list_t* list, slinked_list_t* list_out) {
-    slinked_list_t* copy_list;
-    create_slinked_list(&copy_list);
+void unmap_file(mapped_file_t* file) {
+    if (file->data) {
+        munmap((void*)file->data, file->size);
+    }
+    file->data = NULL;
+    file->size = 0;
+}
+
+// Hands out the next line without its line ending, returns false at the end of the text
+bool next_line(text_cursor_t* cursor, text_cursor_t* line) {
+    if (cursor->pos >= cursor->end) {
+        return false;
+    }
+
+    const char* line_begin = cursor->pos;
+    const char* newline = (const char*)memchr(line_begin, '\n', cursor->end - line_begin);
+    const char* line_end = newline ? newline : cursor->end;
+    cursor->pos = newline ? newline + 1 : cursor->end;
+    if (line_end > line_begin && line_end[-1] == '\r') {
+        line_end--;
+    }
+
+    line->pos = line_begin;
+    line->end = line_end;
+    return true;
+}
+
+#if defined(__x86_64__)
+// Marks every space or tab of an 8-byte word with the high bit of its byte, the lowest marked
+// byte is always a blank, marks above it may be false positives
+uint64_t blank_byte_mask(const uint64_t word) {
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t spaces = word ^ (ones * ' ');
+    const uint64_t tabs = word ^ (ones * '\t');
+    return (((spaces - ones) & ~spaces) | ((tabs - ones) & ~tabs)) & (ones * 0x80);
+}
+
+__attribute__((target("avx2"))) const char* find_blank_avx2(const char* pos, const char* end) {
+    const __m256i spaces = _mm256_set1_epi8(' ');
+    const __m256i tabs = _mm256_set1_epi8('\t');
+    while (end - pos >= 32) {
+        const __m256i block = _mm256_loadu_si256((const __m256i*)pos);
+        const uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, spaces), _mm256_cmpeq_epi8(block, tabs)));
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 32;
+    }
+    return pos;
+}
+#endif
+
+// Returns the first space or tab in [pos, end), or end when there is none. Blocks of 32, 16 and
+// 8 bytes are compared at once while they fit in the range, only the last few bytes one by one
+const char* find_blank(const char* pos, const char* end) {
+#if defined(__x86_64__)
+    // AVX2 is picked at run time, SSE2 is part of every x86-64 CPU. A search stopped on a blank
+    // finds it again right away in the next step
+    if (end - pos >= 32 && __builtin_cpu_supports("avx2")) {
+        pos = find_blank_avx2(pos, end);
+    }
+    const __m128i spaces = _mm_set1_epi8(' ');
+    const __m128i tabs = _mm_set1_epi8('\t');
+    while (end - pos >= 16) {
+        const __m128i block = _mm_loadu_si128((const __m128i*)pos);
+        const uint32_t mask = (uint32_t)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(block, spaces), _mm_cmpeq_epi8(block, tabs)));
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 16;
+    }
+    while (end - pos >= 8) {
+        uint64_t word;
+        memcpy(&word, pos, sizeof(word));
+        const uint64_t mask = blank_byte_mask(word);
+        if (mask != 0) {
+            return pos + (__builtin_ctzll(mask) >> 3);
+        }
+        pos += 8;
+    }
+#endif
+    while (pos < end && *pos != ' ' && *pos != '\t') {
+        pos++;
+    }
+    return pos;
+}
 
-    node_t* temp = list->head;
-    while (temp) {
-        insert_node_at_end(&copy_list, temp->data);
-        temp = temp->next;
+// Splits the next blank separated token off the front of a line, returns false when none is left
+bool next_token(text_cursor_t* line, const char** token, size_t* token_len) {
+    // Tokens are mostly separated by a single blank, so only the token end is searched in blocks
+    const char* pos = line->pos;
+    while (pos < line->end && (*pos == ' ' || *pos == '\t')) {
+        pos++;
     }
+    const char* token_begin = pos;
+    pos = find_blank(pos, line->end);
 
-    node_t* curr_head = copy_list->head;
-    while (curr_head) {
-        node_t* iter = curr_head;
-        node_t* prev_iter = curr_head;
-        node_t* min = curr_head;
-        node_t* prev_min = curr_head;
-        while (iter) {
-            int32_t rc = strcmp(iter->data, min->data);
-            if (rc < 0) {
-                prev_min = prev_iter;
-                min = iter;
+    line->pos = pos;
+    *token = token_begin;
+    *token_len = pos - token_begin;
+    return *token_len > 0;
+}
+
+bool parse_count(const char* token, const size_t token_len, uint64_t* value) {
+    uint64_t result = 0;
+    for (size_t i = 0; i < token_len; i++) {
+        const uint32_t digit = (uint32_t)(token[i] - '0');
+        if (digit > 9 || result > (UINT64_MAX - digit) / 10) {
+            return false;
+        }
+        result = result * 10 + digit;
+    }
+    *value = result;
+    return token_len > 0;
+}
+
+void create_output_sink(output_sink_t** sink, const int fd, const size_t capacity) {
+    *sink = (output_sink_t*)malloc(sizeof(output_sink_t));
+    (*sink)->fd = fd;
+    (*sink)->used = 0;
+    (*sink)->capacity = capacity;
+    (*sink)->data = (char*)malloc(capacity);
+}
+
+void write_all(const int fd, const char* data, size_t size) {
+    // Pipes and sockets may take less than asked for, keep going until everything is out
+    while (size > 0) {
+        const ssize_t written = write(fd, data, size);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
             }
-            prev_iter = iter;
-            iter = iter->next;
+            perror("write() failed for output");
+            exit(EXIT_FAILURE);
         }
-        insert_node_at_end(&list_out, min->data);
-        if (prev_min != min) {
-            delete_node(prev_min, min);
-        } else {
-            curr_head = curr_head->next;
+        data += written;
+        size -= (size_t)written;
+    }
+}
+
+void flush_output_sink(output_sink_t* sink) {
+    write_all(sink->fd, sink->data, sink->used);
+    sink->used = 0;
+}
+
+void free_output_sink(output_sink_t* sink) {
+    flush_output_sink(sink);
+    free(sink->data);
+    sink->data = NULL;
+    sink->capacity = 0;
+}
+
+void sink_write(output_sink_t* sink, const char* data, const size_t size) {
+    if (sink->used + size > sink->capacity) {
+        flush_output_sink(sink);
+        if (size > sink->capacity) {
+            write_all(sink->fd, data, size);
+            return;
+        }
+    }
+    memcpy(sink->data + sink->used, data, size);
+    sink->used += size;
+}
+
+void sink_puts(output_sink_t* sink, const char* str) {
+    sink_write(sink, str, strlen(str));
+}
+
+void sink_putc(output_sink_t* sink, const char c) {
+    if (sink->used == sink->capacity) {
+        flush_output_sink(sink);
+    }
+    sink->data[sink->used++] = c;
+}
+
+void sink_put_uint(output_sink_t* sink, uint64_t value) {
+    // Digits come out lowest first, so they are filled in from the back of the buffer
+    char digits[20];
+    size_t num_digits = 0;
+    do {
+        digits[sizeof(digits) - ++num_digits] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    sink_write(sink, digits + sizeof(digits) - num_digits, num_digits);
+}
+
+// A "shm:<name>" snapshot is published as a new shared memory segment, processes still attached
+// to an earlier segment of that name keep theirs until they detach. The segment is created
+// read-only, so once published no one but its owner can open it for writing
+FILE* open_snapshot_file(const char* file_name) {
+    if (!is_shared_memory_name(file_name)) {
+        return fopen(file_name, "wb");
+    }
+    const char* segment_name = file_name + sizeof(SHARED_MEMORY_PREFIX) - 1;
+    shm_unlink(segment_name);
+    const int fd = shm_open(segment_name, O_CREAT | O_EXCL | O_RDWR, 0444);
+    return fd == -1 ? NULL : fdopen(fd, "wb");
+}
+
+void begin_snapshot(snapshot_writer_t* writer, const char* file_name, const uint32_t flags,
+                    const size_t num_vertices, const size_t num_edges) {
+    writer->file = open_snapshot_file(file_name);
+    if (!writer->file) {
+        perror("Opening the snapshot file failed");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&writer->header, 0, sizeof(snapshot_header_t));
+    memcpy(writer->header.magic, SNAPSHOT_MAGIC, sizeof(writer->header.magic));
+    writer->header.version = SNAPSHOT_VERSION;
+    writer->header.flags = flags;
+    writer->header.num_vertices = num_vertices;
+    writer->header.num_edges = num_edges;
+
+    // The header is written with the section table once all sections are in, until then a blank
+    // one holds its place, so a snapshot that is still being written is never taken for one
+    const snapshot_header_t blank_header = {0};
+    fwrite(&blank_header, sizeof(snapshot_header_t), 1, writer->file);
+    writer->offset = sizeof(snapshot_header_t);
+}
+
+void begin_snapshot_section(snapshot_writer_t* writer, const snapshot_section_id_t section) {
+    writer->section = section;
+    writer->header.sections[section].offset = writer->offset;
+    writer->header.sections[section].size = 0;
+}
+
+void append_snapshot_data(snapshot_writer_t* writer, const void* data, const size_t size) {
+    fwrite(data, 1, size, writer->file);
+    writer->header.sections[writer->section].size += size;
+    writer->offset += size;
+}
+
+void end_snapshot_section(snapshot_writer_t* writer) {
+    static const char padding[8] = {0};
+    const size_t padding_size = (8 - writer->offset % 8) % 8;
+    fwrite(padding, 1, padding_size, writer->file);
+    writer->offset += padding_size;
+}
+
+void write_snapshot_section(snapshot_writer_t* writer, const snapshot_section_id_t section,
+                            const void* data, const size_t size) {
+    begin_snapshot_section(writer, section);
+    append_snapshot_data(writer, data, size);
+    end_snapshot_section(writer);
+}
+
+void end_snapshot(snapshot_writer_t* writer) {
+    fseek(writer->file, 0, SEEK_SET);
+    fwrite(&writer->header, sizeof(snapshot_header_t), 1, writer->file);
+    if (ferror(writer->file) || fclose(writer->file) != 0) {
+        perror("Writing the snapshot file failed");
+        exit(EXIT_FAILURE);
+    }
+    writer->file = NULL;
+}
+
+bool is_graph_snapshot(const mapped_file_t* file) {
+    return file->size >= sizeof(snapshot_header_t) &&
+           memcmp(file->data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC) - 1) == 0;
+}
+
+// Checks the header and the section table, the attach functions check the contents of the
+// sections they use
+const snapshot_header_t* open_graph_snapshot(const mapped_file_t* file, const uint32_t flags) {
+    const snapshot_header_t* header = (const snapshot_header_t*)file->data;
+    if (header->version != SNAPSHOT_VERSION) {
+        fprintf(stderr, "Unsupported snapshot version %u\n", header->version);
+        exit(EXIT_FAILURE);
+    }
+    if ((header->flags & SNAPSHOT_DIRECTED) != (flags & SNAPSHOT_DIRECTED)) {
+        fprintf(stderr, "Snapshot holds %s graph\n",
+                header->flags & SNAPSHOT_DIRECTED ? "a directed" : "an undirected");
+        exit(EXIT_FAILURE);
+    }
+    if ((header->flags & SNAPSHOT_FILE_ORDER) != (flags & SNAPSHOT_FILE_ORDER)) {
+        fprintf(stderr, "Snapshot rows are in %s order\n",
+                header->flags & SNAPSHOT_FILE_ORDER ? "file" : "name");
+        exit(EXIT_FAILURE);
+    }
+    if (header->num_vertices > UINT32_MAX) {
+        fprintf(stderr, "Invalid vertex count in snapshot: %" PRIu64 "\n", header->num_vertices);
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < SNAPSHOT_NUM_SECTIONS; i++) {
+        const snapshot_section_t* section = &header->sections[i];
+        if (section->size > 0 &&
+            (section->offset % 8 != 0 || section->offset > file->size ||
+             section->size > file->size - section->offset)) {
+            fprintf(stderr, "Snapshot section %zu is out of bounds\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Sections are read in place, prefetch the whole mapping
+    madvise((void*)file->data, file->size, MADV_WILLNEED);
+    return header;
+}
+
+// Returns the section in the mapping, or NULL when the snapshot does not have it
+const void* snapshot_section(const mapped_file_t* file, const snapshot_header_t* header,
+                             const snapshot_section_id_t section, const size_t expected_size) {
+    if (header->sections[section].size == 0) {
+        return expected_size == 0 ? file->data + header->sections[section].offset : NULL;
+    }
+    if (header->sections[section].size != expected_size) {
+        fprintf(stderr, "Snapshot section %d has %" PRIu64 " bytes instead of %zu\n", (int)section,
+                header->sections[section].size, expected_size);
+        exit(EXIT_FAILURE);
+    }
+    return file->data + header->sections[section].offset;
+}
+
+const void* required_snapshot_section(const mapped_file_t* file, const snapshot_header_t* header,
+                                      const snapshot_section_id_t section,
+                                      const size_t expected_size) {
+    const void* data = snapshot_section(file, header, section, expected_size);
+    if (data == NULL) {
+        fprintf(stderr, "Snapshot is missing section %d\n", (int)section);
+        exit(EXIT_FAILURE);
+    }
+    return data;
+}
+
+// Stops with an error unless the offsets start at 0, never decrease and end at the given value
+void check_snapshot_offsets(const uint64_t* offsets, const size_t count, const uint64_t end,
+                            const char* table_name) {
+    bool valid = offsets[0] == 0 && offsets[count] == end;
+    for (size_t i = 0; i < count && valid; i++) {
+        valid = offsets[i] <= offsets[i + 1];
+    }
+    if (!valid) {
+        fprintf(stderr, "Snapshot has an invalid %s\n", table_name);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Stops with an error unless every id is below the limit
+void check_snapshot_ids(const uint32_t* ids, const size_t count, const size_t limit,
+                        const char* table_name) {
+    for (size_t i = 0; i < count; i++) {
+        if (ids[i] >= limit) {
+            fprintf(stderr, "Snapshot has an invalid %s\n", table_name);
+            exit(EXIT_FAILURE);
         }
     }
+}
+
+// Every name must end with its terminator inside the names section and every slot must be empty
+// or hold a vertex id. No more ids than vertices leaves empty slots for every lookup to stop at
+void check_snapshot_name_table(const uint64_t* name_offsets, const char* names,
+                               const size_t num_symbols, const uint32_t* slots,
+                               const size_t num_slots) {
+    bool valid = name_offsets[0] == 0;
+    for (size_t i = 0; i < num_symbols && valid; i++) {
+        valid = name_offsets[i] < name_offsets[i + 1];
+    }
+    for (size_t i = 0; i < num_symbols && valid; i++) {
+        valid = names[name_offsets[i + 1] - 1] == '\0';
+    }
+    size_t num_filled = 0;
+    for (size_t i = 0; i < num_slots && valid; i++) {
+        if (slots[i] != INVALID_VERTEX_ID) {
+            valid = slots[i] < num_symbols;
+            num_filled++;
+        }
+    }
+    if (!valid || num_filled > num_symbols) {
+        fprintf(stderr, "Snapshot has an invalid name table\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void write_symbol_table_sections(snapshot_writer_t* writer, const symbol_table_t* table) {
+    // Names are stored back to back with their terminators and found through their offsets
+    uint64_t name_offset = 0;
+    begin_snapshot_section(writer, SNAPSHOT_NAME_OFFSETS);
+    for (size_t i = 0; i < table->num_symbols; i++) {
+        append_snapshot_data(writer, &name_offset, sizeof(uint64_t));
+        name_offset += strlen(symbol_table_name(table, (uint32_t)i)) + 1;
+    }
+    append_snapshot_data(writer, &name_offset, sizeof(uint64_t));
+    end_snapshot_section(writer);
 
-    // Free heap memory
-    free_list(copy_list);
-    free(copy_list);
+    begin_snapshot_section(writer, SNAPSHOT_NAMES);
+    for (size_t i = 0; i < table->num_symbols; i++) {
+        const char* name = symbol_table_name(table, (uint32_t)i);
+        append_snapshot_data(writer, name, strlen(name) + 1);
+    }
+    end_snapshot_section(writer);
+
+    write_snapshot_section(writer, SNAPSHOT_NAME_SLOTS, table->slots,
+                           table->num_slots * sizeof(uint32_t));
 }
 
-void print_slinked_list(const slinked_list_t* list) {
-    for (node_t* nptr = list->head; nptr != NULL; nptr = nptr->next) {
-        printf("%s - ", nptr->data);
+void attach_symbol_table(symbol_table_t** table, const mapped_file_t* file,
+                         const snapshot_header_t* header, arena_t* arena) {
+    const size_t num_symbols = header->num_vertices;
+    const uint64_t* name_offsets = (const uint64_t*)required_snapshot_section(
+        file, header, SNAPSHOT_NAME_OFFSETS, (num_symbols + 1) * sizeof(uint64_t));
+    const char* names = (const char*)required_snapshot_section(file, header, SNAPSHOT_NAMES,
+                                                               name_offsets[num_symbols]);
+
+    // The slot table is used as it is, so it must be a valid open addressing table
+    const size_t num_slots = header->sections[SNAPSHOT_NAME_SLOTS].size / sizeof(uint32_t);
+    if (num_slots <= num_symbols || (num_slots & (num_slots - 1)) != 0) {
+        fprintf(stderr, "Snapshot has an invalid name table\n");
+        exit(EXIT_FAILURE);
     }
-    printf("NULL\n");
+
+    const uint32_t* slots = (const uint32_t*)required_snapshot_section(
+        file, header, SNAPSHOT_NAME_SLOTS, num_slots * sizeof(uint32_t));
+    check_snapshot_name_table(name_offsets, names, num_symbols, slots, num_slots);
+
+    *table = (symbol_table_t*)malloc(sizeof(symbol_table_t));
+    (*table)->arena = arena;
+    (*table)->num_symbols = num_symbols;
+    // Names are looked up in the mapping itself, attaching copies nothing per vertex
+    (*table)->names_capacity = 0;
+    (*table)->names = NULL;
+    (*table)->name_offsets = name_offsets;
+    (*table)->name_data = names;
+    (*table)->num_slots = num_slots;
+    (*table)->slots = (uint32_t*)slots;
+    (*table)->mapped = true;
 }
 
-void create_undirected_graph(undirected_graph_t** graph, int num_vertices) {
+void create_undirected_graph(undirected_graph_t** graph, const size_t num_vertices) {
     *graph = (undirected_graph_t*)malloc(sizeof(undirected_graph_t));
     (*graph)->vertices_count = num_vertices;
-    (*graph)->adjacency_lists = (slinked_list_t**)malloc(num_vertices * sizeof(slinked_list_t*));
+    (*graph)->edges_count = 0;
+    create_arena(&(*graph)->arena, ARENA_BLOCK_SIZE);
+    create_symbol_table(&(*graph)->vertex_names, num_vertices, (*graph)->arena);
+    (*graph)->snapshot = NULL;
+    (*graph)->edge_offsets = NULL;
+    (*graph)->edge_targets = NULL;
+    (*graph)->name_ranks = NULL;
+    (*graph)->listed_targets = NULL;
 }
 
-void print_undirected_graph(const undirected_graph_t* graph) {
-    printf("Undirected graph size: %llu\n", graph->vertices_count);
-    for (size_t i = 0; i < graph->vertices_count; i++) {
-        print_slinked_list(graph->adjacency_lists[i]);
+void create_edge_buffer(edge_buffer_t** buffer, const size_t capacity) {
+    *buffer = (edge_buffer_t*)malloc(sizeof(edge_buffer_t));
+    (*buffer)->size = 0;
+    (*buffer)->capacity = capacity > 0 ? capacity : 16;
+    (*buffer)->records = (edge_record_t*)malloc((*buffer)->capacity * sizeof(edge_record_t));
+}
+
+void push_edge_record(edge_buffer_t* buffer, const uint32_t src_id, const uint32_t dst_id) {
+    if (buffer->size == buffer->capacity) {
+        buffer->capacity *= 2;
+        buffer->records =
+            (edge_record_t*)realloc(buffer->records, buffer->capacity * sizeof(edge_record_t));
     }
+    edge_record_t* record = &buffer->records[buffer->size++];
+    record->src_id = src_id;
+    record->dst_id = dst_id;
 }
 
-void read_graph_from_file(undirected_graph_t* graph, FILE* graph_file) {
-    char vertex_buffer[50];
-    for (size_t i = 0; i < graph->vertices_count; i++) {
-        fgets(vertex_buffer, 50, graph_file);
-        vertex_buffer[strlen(vertex_buffer) - 1] = '\0';
-        create_slinked_list(&graph->adjacency_lists[i]);
-        insert_node_at_end(&graph->adjacency_lists[i], vertex_buffer);
-    }
-
-    while (fgets(vertex_buffer, 50, graph_file) != NULL) {
-        int32_t len_vertex_buffer = strlen(vertex_buffer) - 1;
-        int32_t len_first_edge = 0;
-        vertex_buffer[len_vertex_buffer] = '\0';
-        while (vertex_buffer[len_first_edge] != ' ') {
-            ++len_first_edge;
-        }
-        char edge_u[len_first_edge + 1];
-        char edge_v[len_vertex_buffer - len_first_edge];
-        for (int32_t i = 0; i < len_first_edge; i++) {
-            edge_u[i] = vertex_buffer[i];
-        }
-        edge_u[len_first_edge] = '\0';
-        for (int32_t i = 0, j = len_first_edge + 1; j < len_vertex_buffer; i++, j++) {
-            edge_v[i] = vertex_buffer[j];
-        }
-        edge_v[len_vertex_buffer - len_first_edge - 1] = '\0';
-
-        for (size_t i = 0; i < graph->vertices_count; i++) {
-            char* curr_head_data = graph->adjacency_lists[i]->head->data;
-            if (strcmp(curr_head_data, edge_u) == 0) {
-                insert_node_at_end(&graph->adjacency_lists[i], edge_v);
-            } else if (strcmp(curr_head_data, edge_v) == 0) {
-                insert_node_at_end(&graph->adjacency_lists[i], edge_u);
+void free_edge_buffer(edge_buffer_t* buffer) {
+    free(buffer->records);
+    buffer->records = NULL;
+    buffer->size = buffer->capacity = 0;
+}
+
+// "<u> <v>" adds an edge and "<u>" alone a vertex, a vertex is added the first time the stream
+// names it
+void add_stream_line(undirected_graph_t* graph, text_cursor_t line, edge_buffer_t* edges) {
+    const char* edge_u;
+    const char* edge_v;
+    size_t len_u, len_v;
+    if (!next_token(&line, &edge_u, &len_u)) {
+        return;
+    }
+    const uint32_t u_id = symbol_table_intern(graph->vertex_names, edge_u, len_u);
+    if (!next_token(&line, &edge_v, &len_v)) {
+        return;
+    }
+    const uint32_t v_id = symbol_table_intern(graph->vertex_names, edge_v, len_v);
+    push_edge_record(edges, u_id, v_id);
+}
+
+// Reads the stream in blocks and parses every complete line of a block, the unfinished line at
+// its end is carried over to the next one
+void read_edge_stream(undirected_graph_t* graph, const int fd, edge_buffer_t* edges) {
+    size_t capacity = STREAM_BLOCK_SIZE;
+    char* buffer = (char*)malloc(capacity);
+    size_t pending = 0;
+    bool end_of_stream = false;
+    while (!end_of_stream) {
+        if (pending == capacity) {
+            // A single line fills the whole buffer, make room for the rest of it
+            capacity *= 2;
+            buffer = (char*)realloc(buffer, capacity);
+        }
+        const ssize_t num_read = read(fd, buffer + pending, capacity - pending);
+        if (num_read == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read() failed for edge stream");
+            exit(EXIT_FAILURE);
+        }
+        end_of_stream = num_read == 0;
+
+        // Only the new bytes can hold a newline, the carried over line has none
+        const char* data_end = buffer + pending + num_read;
+        const char* lines_end = data_end;
+        if (!end_of_stream) {
+            while (lines_end > buffer + pending && lines_end[-1] != '\n') {
+                lines_end--;
+            }
+            if (lines_end == buffer + pending) {
+                lines_end = buffer;
             }
         }
+
+        text_cursor_t cursor = {buffer, lines_end};
+        text_cursor_t line;
+        while (next_line(&cursor, &line)) {
+            add_stream_line(graph, line, edges);
+        }
+        pending = data_end - lines_end;
+        memmove(buffer, lines_end, pending);
     }
+    free(buffer);
 }
 
-void free_graph(undirected_graph_t* graph) {
+// Runs one phase of the loader, a single task runs on the calling thread without starting any
+void run_loader_tasks(loader_task_t* tasks, const size_t num_tasks, void* (*work)(void*)) {
+    if (num_tasks == 1) {
+        work(&tasks[0]);
+        return;
+    }
+
+    pthread_t threads[MAX_LOADER_THREADS];
+    for (size_t i = 0; i < num_tasks; i++) {
+        if (pthread_create(&threads[i], NULL, work, &tasks[i]) != 0) {
+            fprintf(stderr, "pthread_create() failed for loader task\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (size_t i = 0; i < num_tasks; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+// Splits the text into one chunk per task, every chunk but the last ends right after a newline
+void split_text_into_chunks(const char* begin, const char* end, loader_task_t* tasks,
+                            const size_t num_tasks) {
+    const size_t text_size = end - begin;
+    const char* chunk_begin = begin;
+    for (size_t i = 0; i < num_tasks; i++) {
+        const char* chunk_end = end;
+        if (i + 1 < num_tasks) {
+            chunk_end = begin + text_size / num_tasks * (i + 1);
+            if (chunk_end <= chunk_begin) {
+                chunk_end = chunk_begin;
+            } else {
+                const char* newline =
+                    (const char*)memchr(chunk_end - 1, '\n', end - (chunk_end - 1));
+                chunk_end = newline ? newline + 1 : end;
+            }
+        }
+        tasks[i].chunk_begin = chunk_begin;
+        tasks[i].chunk_end = chunk_end;
+        chunk_begin = chunk_end;
+    }
+}
+
+void* count_chunk_lines(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    size_t num_lines = 0;
+    const char* pos = task->chunk_begin;
+    while ((pos = (const char*)memchr(pos, '\n', task->chunk_end - pos)) != NULL) {
+        num_lines++;
+        pos++;
+    }
+    task->num_lines = num_lines;
+    return NULL;
+}
+
+void* intern_chunk_vertices(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    text_cursor_t cursor = {task->chunk_begin, task->chunk_end};
+    text_cursor_t line;
+    for (size_t vert_id = task->first_vert_id; next_line(&cursor, &line); vert_id++) {
+        const size_t vertex_len = line.end - line.pos;
+        char* name = (char*)arena_alloc(task->arena, vertex_len + 1);
+        memcpy(name, line.pos, vertex_len);
+        name[vertex_len] = '\0';
+        if (!symbol_table_insert_concurrent(task->graph->vertex_names, name, vertex_len,
+                                            (uint32_t)vert_id)) {
+            fprintf(stderr, "Duplicate vertex %s\n", name);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return NULL;
+}
+
+void* parse_chunk_edges(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    const symbol_table_t* vertex_names = task->graph->vertex_names;
+    text_cursor_t cursor = {task->chunk_begin, task->chunk_end};
+    text_cursor_t line;
+    while (next_line(&cursor, &line)) {
+        // Tokenize "<u> <v>" in place, the names are looked up without being copied
+        const text_cursor_t edge_line = line;
+        const char* edge_u;
+        const char* edge_v;
+        size_t len_u, len_v;
+        if (!next_token(&line, &edge_u, &len_u)) {
+            continue;
+        }
+        if (!next_token(&line, &edge_v, &len_v)) {
+            fprintf(stderr, "Skipping malformed edge: %.*s\n", (int)(edge_line.end - edge_line.pos),
+                    edge_line.pos);
+            continue;
+        }
+
+        const uint32_t u_id = symbol_table_find(vertex_names, edge_u, len_u);
+        const uint32_t v_id = symbol_table_find(vertex_names, edge_v, len_v);
+        if (u_id == INVALID_VERTEX_ID || v_id == INVALID_VERTEX_ID) {
+            fprintf(stderr, "Skipping edge with unknown vertex: %.*s\n",
+                    (int)(edge_line.end - edge_line.pos), edge_line.pos);
+            continue;
+        }
+
+        push_edge_record(task->edges, u_id, v_id);
+    }
+    return NULL;
+}
+
+// Counts the edges of every row into edge_offsets[row + 1]
+void* count_chunk_degrees(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    size_t* row_sizes = task->graph->edge_offsets + 1;
+    for (size_t i = 0; i < task->edges->size; i++) {
+        const edge_record_t* record = &task->edges->records[i];
+        __atomic_fetch_add(&row_sizes[record->src_id], 1, __ATOMIC_RELAXED);
+        // Every edge is stored from both endpoints, a loop only once
+        if (record->src_id != record->dst_id) {
+            __atomic_fetch_add(&row_sizes[record->dst_id], 1, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+// Places every edge in the row of its source, in no particular order within the row
+void* scatter_chunk_edges(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    undirected_graph_t* graph = task->graph;
+    for (size_t i = 0; i < task->edges->size; i++) {
+        const edge_record_t* record = &task->edges->records[i];
+        const size_t position = task->first_edge_position + i;
+        const size_t edge = __atomic_fetch_add(&task->row_cursors[record->src_id], 1,
+                                               __ATOMIC_RELAXED);
+        graph->edge_targets[edge] = record->dst_id;
+        task->edge_positions[edge] = position;
+        if (record->src_id != record->dst_id) {
+            const size_t back_edge = __atomic_fetch_add(&task->row_cursors[record->dst_id], 1,
+                                                        __ATOMIC_RELAXED);
+            graph->edge_targets[back_edge] = record->src_id;
+            task->edge_positions[back_edge] = position;
+        }
+    }
+    return NULL;
+}
+
+int compare_row_entries(const void* lhs, const void* rhs) {
+    const row_entry_t* lhs_entry = (const row_entry_t*)lhs;
+    const row_entry_t* rhs_entry = (const row_entry_t*)rhs;
+    if (lhs_entry->rank != rhs_entry->rank) {
+        return lhs_entry->rank < rhs_entry->rank ? -1 : 1;
+    }
+    if (lhs_entry->position != rhs_entry->position) {
+        return lhs_entry->position < rhs_entry->position ? -1 : 1;
+    }
+    return 0;
+}
+
+int compare_row_positions(const void* lhs, const void* rhs) {
+    const row_entry_t* lhs_entry = (const row_entry_t*)lhs;
+    const row_entry_t* rhs_entry = (const row_entry_t*)rhs;
+    if (lhs_entry->position != rhs_entry->position) {
+        return lhs_entry->position < rhs_entry->position ? -1 : 1;
+    }
+    return 0;
+}
+
+// Sorts the rows of the task by target name, parallel edges stay in the order they were listed.
+// The rows are also kept in the order their edges were listed, which the concurrent scatter does
+// not keep either
+void* sort_chunk_rows(void* arg) {
+    loader_task_t* task = (loader_task_t*)arg;
+    undirected_graph_t* graph = task->graph;
+    row_entry_t* entries = NULL;
+    size_t entries_capacity = 0;
+    for (size_t row = task->first_row; row < task->end_row; row++) {
+        const size_t row_begin = graph->edge_offsets[row];
+        const size_t row_size = graph->edge_offsets[row + 1] - row_begin;
+        if (row_size < 2) {
+            memcpy(&graph->listed_targets[row_begin], &graph->edge_targets[row_begin],
+                   row_size * sizeof(uint32_t));
+            continue;
+        }
+        if (row_size > entries_capacity) {
+            entries_capacity = row_size;
+            entries = (row_entry_t*)realloc(entries, entries_capacity * sizeof(row_entry_t));
+        }
+
+        for (size_t i = 0; i < row_size; i++) {
+            const uint32_t target = graph->edge_targets[row_begin + i];
+            entries[i].rank = task->name_ranks[target];
+            entries[i].target = target;
+            entries[i].position = task->edge_positions[row_begin + i];
+        }
+        qsort(entries, row_size, sizeof(row_entry_t), compare_row_positions);
+        for (size_t i = 0; i < row_size; i++) {
+            graph->listed_targets[row_begin + i] = entries[i].target;
+        }
+        qsort(entries, row_size, sizeof(row_entry_t), compare_row_entries);
+        for (size_t i = 0; i < row_size; i++) {
+            graph->edge_targets[row_begin + i] = entries[i].target;
+        }
+    }
+    free(entries);
+    return NULL;
+}
+
+void print_undirected_graph(const undirected_graph_t* graph, output_sink_t* out) {
+    sink_puts(out, "Undirected graph size: ");
+    sink_put_uint(out, graph->vertices_count);
+    sink_putc(out, '\n');
     for (size_t i = 0; i < graph->vertices_count; i++) {
-        free_list(graph->adjacency_lists[i]);
-        free(graph->adjacency_lists[i]);
+        sink_puts(out, symbol_table_name(graph->vertex_names, (uint32_t)i));
+        sink_puts(out, " - ");
+        for (size_t edge = graph->edge_offsets[i]; edge < graph->edge_offsets[i + 1]; edge++) {
+            sink_puts(out, symbol_table_name(graph->vertex_names, graph->edge_targets[edge]));
+            sink_puts(out, " - ");
+        }
+        sink_puts(out, "NULL\n");
+    }
+}
+
+// Reads the vertex and edge lists with one loader task per chunk of the text
+void read_graph_from_file(undirected_graph_t* graph, text_cursor_t* cursor,
+                          const size_t expected_edges, loader_task_t* tasks,
+                          const size_t num_tasks) {
+    for (size_t i = 0; i < num_tasks; i++) {
+        tasks[i].graph = graph;
+    }
+
+    // Vertex ids are assigned in the order the vertices are listed, so the lines are counted
+    // first to give every chunk the ids of its vertices and to find where the edges begin
+    const size_t num_vertices = graph->vertices_count;
+    split_text_into_chunks(cursor->pos, cursor->end, tasks, num_tasks);
+    run_loader_tasks(tasks, num_tasks, count_chunk_lines);
+    size_t vert_id = 0;
+    const char* edges_begin = cursor->end;
+    for (size_t i = 0; i < num_tasks; i++) {
+        tasks[i].first_vert_id = vert_id;
+        if (vert_id + tasks[i].num_lines < num_vertices) {
+            vert_id += tasks[i].num_lines;
+            continue;
+        }
+
+        // The vertex list ends in this chunk, cut it right after the last vertex
+        const char* pos = tasks[i].chunk_begin;
+        for (; vert_id < num_vertices; vert_id++) {
+            pos = (const char*)memchr(pos, '\n', tasks[i].chunk_end - pos) + 1;
+        }
+        edges_begin = tasks[i].chunk_end = pos;
+        for (size_t j = i + 1; j < num_tasks; j++) {
+            tasks[j].chunk_begin = tasks[j].chunk_end = pos;
+            tasks[j].first_vert_id = num_vertices;
+        }
+        break;
+    }
+    if (vert_id < num_vertices) {
+        // The last line of the file may lack its newline
+        const bool unterminated_line = cursor->end > cursor->pos && cursor->end[-1] != '\n';
+        if (vert_id + unterminated_line < num_vertices) {
+            fprintf(stderr, "Expected %zu vertices, the graph file has only %zu\n", num_vertices,
+                    vert_id + unterminated_line);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Intern the names in parallel, the table is presized so it never grows meanwhile
+    for (size_t i = 0; i < num_tasks; i++) {
+        create_arena(&tasks[i].arena, ARENA_BLOCK_SIZE);
+    }
+    run_loader_tasks(tasks, num_tasks, intern_chunk_vertices);
+    graph->vertex_names->num_symbols = num_vertices;
+    for (size_t i = 0; i < num_tasks; i++) {
+        merge_arena(graph->arena, tasks[i].arena);
+        free(tasks[i].arena);
+        tasks[i].arena = NULL;
+    }
+
+    // Parse the edges in parallel, every task collects the edges of its chunk in file order
+    const size_t edges_size = cursor->end - edges_begin;
+    split_text_into_chunks(edges_begin, cursor->end, tasks, num_tasks);
+    for (size_t i = 0; i < num_tasks; i++) {
+        const size_t chunk_size = tasks[i].chunk_end - tasks[i].chunk_begin;
+        const size_t chunk_edges = expected_edges > 0 && edges_size > 0
+                                       ? (size_t)((double)expected_edges * chunk_size / edges_size)
+                                       : chunk_size / 16;
+        create_edge_buffer(&tasks[i].edges, chunk_edges + 1);
+    }
+    run_loader_tasks(tasks, num_tasks, parse_chunk_edges);
+}
+
+// Builds the CSR layout from the edges the loader tasks parsed, with every row sorted by name and
+// a copy of it in file order
+void freeze_undirected_graph(undirected_graph_t* graph, loader_task_t* tasks,
+                             const size_t num_tasks) {
+    const size_t vertices_count = graph->vertices_count;
+    graph->edge_offsets = (size_t*)arena_alloc(graph->arena, (vertices_count + 1) * sizeof(size_t));
+    memset(graph->edge_offsets, 0, (vertices_count + 1) * sizeof(size_t));
+    run_loader_tasks(tasks, num_tasks, count_chunk_degrees);
+    for (size_t i = 0; i < vertices_count; i++) {
+        graph->edge_offsets[i + 1] += graph->edge_offsets[i];
+    }
+
+    graph->edges_count = graph->edge_offsets[vertices_count];
+    graph->edge_targets =
+        (uint32_t*)arena_alloc(graph->arena, graph->edges_count * sizeof(uint32_t));
+    graph->listed_targets =
+        (uint32_t*)arena_alloc(graph->arena, graph->edges_count * sizeof(uint32_t));
+
+    // Every task scatters its edges through the shared row cursors and tags each with its
+    // position in the file, which the row sort uses to keep the result independent of timing
+    size_t* row_cursors = (size_t*)malloc((vertices_count + 1) * sizeof(size_t));
+    memcpy(row_cursors, graph->edge_offsets, (vertices_count + 1) * sizeof(size_t));
+    size_t* edge_positions = (size_t*)malloc((graph->edges_count + 1) * sizeof(size_t));
+    graph->name_ranks =
+        (uint32_t*)arena_alloc(graph->arena, vertices_count * sizeof(uint32_t));
+    rank_vertex_names(graph->vertex_names, graph->name_ranks);
+    const uint32_t* name_ranks = graph->name_ranks;
+    size_t first_edge_position = 0;
+    for (size_t i = 0; i < num_tasks; i++) {
+        tasks[i].row_cursors = row_cursors;
+        tasks[i].edge_positions = edge_positions;
+        tasks[i].name_ranks = name_ranks;
+        tasks[i].first_edge_position = first_edge_position;
+        first_edge_position += tasks[i].edges->size;
+    }
+    run_loader_tasks(tasks, num_tasks, scatter_chunk_edges);
+
+    // Give every task a run of rows holding about the same number of edges to sort
+    size_t row = 0;
+    for (size_t i = 0; i < num_tasks; i++) {
+        const size_t edges_end = graph->edges_count / num_tasks * (i + 1);
+        tasks[i].first_row = row;
+        const bool last_task = i + 1 == num_tasks;
+        while (row < vertices_count && (last_task || graph->edge_offsets[row + 1] <= edges_end)) {
+            row++;
+        }
+        tasks[i].end_row = row;
+    }
+    run_loader_tasks(tasks, num_tasks, sort_chunk_rows);
+
+    free(edge_positions);
+    free(row_cursors);
+}
+
+void free_graph(undirected_graph_t* graph) {
+    free_symbol_table(graph->vertex_names);
+    free(graph->vertex_names);
+    free_arena(graph->arena);
+    free(graph->arena);
+    if (graph->snapshot) {
+        unmap_file(graph->snapshot);
+        free(graph->snapshot);
     }
-    free(graph->adjacency_lists);
-    graph->vertices_count = 0;
+    graph->vertices_count = graph->edges_count = 0;
+}
+
+void write_undirected_graph_sections(snapshot_writer_t* writer, const undirected_graph_t* graph) {
+    write_symbol_table_sections(writer, graph->vertex_names);
+    write_snapshot_section(writer, SNAPSHOT_EDGE_OFFSETS, graph->edge_offsets,
+                           (graph->vertices_count + 1) * sizeof(size_t));
+    write_snapshot_section(writer, SNAPSHOT_EDGE_TARGETS, graph->edge_targets,
+                           graph->edges_count * sizeof(uint32_t));
 }
 
-void process_bfs_queries(const undirected_graph_t* graph, FILE* query_file) {
-    char query_buffer[50];
-    while (fgets(query_buffer, 50, query_file) != NULL) {
-        int32_t query_lenght = strlen(query_buffer) - 1;
+void attach_undirected_graph(undirected_graph_t** graph, mapped_file_t* file) {
+    const snapshot_header_t* header = open_graph_snapshot(file, 0);
+    const size_t vertices_count = header->num_vertices;
+    const size_t edges_count = header->num_edges;
+
+    *graph = (undirected_graph_t*)malloc(sizeof(undirected_graph_t));
+    (*graph)->vertices_count = vertices_count;
+    (*graph)->edges_count = edges_count;
+    create_arena(&(*graph)->arena, ARENA_BLOCK_SIZE);
+    attach_symbol_table(&(*graph)->vertex_names, file, header, (*graph)->arena);
+
+    // The CSR arrays are used in place, the graph owns the mapping from now on
+    (*graph)->edge_offsets = (size_t*)required_snapshot_section(
+        file, header, SNAPSHOT_EDGE_OFFSETS, (vertices_count + 1) * sizeof(size_t));
+    (*graph)->edge_targets = (uint32_t*)required_snapshot_section(
+        file, header, SNAPSHOT_EDGE_TARGETS, edges_count * sizeof(uint32_t));
+    check_snapshot_offsets((const uint64_t*)(*graph)->edge_offsets, vertices_count, edges_count,
+                           "edge table");
+    check_snapshot_ids((*graph)->edge_targets, edges_count, vertices_count, "edge table");
+    (*graph)->listed_targets = (uint32_t*)required_snapshot_section(
+        file, header, SNAPSHOT_LISTED_TARGETS, edges_count * sizeof(uint32_t));
+    check_snapshot_ids((*graph)->listed_targets, edges_count, vertices_count, "edge table");
+
+    // Name ranks are used in place when the snapshot has them, otherwise ranked again
+    const size_t ranks_size = vertices_count * sizeof(uint32_t);
+    (*graph)->name_ranks =
+        (uint32_t*)snapshot_section(file, header, SNAPSHOT_NAME_RANKS, ranks_size);
+    if ((*graph)->name_ranks == NULL) {
+        (*graph)->name_ranks = (uint32_t*)arena_alloc((*graph)->arena, ranks_size);
+        rank_vertex_names((*graph)->vertex_names, (*graph)->name_ranks);
+    } else {
+        check_snapshot_ids((*graph)->name_ranks, vertices_count, vertices_count, "name ranking");
+    }
+    (*graph)->snapshot = file;
+}
+
+void process_bfs_queries(const undirected_graph_t* graph, FILE* query_file, output_sink_t* out) {
+    char* query_buffer = NULL;
+    size_t query_capacity = 0;
+    while (getline(&query_buffer, &query_capacity, query_file) != -1) {
+        int32_t query_lenght = strcspn(query_buffer, "\r\n");
         query_buffer[query_lenght] = '\0';
+        if (query_lenght < 3) {
+            continue;
+        }
         char query = query_buffer[0];
-        char vertex[query_lenght - 1];
-        for (int32_t i = 0, j = 2; j < query_lenght; i++, j++) {
-            vertex[i] = query_buffer[j];
+        const char* vertex = &query_buffer[2];
+
+        const uint32_t vert_id = symbol_table_find(graph->vertex_names, vertex, query_lenght - 2);
+        if (vert_id == INVALID_VERTEX_ID) {
+            fprintf(stderr, "Unknown vertex %s\n", vertex);
+            continue;
         }
-        vertex[query_lenght - 2] = '\0';
 
         if (query == 'd') {
-            for (size_t i = 0; i < graph->vertices_count; i++) {
-                char* curr_head_data = graph->adjacency_lists[i]->head->data;
-                if (strcmp(curr_head_data, vertex) == 0) {
-                    printf("%llu\n", graph->adjacency_lists[i]->size - 1);
-                    break;
-                }
-            }
+            sink_put_uint(out, graph->edge_offsets[vert_id + 1] - graph->edge_offsets[vert_id]);
+            sink_putc(out, '\n');
         } else if (query == 'a') {
-            for (size_t i = 0; i < graph->vertices_count; i++) {
-                char* curr_head_data = graph->adjacency_lists[i]->head->data;
-                if (strcmp(curr_head_data, vertex) == 0) {
-                    slinked_list_t* sorted = NULL;
-                    create_slinked_list(&sorted);
-                    sort_slinked_list(graph->adjacency_lists[i], sorted);
-                    print_slinked_list(graph->adjacency_lists[i]);
-                    print_slinked_list(sorted);
-                    free_list(sorted);
-                    free(sorted);
-                    break;
+            // The row as listed in the file comes first, then the row sorted by name. It is
+            // already sorted, so the vertex only has to be merged into it
+            const size_t row_begin = graph->edge_offsets[vert_id];
+            const size_t row_end = graph->edge_offsets[vert_id + 1];
+            sink_puts(out, symbol_table_name(graph->vertex_names, vert_id));
+            sink_puts(out, " - ");
+            for (size_t edge = row_begin; edge < row_end; edge++) {
+                sink_puts(out,
+                          symbol_table_name(graph->vertex_names, graph->listed_targets[edge]));
+                sink_puts(out, " - ");
+            }
+            sink_puts(out, "NULL\n");
+
+            bool vertex_printed = false;
+            for (size_t edge = row_begin; edge < row_end; edge++) {
+                const uint32_t neighbor_id = graph->edge_targets[edge];
+                if (!vertex_printed &&
+                    graph->name_ranks[vert_id] < graph->name_ranks[neighbor_id]) {
+                    sink_puts(out, symbol_table_name(graph->vertex_names, vert_id));
+                    sink_puts(out, " - ");
+                    vertex_printed = true;
                 }
+                sink_puts(out, symbol_table_name(graph->vertex_names, neighbor_id));
+                sink_puts(out, " - ");
             }
+            if (!vertex_printed) {
+                sink_puts(out, symbol_table_name(graph->vertex_names, vert_id));
+                sink_puts(out, " - ");
+            }
+            sink_puts(out, "NULL\n");
         }
     }
+    free(query_buffer);
+}
+
+// Reads the "<vertices> [<edges>]" header line, the edge count is optional and 0 when missing
+void read_graph_header(text_cursor_t* cursor, size_t* num_vertices, size_t* num_edges) {
+    text_cursor_t line;
+    if (!next_line(cursor, &line)) {
+        fprintf(stderr, "Missing graph header\n");
+        exit(EXIT_FAILURE);
+    }
+    const text_cursor_t header = line;
+
+    // Vertex ids are 32-bit and UINT32_MAX marks an invalid id, so both counts are capped there
+    const char* token;
+    size_t token_len;
+    uint64_t vertices = 0;
+    if (!next_token(&line, &token, &token_len) || !parse_count(token, token_len, &vertices) ||
+        vertices > UINT32_MAX) {
+        fprintf(stderr, "Invalid vertex count in graph header: %.*s\n",
+                (int)(header.end - header.pos), header.pos);
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t edges = 0;
+    if (next_token(&line, &token, &token_len) &&
+        (!parse_count(token, token_len, &edges) || edges > UINT32_MAX)) {
+        fprintf(stderr, "Invalid edge count in graph header: %.*s\n",
+                (int)(header.end - header.pos), header.pos);
+        exit(EXIT_FAILURE);
+    }
+
+    *num_vertices = (size_t)vertices;
+    *num_edges = (size_t)edges;
 }
 
-int32_t get_number_of_vertices(FILE* graph_file) {
-    int32_t num_vertices = fgetc(graph_file) - 48;
-    int32_t pos = ftell(graph_file);
-    fseek(graph_file, ++pos, SEEK_CUR);
-    return num_vertices;
+void write_graph_snapshot(const undirected_graph_t* graph, const char* file_name) {
+    snapshot_writer_t writer;
+    begin_snapshot(&writer, file_name, 0, graph->vertices_count, graph->edges_count);
+    write_undirected_graph_sections(&writer, graph);
+    write_snapshot_section(&writer, SNAPSHOT_NAME_RANKS, graph->name_ranks,
+                           graph->vertices_count * sizeof(uint32_t));
+    write_snapshot_section(&writer, SNAPSHOT_LISTED_TARGETS, graph->listed_targets,
+                           graph->edges_count * sizeof(uint32_t));
+    end_snapshot(&writer);
+}
+
+// Parses the mapped graph text and takes over the mapping, which is released once loaded
+void load_graph_text(undirected_graph_t** graph, mapped_file_t* graph_file,
+                     const size_t num_threads) {
+    text_cursor_t graph_cursor = {graph_file->data, graph_file->data + graph_file->size};
+
+    // Read the vertex count and the optional edge count from the header
+    size_t num_vertices = 0;
+    size_t num_edges = 0;
+    read_graph_header(&graph_cursor, &num_vertices, &num_edges);
+
+    // Split the text into chunks of at least LOADER_MIN_CHUNK_SIZE bytes, one per task, so
+    // small graphs are loaded on the calling thread alone
+    size_t num_tasks = 1 + (graph_cursor.end - graph_cursor.pos) / LOADER_MIN_CHUNK_SIZE;
+    if (num_tasks > num_threads) {
+        num_tasks = num_threads;
+    }
+    loader_task_t tasks[MAX_LOADER_THREADS];
+    memset(tasks, 0, sizeof(tasks));
+
+    // Create empty graph presized for the vertex count and read it
+    create_undirected_graph(graph, num_vertices);
+    read_graph_from_file(*graph, &graph_cursor, num_edges, tasks, num_tasks);
+
+    // The names were copied and the edges parsed, the mapping is no longer needed
+    unmap_file(graph_file);
+    free(graph_file);
+
+    // Build the CSR layout with neighbors sorted by name
+    freeze_undirected_graph(*graph, tasks, num_tasks);
+    for (size_t i = 0; i < num_tasks; i++) {
+        free_edge_buffer(tasks[i].edges);
+        free(tasks[i].edges);
+    }
+}
+
+// Builds the graph from an edge stream, neither the vertex nor the edge count is known up front
+void load_graph_stream(undirected_graph_t** graph, const int fd) {
+    // The name table and the edge buffer both grow by doubling as the stream goes on
+    loader_task_t task;
+    memset(&task, 0, sizeof(task));
+    create_undirected_graph(graph, 0);
+    task.graph = *graph;
+    create_edge_buffer(&task.edges, 0);
+    read_edge_stream(*graph, fd, task.edges);
+    (*graph)->vertices_count = (*graph)->vertex_names->num_symbols;
+
+    // The stream has ended, build the CSR layout with neighbors sorted by name
+    freeze_undirected_graph(*graph, &task, 1);
+    free_edge_buffer(task.edges);
+    free(task.edges);
 }
 
 int main(int argc, char* argv[]) {
-    FILE* graph_file;
     FILE* query_file;
 
-    if (argc != 3) {
-        fprintf(stderr, "Incorrect number of argument: %i provided instead of 3\n", argc);
+    // -w <file> writes the loaded graph to a binary snapshot, which later runs can be given in
+    // place of the graph file, -j <threads> caps the threads that load graph text
+    const char* snapshot_file_name = NULL;
+    long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t num_threads = online_cpus > 0 ? (size_t)online_cpus : 1;
+    int32_t option;
+    while ((option = getopt(argc, argv, "w:j:")) != -1) {
+        uint64_t threads = 0;
+        if (option == 'w') {
+            snapshot_file_name = optarg;
+        } else if (option == 'j' && parse_count(optarg, strlen(optarg), &threads) && threads > 0) {
+            num_threads = (size_t)threads;
+        } else {
+            fprintf(stderr, "Usage: %s [-w snapshot_file] [-j threads] graph_file query_file\n",
+                    argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (num_threads > MAX_LOADER_THREADS) {
+        num_threads = MAX_LOADER_THREADS;
+    }
+
+    if (argc - optind != 2) {
+        fprintf(stderr, "Incorrect number of argument: %i provided instead of 2\n",
+                argc - optind);
         return 1;
     }
 
-    const char* graph_file_name = argv[1];
-    const char* query_file_name = argv[2];
+    const char* graph_file_name = argv[optind];
+    const char* query_file_name = argv[optind + 1];
 
-    graph_file = fopen(graph_file_name, "r");
     query_file = fopen(query_file_name, "r");
-    if (graph_file == NULL) {
-        fprintf(stderr, "Cannot open %s graph file\n", graph_file_name);
-        return 2;
-    }
-
     if (query_file == NULL) {
         fprintf(stderr, "Cannot open %s quary file\n", query_file_name);
         return 3;
     }
 
-    int32_t num_vertices = get_number_of_vertices(graph_file);
-
-    // Read graph from file
+    // A graph file of "-" is an edge stream read from stdin, any other graph file is mapped and
+    // holds either graph text or a binary snapshot. A "shm:<name>" graph file attaches to the
+    // snapshot a "-w shm:<name>" run published
     undirected_graph_t* graph = NULL;
-    create_undirected_graph(&graph, num_vertices);
-    read_graph_from_file(graph, graph_file);
+    if (strcmp(graph_file_name, "-") == 0) {
+        load_graph_stream(&graph, STDIN_FILENO);
+    } else {
+        mapped_file_t* graph_file = NULL;
+        map_file(&graph_file, graph_file_name);
+        if (is_graph_snapshot(graph_file)) {
+            // Snapshots are stored frozen and sorted, the graph uses the mapping in place
+            attach_undirected_graph(&graph, graph_file);
+        } else {
+            load_graph_text(&graph, graph_file, num_threads);
+        }
+    }
+    if (snapshot_file_name) {
+        write_graph_snapshot(graph, snapshot_file_name);
+    }
 
-    // Process each query from file
-    process_bfs_queries(graph, query_file);
+    // Process each query from file, all results go through one buffered sink on stdout
+    output_sink_t* out = NULL;
+    create_output_sink(&out, STDOUT_FILENO, OUTPUT_BUFFER_SIZE);
+    process_bfs_queries(graph, query_file, out);
+    free_output_sink(out);
+    free(out);
 
-    // Free heap memory
+    // Report allocator usage and free heap memory
+    print_allocation_stats(graph->arena);
     free_graph(graph);
     free(graph);
 
     // Close the opened streams
-    fclose(graph_file);
     fclose(query_file);
 
     return 0;